@@ -0,0 +1,45 @@
+#!/bin/sh
+# Builds toy.c, and checks that gfuzzer -K reaches more of its edges than
+# the same number of sentences without feedback. For every seed, -e picks
+# the sentences with the energy of -K but no credit for new edges, and
+# replaying its decisions with -A under -K counts the edges they reach.
+# The check fails unless -K reaches more edges over all the seeds.
+#
+# Usage: examples/feedback/check.sh [GFUZZER] [N] [SEEDS]
+set -eu
+
+dir=$(cd "$(dirname "$0")" && pwd)
+gfuzzer=${1:-bin/gfuzzer}
+n=${2:-3000}
+seeds=${3:-"1 2 3 4 5 6 7 8"}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT INT TERM
+
+${CC:-cc} -std=c99 -O2 -D_POSIX_C_SOURCE=200809L "$dir/toy.c" -o "$work/toy"
+
+edges() {
+    "$gfuzzer" -b "$dir/toy.bnf" "$@" -K -v -x "$work/toy" @@ 2>&1 >/dev/null |
+        sed -n 's/.*# Edges = \([0-9][0-9]*\).*/\1/p'
+}
+
+total_credit=0
+total_plain=0
+for seed in $seeds; do
+    "$gfuzzer" -b "$dir/toy.bnf" -n "$n" -s "$seed" -e -a "$work/plain.bin" >/dev/null
+    credit=$(edges -n "$n" -s "$seed")
+    plain=$(edges -A "$work/plain.bin")
+    echo "# Edges (Seed $seed) = ${credit:-?} with credit, ${plain:-?} without"
+    if [ -z "$credit" ] || [ -z "$plain" ]; then
+        echo "FAIL: no edge count for seed $seed" >&2
+        exit 1
+    fi
+    total_credit=$((total_credit + credit))
+    total_plain=$((total_plain + plain))
+done
+echo "# Edges = $total_credit with credit, $total_plain without"
+
+if [ "$total_credit" -le "$total_plain" ]; then
+    echo "FAIL: -K did not reach more edges than -e on the same seeds" >&2
+    exit 1
+fi
+echo "OK"
@@ -0,0 +1,82 @@
+/*
+ * A toy target for -K, instrumented by hand the way AFL instrumentation
+ * would: it answers the forkserver handshake on file descriptors 198 and
+ * 199, and marks its edges in the shared memory bitmap whose id is in
+ * __AFL_SHM_ID. Inputs starting with 'K' take a new edge for every
+ * (position, previous byte, byte) triple, the rest take one edge per
+ * first byte.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TOY_FORKSRV_FD  (198)
+#define TOY_MAP_SZ      (65536)
+#define TOY_MAX_INPUT   (4096)
+#define TOY_MAX_ARGS    (40)
+
+static unsigned char* area;
+static unsigned char dummy_area[TOY_MAP_SZ];
+
+static void takeEdge(uint32_t const id) {
+    area[id % TOY_MAP_SZ]++;
+}
+
+/* Returns in every child, and never in the forkserver itself. */
+static void runForkServer(void) {
+    int32_t msg     = 0;
+    int status      = 0;
+    pid_t pid       = 0;
+
+    if (write(TOY_FORKSRV_FD + 1, &msg, sizeof(msg)) != sizeof(msg)) return;
+
+    for (;;) {
+        if (read(TOY_FORKSRV_FD, &msg, sizeof(msg)) != sizeof(msg)) _exit(0);
+
+        pid = fork();
+        if (pid < 0) _exit(1);
+        if (pid == 0) {
+            close(TOY_FORKSRV_FD);
+            close(TOY_FORKSRV_FD + 1);
+            return;
+        }
+
+        msg = (int32_t)pid;
+        if (write(TOY_FORKSRV_FD + 1, &msg, sizeof(msg)) != sizeof(msg)) _exit(1);
+        if (waitpid(pid, &status, 0) < 0) _exit(1);
+        msg = (int32_t)status;
+        if (write(TOY_FORKSRV_FD + 1, &msg, sizeof(msg)) != sizeof(msg)) _exit(1);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    char const* const shm_id    = getenv("__AFL_SHM_ID");
+    unsigned char input[TOY_MAX_INPUT];
+    size_t input_sz             = 0;
+    FILE* fp                    = NULL;
+
+    area = (shm_id == NULL) ? dummy_area : shmat(atoi(shm_id), NULL, 0);
+    if (area == (void*)-1) area = dummy_area;
+
+    runForkServer();
+
+    if (argc < 2) return EXIT_FAILURE;
+    fp = fopen(argv[1], "rb");
+    if (fp == NULL) return EXIT_FAILURE;
+    input_sz = fread(input, 1, sizeof(input), fp);
+    fclose(fp);
+
+    if (input_sz == 0) return EXIT_SUCCESS;
+    if (input[0] != 'K') {
+        takeEdge(1000 + input[0]);
+        return EXIT_SUCCESS;
+    }
+
+    for (size_t i = 1; i < input_sz && i < TOY_MAX_ARGS; i++)
+        takeEdge((uint32_t)(i * 131 + input[i - 1] * 7U + input[i]) * 2654435761U >> 16);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,42 @@
+#ifndef BLOOM_FILTER_H
+    #define BLOOM_FILTER_H
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include "padkit/arraylist.h"
+
+    #ifndef BLOOM_N_HASHES
+        #define BLOOM_N_HASHES  (7)
+    #endif
+
+    #define NOT_A_BLOOM ((BloomFilter){ NULL, 0, 0 })
+
+    /*
+     * Remembers decision sequences in a fixed number of bits, so it never
+     * grows, at the price of now and then mistaking a new sequence for one
+     * it has seen. A sequence sets BLOOM_N_HASHES bits, drawn by double
+     * hashing from one 64-bit hash of its decisions.
+     */
+    typedef struct BloomFilterBody {
+        uint64_t*   words;
+        uint64_t    n_bits;
+        uint64_t    n_inserted;
+    } BloomFilter;
+
+    /* Rounds sz down to whole words, but keeps at least one. */
+    void construct_bloom(
+        BloomFilter* const bloom,
+        size_t const sz
+    );
+
+    void destruct_bloom(BloomFilter* const bloom);
+
+    /* Returns 1 if seq may have been inserted before, and 0 if it surely was not. */
+    bool insert_bloom(
+        BloomFilter* const bloom,
+        ArrayList const* const seq
+    );
+
+    bool isValid_bloom(BloomFilter const* const bloom);
+
+    size_t memoryUsage_bloom(BloomFilter const* const bloom);
+#endif
@@ -0,0 +1,57 @@
+#ifndef CORPUS_H
+    #define CORPUS_H
+    #include "weighttable.h"
+
+    #ifndef CORPUS_MAX_JOBS
+        #define CORPUS_MAX_JOBS     (256)
+    #endif
+
+    #ifndef CORPUS_PSEUDO_COUNT
+        #define CORPUS_PSEUDO_COUNT (1.0)
+    #endif
+
+    #define NOT_A_CORPUS ((Corpus){ { NOT_A_CHUNK } })
+
+    /* The NUL-terminated paths of every regular file under a directory. */
+    typedef struct CorpusBody {
+        Chunk   paths[1];
+    } Corpus;
+
+    #define CORPUS_OK               (0)
+    #define CORPUS_CANNOT_OPEN      (1)
+    int construct_corpus(
+        Corpus* const corpus,
+        char const* const path
+    );
+
+    void destruct_corpus(Corpus* const corpus);
+
+    bool isValid_corpus(Corpus const* const corpus);
+
+    /*
+     * Parses every file of the corpus on n_jobs threads (0 = every online CPU)
+     * and weights each alternative by how often the parses used it, plus
+     * CORPUS_PSEUDO_COUNT. Returns the number of files that parsed.
+     */
+    uint32_t learnWeights_corpus(
+        WeightTable* const wtbl,
+        Corpus const* const corpus,
+        GrammarGraph const* const graph,
+        uint32_t const n_jobs
+    );
+
+    /*
+     * Parses every file of the corpus on n_jobs threads and prints
+     * "ACCEPT <path>" or "REJECT <path>" per file, in corpus order. Accepted
+     * lines may carry the decision sequence after a tab, which
+     * generateSentence_ggraph turns back into the same input. Returns the
+     * number of files that parsed.
+     */
+    uint32_t parse_corpus(
+        FILE* const output,
+        Corpus const* const corpus,
+        GrammarGraph const* const graph,
+        uint32_t const n_jobs,
+        bool const prints_derivations
+    );
+#endif
@@ -0,0 +1,51 @@
+#ifndef COVERAGE_H
+    #define COVERAGE_H
+    #include "grammargraph.h"
+
+    #define NOT_A_COV ((Coverage){ 0, 0, 0, NULL, NULL })
+
+    /*
+     * How many times every term of a GrammarGraph was generated, kept out of
+     * the graph so the graph stays read-only. rule_counts and exp_counts are
+     * parallel to rule_list and exp_list, and n_cov counts the nonzero ones.
+     * Threads rendering in parallel keep one Coverage each, merged by
+     * merge_cov when someone needs the totals.
+     */
+    typedef struct CoverageBody {
+        uint32_t    n_rules;
+        uint32_t    n_exps;
+        uint32_t    n_cov;
+        uint32_t*   rule_counts;
+        uint32_t*   exp_counts;
+    } Coverage;
+
+    void construct_cov(
+        Coverage* const cov,
+        GrammarGraph const* const graph
+    );
+
+    void destruct_cov(Coverage* const cov);
+
+    void hitExp_cov(
+        Coverage* const cov,
+        uint32_t const exp_id
+    );
+
+    void hitRule_cov(
+        Coverage* const cov,
+        uint32_t const rule_id
+    );
+
+    bool isValid_cov(Coverage const* const cov);
+
+    size_t memoryUsage_cov(Coverage const* const cov);
+
+    /* Adds the counts of src to dst, both of the same graph. */
+    void merge_cov(
+        Coverage* const dst,
+        Coverage const* const src
+    );
+
+    /* Covered terms as a percentage of all terms. */
+    uint32_t termCov_cov(Coverage const* const cov);
+#endif
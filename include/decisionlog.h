@@ -0,0 +1,68 @@
+#ifndef DECISION_LOG_H
+    #define DECISION_LOG_H
+    #include <stdio.h>
+    #include "grammargraph.h"
+
+    #define DLOG_MAGIC              "GFD1"
+    #define DLOG_MAGIC_LEN          (4)
+    #define DLOG_MAX_VARINT_LEN     (5)
+
+    #define NOT_A_DLOG              ((DecisionLog){ NULL, NULL, { NOT_AN_ALIST }, 0, 0, 0 })
+
+    /*
+     * Decision sequences in as few bits as the grammar allows: a decision for
+     * a rule of n alternatives takes ceil(log2(n)) bits, so a rule of one
+     * alternative takes none. A file of them starts with DLOG_MAGIC, then the
+     * number of rules, the root rule, and the number of alternatives of every
+     * rule, and holds one record per sentence: the number of decisions, then
+     * their bits, least significant first, padded to a byte. Numbers are
+     * LEB128 varints. The rule of every decision follows from walking the
+     * grammar, so a file replays on any grammar of the same rules and
+     * alternatives, whatever its terminals.
+     */
+    typedef struct DecisionLogBody {
+        GrammarGraph const* graph;
+        unsigned char*      widths;
+        ArrayList           stack[1];
+        uint64_t            n_read;
+        uint64_t            n_written;
+        uint64_t            n_written_bytes;
+    } DecisionLog;
+
+    void construct_dlog(
+        DecisionLog* const dlog,
+        GrammarGraph const* const graph
+    );
+
+    void destruct_dlog(DecisionLog* const dlog);
+
+    bool isValid_dlog(DecisionLog const* const dlog);
+
+    #define DLOG_OK                 (0)
+    #define DLOG_END                (1)
+    #define DLOG_BAD_FORMAT         (2)
+    #define DLOG_MISMATCH           (3)
+    /* Replaces seq with the next record of the file. */
+    int read_dlog(
+        ArrayList* const seq,
+        DecisionLog* const dlog,
+        FILE* const fp
+    );
+
+    /* DLOG_MISMATCH if the file is of a grammar of other rules or alternatives. */
+    int readHeader_dlog(
+        DecisionLog const* const dlog,
+        FILE* const fp
+    );
+
+    bool write_dlog(
+        FILE* const fp,
+        DecisionLog* const dlog,
+        ArrayList const* const seq
+    );
+
+    bool writeHeader_dlog(
+        FILE* const fp,
+        DecisionLog const* const dlog
+    );
+#endif
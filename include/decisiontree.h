@@ -1,11 +1,50 @@
 #ifndef DECISION_TREE_H
     #define DECISION_TREE_H
-    #include "grammargraph.h"
+    #include "derivationbudget.h"
+    #include "energytable.h"
 
-    #define NOT_A_DTREE                             ((DecisionTree){ NOT_AN_ALIST })
+    #define DTREE_DUMP_MAGIC                        "GFP1"
+    #define DTREE_DUMP_MAGIC_LEN                    (4)
 
+    #ifndef DTREE_ENERGY_MAX_DRAWS
+        #define DTREE_ENERGY_MAX_DRAWS              (4)
+    #endif
+
+    #ifndef DTREE_SHARD_BUDGET_CELLS
+        #define DTREE_SHARD_BUDGET_CELLS            (64)
+    #endif
+
+    #ifndef DTREE_SHARD_ESTIMATE_DEPTH
+        #define DTREE_SHARD_ESTIMATE_DEPTH          (8)
+    #endif
+
+    #ifndef DTREE_SHARD_MAX_LEVELS
+        #define DTREE_SHARD_MAX_LEVELS              (64)
+    #endif
+
+    #ifndef DTREE_SHARD_MAX_WEIGHT
+        #define DTREE_SHARD_MAX_WEIGHT              (1e300)
+    #endif
+
+    #ifndef DTREE_SHARD_PREFIXES_PER_SHARD
+        #define DTREE_SHARD_PREFIXES_PER_SHARD      (8)
+    #endif
+
+    #ifndef DTREE_WRITE_BUFFER_SZ
+        #define DTREE_WRITE_BUFFER_SZ               (65536)
+    #endif
+
+    struct GrammarDiffBody;
+
+    #define NOT_A_DTREE                             ((DecisionTree){ NOT_AN_ALIST, NOT_AN_ALIST })
+
+    /*
+     * open_words holds one bitset per explored node, with a bit for every
+     * child that is not fully explored yet.
+     */
     typedef struct DecisionTreeBody {
         ArrayList   node_list[1];
+        ArrayList   open_words[1];
     } DecisionTree;
 
     #define DTREE_NODE_STATE_UNEXPLORED             (0)
@@ -16,6 +55,8 @@
         uint32_t    n_choices;
         uint32_t    parent_id;
         uint32_t    first_child_id;
+        uint32_t    n_open;
+        uint32_t    first_word_id;
     } DecisionTreeNode;
 
     void addUnexploredNodes_dtree(
@@ -24,17 +65,47 @@
         uint32_t const n
     );
 
+    /*
+     * Frees the nodes below fully explored nodes, which uniqueness never
+     * visits again, and returns their number. A dump afterwards sees those
+     * nodes as leaves, and migrate_dtree keeps them closed only while the
+     * rules they leave pending derive the same sentences.
+     */
+    uint32_t compact_dtree(DecisionTree* const dtree);
+
     void constructEmpty_dtree(DecisionTree* const dtree);
 
     void destruct_dtree(DecisionTree* const tree);
 
+    /*
+     * Writes DTREE_DUMP_MAGIC, the number of nodes, and then for every node
+     * in id order n_choices << 2 | state, its id minus its parent id (but
+     * for the root), and 1 + the id of the rule it decides (0 past the end
+     * of a derivation), all as LEB128 varints. n_choices is 0 for a leaf and
+     * for an unexplored node. Returns 0 if the file cannot be written.
+     */
+    bool dump_dtree(
+        FILE* const fp,
+        DecisionTree const* const dtree,
+        GrammarGraph const* const graph
+    );
+
     #define DTREE_GENERATE_OK                       (0)
     #define DTREE_GENERATE_SHALLOW_SEQ              (1)
     #define DTREE_GENERATE_NO_UNIQUE_SEQ_REMAINING  (2)
+    #define DTREE_GENERATE_TIMEOUT                  (3)
+    /*
+     * With an EnergyTable, coverage guidance weights the alternatives by it
+     * instead of restricting them to the uncovered ones.
+     */
     int generateRandomDecisionSequence_dtree(
         ArrayList* const seq,
         DecisionTree* const dtree,
-        GrammarGraph* const graph,
+        Coverage* const cov,
+        EnergyTable* const etbl,
+        GrammarGraph const* const graph,
+        WeightTable const* const wtbl,
+        DerivationBudget const* const budget,
         uint32_t const min_depth,
         bool const cov_guided,
         bool const unique
@@ -47,23 +118,59 @@
 
     bool isValid_dtree(DecisionTree const* const dtree);
 
+    size_t memoryUsage_dtree(DecisionTree const* const dtree);
+
+    /*
+     * Carries the explored paths of old_dtree, a tree of the old graph of
+     * diff, over to dtree, a fresh tree of its new graph. A path keeps its
+     * nodes as long as it takes matched alternatives, new alternatives start
+     * unexplored, and a node stays fully explored only if all of its new
+     * children are. A leaf compact_dtree made stays closed if every rule it
+     * leaves pending refers only to kept rules, all the way down, and opens
+     * again otherwise. Returns the number of nodes carried over.
+     */
+    uint32_t migrate_dtree(
+        DecisionTree* const dtree,
+        struct GrammarDiffBody const* const diff,
+        DecisionTree const* const old_dtree
+    );
+
     uint32_t partiallyExploreNode_dtree(
         ArrayList* const seq, uint32_t* const p_node_id,
-        DecisionTree* const dtree, GrammarGraph const* const graph, uint32_t const rule_id,
+        DecisionTree* const dtree, Coverage const* const cov, EnergyTable* const etbl,
+        GrammarGraph const* const graph, uint32_t const rule_id,
+        WeightTable const* const wtbl, DerivationBudget const* const budget, DerivationCost const* const reserved,
         bool const cov_guided, bool const unique
     );
 
+    /*
+     * Collapses every subtree below max_depth decisions, unless it is 0, and
+     * every fully explored subtree if frontier_only, into one box with the
+     * number of its nodes and the percentage of them fully explored.
+     */
     void printDot_dtree(
         FILE* const fp,
         DecisionTree const* const dtree,
-        GrammarGraph const* const graph
+        GrammarGraph const* const graph,
+        uint32_t const max_depth,
+        bool const frontier_only
     );
 
+    /* Closes node_id under its parent, which closes too once it has no open children left. */
     void propagateUpState_dtree(
         DecisionTree* const dtree,
         uint32_t const node_id
     );
 
+    /* Leaves a fresh tree only the derivations of shard_id out of n_shards. */
+    void restrictToShard_dtree(
+        DecisionTree* const dtree,
+        GrammarGraph const* const graph,
+        DerivationBudget const* const budget,
+        uint32_t const shard_id,
+        uint32_t const n_shards
+    );
+
     void setLeaf_dtree(
         DecisionTree* const dtree,
         uint32_t const leaf_id
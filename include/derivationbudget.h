@@ -0,0 +1,82 @@
+#ifndef DERIVATION_BUDGET_H
+    #define DERIVATION_BUDGET_H
+    #include "grammargraph.h"
+
+    #ifndef DBUDGET_CLOCK_PERIOD
+        #define DBUDGET_CLOCK_PERIOD    (1024)
+    #endif
+
+    #define DBUDGET_UNLIMITED           (UINT64_MAX)
+
+    #define NOT_A_DBUDGET ((DerivationBudget){                  \
+        0, 0, 0, { NOT_AN_ALIST }, { NOT_AN_ALIST },            \
+        { NOT_AN_ALIST }                                        \
+    })
+
+    typedef struct DerivationCostBody {
+        uint64_t    n_decisions;
+        uint64_t    n_bytes;
+    } DerivationCost;
+
+    /*
+     * Caps the decisions and the bytes of every sentence, and the wall-clock
+     * time of a whole run. cost_list holds the cheapest completion of every
+     * alternative, laid out like a WeightTable, and shortest_list the
+     * alternative that completes each rule cheapest (fewest bytes first).
+     * A derivation reserves the cheapest completion of every pending rule,
+     * so it finishes within the budget by taking the shortest alternatives
+     * once the budget is close. That holds only if the root's cheapest
+     * completion fits: otherwise every sentence takes it and exceeds the cap.
+     */
+    typedef struct DerivationBudgetBody {
+        uint64_t    max_decisions;
+        uint64_t    max_bytes;
+        uint64_t    deadline_ns;
+        ArrayList   offset_list[1];
+        ArrayList   shortest_list[1];
+        ArrayList   cost_list[1];
+    } DerivationBudget;
+
+    /* 0 means unlimited for max_decisions, max_bytes, and deadline_ns. */
+    void construct_dbudget(
+        DerivationBudget* const budget,
+        GrammarGraph const* const graph,
+        uint32_t const max_decisions,
+        uint32_t const max_bytes,
+        uint64_t const deadline_ns
+    );
+
+    void destruct_dbudget(DerivationBudget* const budget);
+
+    /* Whether taking alt_id for rule_id keeps the reserved cost within the budget. */
+    bool fits_dbudget(
+        DerivationBudget const* const budget,
+        DerivationCost const* const reserved,
+        uint32_t const rule_id,
+        uint32_t const alt_id
+    );
+
+    bool isPastDeadline_dbudget(DerivationBudget const* const budget);
+
+    /* Whether every alternative fits, whatever the reserved cost. */
+    bool isUnlimited_dbudget(DerivationBudget const* const budget);
+
+    bool isValid_dbudget(DerivationBudget const* const budget);
+
+    size_t memoryUsage_dbudget(DerivationBudget const* const budget);
+
+    DerivationCost const* minCost_dbudget(
+        DerivationBudget const* const budget,
+        uint32_t const rule_id
+    );
+
+    uint64_t monotonicNs_dbudget(void);
+
+    /* Replaces the reserved cheapest completion of rule_id with that of alt_id. */
+    void spend_dbudget(
+        DerivationCost* const reserved,
+        DerivationBudget const* const budget,
+        uint32_t const rule_id,
+        uint32_t const alt_id
+    );
+#endif
@@ -0,0 +1,131 @@
+#ifndef EARLEY_PARSER_H
+    #define EARLEY_PARSER_H
+    #include "grammargraph.h"
+
+    #ifndef EPARSER_INITIAL_TBL_CAP
+        #define EPARSER_INITIAL_TBL_CAP (1024)
+    #endif
+
+    #define NOT_AN_EPARSER ((EarleyParser){                     \
+        NULL, { NOT_AN_ALIST }, { NOT_AN_ALIST },               \
+        { NOT_AN_ALIST }, NULL, 0, NULL, 0, 0,                  \
+        { NOT_AN_ALIST }, { NOT_AN_ALIST }, { NOT_AN_ALIST },   \
+        { NOT_AN_ALIST }, NULL, NULL, 0                         \
+    })
+
+    /*
+     * "dot" is the id of the next ExpansionTerm to match, or the id of the
+     * last ExpansionTerm of the alternative ORed with EPARSER_DOT_COMPLETE once
+     * the alternative matched. Empty terminals make rules nullable, so a
+     * nullable rule is skipped at prediction time (Aycock and Horspool) rather
+     * than waiting for its completion in the set being built.
+     */
+    #define EPARSER_DOT_COMPLETE    (0x80000000)
+    typedef struct EarleyItemBody {
+        uint32_t    dot;
+        uint32_t    origin;
+        uint32_t    set_id;
+        uint32_t    next_in_set;
+        uint32_t    next_waiting;
+    } EarleyItem;
+
+    typedef struct EarleySetBody {
+        uint32_t    head;
+        uint32_t    tail;
+    } EarleySet;
+
+    typedef struct EarleyExpInfoBody {
+        uint32_t    rule_id;
+        uint32_t    alt_id;
+        uint32_t    first_exp_id;
+        uint32_t    last_exp_id;
+    } EarleyExpInfo;
+
+    /*
+     * The items of a set that wait for a rule, chained through next_waiting.
+     * leo_dot and leo_origin memoize Leo's topmost item: when exactly one
+     * item waits and the rule is its last symbol, completing the rule
+     * completes a whole chain, so only the top of the chain enters the chart.
+     */
+    #define EPARSER_LEO_UNKNOWN     (0xFFFFFFFE)
+    #define EPARSER_LEO_VISITING    (0xFFFFFFFD)
+    typedef struct EarleyWaitingBody {
+        uint32_t    set_id;
+        uint32_t    rule_id;
+        uint32_t    head;
+        uint32_t    is_predicted;
+        uint32_t    leo_dot;
+        uint32_t    leo_origin;
+    } EarleyWaiting;
+
+    typedef struct EarleyLeoStepBody {
+        uint32_t    set_id;
+        uint32_t    rule_id;
+        uint32_t    dot;
+        uint32_t    origin;
+    } EarleyLeoStep;
+
+    typedef struct EarleyTaskBody {
+        uint32_t    rule_id;
+        uint32_t    start;
+        uint32_t    end;
+    } EarleyTask;
+
+    /*
+     * A step from prev_rule_id to a rule spanning the same input, where every
+     * other term of alternative prev_alt_id matches the empty string.
+     */
+    typedef struct EarleyUnitStepBody {
+        uint32_t    stamp;
+        uint32_t    prev_rule_id;
+        uint32_t    prev_alt_id;
+        uint32_t    prev_exp_id;
+    } EarleyUnitStep;
+
+    /*
+     * A parser only reads its GrammarGraph, so every thread may own one.
+     * empty_alts[rule_id] is an alternative of a nullable rule whose terms
+     * are all nullable by an earlier fixpoint round, or INVALID_UINT32.
+     */
+    typedef struct EarleyParserBody {
+        GrammarGraph const* graph;
+        ArrayList           info_list[1];
+        ArrayList           item_list[1];
+        ArrayList           set_list[1];
+        uint32_t*           item_tbl;
+        uint32_t            item_tbl_cap;
+        EarleyWaiting*      waiting_tbl;
+        uint32_t            waiting_tbl_cap;
+        uint32_t            n_waiting;
+        ArrayList           task_list[1];
+        ArrayList           unit_list[1];
+        ArrayList           leo_list[1];
+        ArrayList           split_list[1];
+        uint32_t*           empty_alts;
+        EarleyUnitStep*     unit_steps;
+        uint32_t            last_stamp;
+    } EarleyParser;
+
+    void construct_eparser(
+        EarleyParser* const parser,
+        GrammarGraph const* const graph
+    );
+
+    void destruct_eparser(EarleyParser* const parser);
+
+    bool isValid_eparser(EarleyParser const* const parser);
+
+    /*
+     * Recognizes input[0..len), and rebuilds its decision sequence into seq
+     * unless seq is NULL. Recognition alone uses Leo's items, so it is linear
+     * on right recursion; a derivation needs every completed item instead.
+     */
+    #define EPARSER_ACCEPT          (0)
+    #define EPARSER_REJECT          (1)
+    int parse_eparser(
+        ArrayList* const seq,
+        EarleyParser* const parser,
+        char const* const input,
+        uint32_t const len
+    );
+#endif
@@ -0,0 +1,80 @@
+#ifndef ENERGY_TABLE_H
+    #define ENERGY_TABLE_H
+    #include "coverage.h"
+    #include "weighttable.h"
+
+    #ifndef ETBL_CREDIT_EXPONENT
+        #define ETBL_CREDIT_EXPONENT    (1.0)
+    #endif
+
+    #ifndef ETBL_DRIFT_RATIO
+        #define ETBL_DRIFT_RATIO    (0.25)
+    #endif
+
+    #ifndef ETBL_EXPONENT
+        #define ETBL_EXPONENT       (1.0)
+    #endif
+
+    #ifndef ETBL_MAX_BOOST
+        #define ETBL_MAX_BOOST      (16.0)
+    #endif
+
+    #define NOT_AN_ETBL ((EnergyTable){ { NOT_A_WTBL }, NULL, NULL, NULL, { NOT_AN_ALIST }, 0, 0 })
+
+    /*
+     * Weights every alternative by the inverse of how often it was generated,
+     * relative to the rarest alternative of its rule and raised to
+     * ETBL_EXPONENT, times its weight in base. No alternative gets more than
+     * ETBL_MAX_BOOST times the weight of another, or an unlucky recursive
+     * alternative would never let a derivation end. The alias table of a
+     * rule is rebuilt only once the rule has been generated some more times,
+     * ETBL_DRIFT_RATIO of the count at the last rebuild but at least as many
+     * as it has alternatives, so sampling stays O(1) amortized.
+     *
+     * Once any sentence earns credit, every alternative is also weighted by
+     * its credit per generation, relative to the most productive alternative
+     * of its rule and raised to ETBL_CREDIT_EXPONENT. A credited rule is
+     * rebuilt on its next refresh.
+     */
+    typedef struct EnergyTableBody {
+        WeightTable         wtbl[1];
+        WeightTable const*  base;
+        uint32_t*           rebuilt_counts;
+        uint32_t*           exp_credits;
+        ArrayList           stack[1];
+        uint64_t            n_credited;
+        uint64_t            n_rebuilds;
+    } EnergyTable;
+
+    /* base = NULL means uniform base weights. */
+    void construct_etbl(
+        EnergyTable* const etbl,
+        GrammarGraph const* const graph,
+        WeightTable const* const base
+    );
+
+    /* Adds n_credits to every alternative the decisions of seq took, in O(seq->len). */
+    void credit_etbl(
+        EnergyTable* const etbl,
+        GrammarGraph const* const graph,
+        ArrayList const* const seq,
+        uint32_t const n_credits
+    );
+
+    void destruct_etbl(EnergyTable* const etbl);
+
+    bool isValid_etbl(EnergyTable const* const etbl);
+
+    size_t memoryUsage_etbl(
+        EnergyTable const* const etbl,
+        GrammarGraph const* const graph
+    );
+
+    /* Rebuilds the weights and the alias table of rule_id if its count drifted enough. */
+    void refresh_etbl(
+        EnergyTable* const etbl,
+        Coverage const* const cov,
+        GrammarGraph const* const graph,
+        uint32_t const rule_id
+    );
+#endif
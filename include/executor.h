@@ -0,0 +1,94 @@
+#ifndef EXECUTOR_H
+    #define EXECUTOR_H
+    #include <stdbool.h>
+    #include <stdint.h>
+    #include <sys/types.h>
+
+    #ifndef EXEC_FORKSRV_FD
+        #define EXEC_FORKSRV_FD         (198)
+    #endif
+
+    #ifndef EXEC_HANDSHAKE_MS
+        #define EXEC_HANDSHAKE_MS       (2000)
+    #endif
+
+    #ifndef EXEC_MAP_SZ
+        #define EXEC_MAP_SZ             (65536)
+    #endif
+
+    #define EXEC_INPUT_PLACEHOLDER      "@@"
+    #define EXEC_SHM_ENV_VAR            "__AFL_SHM_ID"
+    #define EXEC_MAX_SIGNAL             (65)
+
+    #define NOT_AN_EXEC ((Executor){                            \
+        NULL, NULL, -1, -1, -1, -1, 0, 0, 0, 0, -1, NULL,      \
+        NULL, 0, 0, 0, 0, 0, 0, { 0 }                           \
+    })
+
+    /*
+     * Runs a target program on one sentence at a time. The sentence goes to
+     * a temporary file that replaces every "@@" argument, or becomes the
+     * stdin of the target if there is none. A target built with AFL
+     * instrumentation answers the forkserver handshake on EXEC_FORKSRV_FD,
+     * and then every run forks from its already initialized process.
+     * Any other target is forked and executed cold for every run.
+     *
+     * With a bitmap, the target also gets the id of an EXEC_MAP_SZ System V
+     * shared memory segment in EXEC_SHM_ENV_VAR, where AFL instrumentation
+     * counts the edges it takes. Every run starts on a clear bitmap, and
+     * an edge is new the first time any run takes it.
+     */
+    typedef struct ExecutorBody {
+        char**          argv;
+        char*           input_path;
+        int             input_fd;
+        int             ctl_fd;
+        int             st_fd;
+        pid_t           fsrv_pid;
+        uint32_t        timeout_ms;
+        bool            uses_stdin;
+        bool            was_killed;
+        int             last_status;
+        int             shm_id;
+        unsigned char*  trace_bits;
+        uint64_t*       seen_words;
+        uint32_t        n_edges;
+        uint64_t        start_ns;
+        uint64_t        n_execs;
+        uint64_t        n_nonzero_exits;
+        uint64_t        n_timeouts;
+        uint64_t        n_crashes;
+        uint64_t        n_crashes_by_signal[EXEC_MAX_SIGNAL];
+    } Executor;
+
+    #define EXEC_OK                 (0)
+    #define EXEC_CANNOT_START       (1)
+    int construct_exec(
+        Executor* const executor,
+        char* const* const target_argv,
+        uint32_t const timeout_ms,
+        bool const uses_bitmap
+    );
+
+    /* The edges the last run took for the first time. */
+    uint32_t countNewEdges_exec(Executor* const executor);
+
+    void destruct_exec(Executor* const executor);
+
+    double execsPerSecond_exec(Executor const* const executor);
+
+    bool isUsingForkserver_exec(Executor const* const executor);
+
+    bool isValid_exec(Executor const* const executor);
+
+    #define EXEC_RUN_OK             (0)
+    #define EXEC_RUN_NONZERO_EXIT   (1)
+    #define EXEC_RUN_TIMEOUT        (2)
+    #define EXEC_RUN_CRASH          (3)
+    #define EXEC_RUN_ERROR          (4)
+    int run_exec(
+        Executor* const executor,
+        void const* const data,
+        uint32_t const sz
+    );
+#endif
@@ -0,0 +1,66 @@
+#ifndef FILE_SINK_H
+    #define FILE_SINK_H
+    #include "padkit/chunk.h"
+
+    #ifndef FSINK_BATCH_LEN
+        #define FSINK_BATCH_LEN         (64)
+    #endif
+
+    #define FSINK_MAX_LEN_PATH          (32)
+    #define FSINK_MAX_SUBDIR_BITS       (16)
+
+    #define NOT_A_FSINK ((FileSink){                            \
+        -1, 0, 0, 0, 0, 0, { NOT_A_CHUNK }, NULL, NULL, NULL    \
+    })
+
+    struct FileSinkRingBody;
+
+    /*
+     * Writes every sentence to its own file under a directory. A file is
+     * named after the 64-bit FNV-1a hash of its contents, and lives in the
+     * subdirectory named by the top subdir_bits of that hash, so duplicates
+     * collide wherever they are written (no subdirectories if files_per_dir
+     * is 0). Files are created in batches of FSINK_BATCH_LEN, through
+     * io_uring where the kernel allows it and with plain system calls
+     * otherwise.
+     */
+    typedef struct FileSinkBody {
+        int                         dir_fd;
+        uint32_t                    files_per_dir;
+        uint32_t                    subdir_bits;
+        uint32_t                    n_files;
+        uint32_t                    n_pending;
+        uint32_t                    n_failed;
+        Chunk                       contents[1];
+        char                        (*paths)[FSINK_MAX_LEN_PATH];
+        unsigned char*              made_subdirs;
+        struct FileSinkRingBody*    ring;
+    } FileSink;
+
+    #define FSINK_OK                (0)
+    #define FSINK_CANNOT_OPEN       (1)
+    #define FSINK_CANNOT_WRITE      (2)
+    /* Takes enough subdirectories for about files_per_dir of n_expected files each. */
+    int construct_fsink(
+        FileSink* const sink,
+        char const* const dir_path,
+        uint32_t const files_per_dir,
+        uint32_t const n_expected
+    );
+
+    /* Flushes the pending files first, so it may fail like flush_fsink. */
+    int destruct_fsink(FileSink* const sink);
+
+    /* Creates every pending file, and fails if any file so far could not be written. */
+    int flush_fsink(FileSink* const sink);
+
+    bool isUsingRing_fsink(FileSink const* const sink);
+
+    bool isValid_fsink(FileSink const* const sink);
+
+    int write_fsink(
+        FileSink* const sink,
+        void const* const data,
+        uint32_t const sz
+    );
+#endif
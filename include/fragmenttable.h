@@ -0,0 +1,79 @@
+#ifndef FRAGMENT_TABLE_H
+    #define FRAGMENT_TABLE_H
+    #include "coverage.h"
+
+    #ifndef FTBL_MAX_DERIVATIONS
+        #define FTBL_MAX_DERIVATIONS    (256)
+    #endif
+
+    #ifndef FTBL_MAX_RULE_SZ
+        #define FTBL_MAX_RULE_SZ        (65536)
+    #endif
+
+    #define NOT_A_FTBL ((FragmentTable){                        \
+        { NOT_A_CHUNK }, { NOT_AN_ALIST }, { NOT_AN_ALIST },    \
+        { NOT_AN_ALIST }, NULL, NULL, 0, 0                      \
+    })
+
+    /* hit_list[hit_offset .. hit_offset + n_hits) are the terms a fragment covers. */
+    typedef struct FragmentBody {
+        uint32_t    hit_offset;
+        uint32_t    n_hits;
+    } Fragment;
+
+    #define FTBL_HIT(id, is_rule)       (((uint32_t)(id) << 1) | (uint32_t)(is_rule))
+    #define FTBL_HIT_IS_RULE(hit)       ((hit) & 1)
+    #define FTBL_HIT_ID(hit)            ((hit) >> 1)
+
+    #define FTBL_LEAF                   (0x80000000)
+
+    /*
+     * The bytes of every derivation of a small finite rule, and of every
+     * alternative made of two or more terminals, precomputed at load time,
+     * fragment i being the item i of fragments. A rule of at most
+     * FTBL_MAX_DERIVATIONS derivations gets a trie in trie_list, one slot per
+     * alternative at every decision, so its decisions walk the trie down to
+     * one fragment instead of expanding the subtree. A slot holds the offset
+     * of the next node, or FTBL_LEAF | fragment id. Only the rules that a
+     * larger rule does not already render get a trie, and no more than
+     * FTBL_MAX_RULE_SZ bytes go into one.
+     */
+    typedef struct FragmentTableBody {
+        Chunk       fragments[1];
+        ArrayList   frag_list[1];
+        ArrayList   hit_list[1];
+        ArrayList   trie_list[1];
+        uint32_t*   rule_tries;
+        uint32_t*   exp_frags;
+        uint32_t    n_rules;
+        uint32_t    n_exps;
+    } FragmentTable;
+
+    void construct_ftbl(
+        FragmentTable* const ftbl,
+        GrammarGraph const* const graph
+    );
+
+    void destruct_ftbl(FragmentTable* const ftbl);
+
+    bool isValid_ftbl(FragmentTable const* const ftbl);
+
+    size_t memoryUsage_ftbl(FragmentTable const* const ftbl);
+
+    /* Renders the alternative that starts at exp_id, unless it has no fragment. */
+    bool renderAlt_ftbl(
+        Chunk* const str_builder,
+        Coverage* const cov,
+        FragmentTable const* const ftbl,
+        uint32_t const exp_id
+    );
+
+    /* Renders rule_id and moves *p_decision past its decisions, unless it has no trie. */
+    bool renderRule_ftbl(
+        Chunk* const str_builder,
+        Coverage* const cov,
+        FragmentTable const* const ftbl,
+        uint32_t const rule_id,
+        uint32_t const** const p_decision
+    );
+#endif
@@ -0,0 +1,70 @@
+#ifndef GRAMMAR_DIFF_H
+    #define GRAMMAR_DIFF_H
+    #include "coverage.h"
+
+    #define NOT_A_GDIFF ((GrammarDiff){                         \
+        NULL, NULL, { NOT_AN_ALIST }, { NOT_AN_ALIST },         \
+        { NOT_AN_ALIST }, { NOT_AN_ALIST }, 0, 0, 0, 0          \
+    })
+
+    /*
+     * Matches the rules of an old and a new version of a grammar by name,
+     * and the alternatives of matching rules by content, where terminals
+     * compare by their bytes and rules by their names.
+     *
+     * rule_targets maps every old rule to the new rule of the same name, or
+     * to INVALID_UINT32. alt_targets maps the alternatives of every old rule,
+     * laid out like a WeightTable, to the index of the identical alternative
+     * of the new rule, or to INVALID_UINT32, and no two of them to the same
+     * one. exp_targets maps every term of a matched alternative to its
+     * counterpart. A rule is kept if all of its alternatives match and it
+     * has no new ones, and changed otherwise.
+     */
+    typedef struct GrammarDiffBody {
+        GrammarGraph const* old_graph;
+        GrammarGraph const* new_graph;
+        ArrayList           rule_targets[1];
+        ArrayList           alt_offsets[1];
+        ArrayList           alt_targets[1];
+        ArrayList           exp_targets[1];
+        uint32_t            n_kept_rules;
+        uint32_t            n_changed_rules;
+        uint32_t            n_added_rules;
+        uint32_t            n_removed_rules;
+    } GrammarDiff;
+
+    /* INVALID_UINT32 if the rule is gone or the alternative changed. */
+    uint32_t altTarget_gdiff(
+        GrammarDiff const* const diff,
+        uint32_t const old_rule_id,
+        uint32_t const old_alt_id
+    );
+
+    /* Both graphs must outlive the diff. */
+    void construct_gdiff(
+        GrammarDiff* const diff,
+        GrammarGraph const* const old_graph,
+        GrammarGraph const* const new_graph
+    );
+
+    void destruct_gdiff(GrammarDiff* const diff);
+
+    bool isKeptRule_gdiff(
+        GrammarDiff const* const diff,
+        uint32_t const old_rule_id
+    );
+
+    bool isValid_gdiff(GrammarDiff const* const diff);
+
+    /* Overwrites cov of the new graph with the counts of kept rules and matched alternatives in old_cov. */
+    void migrateCoverage_gdiff(
+        Coverage* const cov,
+        GrammarDiff const* const diff,
+        Coverage const* const old_cov
+    );
+
+    uint32_t ruleTarget_gdiff(
+        GrammarDiff const* const diff,
+        uint32_t const old_rule_id
+    );
+#endif
@@ -7,9 +7,13 @@
     #define NOT_A_GGRAPH ((GrammarGraph){   \
         { NOT_A_CHUNK }, { NOT_A_CHUNK },   \
         { NOT_AN_ALIST }, { NOT_AN_ALIST }, \
-        0, 0                                \
+        0                                   \
     })
 
+    struct CoverageBody;
+    struct FragmentTableBody;
+    struct SpanTreeBody;
+
     /* "exp" is an abbreviation for "expansion". */
     typedef struct GrammarGraphBody {
         Chunk       rule_names[1];
@@ -17,25 +21,24 @@
         ArrayList   rule_list[1];
         ArrayList   exp_list[1];
         uint32_t    root_rule_id;
-        uint32_t    n_cov;
     } GrammarGraph;
 
     typedef struct RuleTermBody {
         uint32_t    name_id;
-        uint32_t    cov_count;
         ArrayList   alt_list[1];
     } RuleTerm;
 
     /* is_terminal == !is_rule */
     typedef struct ExpansionTermBody {
-        uint32_t    rt_id:31;
+        uint32_t    rt_id:30;
         uint32_t    is_terminal:1;
-        uint32_t    cov_count:31;
         uint32_t    has_next:1;
     } ExpansionTerm;
 
     #define GRAMMAR_OK              (0)
     #define GRAMMAR_SYNTAX_ERROR    (1)
+    #define GRAMMAR_NO_SENTENCE     (2)
+    /* Also prunes every rule and alternative that the root cannot use in a finite sentence. */
     int construct_ggraph(
         GrammarGraph* const graph,
         FILE* const bnf_file,
@@ -45,27 +48,31 @@
 
     void destruct_ggraph(GrammarGraph* const graph);
 
-    void fillCovMtx_ggraph(
-        BitMatrix* const cov_mtx,
-        GrammarGraph const* const graph,
-        uint32_t const rule_id
-    );
-
     bool isValid_ggraph(GrammarGraph const* const graph);
 
+    size_t memoryUsage_ggraph(GrammarGraph const* const graph);
+
+    /*
+     * Only reads the graph, counts the generated terms in cov, records their
+     * byte spans in stree, and renders the fragments of ftbl at once, unless
+     * they are NULL.
+     */
     void generateSentence_ggraph(
         Chunk* const str_builder,
-        GrammarGraph* const graph,
+        struct CoverageBody* const cov,
+        struct SpanTreeBody* const stree,
+        struct FragmentTableBody const* const ftbl,
+        GrammarGraph const* const graph,
         ArrayList const* const decision_sequence
     );
 
+    /* Fills the covered terms, if cov is not NULL. */
     void printDot_ggraph(
         FILE* const output,
-        GrammarGraph const* const graph
+        GrammarGraph const* const graph,
+        struct CoverageBody const* const cov
     );
 
     uint32_t nTerms_ggraph(GrammarGraph const* const graph);
-
-    uint32_t termCov_ggraph(GrammarGraph const* const graph);
 #endif
 
@@ -0,0 +1,75 @@
+#ifndef HARNESS_H
+    #define HARNESS_H
+    #include <pthread.h>
+    #include "padkit/chunk.h"
+
+    #ifndef HARNESS_BATCH_LEN
+        #define HARNESS_BATCH_LEN   (256)
+    #endif
+
+    #ifndef HARNESS_MAX_JOBS
+        #define HARNESS_MAX_JOBS    (256)
+    #endif
+
+    #define HARNESS_ENTRY_POINT     "LLVMFuzzerTestOneInput"
+    #define HARNESS_INIT_POINT      "LLVMFuzzerInitialize"
+
+    #define NOT_A_HARNESS ((Harness){                           \
+        0, NULL, NULL, PTHREAD_MUTEX_INITIALIZER,               \
+        PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,     \
+        NULL, 0, 0, 0, 0, 0, 0, 0                               \
+    })
+
+    struct HarnessWorkerBody;
+
+    /*
+     * Calls LLVMFuzzerTestOneInput of a shared object on every sentence, in
+     * process and straight from the buffer the sentences were rendered
+     * into. With one worker, the calling thread runs the harness. With
+     * more, every worker thread loads its own copy of the shared object,
+     * so the instances share no globals, and runs a submitted batch while
+     * the calling thread renders the next one.
+     */
+    typedef struct HarnessBody {
+        uint32_t                    n_workers;
+        struct HarnessWorkerBody*   workers;
+        pthread_t*                  threads;
+        pthread_mutex_t             mutex;
+        pthread_cond_t              batch_ready;
+        pthread_cond_t              batch_done;
+        Chunk const*                batch;
+        uint32_t                    next_id;
+        uint32_t                    n_done;
+        uint64_t                    batch_no;
+        bool                        is_stopping;
+        uint64_t                    start_ns;
+        uint64_t                    n_execs;
+        uint64_t                    n_rejects;
+    } Harness;
+
+    #define HARNESS_OK              (0)
+    #define HARNESS_CANNOT_LOAD     (1)
+    /* n_jobs = 0 means one worker per online CPU. */
+    int construct_harness(
+        Harness* const harness,
+        char const* const lib_path,
+        uint32_t const n_jobs
+    );
+
+    void destruct_harness(Harness* const harness);
+
+    double execsPerSecond_harness(Harness const* const harness);
+
+    bool isValid_harness(Harness const* const harness);
+
+    /*
+     * Starts running every sentence of the batch, which must stay untouched
+     * until wait_harness returns. With one worker, runs them before returning.
+     */
+    void submit_harness(
+        Harness* const harness,
+        Chunk const* const batch
+    );
+
+    void wait_harness(Harness* const harness);
+#endif
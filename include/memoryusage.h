@@ -0,0 +1,38 @@
+#ifndef MEMORY_USAGE_H
+    #define MEMORY_USAGE_H
+    #include <stddef.h>
+    #include "padkit/chunk.h"
+
+    /* The bytes in use of an ArrayList or a Chunk, without their spare capacity. */
+    #define MUSAGE_ALIST(list)          ((size_t)(list)->len * (list)->sz_elem)
+    #define MUSAGE_CHUNK(chunk)         ((size_t)AREA_CHUNK(chunk) + (size_t)LEN_CHUNK(chunk) * sizeof(Item))
+
+    #define MUSAGE_GRAMMAR              (0)
+    #define MUSAGE_COVERAGE             (1)
+    #define MUSAGE_BUDGET               (2)
+    #define MUSAGE_WEIGHTS              (3)
+    #define MUSAGE_FRAGMENTS            (4)
+    #define MUSAGE_PREFIX_TREE          (5)
+    #define MUSAGE_SENTENCES            (6)
+    #define MUSAGE_DECISIONS            (7)
+    #define MUSAGE_FILTER               (8)
+    #define MUSAGE_N_SUBSYSTEMS         (9)
+
+    #define NOT_A_MUSAGE                ((MemoryUsage){ { 0 }, 0 })
+
+    /*
+     * The bytes every subsystem of a generator has in use, and the peak of
+     * their total. A subsystem counts the elements of its lists, not their
+     * capacity, so a list that doubles may briefly take twice its bytes.
+     */
+    typedef struct MemoryUsageBody {
+        size_t  bytes[MUSAGE_N_SUBSYSTEMS];
+        size_t  peak_bytes;
+    } MemoryUsage;
+
+    /* Outputs every subsystem and the peak with fprintf_verbose. */
+    void report_musage(MemoryUsage const* const mem);
+
+    /* Also raises the peak. */
+    size_t total_musage(MemoryUsage* const mem);
+#endif
@@ -0,0 +1,62 @@
+#ifndef OPTIMIZED_GRAMMAR_H
+    #define OPTIMIZED_GRAMMAR_H
+    #include "coverage.h"
+    #include "weighttable.h"
+
+    #ifndef OGRAMMAR_MAX_INLINE_LEN
+        #define OGRAMMAR_MAX_INLINE_LEN (256)
+    #endif
+
+    #define NOT_AN_OGRAMMAR ((OptimizedGrammar){                \
+        { NOT_A_GGRAPH }, { NOT_AN_ALIST }, { NOT_AN_ALIST },   \
+        { NOT_AN_ALIST }, { NOT_AN_ALIST }                      \
+    })
+
+    /* opt_exp_id stands for orig_term_id, a rule id or (# rules + exp id). */
+    typedef struct OriginPairBody {
+        uint32_t    opt_exp_id;
+        uint32_t    orig_term_id;
+    } OriginPair;
+
+    /*
+     * A GrammarGraph generating the same language with fewer decisions:
+     * non-recursive single-alternative rules are inlined, adjacent terminals
+     * are fused into one, and identical alternatives of a rule are merged.
+     *
+     * rule_targets maps every original rule to its optimized rule, or to
+     * INVALID_UINT32 if the rule was inlined. alt_targets maps the
+     * alternatives of every original rule, laid out like a WeightTable, to
+     * their optimized alternatives. origin_list maps optimized ExpansionTerms
+     * back to the original terms they stand for.
+     */
+    typedef struct OptimizedGrammarBody {
+        GrammarGraph    graph[1];
+        ArrayList       rule_targets[1];
+        ArrayList       alt_offsets[1];
+        ArrayList       alt_targets[1];
+        ArrayList       origin_list[1];
+    } OptimizedGrammar;
+
+    void construct_ogrammar(
+        OptimizedGrammar* const ogrammar,
+        GrammarGraph const* const graph
+    );
+
+    void destruct_ogrammar(OptimizedGrammar* const ogrammar);
+
+    bool isValid_ogrammar(OptimizedGrammar const* const ogrammar);
+
+    /* Overwrites the coverage of the original graph with that of the optimized one. */
+    void projectCoverage_ogrammar(
+        Coverage* const cov,
+        OptimizedGrammar const* const ogrammar,
+        Coverage const* const opt_cov
+    );
+
+    /* Merged alternatives get the sum of their original weights. */
+    void projectWeights_ogrammar(
+        WeightTable* const opt_wtbl,
+        OptimizedGrammar const* const ogrammar,
+        WeightTable const* const wtbl
+    );
+#endif
@@ -0,0 +1,41 @@
+#ifndef RANDOM_WALK_H
+    #define RANDOM_WALK_H
+    #include "decisiontree.h"
+
+    #define NOT_A_RWALK ((RandomWalk){ { NOT_AN_ALIST }, { NOT_AN_ALIST }, { NOT_AN_ALIST } })
+
+    /*
+     * Draws decision sequences without a DecisionTree, for when sentences
+     * need not be unique and nothing outputs the prefix tree. Every decision
+     * chooses among the same candidates with the same draws of rand() as
+     * partiallyExploreNode_dtree without uniqueness, so both generate the same
+     * sentences, but a walk keeps nothing from one sentence to the next
+     * beyond its buffers, which stop growing at the deepest derivation.
+     */
+    typedef struct RandomWalkBody {
+        ArrayList   stack[1];
+        ArrayList   taken_list[1];
+        ArrayList   pool[1];
+    } RandomWalk;
+
+    void construct_rwalk(RandomWalk* const walk);
+
+    void destruct_rwalk(RandomWalk* const walk);
+
+    /* Returns DTREE_GENERATE_OK, DTREE_GENERATE_SHALLOW_SEQ, or DTREE_GENERATE_TIMEOUT. */
+    int generate_rwalk(
+        ArrayList* const seq,
+        RandomWalk* const walk,
+        Coverage* const cov,
+        EnergyTable* const etbl,
+        GrammarGraph const* const graph,
+        WeightTable const* const wtbl,
+        DerivationBudget const* const budget,
+        uint32_t const min_depth,
+        bool const cov_guided
+    );
+
+    bool isValid_rwalk(RandomWalk const* const walk);
+
+    size_t memoryUsage_rwalk(RandomWalk const* const walk);
+#endif
@@ -0,0 +1,80 @@
+#ifndef REDUCER_H
+    #define REDUCER_H
+    #include "derivationbudget.h"
+
+    #ifndef REDUCER_MAX_JOBS
+        #define REDUCER_MAX_JOBS    (256)
+    #endif
+
+    #define NOT_A_REDUCER ((Reducer){                           \
+        NULL, NULL, 0, { NOT_A_DBUDGET }, { NOT_AN_ALIST },     \
+        { NOT_AN_ALIST }, { NOT_AN_ALIST }, { NOT_AN_ALIST },   \
+        { NOT_AN_ALIST }, { NOT_A_CHUNK }, 0, 0, 0, 0, 0, 0     \
+    })
+
+    struct ReducerWorkerBody;
+
+    /*
+     * Shrinks a sentence while a target keeps ending the same way on it: with
+     * the same exit status, by the same signal, or by a timeout. The sentence
+     * shrinks as its derivation, in the manner of hierarchical delta
+     * debugging: level by level from the root, ddmin looks for subtrees to
+     * replace with the shortest derivation of their rule, then every subtree
+     * is tried in place of its nearest descendant of the same rule, which
+     * drops the middle of a recursion. The levels repeat until none shrinks.
+     * Every worker owns an Executor, so a batch of candidates runs side by
+     * side.
+     */
+    typedef struct ReducerBody {
+        GrammarGraph const*         graph;
+        struct ReducerWorkerBody*   workers;
+        uint32_t                    n_workers;
+        DerivationBudget            budget[1];
+        ArrayList                   seq[1];
+        ArrayList                   node_list[1];
+        ArrayList                   cand_list[1];
+        ArrayList                   hoist_list[1];
+        ArrayList                   stack[1];
+        Chunk                       best[1];
+        int                         expected_result;
+        int                         expected_status;
+        uint32_t                    input_sz;
+        uint64_t                    start_ns;
+        uint64_t                    n_tests;
+        uint64_t                    n_reductions;
+    } Reducer;
+
+    #define REDUCER_OK              (0)
+    #define REDUCER_CANNOT_START    (1)
+    /* n_jobs = 0 means one worker per online CPU. */
+    int construct_reducer(
+        Reducer* const reducer,
+        GrammarGraph const* const graph,
+        char* const* const target_argv,
+        uint32_t const timeout_ms,
+        uint32_t const n_jobs
+    );
+
+    void destruct_reducer(Reducer* const reducer);
+
+    bool isValid_reducer(Reducer const* const reducer);
+
+    /*
+     * Reduces the file to the last item of reducer->best, until nothing
+     * shrinks or deadline_ns passes (0 means none). REDUCER_REJECTED if the
+     * grammar does not derive the file, REDUCER_CANNOT_RUN if the target
+     * could not be executed on it, and REDUCER_NOT_FAILING if the target
+     * passes on it, since then every candidate would pass the same way.
+     */
+    #define REDUCER_CANNOT_OPEN     (2)
+    #define REDUCER_REJECTED        (3)
+    #define REDUCER_CANNOT_RUN      (4)
+    #define REDUCER_NOT_FAILING     (5)
+    int reduce_reducer(
+        Reducer* const reducer,
+        char const* const input_path,
+        uint64_t const deadline_ns
+    );
+
+    double testsPerSecond_reducer(Reducer const* const reducer);
+#endif
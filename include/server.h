@@ -0,0 +1,154 @@
+#ifndef SERVER_H
+    #define SERVER_H
+    #include <pthread.h>
+    #include <stdio.h>
+    #include "decisiontree.h"
+    #include "fragmenttable.h"
+    #include "randomwalk.h"
+
+    #ifndef SRV_MAX_BATCH
+        #define SRV_MAX_BATCH           (65536)
+    #endif
+
+    #ifndef SRV_MAX_CLIENTS
+        #define SRV_MAX_CLIENTS         (256)
+    #endif
+
+    #ifndef SRV_MAX_NAME_LEN
+        #define SRV_MAX_NAME_LEN        (4096)
+    #endif
+
+    #define SRV_LATENCY_SUB_BITS        (3)
+    #define SRV_LATENCY_BUCKETS         (64 << SRV_LATENCY_SUB_BITS)
+
+    #define SRV_HEADER_SZ               (4)
+    #define SRV_MAX_REQUEST_SZ          (SRV_HEADER_SZ + 4 + SRV_MAX_NAME_LEN)
+
+    #define SRV_STATUS_OK               (0)
+    #define SRV_STATUS_EXHAUSTED        (1)
+    #define SRV_STATUS_NOT_SERVED       (2)
+    #define SRV_STATUS_BAD_REQUEST      (3)
+
+    #define NOT_A_SRV ((Server){                                    \
+        NULL, -1, { NOT_AN_ALIST }, { NOT_AN_ALIST },               \
+        { NOT_A_CHUNK }, { NOT_A_CHUNK }, { NOT_AN_ALIST },         \
+        0, 0, 0, 0, 0, 0, { 0 }, 0                                  \
+    })
+
+    struct ServerBody;
+
+    /*
+     * The generation state of one grammar, shared by every client. With a
+     * pool, a refill thread owns the generation state and keeps up to
+     * pool_sz sentences ready in the filling Chunk, while requests take
+     * sentences from the serving Chunk. Taking one is an index increment,
+     * and only an empty serving Chunk makes a request lock the mutex, to
+     * swap the two Chunks.
+     */
+    typedef struct ServedGrammarBody {
+        char const*                 name;
+        struct ServerBody const*    srv;
+        GrammarGraph                graph[1];
+        Coverage                    cov[1];
+        FragmentTable               ftbl[1];
+        DecisionTree                dtree[1];
+        RandomWalk                  walk[1];
+        DerivationBudget            budget[1];
+        EnergyTable                 etbl[1];
+        uint64_t                    n_sentences;
+        bool                        is_exhausted;
+        bool                        has_refiller;
+        bool                        is_stopping;
+        pthread_t                   refiller;
+        pthread_mutex_t             mutex;
+        pthread_cond_t              has_room;
+        pthread_cond_t              has_sentences;
+        Chunk                       pool[2];
+        Chunk*                      serving;
+        Chunk*                      filling;
+        uint32_t                    n_served;
+        uint64_t                    n_misses;
+    } ServedGrammar;
+
+    /*
+     * Serves sentences of already loaded grammars over a Unix socket, one
+     * request at a time, so every client draws from the same DecisionTree
+     * and Coverage of a grammar. Every frame is a little-endian uint32
+     * length and that many bytes. A request frame holds the uint32 number
+     * of sentences, at most SRV_MAX_BATCH, and then the name the grammar
+     * was loaded with. The response is a frame of the uint32 status and
+     * the uint32 number of sentences, followed by a frame per sentence.
+     * Client sockets never block: what a slow client does not take of a
+     * response waits in its own output, and its next requests wait unread,
+     * so it holds back no other client. grammar_list holds a ServedGrammar
+     * pointer per grammar, in the order they were added.
+     */
+    typedef struct ServerBody {
+        char const*                 path;
+        int                         listen_fd;
+        ArrayList                   grammar_list[1];
+        ArrayList                   client_list[1];
+        Chunk                       str_builder[1];
+        Chunk                       response[1];
+        ArrayList                   seq[1];
+        uint32_t                    min_depth;
+        bool                        cov_guided;
+        bool                        uses_energy;
+        bool                        unique;
+        uint32_t                    pool_sz;
+        uint64_t                    n_requests;
+        uint64_t                    latency_counts[SRV_LATENCY_BUCKETS];
+        uint64_t                    max_latency_ns;
+    } Server;
+
+    /* Also prunes the grammar like construct_ggraph, and returns its result. Starts the refill thread of a pool. */
+    int addGrammar_srv(
+        Server* const srv,
+        char const* const name,
+        FILE* const bnf_file,
+        char* const root_str,
+        uint32_t const root_len,
+        uint32_t const max_decisions,
+        uint32_t const max_bytes
+    );
+
+    #define SRV_OK                  (0)
+    #define SRV_CANNOT_LISTEN       (1)
+    #define SRV_CANNOT_CONNECT      (2)
+    #define SRV_BAD_RESPONSE        (3)
+    #define SRV_EXHAUSTED           (4)
+    #define SRV_NOT_SERVED          (5)
+    /* pool_sz = 0 generates every sentence while its request waits. */
+    int construct_srv(
+        Server* const srv,
+        char const* const path,
+        uint32_t const min_depth,
+        bool const cov_guided,
+        bool const uses_energy,
+        bool const unique,
+        uint32_t const pool_sz
+    );
+
+    /* Also removes the socket file, and stops the refill threads first. */
+    void destruct_srv(Server* const srv);
+
+    bool isValid_srv(Server const* const srv);
+
+    /*
+     * Asks the server at path for n sentences of the grammar called name,
+     * in batches of SRV_MAX_BATCH, and prints them one per line.
+     */
+    int query_srv(
+        FILE* const output,
+        uint32_t* const p_n_received,
+        char const* const path,
+        char const* const name,
+        uint32_t n
+    );
+
+    /* Serves until SIGINT or SIGTERM, or for t seconds unless t is 0. */
+    int run_srv(
+        Server* const srv,
+        uint32_t const t
+    );
+#endif
@@ -0,0 +1,94 @@
+#ifndef SHARED_RING_H
+    #define SHARED_RING_H
+    #include <stdbool.h>
+    #include "padkit/item.h"
+
+    #ifndef SRING_CAPACITY
+        #define SRING_CAPACITY          (16777216)
+    #endif
+
+    #ifndef SRING_WAIT_MS
+        #define SRING_WAIT_MS           (100)
+    #endif
+
+    #ifndef SRING_DRAIN_MS
+        #define SRING_DRAIN_MS          (1000)
+    #endif
+
+    #define SRING_MAGIC                 "GFR1"
+    #define SRING_MAGIC_LEN             (4)
+    #define SRING_MAX_LEN_NAME          (255)
+
+    #define NOT_A_SRING ((SharedRing){ { 0 }, NULL, NULL, 0, 0, 0, 0, 0 })
+
+    struct SharedRingHeaderBody;
+
+    /*
+     * A ring of variable-length records in POSIX shared memory, with one
+     * generator writing sentences and any number of processes reading them
+     * in place. A record is its length, its state, and its bytes, padded to
+     * 8 bytes, and a record that would cross the end of the ring is preceded
+     * by a padding record instead. Readers claim records by compare-and-swap
+     * on a shared cursor and release them in any order, and the writer only
+     * reuses the space of released records, oldest first. Either side sleeps
+     * on a futex when the ring is empty or full, where the kernel has them,
+     * and polls every millisecond otherwise.
+     */
+    typedef struct SharedRingBody {
+        char                            name[SRING_MAX_LEN_NAME + 2];
+        struct SharedRingHeaderBody*    header;
+        unsigned char*                  data;
+        uint64_t                        deadline_ns;
+        uint64_t                        n_records;
+        uint64_t                        n_waits;
+        bool                            is_writer;
+        bool                            is_timed_out;
+    } SharedRing;
+
+    #define SRING_OK                (0)
+    #define SRING_END               (1)
+    #define SRING_TIMEOUT           (2)
+    #define SRING_TOO_LARGE         (3)
+    #define SRING_CANNOT_OPEN       (4)
+    #define SRING_UNCLAIMED         (5)
+    /* Reads the next record in place, until release_sring. SRING_END once the writer is gone and the ring is empty. */
+    int claim_sring(
+        SharedRing* const ring,
+        Item* const record
+    );
+
+    /* Creates the ring as its writer, and fails if it exists. 0 means no deadline_ns. */
+    int construct_sring(
+        SharedRing* const ring,
+        char const* const name,
+        uint64_t const deadline_ns
+    );
+
+    /*
+     * The writer waits for a first reader until the deadline, or for
+     * SRING_DRAIN_MS without one, then for the readers to release every
+     * record unless the deadline passes or they stall for SRING_DRAIN_MS, and
+     * removes the ring. SRING_UNCLAIMED if records were left unclaimed.
+     */
+    int destruct_sring(SharedRing* const ring);
+
+    bool isValid_sring(SharedRing const* const ring);
+
+    /* Attaches to the ring of a running writer as a reader. */
+    int open_sring(
+        SharedRing* const ring,
+        char const* const name
+    );
+
+    void release_sring(
+        SharedRing* const ring,
+        Item const* const record
+    );
+
+    /* Waits for room if the ring is full, unless the deadline passes. */
+    int write_sring(
+        SharedRing* const ring,
+        void const* const data,
+        uint32_t const sz
+    );
+#endif
@@ -0,0 +1,70 @@
+#ifndef SPAN_TREE_H
+    #define SPAN_TREE_H
+    #include <stdio.h>
+    #include "grammargraph.h"
+
+    #define STREE_MAGIC             "GFT2"
+    #define STREE_MAGIC_LEN         (4)
+    #define STREE_MAX_VARINT_LEN    (5)
+
+    #define NOT_A_STREE             ((SpanTree){ NOT_AN_ALIST })
+
+    /* A rule or a terminal, term >> 1 is its id and term & 1 is 1 for a terminal. */
+    typedef struct SpanBody {
+        uint32_t    term;
+        uint32_t    start;
+        uint32_t    len;
+    } Span;
+
+    #define STREE_TERM(rt_id, is_terminal)  (((uint32_t)(rt_id) << 1) | (uint32_t)(is_terminal))
+    #define STREE_IS_TERMINAL(term)         ((term) & 1)
+    #define STREE_RT_ID(term)               ((term) >> 1)
+
+    /*
+     * The derivation tree of one sentence as the byte span of every term, in
+     * preorder. A file of them starts with STREE_MAGIC, the number of rules
+     * and the length and name of every rule, then the number of terminals
+     * and the length and bytes of every terminal, so the ids of a record
+     * need no grammar. One record per sentence follows: the number of spans,
+     * then the term, start, and length of every span. Every number is a
+     * LEB128 varint.
+     */
+    typedef struct SpanTreeBody {
+        ArrayList   span_list[1];
+    } SpanTree;
+
+    /* Appends a span of unknown length, returns its index for close_stree. */
+    uint32_t add_stree(
+        SpanTree* const stree,
+        uint32_t const term,
+        uint32_t const start
+    );
+
+    /* Ends a span at byte end. */
+    void close_stree(
+        SpanTree* const stree,
+        uint32_t const span_id,
+        uint32_t const end
+    );
+
+    void constructEmpty_stree(SpanTree* const stree);
+
+    void destruct_stree(SpanTree* const stree);
+
+    void flush_stree(SpanTree* const stree);
+
+    bool isValid_stree(SpanTree const* const stree);
+
+    size_t memoryUsage_stree(SpanTree const* const stree);
+
+    bool write_stree(
+        FILE* const fp,
+        SpanTree const* const stree
+    );
+
+    /* The magic and the name tables of the graph, once at the start of the file. */
+    bool writeHeader_stree(
+        FILE* const fp,
+        GrammarGraph const* const graph
+    );
+#endif
@@ -0,0 +1,103 @@
+#ifndef WEIGHT_TABLE_H
+    #define WEIGHT_TABLE_H
+    #include "grammargraph.h"
+
+    #ifndef WTBL_BOLTZMANN_MAX_DENSE_RULES
+        #define WTBL_BOLTZMANN_MAX_DENSE_RULES  (1024)
+    #endif
+
+    #ifndef WTBL_BOLTZMANN_MAX_ITERATIONS
+        #define WTBL_BOLTZMANN_MAX_ITERATIONS   (4096)
+    #endif
+
+    #ifndef WTBL_BOLTZMANN_N_BISECTIONS
+        #define WTBL_BOLTZMANN_N_BISECTIONS     (128)
+    #endif
+
+    #define NOT_A_WTBL ((WeightTable){                          \
+        { NOT_AN_ALIST }, { NOT_AN_ALIST },                     \
+        { NOT_AN_ALIST }, { NOT_AN_ALIST }                      \
+    })
+
+    /*
+     * One weight per alternative, laid out rule by rule. The alternatives of
+     * rule r occupy [offset[r], offset[r + 1]). Every rule also owns a Walker
+     * alias table over the same range, so sampling is O(1).
+     */
+    typedef struct WeightTableBody {
+        ArrayList   offset_list[1];
+        ArrayList   weight_list[1];
+        ArrayList   prob_list[1];
+        ArrayList   alias_list[1];
+    } WeightTable;
+
+    #define WTBL_OK                 (0)
+    #define WTBL_NOT_TUNABLE        (1)
+    #define WTBL_SYNTAX_ERROR       (2)
+    int constructBoltzmann_wtbl(
+        WeightTable* const wtbl,
+        double* const p_expected_size,
+        GrammarGraph const* const graph,
+        double const target_size
+    );
+
+    void constructUniform_wtbl(
+        WeightTable* const wtbl,
+        GrammarGraph const* const graph
+    );
+
+    void destruct_wtbl(WeightTable* const wtbl);
+
+    double getWeight_wtbl(
+        WeightTable const* const wtbl,
+        uint32_t const rule_id,
+        uint32_t const alt_id
+    );
+
+    bool isValid_wtbl(WeightTable const* const wtbl);
+
+    size_t memoryUsage_wtbl(WeightTable const* const wtbl);
+
+    int load_wtbl(
+        WeightTable* const wtbl,
+        FILE* const weight_file,
+        GrammarGraph const* const graph
+    );
+
+    uint32_t nAlternatives_wtbl(
+        WeightTable const* const wtbl,
+        uint32_t const rule_id
+    );
+
+    void rebuildAlias_wtbl(
+        WeightTable* const wtbl,
+        uint32_t const rule_id
+    );
+
+    void rebuildAllAliases_wtbl(WeightTable* const wtbl);
+
+    uint32_t sample_wtbl(
+        WeightTable const* const wtbl,
+        uint32_t const rule_id
+    );
+
+    uint32_t sampleSubset_wtbl(
+        WeightTable const* const wtbl,
+        uint32_t const rule_id,
+        uint32_t const* const alt_ids,
+        uint32_t const n_alt_ids
+    );
+
+    void save_wtbl(
+        FILE* const weight_file,
+        WeightTable const* const wtbl,
+        GrammarGraph const* const graph
+    );
+
+    void setWeight_wtbl(
+        WeightTable* const wtbl,
+        uint32_t const rule_id,
+        uint32_t const alt_id,
+        double const weight
+    );
+#endif
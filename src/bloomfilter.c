@@ -0,0 +1,79 @@
+#include <assert.h>
+#include <stdlib.h>
+#include "bloomfilter.h"
+#include "padkit/memalloc.h"
+#include "padkit/repeat.h"
+
+static uint64_t hashSequence(ArrayList const* const seq);
+
+void construct_bloom(
+    BloomFilter* const bloom,
+    size_t const sz
+) {
+    size_t const n_words = (sz < sizeof(uint64_t)) ? 1 : sz / sizeof(uint64_t);
+
+    assert(bloom != NULL);
+    bloom->words        = mem_calloc(n_words, sizeof(uint64_t));
+    bloom->n_bits       = (uint64_t)n_words * 64;
+    bloom->n_inserted   = 0;
+}
+
+void destruct_bloom(BloomFilter* const bloom) {
+    assert(isValid_bloom(bloom));
+    free(bloom->words);
+    *bloom = NOT_A_BLOOM;
+}
+
+/* FNV-1a over the decisions, then the splitmix64 finalizer to spread the low bits. */
+static uint64_t hashSequence(ArrayList const* const seq) {
+    uint32_t const* decision    = getFirst_alist(seq);
+    uint64_t h                  = 0xCBF29CE484222325ULL;
+
+    REPEAT(seq->len) {
+        h ^= *(decision++);
+        h *= 0x100000001B3ULL;
+    }
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+}
+
+bool insert_bloom(
+    BloomFilter* const bloom,
+    ArrayList const* const seq
+) {
+    uint64_t const h    = hashSequence(seq);
+    uint64_t const h1   = h & 0xFFFFFFFF;
+    uint64_t const h2   = (h >> 32) | 1;
+    bool is_seen        = 1;
+
+    assert(isValid_bloom(bloom));
+    assert(isValid_alist(seq));
+    assert(seq->sz_elem == sizeof(uint32_t));
+
+    for (uint64_t i = 0; i < BLOOM_N_HASHES; i++) {
+        uint64_t const bit_id   = (h1 + i * h2) % bloom->n_bits;
+        uint64_t const mask     = (uint64_t)1 << (bit_id % 64);
+
+        if (bloom->words[bit_id / 64] & mask) continue;
+
+        bloom->words[bit_id / 64] |= mask;
+        is_seen = 0;
+    }
+    if (!is_seen) bloom->n_inserted++;
+
+    return is_seen;
+}
+
+bool isValid_bloom(BloomFilter const* const bloom) {
+    if (bloom == NULL)          return 0;
+    if (bloom->words == NULL)   return 0;
+    if (bloom->n_bits == 0)     return 0;
+
+    return 1;
+}
+
+size_t memoryUsage_bloom(BloomFilter const* const bloom) {
+    assert(isValid_bloom(bloom));
+    return (size_t)(bloom->n_bits / 8);
+}
@@ -0,0 +1,488 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "corpus.h"
+#include "earleyparser.h"
+#include "padkit/invalid.h"
+#include "padkit/memalloc.h"
+#include "padkit/repeat.h"
+#include "padkit/size.h"
+#include "padkit/verbose.h"
+
+#define CORPUS_INITIAL_BUFFER_SZ    (65536)
+
+/* A parsed file waiting for the files before it to be printed, decisions is NULL unless it is kept. */
+typedef struct CorpusResultBody {
+    bool        is_done;
+    bool        is_accepted;
+    uint32_t    n_decisions;
+    uint32_t*   decisions;
+} CorpusResult;
+
+/*
+ * Every thread owns a parser and its counters, so only the file cursors are
+ * shared. A result slot is written by the one thread that took its file,
+ * and the thread that completes the earliest unprinted file prints every
+ * finished file from there on and frees their decisions, so only the files
+ * parsed out of order wait in memory.
+ */
+typedef struct CorpusWorkerBody {
+    Corpus const*       corpus;
+    GrammarGraph const* graph;
+    pthread_mutex_t*    mutex;
+    uint32_t*           next_path_id;
+    uint32_t*           next_print_id;
+    FILE*               output;
+    EarleyParser        parser[1];
+    ArrayList           seq[1];
+    ArrayList           stack[1];
+    char*               buffer;
+    size_t              buffer_cap;
+    uint32_t const*     offsets;
+    uint64_t*           counts;
+    CorpusResult*       results;
+    bool                needs_seq;
+    uint32_t            n_accepted;
+} CorpusWorker;
+
+static void addDirectory(
+    Corpus* const corpus,
+    char* const path,
+    size_t const path_len
+);
+
+static void constructWorkers(
+    CorpusWorker* const workers,
+    uint32_t const n_workers,
+    pthread_mutex_t* const mutex,
+    uint32_t* const next_path_id,
+    Corpus const* const corpus,
+    GrammarGraph const* const graph,
+    bool const needs_seq
+);
+
+static void countDecisions(CorpusWorker* const worker);
+
+static uint32_t destructWorkers(
+    CorpusWorker* const workers,
+    uint32_t const n_workers
+);
+
+static uint32_t nThreads(
+    Corpus const* const corpus,
+    uint32_t const n_jobs
+);
+
+static void printResults(CorpusWorker* const worker);
+
+/* Prints results in path order, whichever thread parsed them, and needs the mutex. */
+static void printResults(CorpusWorker* const worker) {
+    uint32_t const n_paths = LEN_CHUNK(worker->corpus->paths);
+
+    while (*(worker->next_print_id) < n_paths) {
+        CorpusResult* const result  = worker->results + *(worker->next_print_id);
+        Item const path             = get_chunk(worker->corpus->paths, *(worker->next_print_id));
+
+        if (!result->is_done) break;
+
+        fprintf(worker->output, "%s %.*s", result->is_accepted ? "ACCEPT" : "REJECT", (int)path.sz - 1, (char*)path.p);
+        if (result->decisions != NULL) {
+            fputc('\t', worker->output);
+            for (uint32_t i = 0; i < result->n_decisions; i++)
+                fprintf(worker->output, i == 0 ? "%"PRIu32 : " %"PRIu32, result->decisions[i]);
+            free(result->decisions);
+            result->decisions = NULL;
+        }
+        fputc('\n', worker->output);
+        (*(worker->next_print_id))++;
+    }
+}
+
+static bool readFile(
+    size_t* const p_sz,
+    CorpusWorker* const worker,
+    char const* const path
+);
+
+static void runWorkers(
+    CorpusWorker* const workers,
+    uint32_t const n_workers
+);
+
+static void* work(void* const arg);
+
+static void addDirectory(
+    Corpus* const corpus,
+    char* const path,
+    size_t const path_len
+) {
+    DIR* const dir          = opendir(path);
+    struct dirent* entry    = NULL;
+
+    if (dir == NULL) {
+        fprintf_verbose(stderr, "Skipping unreadable directory '%.*s'", FILENAME_MAX, path);
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        size_t const name_len = strlen(entry->d_name);
+        struct stat st;
+
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (path_len + 1 + name_len >= FILENAME_MAX)                            continue;
+
+        path[path_len] = '/';
+        memcpy(path + path_len + 1, entry->d_name, name_len + 1);
+
+        /* Symbolic links are followed to files only, so directory cycles are impossible. */
+        if (lstat(path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            addDirectory(corpus, path, path_len + 1 + name_len);
+        } else {
+            if (S_ISLNK(st.st_mode) && stat(path, &st) != 0)    continue;
+            if (S_ISREG(st.st_mode))                            add_chunk(corpus->paths, path, (uint32_t)(path_len + name_len + 2));
+        }
+    }
+    path[path_len] = '\0';
+
+    closedir(dir);
+}
+
+int construct_corpus(
+    Corpus* const corpus,
+    char const* const path
+) {
+    char path_buffer[FILENAME_MAX];
+    size_t path_len = 0;
+    struct stat st;
+
+    assert(corpus != NULL);
+    assert(path != NULL);
+
+    path_len = strlen(path);
+    if (path_len >= FILENAME_MAX || stat(path, &st) != 0) return CORPUS_CANNOT_OPEN;
+
+    constructEmpty_chunk(corpus->paths, CHUNK_RECOMMENDED_PARAMETERS);
+    if (S_ISREG(st.st_mode)) {
+        add_chunk(corpus->paths, path, (uint32_t)(path_len + 1));
+    } else if (S_ISDIR(st.st_mode)) {
+        memcpy(path_buffer, path, path_len + 1);
+        while (path_len > 1 && path_buffer[path_len - 1] == '/') path_buffer[--path_len] = '\0';
+        addDirectory(corpus, path_buffer, path_len);
+    } else {
+        destruct_chunk(corpus->paths);
+        *corpus = NOT_A_CORPUS;
+        return CORPUS_CANNOT_OPEN;
+    }
+
+    return CORPUS_OK;
+}
+
+static void constructWorkers(
+    CorpusWorker* const workers,
+    uint32_t const n_workers,
+    pthread_mutex_t* const mutex,
+    uint32_t* const next_path_id,
+    Corpus const* const corpus,
+    GrammarGraph const* const graph,
+    bool const needs_seq
+) {
+    for (uint32_t i = 0; i < n_workers; i++) {
+        CorpusWorker* const worker = workers + i;
+
+        worker->corpus          = corpus;
+        worker->graph           = graph;
+        worker->mutex           = mutex;
+        worker->next_path_id    = next_path_id;
+        worker->next_print_id   = NULL;
+        worker->output          = NULL;
+        worker->parser[0]       = NOT_AN_EPARSER;
+        worker->seq[0]          = NOT_AN_ALIST;
+        worker->stack[0]        = NOT_AN_ALIST;
+        worker->buffer_cap      = CORPUS_INITIAL_BUFFER_SZ;
+        worker->buffer          = mem_alloc(worker->buffer_cap);
+        worker->offsets         = NULL;
+        worker->counts          = NULL;
+        worker->results         = NULL;
+        worker->needs_seq       = needs_seq;
+        worker->n_accepted      = 0;
+        construct_eparser(worker->parser, graph);
+        constructEmpty_alist(worker->seq, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+        constructEmpty_alist(worker->stack, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    }
+}
+
+/* Decision sequences are in preorder, so a stack of pending rules tells whom each decision belongs to. */
+static void countDecisions(CorpusWorker* const worker) {
+    GrammarGraph const* const graph = worker->graph;
+    uint32_t const* decision        = getFirst_alist(worker->seq);
+
+    flush_alist(worker->stack);
+    push_alist(worker->stack, &(graph->root_rule_id));
+    REPEAT(worker->seq->len) {
+        uint32_t const rule_id      = *(uint32_t*)pop_alist(worker->stack);
+        RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+        uint32_t const first_exp_id = *(uint32_t*)get_alist(rule->alt_list, *decision);
+        uint32_t last_exp_id        = first_exp_id;
+
+        worker->counts[worker->offsets[rule_id] + *(decision++)]++;
+
+        while (((ExpansionTerm*)get_alist(graph->exp_list, last_exp_id))->has_next) last_exp_id++;
+        for (uint32_t exp_id = last_exp_id; ; exp_id--) {
+            ExpansionTerm const* const exp = get_alist(graph->exp_list, exp_id);
+            if (!exp->is_terminal) {
+                uint32_t const child_id = exp->rt_id;
+                push_alist(worker->stack, &child_id);
+            }
+            if (exp_id == first_exp_id) break;
+        }
+    }
+}
+
+void destruct_corpus(Corpus* const corpus) {
+    assert(isValid_corpus(corpus));
+
+    destruct_chunk(corpus->paths);
+
+    *corpus = NOT_A_CORPUS;
+}
+
+static uint32_t destructWorkers(
+    CorpusWorker* const workers,
+    uint32_t const n_workers
+) {
+    uint32_t n_accepted = 0;
+
+    for (uint32_t i = 0; i < n_workers; i++) {
+        CorpusWorker* const worker = workers + i;
+
+        n_accepted += worker->n_accepted;
+        destruct_eparser(worker->parser);
+        destruct_alist(worker->seq);
+        destruct_alist(worker->stack);
+        free(worker->buffer);
+        free(worker->counts);
+    }
+
+    return n_accepted;
+}
+
+bool isValid_corpus(Corpus const* const corpus) {
+    return corpus != NULL && isValid_chunk(corpus->paths);
+}
+
+uint32_t learnWeights_corpus(
+    WeightTable* const wtbl,
+    Corpus const* const corpus,
+    GrammarGraph const* const graph,
+    uint32_t const n_jobs
+) {
+    pthread_mutex_t mutex       = PTHREAD_MUTEX_INITIALIZER;
+    uint32_t const n_threads    = nThreads(corpus, n_jobs);
+    CorpusWorker* workers       = NULL;
+    uint32_t next_path_id       = 0;
+    uint32_t n_alts             = 0;
+    uint32_t n_accepted         = 0;
+
+    assert(wtbl != NULL);
+    assert(isValid_corpus(corpus));
+    assert(isValid_ggraph(graph));
+
+    fprintf_verbose(stderr, "# Learning Threads = %"PRIu32, n_threads);
+
+    constructUniform_wtbl(wtbl, graph);
+    n_alts = wtbl->weight_list->len;
+
+    workers = mem_calloc(n_threads, sizeof(CorpusWorker));
+    constructWorkers(workers, n_threads, &mutex, &next_path_id, corpus, graph, 1);
+    for (uint32_t i = 0; i < n_threads; i++) {
+        workers[i].offsets  = getFirst_alist(wtbl->offset_list);
+        workers[i].counts   = mem_calloc(n_alts + 1, sizeof(uint64_t));
+    }
+
+    runWorkers(workers, n_threads);
+
+    for (uint32_t alt = 0; alt < n_alts; alt++) {
+        uint64_t count = 0;
+        for (uint32_t i = 0; i < n_threads; i++) count += workers[i].counts[alt];
+        *(double*)get_alist(wtbl->weight_list, alt) = (double)count + CORPUS_PSEUDO_COUNT;
+    }
+    rebuildAllAliases_wtbl(wtbl);
+
+    n_accepted = destructWorkers(workers, n_threads);
+    free(workers);
+    pthread_mutex_destroy(&mutex);
+
+    return n_accepted;
+}
+
+static uint32_t nThreads(
+    Corpus const* const corpus,
+    uint32_t const n_jobs
+) {
+    uint32_t n_threads = n_jobs;
+
+    if (n_threads == 0) {
+        long const n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = (n_cpus > 0) ? (uint32_t)n_cpus : 1;
+    }
+    if (n_threads > CORPUS_MAX_JOBS)                n_threads = CORPUS_MAX_JOBS;
+    if (n_threads > LEN_CHUNK(corpus->paths))       n_threads = LEN_CHUNK(corpus->paths);
+    if (n_threads == 0)                             n_threads = 1;
+
+    return n_threads;
+}
+
+uint32_t parse_corpus(
+    FILE* const output,
+    Corpus const* const corpus,
+    GrammarGraph const* const graph,
+    uint32_t const n_jobs,
+    bool const prints_derivations
+) {
+    pthread_mutex_t mutex       = PTHREAD_MUTEX_INITIALIZER;
+    uint32_t const n_threads    = nThreads(corpus, n_jobs);
+    uint32_t const n_paths      = LEN_CHUNK(corpus->paths);
+    CorpusWorker* workers       = NULL;
+    CorpusResult* results       = NULL;
+    uint32_t next_path_id       = 0;
+    uint32_t next_print_id      = 0;
+    uint32_t n_accepted         = 0;
+
+    assert(output != NULL);
+    assert(isValid_corpus(corpus));
+    assert(isValid_ggraph(graph));
+
+    fprintf_verbose(stderr, "# Parsing Threads = %"PRIu32, n_threads);
+
+    results = mem_calloc((size_t)n_paths + 1, sizeof(CorpusResult));
+    workers = mem_calloc(n_threads, sizeof(CorpusWorker));
+    constructWorkers(workers, n_threads, &mutex, &next_path_id, corpus, graph, prints_derivations);
+    for (uint32_t i = 0; i < n_threads; i++) {
+        workers[i].results          = results;
+        workers[i].next_print_id    = &next_print_id;
+        workers[i].output           = output;
+    }
+
+    runWorkers(workers, n_threads);
+    assert(next_print_id == n_paths);
+
+    n_accepted = destructWorkers(workers, n_threads);
+    free(workers);
+    free(results);
+    pthread_mutex_destroy(&mutex);
+
+    return n_accepted;
+}
+
+static bool readFile(
+    size_t* const p_sz,
+    CorpusWorker* const worker,
+    char const* const path
+) {
+    FILE* const fp  = fopen(path, "rb");
+    size_t sz       = 0;
+
+    if (fp == NULL) return 0;
+
+    for (;;) {
+        size_t const n_read = fread(worker->buffer + sz, 1, worker->buffer_cap - sz, fp);
+        sz += n_read;
+        if (sz < worker->buffer_cap) break;
+        if (worker->buffer_cap >= SZ32_MAX) {
+            fclose(fp);
+            return 0;
+        }
+
+        worker->buffer_cap <<= 1;
+        worker->buffer = mem_realloc(worker->buffer, worker->buffer_cap);
+    }
+
+    if (ferror(fp)) {
+        fclose(fp);
+        return 0;
+    }
+
+    fclose(fp);
+    *p_sz = sz;
+    return 1;
+}
+
+static void runWorkers(
+    CorpusWorker* const workers,
+    uint32_t const n_workers
+) {
+    if (n_workers == 1) {
+        work(workers);
+    } else {
+        pthread_t* const threads    = mem_calloc(n_workers, sizeof(pthread_t));
+        uint32_t n_started          = 0;
+
+        while (n_started < n_workers && pthread_create(threads + n_started, NULL, work, workers + n_started) == 0)
+            n_started++;
+        /* If no thread could start, the calling thread does all the work. */
+        if (n_started == 0) work(workers);
+        for (uint32_t i = 0; i < n_started; i++) pthread_join(threads[i], NULL);
+
+        free(threads);
+    }
+}
+
+static void* work(void* const arg) {
+    CorpusWorker* const worker  = arg;
+    ArrayList* const seq        = worker->needs_seq ? worker->seq : NULL;
+
+    for (;;) {
+        uint32_t path_id    = INVALID_UINT32;
+        size_t sz           = 0;
+        char const* path    = NULL;
+        bool is_accepted    = 0;
+
+        pthread_mutex_lock(worker->mutex);
+        path_id = (*(worker->next_path_id))++;
+        pthread_mutex_unlock(worker->mutex);
+
+        if (path_id >= LEN_CHUNK(worker->corpus->paths)) break;
+
+        path = get_chunk(worker->corpus->paths, path_id).p;
+        if (readFile(&sz, worker, path)) {
+            if (seq != NULL) flush_alist(seq);
+            is_accepted = (parse_eparser(seq, worker->parser, worker->buffer, (uint32_t)sz) == EPARSER_ACCEPT);
+
+            /* Most text files end with a newline the grammar does not mention. */
+            if (!is_accepted && sz > 0 && worker->buffer[sz - 1] == '\n') {
+                if (seq != NULL) flush_alist(seq);
+                is_accepted = (parse_eparser(seq, worker->parser, worker->buffer, (uint32_t)(sz - 1)) == EPARSER_ACCEPT);
+            }
+        }
+
+        if (is_accepted) {
+            worker->n_accepted++;
+            if (worker->counts != NULL) countDecisions(worker);
+        }
+        if (worker->results != NULL) {
+            CorpusResult* const result  = worker->results + path_id;
+            uint32_t* decisions         = NULL;
+
+            if (is_accepted && seq != NULL) {
+                decisions = mem_alloc(((size_t)seq->len + 1) * sizeof(uint32_t));
+                memcpy(decisions, getFirst_alist(seq), (size_t)seq->len * sizeof(uint32_t));
+            }
+
+            pthread_mutex_lock(worker->mutex);
+            result->is_accepted = is_accepted;
+            result->n_decisions = (decisions == NULL) ? 0 : seq->len;
+            result->decisions   = decisions;
+            result->is_done     = 1;
+            printResults(worker);
+            pthread_mutex_unlock(worker->mutex);
+        }
+    }
+
+    return NULL;
+}
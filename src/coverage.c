@@ -0,0 +1,99 @@
+#include <assert.h>
+#include "coverage.h"
+#include "memoryusage.h"
+#include "padkit/memalloc.h"
+#include "padkit/size.h"
+
+void construct_cov(
+    Coverage* const cov,
+    GrammarGraph const* const graph
+) {
+    assert(cov != NULL);
+    assert(isValid_ggraph(graph));
+
+    cov->n_rules        = graph->rule_list->len;
+    cov->n_exps         = graph->exp_list->len;
+    cov->n_cov          = 0;
+    cov->rule_counts    = mem_calloc((size_t)cov->n_rules + 1, sizeof(uint32_t));
+    cov->exp_counts     = mem_calloc((size_t)cov->n_exps + 1, sizeof(uint32_t));
+}
+
+void destruct_cov(Coverage* const cov) {
+    assert(isValid_cov(cov));
+
+    free(cov->rule_counts);
+    free(cov->exp_counts);
+
+    *cov = NOT_A_COV;
+}
+
+void hitExp_cov(
+    Coverage* const cov,
+    uint32_t const exp_id
+) {
+    uint32_t* const count = cov->exp_counts + exp_id;
+
+    assert(exp_id < cov->n_exps);
+
+    if (*count == 0)        cov->n_cov++;
+    if (*count < SZ32_MAX)  (*count)++;
+}
+
+void hitRule_cov(
+    Coverage* const cov,
+    uint32_t const rule_id
+) {
+    uint32_t* const count = cov->rule_counts + rule_id;
+
+    assert(rule_id < cov->n_rules);
+
+    if (*count == 0)        cov->n_cov++;
+    if (*count < SZ32_MAX)  (*count)++;
+}
+
+bool isValid_cov(Coverage const* const cov) {
+    if (cov == NULL)                                return 0;
+    if (cov->rule_counts == NULL)                   return 0;
+    if (cov->exp_counts == NULL)                    return 0;
+    if (cov->n_cov > cov->n_rules + cov->n_exps)    return 0;
+
+    return 1;
+}
+
+size_t memoryUsage_cov(Coverage const* const cov) {
+    assert(isValid_cov(cov));
+    return ((size_t)cov->n_rules + 1 + cov->n_exps + 1) * sizeof(uint32_t);
+}
+
+void merge_cov(
+    Coverage* const dst,
+    Coverage const* const src
+) {
+    assert(isValid_cov(dst));
+    assert(isValid_cov(src));
+    assert(dst->n_rules == src->n_rules);
+    assert(dst->n_exps == src->n_exps);
+
+    dst->n_cov = 0;
+    for (uint32_t rule_id = 0; rule_id < dst->n_rules; rule_id++) {
+        uint64_t const count        = (uint64_t)dst->rule_counts[rule_id] + src->rule_counts[rule_id];
+        dst->rule_counts[rule_id]   = (count < SZ32_MAX) ? (uint32_t)count : SZ32_MAX;
+        dst->n_cov                 += (count > 0);
+    }
+    for (uint32_t exp_id = 0; exp_id < dst->n_exps; exp_id++) {
+        uint64_t const count        = (uint64_t)dst->exp_counts[exp_id] + src->exp_counts[exp_id];
+        dst->exp_counts[exp_id]     = (count < SZ32_MAX) ? (uint32_t)count : SZ32_MAX;
+        dst->n_cov                 += (count > 0);
+    }
+}
+
+uint32_t termCov_cov(Coverage const* const cov) {
+    assert(isValid_cov(cov));
+    {
+        uint32_t const n_total      = cov->n_rules + cov->n_exps;
+        uint32_t const n_cov_x_100  = 100 * cov->n_cov;
+        assert(n_cov_x_100 / 100 == cov->n_cov);
+
+        return n_cov_x_100 / n_total;
+    }
+}
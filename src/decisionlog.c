@@ -0,0 +1,280 @@
+#include <assert.h>
+#include <string.h>
+#include "decisionlog.h"
+#include "padkit/invalid.h"
+#include "padkit/memalloc.h"
+#include "padkit/repeat.h"
+
+static uint32_t nextRule(
+    ArrayList* const stack,
+    GrammarGraph const* const graph,
+    uint32_t const rule_id,
+    uint32_t const decision
+);
+
+static int readVarint(
+    uint32_t* const p_value,
+    FILE* const fp
+);
+
+static uint32_t writeVarint(
+    FILE* const fp,
+    uint32_t value
+);
+
+void construct_dlog(
+    DecisionLog* const dlog,
+    GrammarGraph const* const graph
+) {
+    RuleTerm const* rule = NULL;
+
+    assert(dlog != NULL);
+    assert(isValid_ggraph(graph));
+
+    dlog->graph             = graph;
+    dlog->widths            = mem_alloc((size_t)graph->rule_list->len);
+    dlog->n_read            = 0;
+    dlog->n_written         = 0;
+    dlog->n_written_bytes   = 0;
+    constructEmpty_alist(dlog->stack, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+
+    rule = getFirst_alist(graph->rule_list);
+    for (uint32_t rule_id = 0; rule_id < graph->rule_list->len; rule++, rule_id++) {
+        unsigned char width = 0;
+        while (((uint64_t)1 << width) < rule->alt_list->len) width++;
+        dlog->widths[rule_id] = width;
+    }
+}
+
+void destruct_dlog(DecisionLog* const dlog) {
+    assert(isValid_dlog(dlog));
+    free(dlog->widths);
+    destruct_alist(dlog->stack);
+    *dlog = NOT_A_DLOG;
+}
+
+bool isValid_dlog(DecisionLog const* const dlog) {
+    if (dlog == NULL)                   return 0;
+    if (!isValid_ggraph(dlog->graph))   return 0;
+    if (dlog->widths == NULL)           return 0;
+    if (!isValid_alist(dlog->stack))    return 0;
+
+    return 1;
+}
+
+/* Pushes the rules of the chosen alternative, and pops the next rule to decide, INVALID_UINT32 if none. */
+static uint32_t nextRule(
+    ArrayList* const stack,
+    GrammarGraph const* const graph,
+    uint32_t const rule_id,
+    uint32_t const decision
+) {
+    RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+    uint32_t const exp_id       = *(uint32_t*)get_alist(rule->alt_list, decision);
+    ExpansionTerm const* exp    = get_alist(graph->exp_list, exp_id);
+    uint32_t n_exps             = 1;
+
+    while ((exp++)->has_next) n_exps++;
+    REPEAT(n_exps) {
+        exp--;
+        if (!exp->is_terminal) push_alist(stack, &(uint32_t){ exp->rt_id });
+    }
+
+    return (stack->len == 0) ? INVALID_UINT32 : *(uint32_t*)pop_alist(stack);
+}
+
+int read_dlog(
+    ArrayList* const seq,
+    DecisionLog* const dlog,
+    FILE* const fp
+) {
+    GrammarGraph const* graph   = NULL;
+    uint64_t bits               = 0;
+    uint32_t n_bits             = 0;
+    uint32_t n_decisions        = 0;
+    uint32_t rule_id            = 0;
+
+    assert(isValid_alist(seq));
+    assert(seq->sz_elem == sizeof(uint32_t));
+    assert(isValid_dlog(dlog));
+    assert(fp != NULL);
+
+    graph   = dlog->graph;
+    rule_id = graph->root_rule_id;
+    flush_alist(seq);
+    flush_alist(dlog->stack);
+    switch (readVarint(&n_decisions, fp)) {
+        case DLOG_OK:   break;
+        case DLOG_END:  return DLOG_END;
+        default:        return DLOG_BAD_FORMAT;
+    }
+    if (n_decisions == 0) return DLOG_BAD_FORMAT;
+
+    REPEAT(n_decisions) {
+        RuleTerm const* rule    = NULL;
+        uint32_t width          = 0;
+        uint32_t decision       = 0;
+
+        if (rule_id == INVALID_UINT32) return DLOG_BAD_FORMAT;
+        rule    = get_alist(graph->rule_list, rule_id);
+        width   = dlog->widths[rule_id];
+
+        while (n_bits < width) {
+            int const c = getc(fp);
+            if (c == EOF) return DLOG_BAD_FORMAT;
+
+            bits   |= (uint64_t)c << n_bits;
+            n_bits += 8;
+        }
+        decision    = (uint32_t)(bits & (((uint64_t)1 << width) - 1));
+        bits      >>= width;
+        n_bits     -= width;
+        if (decision >= rule->alt_list->len) return DLOG_BAD_FORMAT;
+
+        add_alist(seq, &decision);
+        rule_id = nextRule(dlog->stack, graph, rule_id, decision);
+    }
+    if (rule_id != INVALID_UINT32) return DLOG_BAD_FORMAT;
+
+    dlog->n_read++;
+    return DLOG_OK;
+}
+
+int readHeader_dlog(
+    DecisionLog const* const dlog,
+    FILE* const fp
+) {
+    char magic[DLOG_MAGIC_LEN];
+    GrammarGraph const* graph   = NULL;
+    RuleTerm const* rule        = NULL;
+    uint32_t n_rules            = 0;
+    uint32_t root_rule_id       = 0;
+
+    assert(isValid_dlog(dlog));
+    assert(fp != NULL);
+
+    graph = dlog->graph;
+    if (fread(magic, 1, DLOG_MAGIC_LEN, fp) != DLOG_MAGIC_LEN)  return DLOG_BAD_FORMAT;
+    if (memcmp(magic, DLOG_MAGIC, DLOG_MAGIC_LEN) != 0)         return DLOG_BAD_FORMAT;
+    if (readVarint(&n_rules, fp) != DLOG_OK)                    return DLOG_BAD_FORMAT;
+    if (readVarint(&root_rule_id, fp) != DLOG_OK)               return DLOG_BAD_FORMAT;
+    if (n_rules != graph->rule_list->len)                       return DLOG_MISMATCH;
+    if (root_rule_id != graph->root_rule_id)                    return DLOG_MISMATCH;
+
+    rule = getFirst_alist(graph->rule_list);
+    REPEAT(n_rules) {
+        uint32_t n_alts = 0;
+        if (readVarint(&n_alts, fp) != DLOG_OK)                 return DLOG_BAD_FORMAT;
+        if (n_alts != rule->alt_list->len)                      return DLOG_MISMATCH;
+        rule++;
+    }
+
+    return DLOG_OK;
+}
+
+/* DLOG_END only if the file ends before the first byte. */
+static int readVarint(
+    uint32_t* const p_value,
+    FILE* const fp
+) {
+    uint32_t value = 0;
+
+    for (uint32_t i = 0; i < DLOG_MAX_VARINT_LEN; i++) {
+        int const c = getc(fp);
+        if (c == EOF) return (i == 0) ? DLOG_END : DLOG_BAD_FORMAT;
+
+        value |= (uint32_t)(c & 0x7F) << (7 * i);
+        if ((c & 0x80) == 0) {
+            *p_value = value;
+            return DLOG_OK;
+        }
+    }
+
+    return DLOG_BAD_FORMAT;
+}
+
+bool write_dlog(
+    FILE* const fp,
+    DecisionLog* const dlog,
+    ArrayList const* const seq
+) {
+    GrammarGraph const* graph   = NULL;
+    uint32_t const* decision    = NULL;
+    uint64_t bits               = 0;
+    uint32_t n_bits             = 0;
+    uint32_t rule_id            = 0;
+    uint32_t n                  = 0;
+
+    assert(fp != NULL);
+    assert(isValid_dlog(dlog));
+    assert(isValid_alist(seq));
+    assert(seq->sz_elem == sizeof(uint32_t));
+    assert(seq->len > 0);
+
+    graph   = dlog->graph;
+    rule_id = graph->root_rule_id;
+    flush_alist(dlog->stack);
+    if ((n = writeVarint(fp, seq->len)) == 0) return 0;
+    dlog->n_written_bytes += n;
+
+    decision = getFirst_alist(seq);
+    REPEAT(seq->len) {
+        assert(rule_id != INVALID_UINT32);
+
+        bits   |= (uint64_t)*decision << n_bits;
+        n_bits += dlog->widths[rule_id];
+        for (; n_bits >= 8; n_bits -= 8, bits >>= 8) {
+            if (putc((int)(bits & 0xFF), fp) == EOF) return 0;
+            dlog->n_written_bytes++;
+        }
+
+        rule_id = nextRule(dlog->stack, graph, rule_id, *(decision++));
+    }
+    assert(rule_id == INVALID_UINT32);
+    if (n_bits > 0) {
+        if (putc((int)bits, fp) == EOF) return 0;
+        dlog->n_written_bytes++;
+    }
+
+    dlog->n_written++;
+    return 1;
+}
+
+bool writeHeader_dlog(
+    FILE* const fp,
+    DecisionLog const* const dlog
+) {
+    GrammarGraph const* graph   = NULL;
+    RuleTerm const* rule        = NULL;
+
+    assert(fp != NULL);
+    assert(isValid_dlog(dlog));
+
+    graph = dlog->graph;
+    if (fwrite(DLOG_MAGIC, 1, DLOG_MAGIC_LEN, fp) != DLOG_MAGIC_LEN)  return 0;
+    if (writeVarint(fp, graph->rule_list->len) == 0)                    return 0;
+    if (writeVarint(fp, graph->root_rule_id) == 0)                      return 0;
+
+    rule = getFirst_alist(graph->rule_list);
+    REPEAT(graph->rule_list->len) {
+        if (writeVarint(fp, (rule++)->alt_list->len) == 0) return 0;
+    }
+
+    return 1;
+}
+
+/* The number of bytes written, 0 if writing failed. */
+static uint32_t writeVarint(
+    FILE* const fp,
+    uint32_t value
+) {
+    uint32_t n = 1;
+
+    while (value >= 0x80) {
+        if (putc((int)((value & 0x7F) | 0x80), fp) == EOF) return 0;
+        value >>= 7;
+        n++;
+    }
+
+    return (putc((int)value, fp) == EOF) ? 0 : n;
+}
@@ -1,12 +1,199 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include "bnf.h"
 #include "decisiontree.h"
-#include "padkit/bitmatrix.h"
+#include "grammardiff.h"
+#include "memoryusage.h"
+#include "padkit/implication.h"
 #include "padkit/invalid.h"
+#include "padkit/memalloc.h"
 #include "padkit/repeat.h"
 #include "padkit/size.h"
+#include "padkit/verbose.h"
+
+#ifdef WRITE_LITERAL
+    #undef WRITE_LITERAL
+#endif
+#define WRITE_LITERAL(writer, lit)  writeBytes(writer, lit, sizeof(lit) - 1)
+
+#define WORD_BITS (64)
+
+/* An old node to carry over into a new node, with the old rule it decides and the cell of the rule pending after it. */
+typedef struct MigrationBody {
+    uint32_t    old_id;
+    uint32_t    new_id;
+    uint32_t    rule_id;
+    uint32_t    cont_id;
+} Migration;
+
+/* A decision prefix with the rules it leaves pending, in stack order. */
+typedef struct ShardPrefixBody {
+    uint32_t        node_id;
+    uint32_t        stack_offset;
+    uint32_t        stack_len;
+    uint32_t        prefix_id;
+    DerivationCost  reserved;
+    double          weight;
+} ShardPrefix;
+
+/*
+ * counts[r * n_cells + c] estimates the derivations of r that cost c cells
+ * more than its cheapest one, along the tighter of the two budget limits,
+ * unit bytes or decisions a cell. Without a budget, there is a single cell.
+ */
+typedef struct ShardEstimatesBody {
+    double*     counts;
+    double*     acc;
+    double*     tmp;
+    uint64_t    unit;
+    uint32_t    n_cells;
+    bool        is_bytes;
+} ShardEstimates;
+
+/* A rule left pending after a node, next_id is the cell of the rule pending after it. */
+typedef struct RuleCellBody {
+    uint32_t    rule_id;
+    uint32_t    next_id;
+} RuleCell;
+
+/* Formats a large tree into a buffer, and remembers if a write ever failed. */
+typedef struct TreeWriterBody {
+    FILE*       fp;
+    uint32_t    len;
+    bool        is_ok;
+    char        buffer[DTREE_WRITE_BUFFER_SZ];
+} TreeWriter;
+
+static uint32_t collectCandidates(
+    uint32_t* const pool,
+    DecisionTree const* const dtree,
+    DecisionTreeNode const* const node,
+    Coverage const* const cov,
+    RuleTerm const* const rule,
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    uint32_t const rule_id,
+    bool const unique,
+    bool const uncovered_only
+);
+
+static int compareShardPrefixes(
+    void const* a,
+    void const* b
+);
+
+static void convolveEstimates(
+    double* const acc,
+    double const* const estimates,
+    double* const tmp,
+    uint32_t const n_cells
+);
+
+static uint64_t costOnAxis(
+    ShardEstimates const* const est,
+    DerivationCost const* const cost
+);
+
+static uint32_t countBits(uint64_t word);
+
+static uint32_t drawCandidate(
+    WeightTable const* const sampler,
+    DecisionTree const* const dtree,
+    DecisionTreeNode const* const node,
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    uint32_t const rule_id,
+    bool const unique
+);
+
+static void exploreNode(
+    DecisionTree* const dtree,
+    uint32_t const node_id,
+    GrammarGraph const* const graph,
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    uint32_t const rule_id
+);
+
+static void flushWriter(TreeWriter* const writer);
+
+static bool isCovered(
+    Coverage const* const cov,
+    RuleTerm const* const rule,
+    uint32_t const choice
+);
+
+static uint32_t lowestBit(uint64_t const word);
+
+static void mapRules(
+    uint32_t* const node_rules,
+    DecisionTree const* const dtree,
+    GrammarGraph const* const graph
+);
+
+static void markStableRules(
+    bool* const is_stable,
+    GrammarDiff const* const diff
+);
+
+static void openChildren(
+    DecisionTree* const dtree,
+    uint32_t const node_id,
+    uint32_t const n_choices
+);
+
+static uint32_t nextCandidate(
+    DecisionTree const* const dtree,
+    DecisionTreeNode const* const node,
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    uint32_t const rule_id,
+    bool const unique,
+    uint32_t choice
+);
+
+static uint32_t nthOpenChoice(
+    DecisionTree const* const dtree,
+    DecisionTreeNode const* const node,
+    uint32_t n
+);
+
+static void uncoverTaken(
+    Coverage* const cov,
+    ArrayList const* const taken_list
+);
+
+static double weighShardPrefix(
+    ShardEstimates* const est,
+    DerivationBudget const* const budget,
+    ShardPrefix const* const prefix,
+    ArrayList const* const stack_list
+);
+
+static void writeAlternative(
+    TreeWriter* const writer,
+    GrammarGraph const* const graph,
+    uint32_t const rule_id,
+    uint32_t const choice
+);
+
+static void writeBytes(
+    TreeWriter* const writer,
+    void const* const p,
+    uint32_t const sz
+);
+
+static void writeDecimal(
+    TreeWriter* const writer,
+    uint64_t value
+);
+
+static void writeVarint(
+    TreeWriter* const writer,
+    uint64_t value
+);
 
 void addUnexploredNodes_dtree(
     DecisionTree* const dtree,
@@ -24,29 +211,222 @@ void addUnexploredNodes_dtree(
         node->n_choices         = INVALID_UINT32;
         node->parent_id         = parent_id;
         node->first_child_id    = INVALID_UINT32;
+        node->n_open            = 0;
+        node->first_word_id     = INVALID_UINT32;
+    }
+}
+
+/* Counts the candidates of a node, and lists them in pool unless it is NULL. */
+static uint32_t collectCandidates(
+    uint32_t* const pool,
+    DecisionTree const* const dtree,
+    DecisionTreeNode const* const node,
+    Coverage const* const cov,
+    RuleTerm const* const rule,
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    uint32_t const rule_id,
+    bool const unique,
+    bool const uncovered_only
+) {
+    uint32_t n = 0;
+    for (
+        uint32_t choice = nextCandidate(dtree, node, budget, reserved, rule_id, unique, 0);
+        choice < node->n_choices;
+        choice = nextCandidate(dtree, node, budget, reserved, rule_id, unique, choice + 1)
+    ) {
+        if (uncovered_only && isCovered(cov, rule, choice)) continue;
+        if (pool != NULL) pool[n] = choice;
+        n++;
+    }
+    return n;
+}
+
+/* Heaviest first, ties in discovery order, so every process sorts alike. */
+static int compareShardPrefixes(
+    void const* a,
+    void const* b
+) {
+    ShardPrefix const* const prefix_a = a;
+    ShardPrefix const* const prefix_b = b;
+
+    if (prefix_a->weight > prefix_b->weight)        return -1;
+    if (prefix_a->weight < prefix_b->weight)        return 1;
+    if (prefix_a->prefix_id < prefix_b->prefix_id)  return -1;
+    if (prefix_a->prefix_id > prefix_b->prefix_id)  return 1;
+    return 0;
+}
+
+/* acc becomes the number of ways to split every extra cost between acc and estimates, cut at n_cells. */
+static void convolveEstimates(
+    double* const acc,
+    double const* const estimates,
+    double* const tmp,
+    uint32_t const n_cells
+) {
+    for (uint32_t cell = 0; cell < n_cells; cell++) {
+        tmp[cell] = 0.0;
+        for (uint32_t i = 0; i <= cell; i++) tmp[cell] += acc[i] * estimates[cell - i];
+        if (tmp[cell] > DTREE_SHARD_MAX_WEIGHT) tmp[cell] = DTREE_SHARD_MAX_WEIGHT;
+    }
+    memcpy(acc, tmp, (size_t)n_cells * sizeof(double));
+}
+
+static uint64_t costOnAxis(
+    ShardEstimates const* const est,
+    DerivationCost const* const cost
+) {
+    return est->is_bytes ? cost->n_bytes : cost->n_decisions;
+}
+
+static uint32_t countBits(uint64_t word) {
+    word = word - ((word >> 1) & 0x5555555555555555);
+    word = (word & 0x3333333333333333) + ((word >> 2) & 0x3333333333333333);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0F;
+    return (uint32_t)((word * 0x0101010101010101) >> 56);
+}
+
+/*
+ * Copies the tree breadth-first into fresh lists, so the children of every
+ * node stay side by side, and leaves out what lies below fully explored
+ * nodes, which become leaves.
+ */
+uint32_t compact_dtree(DecisionTree* const dtree) {
+    ArrayList node_list[1]  = { NOT_AN_ALIST };
+    ArrayList open_words[1] = { NOT_AN_ALIST };
+    uint32_t n_dropped      = 0;
+
+    assert(isValid_dtree(dtree));
+
+    constructEmpty_alist(node_list, sizeof(DecisionTreeNode), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(open_words, sizeof(uint64_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    add_alist(node_list, getFirst_alist(dtree->node_list));
+    for (uint32_t new_id = 0; new_id < node_list->len; new_id++) {
+        DecisionTreeNode* const node    = get_alist(node_list, new_id);
+        uint32_t const old_child_id     = node->first_child_id;
+        uint32_t const old_word_id      = node->first_word_id;
+        uint32_t const n_choices        = node->n_choices;
+
+        if (node->state == DTREE_NODE_STATE_UNEXPLORED) continue;
+
+        if (node->state == DTREE_NODE_STATE_FULLY_EXPLORED) {
+            node->n_choices         = 0;
+            node->first_child_id    = INVALID_UINT32;
+            node->n_open            = 0;
+            node->first_word_id     = INVALID_UINT32;
+            continue;
+        }
+
+        /* node moves once add_alist grows node_list. */
+        node->first_child_id    = node_list->len;
+        node->first_word_id     = open_words->len;
+        for (uint32_t choice = 0; choice < n_choices; choice++) {
+            DecisionTreeNode child = *(DecisionTreeNode*)get_alist(dtree->node_list, old_child_id + choice);
+            child.parent_id = new_id;
+            add_alist(node_list, &child);
+        }
+        for (uint32_t word_id = 0; word_id < (n_choices + WORD_BITS - 1) / WORD_BITS; word_id++)
+            add_alist(open_words, get_alist(dtree->open_words, old_word_id + word_id));
     }
+    n_dropped = dtree->node_list->len - node_list->len;
+
+    destruct_alist(dtree->node_list);
+    destruct_alist(dtree->open_words);
+    dtree->node_list[0]     = node_list[0];
+    dtree->open_words[0]    = open_words[0];
+
+    return n_dropped;
 }
 
 void constructEmpty_dtree(DecisionTree* const dtree) {
     assert(dtree != NULL);
     constructEmpty_alist(dtree->node_list, sizeof(DecisionTreeNode), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(dtree->open_words, sizeof(uint64_t), ALIST_RECOMMENDED_INITIAL_CAP);
     addUnexploredNodes_dtree(dtree, INVALID_UINT32, 1);
 }
 
 void destruct_dtree(DecisionTree* const dtree) {
     assert(isValid_dtree(dtree));
     destruct_alist(dtree->node_list);
+    destruct_alist(dtree->open_words);
+}
+
+bool dump_dtree(
+    FILE* const fp,
+    DecisionTree const* const dtree,
+    GrammarGraph const* const graph
+) {
+    uint32_t const n_nodes          = dtree->node_list->len;
+    uint32_t* const node_rules      = mem_alloc(((size_t)n_nodes + 1) * sizeof(uint32_t));
+    TreeWriter* const writer        = mem_alloc(sizeof(TreeWriter));
+    DecisionTreeNode const* node    = NULL;
+    bool is_ok                      = 0;
+
+    assert(fp != NULL);
+    assert(isValid_dtree(dtree));
+    assert(isValid_ggraph(graph));
+
+    mapRules(node_rules, dtree, graph);
+
+    writer->fp      = fp;
+    writer->len     = 0;
+    writer->is_ok   = 1;
+    writeBytes(writer, DTREE_DUMP_MAGIC, DTREE_DUMP_MAGIC_LEN);
+    writeVarint(writer, n_nodes);
+
+    node = getFirst_alist(dtree->node_list);
+    for (uint32_t node_id = 0; node_id < n_nodes; node++, node_id++) {
+        uint64_t const n_choices = (node->state == DTREE_NODE_STATE_UNEXPLORED) ? 0 : node->n_choices;
+
+        writeVarint(writer, n_choices << 2 | node->state);
+        if (node_id > 0) writeVarint(writer, node_id - node->parent_id);
+        writeVarint(writer, (node_rules[node_id] == INVALID_UINT32) ? 0 : (uint64_t)node_rules[node_id] + 1);
+    }
+    flushWriter(writer);
+
+    is_ok = writer->is_ok;
+    free(node_rules);
+    free(writer);
+
+    return is_ok;
+}
+
+/*
+ * A draw from all the alternatives that lands on a candidate is a draw from
+ * the candidates, so a few draws usually beat listing them. Returns
+ * INVALID_UINT32 if none of them lands.
+ */
+static uint32_t drawCandidate(
+    WeightTable const* const sampler,
+    DecisionTree const* const dtree,
+    DecisionTreeNode const* const node,
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    uint32_t const rule_id,
+    bool const unique
+) {
+    REPEAT(DTREE_ENERGY_MAX_DRAWS) {
+        uint32_t const choice = sample_wtbl(sampler, rule_id);
+        if (nextCandidate(dtree, node, budget, reserved, rule_id, unique, choice) == choice) return choice;
+    }
+    return INVALID_UINT32;
 }
 
 int generateRandomDecisionSequence_dtree(
     ArrayList* const seq,
     DecisionTree* const dtree,
-    GrammarGraph* const graph,
+    Coverage* const cov,
+    EnergyTable* const etbl,
+    GrammarGraph const* const graph,
+    WeightTable const* const wtbl,
+    DerivationBudget const* const budget,
     uint32_t const min_depth,
     bool const cov_guided,
     bool const unique
 ) {
+    DerivationCost reserved     = { 0, 0 };
     ArrayList stack[1]          = { NOT_AN_ALIST };
+    ArrayList taken_list[1]     = { NOT_AN_ALIST };
     uint32_t node_id            = 0;
     uint32_t n_exps             = 0;
     uint32_t rule_id            = INVALID_UINT32;
@@ -59,7 +439,11 @@ int generateRandomDecisionSequence_dtree(
     assert(seq->len == 0);
     assert(seq->sz_elem == sizeof(uint32_t));
     assert(isValid_dtree(dtree));
+    assert(IMPLIES(cov_guided, isValid_cov(cov)));
+    assert(IMPLIES(etbl != NULL, cov_guided && isValid_etbl(etbl)));
     assert(isValid_ggraph(graph));
+    assert(wtbl == NULL || isValid_wtbl(wtbl));
+    assert(isValid_dbudget(budget));
 
     if (unique) {
         DecisionTreeNode const* const root_node = get_alist(dtree->node_list, node_id);
@@ -68,17 +452,40 @@ int generateRandomDecisionSequence_dtree(
     }
 
     constructEmpty_alist(stack, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(taken_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
     push_alist(stack, &(graph->root_rule_id));
+    reserved = *minCost_dbudget(budget, graph->root_rule_id);
     do {
+        /* The partial path stays consistent, it just never reaches a leaf. */
+        if (seq->len % DBUDGET_CLOCK_PERIOD == 0 && isPastDeadline_dbudget(budget)) {
+            uncoverTaken(cov, taken_list);
+            destruct_alist(taken_list);
+            destruct_alist(stack);
+            return DTREE_GENERATE_TIMEOUT;
+        }
+
         rule_id     = *(uint32_t*)pop_alist(stack);
         decision    = partiallyExploreNode_dtree(
             seq, &node_id,
-            dtree, graph, rule_id,
-            cov_guided, unique
+            dtree, cov, etbl, graph, rule_id,
+            wtbl, budget, &reserved, cov_guided, unique
         );
+        spend_dbudget(&reserved, budget, rule_id, decision);
         rule        = get_alist(graph->rule_list, rule_id);
         exp_id      = *(uint32_t*)get_alist(rule->alt_list, decision);
         exp         = get_alist(graph->exp_list, exp_id);
+
+        /*
+         * A taken alternative counts as covered for the rest of the
+         * derivation, or coverage guidance would keep taking an uncovered
+         * recursive alternative forever. Energy caps the weight of
+         * such an alternative instead.
+         */
+        if (cov_guided && etbl == NULL && cov->exp_counts[exp_id] == 0) {
+            cov->exp_counts[exp_id] = 1;
+            add_alist(taken_list, &exp_id);
+        }
+
         n_exps      = 1;
         while (exp->has_next) { exp++; n_exps++; }
         REPEAT(n_exps) {
@@ -89,9 +496,13 @@ int generateRandomDecisionSequence_dtree(
             exp--;
         }
     } while (stack->len > 0);
+    uncoverTaken(cov, taken_list);
+    destruct_alist(taken_list);
     destruct_alist(stack);
 
-    setLeaf_dtree(dtree, node_id);
+    /* Without uniqueness, the same leaf may be reached more than once. */
+    if (unique || ((DecisionTreeNode*)get_alist(dtree->node_list, node_id))->state == DTREE_NODE_STATE_UNEXPLORED)
+        setLeaf_dtree(dtree, node_id);
 
     if (seq->len < min_depth)
         return DTREE_GENERATE_SHALLOW_SEQ;
@@ -99,6 +510,43 @@ int generateRandomDecisionSequence_dtree(
         return DTREE_GENERATE_OK;
 }
 
+/* Creates the children of an unexplored node, and closes the ones that never fit the budget. */
+static void exploreNode(
+    DecisionTree* const dtree,
+    uint32_t const node_id,
+    GrammarGraph const* const graph,
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    uint32_t const rule_id
+) {
+    RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+    DecisionTreeNode* node      = NULL;
+    DecisionTreeNode* child     = NULL;
+    uint64_t* words             = NULL;
+
+    openChildren(dtree, node_id, rule->alt_list->len);
+    if (isUnlimited_dbudget(budget)) return;
+
+    node    = get_alist(dtree->node_list, node_id);
+    words   = get_alist(dtree->open_words, node->first_word_id);
+    for (uint32_t word_id = 0; word_id < (node->n_choices + WORD_BITS - 1) / WORD_BITS; word_id++)
+        words[word_id] = 0;
+
+    /* A node fixes its prefix and so the reserved cost, so these children never fit. */
+    node->n_open    = 0;
+    child           = get_alist(dtree->node_list, node->first_child_id);
+    for (uint32_t choice = 0; choice < node->n_choices; choice++, child++) {
+        if (fits_dbudget(budget, reserved, rule_id, choice)) {
+            words[choice / WORD_BITS] |= (uint64_t)1 << (choice % WORD_BITS);
+            node->n_open++;
+            continue;
+        }
+
+        child->state        = DTREE_NODE_STATE_FULLY_EXPLORED;
+        child->n_choices    = 0;
+    }
+}
+
 bool isAllChildrenFullyExplored_dtree(
     DecisionTree const* const dtree,
     uint32_t const parent_id
@@ -109,13 +557,7 @@ bool isAllChildrenFullyExplored_dtree(
         DecisionTreeNode const* const parent = get_alist(dtree->node_list, parent_id);
         assert(parent->state != DTREE_NODE_STATE_UNEXPLORED);
         assert(parent->n_choices > 0);
-        if (parent->state == DTREE_NODE_STATE_FULLY_EXPLORED) {
-            return 1;
-        } else {
-            DecisionTreeNode const* child = get_alist(dtree->node_list, parent->first_child_id);
-            REPEAT(parent->n_choices) if ((child++)->state != DTREE_NODE_STATE_FULLY_EXPLORED) return 0;
-            return 1;
-        }
+        return parent->state == DTREE_NODE_STATE_FULLY_EXPLORED || parent->n_open == 0;
     }
 }
 
@@ -124,22 +566,336 @@ bool isValid_dtree(DecisionTree const* const dtree) {
     if (!isValid_alist(dtree->node_list))                       return 0;
     if (dtree->node_list->len == 0)                             return 0;
     if (dtree->node_list->sz_elem != sizeof(DecisionTreeNode))  return 0;
+    if (!isValid_alist(dtree->open_words))                      return 0;
+    if (dtree->open_words->sz_elem != sizeof(uint64_t))         return 0;
 
     return 1;
 }
 
+size_t memoryUsage_dtree(DecisionTree const* const dtree) {
+    assert(isValid_dtree(dtree));
+    return MUSAGE_ALIST(dtree->node_list) + MUSAGE_ALIST(dtree->open_words);
+}
+
+static void flushWriter(TreeWriter* const writer) {
+    if (writer->len > 0 && fwrite(writer->buffer, 1, writer->len, writer->fp) != writer->len)
+        writer->is_ok = 0;
+    writer->len = 0;
+}
+
+static bool isCovered(
+    Coverage const* const cov,
+    RuleTerm const* const rule,
+    uint32_t const choice
+) {
+    return cov->exp_counts[*(uint32_t*)get_alist(rule->alt_list, choice)] > 0;
+}
+
+static uint32_t lowestBit(uint64_t const word) {
+    assert(word != 0);
+    return countBits((word & (~word + 1)) - 1);
+}
+
+/*
+ * node_rules[node_id] is the rule node_id decides, INVALID_UINT32 past the
+ * end of a derivation. Every child comes after its parent, so one pass in
+ * id order follows every path with the rules it leaves pending, which the
+ * paths share as linked cells.
+ */
+static void mapRules(
+    uint32_t* const node_rules,
+    DecisionTree const* const dtree,
+    GrammarGraph const* const graph
+) {
+    uint32_t const n_nodes          = dtree->node_list->len;
+    uint32_t* const cont_ids        = mem_alloc(((size_t)n_nodes + 1) * sizeof(uint32_t));
+    ArrayList cell_list[1]          = { NOT_AN_ALIST };
+    DecisionTreeNode const* node    = NULL;
+
+    constructEmpty_alist(cell_list, sizeof(RuleCell), ALIST_RECOMMENDED_INITIAL_CAP);
+    for (uint32_t node_id = 0; node_id < n_nodes; node_id++)
+        node_rules[node_id] = INVALID_UINT32;
+    node_rules[0]   = graph->root_rule_id;
+    cont_ids[0]     = INVALID_UINT32;
+
+    node = getFirst_alist(dtree->node_list);
+    for (uint32_t node_id = 0; node_id < n_nodes; node++, node_id++) {
+        RuleTerm const* rule = NULL;
+        if (node->state == DTREE_NODE_STATE_UNEXPLORED || node->n_choices == 0) continue;
+
+        assert(node_rules[node_id] < graph->rule_list->len);
+        rule = get_alist(graph->rule_list, node_rules[node_id]);
+        assert(node->n_choices == rule->alt_list->len);
+        for (uint32_t choice = 0; choice < node->n_choices; choice++) {
+            uint32_t const child_id     = node->first_child_id + choice;
+            uint32_t exp_id             = *(uint32_t*)get_alist(rule->alt_list, choice);
+            uint32_t cont_id            = cont_ids[node_id];
+            ExpansionTerm const* exp    = get_alist(graph->exp_list, exp_id);
+            uint32_t n_exps             = 1;
+
+            assert(child_id > node_id);
+            assert(child_id < n_nodes);
+
+            while ((exp++)->has_next) n_exps++;
+            REPEAT(n_exps) {
+                exp--;
+                if (exp->is_terminal) continue;
+
+                add_alist(cell_list, &(RuleCell){ exp->rt_id, cont_id });
+                cont_id = cell_list->len - 1;
+            }
+
+            if (cont_id == INVALID_UINT32) {
+                node_rules[child_id]    = INVALID_UINT32;
+                cont_ids[child_id]      = INVALID_UINT32;
+            } else {
+                RuleCell const* const cell = get_alist(cell_list, cont_id);
+                node_rules[child_id]    = cell->rule_id;
+                cont_ids[child_id]      = cell->next_id;
+            }
+        }
+    }
+
+    destruct_alist(cell_list);
+    free(cont_ids);
+}
+
+/*
+ * A rule is stable if it is kept and every rule its alternatives refer to is
+ * stable too, so it derives the same sentences in both graphs of diff.
+ */
+static void markStableRules(
+    bool* const is_stable,
+    GrammarDiff const* const diff
+) {
+    GrammarGraph const* const graph = diff->old_graph;
+    bool is_changed                 = 1;
+
+    for (uint32_t rule_id = 0; rule_id < graph->rule_list->len; rule_id++)
+        is_stable[rule_id] = isKeptRule_gdiff(diff, rule_id);
+
+    while (is_changed) {
+        is_changed = 0;
+        for (uint32_t rule_id = 0; rule_id < graph->rule_list->len; rule_id++) {
+            RuleTerm const* const rule = get_alist(graph->rule_list, rule_id);
+
+            for (uint32_t choice = 0; is_stable[rule_id] && choice < rule->alt_list->len; choice++) {
+                uint32_t const exp_id       = *(uint32_t*)get_alist(rule->alt_list, choice);
+                ExpansionTerm const* exp    = get_alist(graph->exp_list, exp_id);
+
+                do {
+                    if (exp->is_terminal || is_stable[exp->rt_id]) continue;
+
+                    is_stable[rule_id]  = 0;
+                    is_changed          = 1;
+                    break;
+                } while ((exp++)->has_next);
+            }
+        }
+    }
+}
+
+uint32_t migrate_dtree(
+    DecisionTree* const dtree,
+    GrammarDiff const* const diff,
+    DecisionTree const* const old_dtree
+) {
+    GrammarGraph const* const old_graph = diff->old_graph;
+    GrammarGraph const* const new_graph = diff->new_graph;
+    ArrayList stack[1]                  = { NOT_AN_ALIST };
+    ArrayList cell_list[1]              = { NOT_AN_ALIST };
+    bool* is_stable                     = NULL;
+    uint32_t n_carried                  = 0;
+
+    assert(isValid_dtree(dtree));
+    assert(dtree->node_list->len == 1);
+    assert(isValid_gdiff(diff));
+    assert(isValid_dtree(old_dtree));
+
+    if (ruleTarget_gdiff(diff, old_graph->root_rule_id) != new_graph->root_rule_id) return 0;
+
+    is_stable = mem_alloc((size_t)old_graph->rule_list->len * sizeof(bool));
+    markStableRules(is_stable, diff);
+    constructEmpty_alist(stack, sizeof(Migration), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(cell_list, sizeof(RuleCell), ALIST_RECOMMENDED_INITIAL_CAP);
+    add_alist(stack, &(Migration){ 0, 0, old_graph->root_rule_id, INVALID_UINT32 });
+    while (stack->len > 0) {
+        Migration const m                   = *(Migration*)pop_alist(stack);
+        DecisionTreeNode const* const old   = get_alist(old_dtree->node_list, m.old_id);
+        RuleTerm const* rule                = NULL;
+        uint32_t first_child_id             = INVALID_UINT32;
+
+        if (old->state == DTREE_NODE_STATE_UNEXPLORED) continue;
+
+        /*
+         * Under the unlimited budget of a reload, a closed node that still
+         * has rules pending lost its subtree to compact_dtree. It stays
+         * closed if those rules derive the same sentences, and opens again
+         * otherwise.
+         */
+        if (old->n_choices == 0) {
+            bool is_closed = (m.rule_id == INVALID_UINT32 || is_stable[m.rule_id]);
+            for (uint32_t cont_id = m.cont_id; is_closed && cont_id != INVALID_UINT32;) {
+                RuleCell const* const cell = get_alist(cell_list, cont_id);
+                is_closed   = is_stable[cell->rule_id];
+                cont_id     = cell->next_id;
+            }
+            if (is_closed) {
+                DecisionTreeNode* const leaf = get_alist(dtree->node_list, m.new_id);
+                leaf->state     = DTREE_NODE_STATE_FULLY_EXPLORED;
+                leaf->n_choices = 0;
+                n_carried++;
+            }
+            continue;
+        }
+
+        rule = get_alist(new_graph->rule_list, ruleTarget_gdiff(diff, m.rule_id));
+        openChildren(dtree, m.new_id, rule->alt_list->len);
+        first_child_id = ((DecisionTreeNode*)get_alist(dtree->node_list, m.new_id))->first_child_id;
+        n_carried++;
+
+        rule = get_alist(old_graph->rule_list, m.rule_id);
+        for (uint32_t choice = 0; choice < old->n_choices; choice++) {
+            uint32_t const target       = altTarget_gdiff(diff, m.rule_id, choice);
+            uint32_t const exp_id       = *(uint32_t*)get_alist(rule->alt_list, choice);
+            ExpansionTerm const* exp    = get_alist(old_graph->exp_list, exp_id);
+            uint32_t cont_id            = m.cont_id;
+            uint32_t n_exps             = 1;
+            Migration child             = { old->first_child_id + choice, 0, INVALID_UINT32, INVALID_UINT32 };
+
+            if (target == INVALID_UINT32) continue;
+            child.new_id = first_child_id + target;
+
+            while ((exp++)->has_next) n_exps++;
+            REPEAT(n_exps) {
+                exp--;
+                if (exp->is_terminal) continue;
+
+                add_alist(cell_list, &(RuleCell){ exp->rt_id, cont_id });
+                cont_id = cell_list->len - 1;
+            }
+            if (cont_id != INVALID_UINT32) {
+                RuleCell const* const cell = get_alist(cell_list, cont_id);
+                child.rule_id = cell->rule_id;
+                child.cont_id = cell->next_id;
+            }
+            add_alist(stack, &child);
+        }
+    }
+    destruct_alist(cell_list);
+    destruct_alist(stack);
+    free(is_stable);
+
+    /* Children come after their parents, so backwards every node is final before its parent reads it. */
+    for (uint32_t node_id = dtree->node_list->len - 1; node_id > 0; node_id--) {
+        DecisionTreeNode const* const node  = get_alist(dtree->node_list, node_id);
+        DecisionTreeNode* parent            = NULL;
+        uint64_t* words                     = NULL;
+        uint32_t choice                     = 0;
+
+        if (node->state != DTREE_NODE_STATE_FULLY_EXPLORED) continue;
+
+        parent  = get_alist(dtree->node_list, node->parent_id);
+        words   = get_alist(dtree->open_words, parent->first_word_id);
+        choice  = node_id - parent->first_child_id;
+        words[choice / WORD_BITS] &= ~((uint64_t)1 << (choice % WORD_BITS));
+        if (--parent->n_open == 0) parent->state = DTREE_NODE_STATE_FULLY_EXPLORED;
+    }
+
+    return n_carried;
+}
+
+/* The first candidate from choice on, or n_choices if there is none. */
+static uint32_t nextCandidate(
+    DecisionTree const* const dtree,
+    DecisionTreeNode const* const node,
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    uint32_t const rule_id,
+    bool const unique,
+    uint32_t choice
+) {
+    if (choice >= node->n_choices) return node->n_choices;
+
+    if (unique) {
+        uint64_t const* const words = get_alist(dtree->open_words, node->first_word_id);
+        uint32_t const n_words      = (node->n_choices + WORD_BITS - 1) / WORD_BITS;
+        uint32_t word_id            = choice / WORD_BITS;
+        uint64_t word               = words[word_id] & (~(uint64_t)0 << (choice % WORD_BITS));
+
+        while (word == 0) {
+            if (++word_id == n_words) return node->n_choices;
+            word = words[word_id];
+        }
+        return word_id * WORD_BITS + lowestBit(word);
+    } else {
+        while (choice < node->n_choices && !fits_dbudget(budget, reserved, rule_id, choice)) choice++;
+        return choice;
+    }
+}
+
+/* The n-th open child of node, counting from zero. */
+static uint32_t nthOpenChoice(
+    DecisionTree const* const dtree,
+    DecisionTreeNode const* const node,
+    uint32_t n
+) {
+    uint64_t const* const words = get_alist(dtree->open_words, node->first_word_id);
+    uint32_t word_id            = 0;
+    uint64_t word               = 0;
+
+    assert(n < node->n_open);
+    while (n >= countBits(words[word_id])) n -= countBits(words[word_id++]);
+    word = words[word_id];
+    REPEAT(n) word &= word - 1;
+    return word_id * WORD_BITS + lowestBit(word);
+}
+
+/* Turns an unexplored node into a partially explored one with n_choices open unexplored children. */
+static void openChildren(
+    DecisionTree* const dtree,
+    uint32_t const node_id,
+    uint32_t const n_choices
+) {
+    DecisionTreeNode* const node    = get_alist(dtree->node_list, node_id);
+    uint32_t const first_word_id    = dtree->open_words->len;
+    uint64_t* words                 = NULL;
+
+    assert(node->state == DTREE_NODE_STATE_UNEXPLORED);
+    assert(n_choices > 0);
+    node->state             = DTREE_NODE_STATE_PARTIALLY_EXPLORED;
+    node->n_choices         = n_choices;
+    node->first_child_id    = dtree->node_list->len;
+    node->n_open            = n_choices;
+    node->first_word_id     = first_word_id;
+    addUnexploredNodes_dtree(dtree, node_id, n_choices);
+    REPEAT((n_choices + WORD_BITS - 1) / WORD_BITS) addIndeterminate_alist(dtree->open_words);
+    words                   = get_alist(dtree->open_words, first_word_id);
+
+    for (uint32_t choice = 0; choice < n_choices; choice += WORD_BITS)
+        words[choice / WORD_BITS] = (n_choices - choice >= WORD_BITS)
+            ? ~(uint64_t)0
+            : ((uint64_t)1 << (n_choices - choice)) - 1;
+}
+
+/*
+ * Candidates are the open children with uniqueness, and the children within
+ * the budget without. The open children are counted and indexed by the
+ * bitset of the node, so choosing one never looks at the closed ones.
+ */
 uint32_t partiallyExploreNode_dtree(
     ArrayList* const seq, uint32_t* const p_node_id,
-    DecisionTree* const dtree, GrammarGraph const* const graph, uint32_t const rule_id,
+    DecisionTree* const dtree, Coverage const* const cov, EnergyTable* const etbl,
+    GrammarGraph const* const graph, uint32_t const rule_id,
+    WeightTable const* const wtbl, DerivationBudget const* const budget, DerivationCost const* const reserved,
     bool const cov_guided, bool const unique
 ) {
-    BitMatrix cov_mtx[1]        = { NOT_A_BMATRIX };
-    ArrayList decision_list[1]  = { NOT_AN_ALIST };
+    RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+    WeightTable const* sampler  = wtbl;
     DecisionTreeNode* node      = NULL;
-    DecisionTreeNode* child     = NULL;
-    RuleTerm const* rule        = NULL;
-    uint32_t choice             = 0;
-    bool all_covered_once       = 1;
+    uint32_t n_candidates       = 0;
+    uint32_t n_uncovered        = 0;
+    uint32_t n_pool             = 0;
     uint32_t decision           = 0;
 
     assert(isValid_alist(seq));
@@ -147,153 +903,184 @@ uint32_t partiallyExploreNode_dtree(
     assert(p_node_id != NULL);
     assert(isValid_dtree(dtree));
     assert(*p_node_id < dtree->node_list->len);
+    assert(IMPLIES(cov_guided, isValid_cov(cov)));
+    assert(IMPLIES(etbl != NULL, cov_guided && isValid_etbl(etbl)));
     assert(isValid_ggraph(graph));
     assert(rule_id < graph->rule_list->len);
+    assert(wtbl == NULL || isValid_wtbl(wtbl));
+    assert(isValid_dbudget(budget));
+    assert(reserved != NULL);
 
-    rule = get_alist(graph->rule_list, rule_id);
     node = get_alist(dtree->node_list, *p_node_id);
-    assert(node->state != DTREE_NODE_STATE_FULLY_EXPLORED);
+    assert(IMPLIES(unique, node->state != DTREE_NODE_STATE_FULLY_EXPLORED));
     if (node->state == DTREE_NODE_STATE_UNEXPLORED) {
-        node->state             = DTREE_NODE_STATE_PARTIALLY_EXPLORED;
-        node->n_choices         = rule->alt_list->len;
-        node->first_child_id    = dtree->node_list->len;
-        assert(node->n_choices > 0);
-        addUnexploredNodes_dtree(dtree, *p_node_id, node->n_choices);
+        exploreNode(dtree, *p_node_id, graph, budget, reserved, rule_id);
+        node = get_alist(dtree->node_list, *p_node_id);
     }
 
-    if (cov_guided) construct_bmtx(cov_mtx, 1, node->n_choices);
-    constructEmpty_alist(decision_list, sizeof(uint32_t), node->n_choices);
+    if (unique)
+        n_candidates = node->n_open;
+    else if (isUnlimited_dbudget(budget))
+        n_candidates = node->n_choices;
+    else
+        n_candidates = collectCandidates(NULL, dtree, node, cov, rule, budget, reserved, rule_id, unique, 0);
+    assert(n_candidates > 0);
 
-    if (cov_guided) {
-        fillCovMtx_ggraph(cov_mtx, graph, rule_id);
-        for (choice = 0; choice < node->n_choices && get_bmtx(cov_mtx, 0, choice); choice++) {}
-        all_covered_once = (choice >= node->n_choices);
+    /* Coverage only narrows the candidates, so it never leaves none. */
+    if (etbl != NULL) {
+        refresh_etbl(etbl, cov, graph, rule_id);
+        sampler = etbl->wtbl;
+    } else if (cov_guided) {
+        n_uncovered = collectCandidates(NULL, dtree, node, cov, rule, budget, reserved, rule_id, unique, 1);
     }
+    n_pool = (n_uncovered > 0) ? n_uncovered : n_candidates;
 
-    child = get_alist(dtree->node_list, node->first_child_id);
-    for (choice = 0; choice < node->n_choices; choice++, child++) {
-        if (unique && child->state == DTREE_NODE_STATE_FULLY_EXPLORED)          continue;
-        if (cov_guided && !all_covered_once && get_bmtx(cov_mtx, 0, choice))    continue;
+    if (sampler != NULL && n_pool == node->n_choices) {
+        decision = sample_wtbl(sampler, rule_id);
+    } else if (n_uncovered == 0 && unique && sampler == NULL) {
+        decision = nthOpenChoice(dtree, node, (uint32_t)rand() % n_pool);
+    } else if (n_pool == node->n_choices && sampler == NULL) {
+        decision = (uint32_t)rand() % n_pool;
+    } else {
+        decision = (etbl == NULL) ? INVALID_UINT32 : drawCandidate(sampler, dtree, node, budget, reserved, rule_id, unique);
+        if (decision == INVALID_UINT32) {
+            uint32_t* const pool = mem_alloc((size_t)n_pool * sizeof(uint32_t));
 
-        add_alist(decision_list, &choice);
+            collectCandidates(pool, dtree, node, cov, rule, budget, reserved, rule_id, unique, n_uncovered > 0);
+            if (sampler == NULL)
+                decision = pool[(uint32_t)rand() % n_pool];
+            else
+                decision = sampleSubset_wtbl(sampler, rule_id, pool, n_pool);
+            free(pool);
+        }
     }
+    assert(decision < node->n_choices);
 
-    if (cov_guided) destruct_bmtx(cov_mtx);
-
-    assert(decision_list->len > 0);
-    decision    = *(uint32_t*)get_alist(decision_list, (uint32_t)rand() % decision_list->len);
     *p_node_id  = node->first_child_id + decision;
     add_alist(seq, &decision);
 
-    destruct_alist(decision_list);
-
     return decision;
 }
 
-struct IdPair {
-    uint32_t node_id;
-    uint32_t rule_id;
-};
 void printDot_dtree(
     FILE* const output,
     DecisionTree const* const dtree,
-    GrammarGraph const* const graph
+    GrammarGraph const* const graph,
+    uint32_t const max_depth,
+    bool const frontier_only
 ) {
+    uint32_t const n_nodes          = dtree->node_list->len;
+    uint32_t* const node_rules      = mem_alloc(((size_t)n_nodes + 1) * sizeof(uint32_t));
+    uint32_t* const depths          = mem_alloc(((size_t)n_nodes + 1) * sizeof(uint32_t));
+    uint32_t* const n_subtree       = mem_alloc(((size_t)n_nodes + 1) * sizeof(uint32_t));
+    uint32_t* const n_explored      = mem_alloc(((size_t)n_nodes + 1) * sizeof(uint32_t));
+    bool* const is_shown            = mem_calloc((size_t)n_nodes + 1, sizeof(bool));
+    TreeWriter* const writer        = mem_alloc(sizeof(TreeWriter));
     DecisionTreeNode const* node    = NULL;
-    RuleTerm const* rule            = NULL;
-    RuleTerm const* child_rule      = NULL;
-    ExpansionTerm const* exp        = NULL;
-    struct IdPair id_pair[2]        = { { INVALID_UINT32, INVALID_UINT32 }, { INVALID_UINT32, INVALID_UINT32 } };
-    struct IdPair* id_pair_A        = id_pair;
-    struct IdPair* id_pair_B        = id_pair + 1;
-    ArrayList stack[1]              = { NOT_AN_ALIST };
-    Item term                       = NOT_AN_ITEM;
-    uint32_t child_id               = INVALID_UINT32;
-    uint32_t exp_id                 = INVALID_UINT32;
-    uint32_t n_exps                 = 0;
 
     assert(output != NULL);
     assert(isValid_dtree(dtree));
     assert(isValid_ggraph(graph));
 
-    fprintf(output,
+    mapRules(node_rules, dtree, graph);
+
+    node = getFirst_alist(dtree->node_list);
+    for (uint32_t node_id = 0; node_id < n_nodes; node++, node_id++) {
+        n_subtree[node_id]  = 1;
+        n_explored[node_id] = (node->state == DTREE_NODE_STATE_FULLY_EXPLORED);
+    }
+    for (uint32_t node_id = n_nodes - 1; node_id > 0; node_id--) {
+        node = get_alist(dtree->node_list, node_id);
+        n_subtree[node->parent_id]  += n_subtree[node_id];
+        n_explored[node->parent_id] += n_explored[node_id];
+    }
+
+    writer->fp      = output;
+    writer->len     = 0;
+    writer->is_ok   = 1;
+    WRITE_LITERAL(
+        writer,
         "digraph GrammarGraph {\n"
         "    edge [fontname=\"PT Mono\"];\n"
         "    node [fontname=\"PT Mono\",label=\"\",shape=\"circle\"];\n"
         "    root [shape=\"none\",width=0,height=0,label=\"\"];\n"
         "\n"
+        "    root->n0;\n"
     );
-    node = getFirst_alist(dtree->node_list);
-    for (uint32_t node_id = 0; node_id < dtree->node_list->len; node++, node_id++) {
+
+    is_shown[0] = 1;
+    depths[0]   = 0;
+    node        = getFirst_alist(dtree->node_list);
+    for (uint32_t node_id = 0; node_id < n_nodes; node++, node_id++) {
+        bool const has_children = node->state != DTREE_NODE_STATE_UNEXPLORED && node->n_choices > 0;
+        bool const is_collapsed = has_children && (
+            (max_depth > 0 && depths[node_id] >= max_depth) ||
+            (frontier_only && node->state == DTREE_NODE_STATE_FULLY_EXPLORED)
+        );
+        if (!is_shown[node_id]) continue;
+
+        WRITE_LITERAL(writer, "    n");
+        writeDecimal(writer, node_id);
+        if (is_collapsed) {
+            WRITE_LITERAL(writer, " [shape=\"box\",label=\"");
+            writeDecimal(writer, n_subtree[node_id]);
+            WRITE_LITERAL(writer, "\\n");
+            writeDecimal(writer, 100 * (uint64_t)n_explored[node_id] / n_subtree[node_id]);
+            if (node->state == DTREE_NODE_STATE_FULLY_EXPLORED)
+                WRITE_LITERAL(writer, "%\",peripheries=2];\n");
+            else
+                WRITE_LITERAL(writer, "%\"];\n");
+            continue;
+        }
         switch (node->state) {
             case DTREE_NODE_STATE_PARTIALLY_EXPLORED:
-                fprintf(output, "    n%"PRIu32";\n", node_id);
+                WRITE_LITERAL(writer, ";\n");
                 break;
             case DTREE_NODE_STATE_FULLY_EXPLORED:
-                fprintf(output, "    n%"PRIu32" [peripheries=2];\n", node_id);
+                WRITE_LITERAL(writer, " [peripheries=2];\n");
                 break;
             case DTREE_NODE_STATE_UNEXPLORED:
             default:
-                fprintf(output, "    n%"PRIu32" [label=\"??\",shape=\"none\",height=0];\n", node_id);
+                WRITE_LITERAL(writer, " [label=\"??\",shape=\"none\",height=0];\n");
         }
-    }
-
-    fprintf(output, "    root->n0;\n");
-    constructEmpty_alist(stack, sizeof(struct IdPair), ALIST_RECOMMENDED_INITIAL_CAP);
-    *id_pair_A = (struct IdPair){ 0, graph->root_rule_id };
-    push_alist(stack, id_pair_A);
-    do {
-        *id_pair_A = *(struct IdPair*)pop_alist(stack);
-
-        node = get_alist(dtree->node_list, id_pair->node_id);
-        if (node->n_choices == 0 || node->state == DTREE_NODE_STATE_UNEXPLORED) continue;
-        rule = get_alist(graph->rule_list, id_pair->rule_id);
+        if (!has_children) continue;
 
         for (uint32_t choice = 0; choice < node->n_choices; choice++) {
-            child_id    = node->first_child_id + choice;
-            exp_id      = *(uint32_t*)get_alist(rule->alt_list, choice);
-            exp         = get_alist(graph->exp_list, exp_id);
-            n_exps      = 0;
-
-            fprintf(output, "    n%"PRIu32"->n%"PRIu32" [label=\"", id_pair_A->node_id, child_id);
-
-            do {
-                if (exp->is_terminal) {
-                    term = get_chunk(graph->terminals, exp->rt_id);
-                    fprintf(
-                        output, BNF_STR_TERMINAL_OPEN"%.*s"BNF_STR_TERMINAL_CLOSE,
-                        (int)term.sz, (char*)term.p
-                    );
-                } else {
-                    *id_pair_B  = (struct IdPair){ child_id, exp->rt_id };
-                    child_rule  = get_alist(graph->rule_list, exp->rt_id);
-                    term        = get_chunk(graph->rule_names, child_rule->name_id);
-                    fprintf(output, "%.*s", (int)term.sz, (char*)term.p);
-                }
-                n_exps++;
-            } while ((exp++)->has_next);
-
-            REPEAT(n_exps) {
-                exp--;
+            uint32_t const child_id = node->first_child_id + choice;
 
-                if (exp->is_terminal) continue;
+            is_shown[child_id]  = 1;
+            depths[child_id]    = depths[node_id] + 1;
 
-                *id_pair_B  = (struct IdPair){ child_id, exp->rt_id };
-                push_alist(stack, id_pair_B);
-            }
-            fprintf(output, "\"];\n");
+            WRITE_LITERAL(writer, "    n");
+            writeDecimal(writer, node_id);
+            WRITE_LITERAL(writer, "->n");
+            writeDecimal(writer, child_id);
+            WRITE_LITERAL(writer, " [label=\"");
+            writeAlternative(writer, graph, node_rules[node_id], choice);
+            WRITE_LITERAL(writer, "\"];\n");
         }
-    } while (stack->len > 0);
-    destruct_alist(stack);
+    }
+
+    WRITE_LITERAL(writer, "}\n");
+    flushWriter(writer);
 
-    fprintf(output, "}\n");
+    free(node_rules);
+    free(depths);
+    free(n_subtree);
+    free(n_explored);
+    free(is_shown);
+    free(writer);
 }
 
 void propagateUpState_dtree(
     DecisionTree* const dtree,
     uint32_t const node_id
 ) {
-    DecisionTreeNode* node = NULL;
+    DecisionTreeNode* node      = NULL;
+    DecisionTreeNode* parent    = NULL;
+    uint64_t* words             = NULL;
+    uint32_t child_id           = node_id;
+    uint32_t choice             = 0;
 
     assert(isValid_dtree(dtree));
     assert(node_id < dtree->node_list->len);
@@ -301,12 +1088,239 @@ void propagateUpState_dtree(
     node = get_alist(dtree->node_list, node_id);
     if (node->state != DTREE_NODE_STATE_FULLY_EXPLORED) return;
     while (node->parent_id < dtree->node_list->len) {
-        if (!isAllChildrenFullyExplored_dtree(dtree, node->parent_id)) return;
-        node        = get_alist(dtree->node_list, node->parent_id);
-        node->state = DTREE_NODE_STATE_FULLY_EXPLORED;
+        parent  = get_alist(dtree->node_list, node->parent_id);
+        words   = get_alist(dtree->open_words, parent->first_word_id);
+        choice  = child_id - parent->first_child_id;
+        assert(parent->n_open > 0);
+        assert(words[choice / WORD_BITS] & ((uint64_t)1 << (choice % WORD_BITS)));
+
+        words[choice / WORD_BITS] &= ~((uint64_t)1 << (choice % WORD_BITS));
+        if (--parent->n_open > 0) return;
+
+        parent->state   = DTREE_NODE_STATE_FULLY_EXPLORED;
+        child_id        = node->parent_id;
+        node            = parent;
     }
 }
 
+/*
+ * Expands the decision prefixes level by level until there are about
+ * DTREE_SHARD_PREFIXES_PER_SHARD per shard, estimates the sentences under
+ * every prefix that fit what is left of the budget, and deals the prefixes
+ * heaviest first to the lightest shard. The prefixes of the other shards
+ * become fully explored. Everything depends on the grammar and the budget
+ * only, so N processes agree on a disjoint cover without talking to each
+ * other.
+ */
+void restrictToShard_dtree(
+    DecisionTree* const dtree,
+    GrammarGraph const* const graph,
+    DerivationBudget const* const budget,
+    uint32_t const shard_id,
+    uint32_t const n_shards
+) {
+    uint32_t const n_rules          = graph->rule_list->len;
+    uint32_t const target_len       = n_shards * DTREE_SHARD_PREFIXES_PER_SHARD;
+    DerivationCost const* root_cost = NULL;
+    ShardEstimates est[1];
+    double* next_counts             = NULL;
+    double* loads                   = mem_calloc((size_t)n_shards + 1, sizeof(double));
+    ArrayList prefix_list[1]        = { NOT_AN_ALIST };
+    ArrayList next_prefix_list[1]   = { NOT_AN_ALIST };
+    ArrayList stack_list[1]         = { NOT_AN_ALIST };
+    ArrayList next_stack_list[1]    = { NOT_AN_ALIST };
+    ArrayList swap[1]               = { NOT_AN_ALIST };
+    ShardPrefix prefix;
+    double own_load                 = 0.0;
+    double total_load               = 0.0;
+
+    assert(isValid_dtree(dtree));
+    assert(dtree->node_list->len == 1);
+    assert(isValid_ggraph(graph));
+    assert(isValid_dbudget(budget));
+    assert(shard_id < n_shards);
+
+    /* The budget left past the cheapest sentence, split into at most DTREE_SHARD_BUDGET_CELLS cells. */
+    root_cost       = minCost_dbudget(budget, graph->root_rule_id);
+    est->is_bytes   = budget->max_bytes - root_cost->n_bytes <= budget->max_decisions - root_cost->n_decisions;
+    est->unit       = DBUDGET_UNLIMITED;
+    est->n_cells    = 1;
+    if (!isUnlimited_dbudget(budget)) {
+        uint64_t const max_cost = est->is_bytes ? budget->max_bytes : budget->max_decisions;
+        uint64_t const slack    = (max_cost > costOnAxis(est, root_cost)) ? max_cost - costOnAxis(est, root_cost) : 0;
+
+        est->unit       = (slack + DTREE_SHARD_BUDGET_CELLS - 2) / (DTREE_SHARD_BUDGET_CELLS - 1);
+        if (est->unit == 0) est->unit = 1;
+        est->n_cells    = (uint32_t)(slack / est->unit) + 1;
+    }
+    est->counts = mem_calloc(((size_t)n_rules + 1) * est->n_cells, sizeof(double));
+    est->acc    = mem_calloc(est->n_cells, sizeof(double));
+    est->tmp    = mem_calloc(est->n_cells, sizeof(double));
+    next_counts = mem_calloc(((size_t)n_rules + 1) * est->n_cells, sizeof(double));
+
+    /* Only the derivations at most DTREE_SHARD_ESTIMATE_DEPTH levels deep, and within the budget, count. */
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) est->counts[(size_t)rule_id * est->n_cells] = 1.0;
+    REPEAT(DTREE_SHARD_ESTIMATE_DEPTH) {
+        double* tmp = NULL;
+        for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+            RuleTerm const* const rule              = get_alist(graph->rule_list, rule_id);
+            DerivationCost const* const min_cost    = minCost_dbudget(budget, rule_id);
+            double* const next                      = next_counts + (size_t)rule_id * est->n_cells;
+
+            memset(next, 0, (size_t)est->n_cells * sizeof(double));
+            for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+                uint32_t exp_id             = *(uint32_t*)get_alist(rule->alt_list, alt_id);
+                ExpansionTerm const* exp    = NULL;
+                DerivationCost alt_cost     = *min_cost;
+                uint64_t extra              = 0;
+
+                /* Spending the alternative on the cheapest completion of the rule leaves that of the alternative. */
+                spend_dbudget(&alt_cost, budget, rule_id, alt_id);
+                if (alt_cost.n_decisions == DBUDGET_UNLIMITED) continue;
+                if (costOnAxis(est, &alt_cost) > costOnAxis(est, min_cost))
+                    extra = (costOnAxis(est, &alt_cost) - costOnAxis(est, min_cost)) / est->unit;
+                if (extra >= est->n_cells) continue;
+
+                memset(est->acc, 0, (size_t)est->n_cells * sizeof(double));
+                est->acc[extra] = 1.0;
+                do {
+                    exp = get_alist(graph->exp_list, exp_id++);
+                    if (!exp->is_terminal)
+                        convolveEstimates(est->acc, est->counts + (size_t)exp->rt_id * est->n_cells, est->tmp, est->n_cells);
+                } while (exp->has_next);
+                for (uint32_t cell = 0; cell < est->n_cells; cell++) {
+                    next[cell] += est->acc[cell];
+                    if (next[cell] > DTREE_SHARD_MAX_WEIGHT) next[cell] = DTREE_SHARD_MAX_WEIGHT;
+                }
+            }
+        }
+        tmp         = est->counts;
+        est->counts = next_counts;
+        next_counts = tmp;
+    }
+
+    constructEmpty_alist(prefix_list, sizeof(ShardPrefix), target_len + 1);
+    constructEmpty_alist(next_prefix_list, sizeof(ShardPrefix), target_len + 1);
+    constructEmpty_alist(stack_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(next_stack_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+
+    prefix.node_id      = 0;
+    prefix.stack_offset = 0;
+    prefix.stack_len    = 1;
+    prefix.prefix_id    = 0;
+    prefix.reserved     = *root_cost;
+    add_alist(stack_list, &(graph->root_rule_id));
+    prefix.weight       = weighShardPrefix(est, budget, &prefix, stack_list);
+    add_alist(prefix_list, &prefix);
+
+    for (uint32_t level = 0; level < DTREE_SHARD_MAX_LEVELS && prefix_list->len < target_len; level++) {
+        bool is_expanded = 0;
+
+        flush_alist(next_prefix_list);
+        flush_alist(next_stack_list);
+        for (uint32_t prefix_id = 0; prefix_id < prefix_list->len; prefix_id++) {
+            ShardPrefix const parent    = *(ShardPrefix*)get_alist(prefix_list, prefix_id);
+            uint32_t rule_id            = INVALID_UINT32;
+            RuleTerm const* rule        = NULL;
+            DecisionTreeNode const* node = NULL;
+
+            /* A complete sentence cannot be split any further. */
+            if (parent.stack_len == 0) {
+                prefix              = parent;
+                prefix.prefix_id    = next_prefix_list->len;
+                add_alist(next_prefix_list, &prefix);
+                continue;
+            }
+
+            is_expanded = 1;
+            rule_id     = *(uint32_t*)get_alist(stack_list, parent.stack_offset + parent.stack_len - 1);
+            rule        = get_alist(graph->rule_list, rule_id);
+            exploreNode(dtree, parent.node_id, graph, budget, &(parent.reserved), rule_id);
+            node        = get_alist(dtree->node_list, parent.node_id);
+
+            for (uint32_t choice = 0; choice < node->n_choices; choice++) {
+                DecisionTreeNode const* const child = get_alist(dtree->node_list, node->first_child_id + choice);
+                uint32_t exp_id                     = *(uint32_t*)get_alist(rule->alt_list, choice);
+                ExpansionTerm const* exp            = get_alist(graph->exp_list, exp_id);
+                uint32_t n_exps                     = 1;
+
+                if (child->state == DTREE_NODE_STATE_FULLY_EXPLORED) continue;
+
+                prefix.node_id      = node->first_child_id + choice;
+                prefix.stack_offset = next_stack_list->len;
+                prefix.stack_len    = parent.stack_len - 1;
+                prefix.prefix_id    = next_prefix_list->len;
+                prefix.reserved     = parent.reserved;
+                spend_dbudget(&(prefix.reserved), budget, rule_id, choice);
+
+                for (uint32_t i = 0; i < parent.stack_len - 1; i++)
+                    add_alist(next_stack_list, get_alist(stack_list, parent.stack_offset + i));
+                while (exp->has_next) { exp++; n_exps++; }
+                REPEAT(n_exps) {
+                    if (!exp->is_terminal) {
+                        uint32_t const child_rule_id = exp->rt_id;
+                        add_alist(next_stack_list, &child_rule_id);
+                        prefix.stack_len++;
+                    }
+                    exp--;
+                }
+                prefix.weight = weighShardPrefix(est, budget, &prefix, next_stack_list);
+                add_alist(next_prefix_list, &prefix);
+            }
+        }
+        if (!is_expanded) break;
+
+        swap[0]             = prefix_list[0];
+        prefix_list[0]      = next_prefix_list[0];
+        next_prefix_list[0] = swap[0];
+        swap[0]             = stack_list[0];
+        stack_list[0]       = next_stack_list[0];
+        next_stack_list[0]  = swap[0];
+    }
+
+    qsort(getFirst_alist(prefix_list), prefix_list->len, sizeof(ShardPrefix), compareShardPrefixes);
+    for (uint32_t prefix_id = 0; prefix_id < prefix_list->len; prefix_id++) {
+        ShardPrefix const* const p  = get_alist(prefix_list, prefix_id);
+        uint32_t lightest_id        = 0;
+
+        for (uint32_t i = 1; i < n_shards; i++)
+            if (loads[i] < loads[lightest_id]) lightest_id = i;
+        loads[lightest_id]  += p->weight;
+        total_load          += p->weight;
+
+        if (lightest_id == shard_id) {
+            own_load += p->weight;
+        } else {
+            DecisionTreeNode* const node = get_alist(dtree->node_list, p->node_id);
+            node->state     = DTREE_NODE_STATE_FULLY_EXPLORED;
+            node->n_choices = 0;
+            propagateUpState_dtree(dtree, p->node_id);
+        }
+    }
+
+    fprintf_verbose(stderr, "# Shard Prefixes = %"PRIu32, prefix_list->len);
+    fprintf_verbose(stderr, "Shard Share = %.1f%%", total_load > 0.0 ? 100.0 * own_load / total_load : 0.0);
+
+    free(est->counts);
+    free(est->acc);
+    free(est->tmp);
+    free(next_counts);
+    free(loads);
+    destruct_alist(prefix_list);
+    destruct_alist(next_prefix_list);
+    destruct_alist(stack_list);
+    destruct_alist(next_stack_list);
+}
+
+/* Undoes the temporary coverage of the alternatives a derivation took, generateSentence_ggraph counts them for real. */
+static void uncoverTaken(
+    Coverage* const cov,
+    ArrayList const* const taken_list
+) {
+    for (uint32_t i = 0; i < taken_list->len; i++)
+        cov->exp_counts[*(uint32_t*)get_alist(taken_list, i)] = 0;
+}
+
 void setLeaf_dtree(
     DecisionTree* const dtree,
     uint32_t const leaf_id
@@ -322,3 +1336,98 @@ void setLeaf_dtree(
     leaf->n_choices = 0;
     propagateUpState_dtree(dtree, leaf_id);
 }
+
+/* The completions of the rules a prefix leaves pending that fit what is left of the budget. */
+static double weighShardPrefix(
+    ShardEstimates* const est,
+    DerivationBudget const* const budget,
+    ShardPrefix const* const prefix,
+    ArrayList const* const stack_list
+) {
+    uint64_t const max_cost = est->is_bytes ? budget->max_bytes : budget->max_decisions;
+    uint64_t const reserved = costOnAxis(est, &(prefix->reserved));
+    uint64_t last_cell      = (max_cost > reserved) ? (max_cost - reserved) / est->unit : 0;
+    double weight           = 0.0;
+
+    if (last_cell >= est->n_cells) last_cell = est->n_cells - 1;
+
+    memset(est->acc, 0, (size_t)est->n_cells * sizeof(double));
+    est->acc[0] = 1.0;
+    for (uint32_t i = 0; i < prefix->stack_len; i++) {
+        uint32_t const rule_id = *(uint32_t*)get_alist(stack_list, prefix->stack_offset + i);
+        convolveEstimates(est->acc, est->counts + (size_t)rule_id * est->n_cells, est->tmp, est->n_cells);
+    }
+    for (uint32_t cell = 0; cell <= last_cell; cell++) weight += est->acc[cell];
+
+    return (weight > DTREE_SHARD_MAX_WEIGHT) ? DTREE_SHARD_MAX_WEIGHT : weight;
+}
+
+static void writeAlternative(
+    TreeWriter* const writer,
+    GrammarGraph const* const graph,
+    uint32_t const rule_id,
+    uint32_t const choice
+) {
+    RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+    uint32_t const exp_id       = *(uint32_t*)get_alist(rule->alt_list, choice);
+    ExpansionTerm const* exp    = get_alist(graph->exp_list, exp_id);
+
+    do {
+        if (exp->is_terminal) {
+            Item const term = get_chunk(graph->terminals, exp->rt_id);
+            WRITE_LITERAL(writer, BNF_STR_TERMINAL_OPEN);
+            writeBytes(writer, term.p, term.sz);
+            WRITE_LITERAL(writer, BNF_STR_TERMINAL_CLOSE);
+        } else {
+            RuleTerm const* const child_rule    = get_alist(graph->rule_list, exp->rt_id);
+            Item const term                     = get_chunk(graph->rule_names, child_rule->name_id);
+            writeBytes(writer, term.p, term.sz);
+        }
+    } while ((exp++)->has_next);
+}
+
+static void writeBytes(
+    TreeWriter* const writer,
+    void const* const p,
+    uint32_t const sz
+) {
+    if (writer->len + sz > DTREE_WRITE_BUFFER_SZ) flushWriter(writer);
+
+    if (sz > DTREE_WRITE_BUFFER_SZ) {
+        if (fwrite(p, 1, sz, writer->fp) != sz) writer->is_ok = 0;
+    } else {
+        memcpy(writer->buffer + writer->len, p, sz);
+        writer->len += sz;
+    }
+}
+
+static void writeDecimal(
+    TreeWriter* const writer,
+    uint64_t value
+) {
+    char digits[20];
+    uint32_t n = sizeof(digits);
+
+    do {
+        digits[--n] = (char)('0' + value % 10);
+        value      /= 10;
+    } while (value > 0);
+
+    writeBytes(writer, digits + n, sizeof(digits) - n);
+}
+
+static void writeVarint(
+    TreeWriter* const writer,
+    uint64_t value
+) {
+    unsigned char bytes[10];
+    uint32_t n = 0;
+
+    while (value >= 0x80) {
+        bytes[n++]  = (unsigned char)(value | 0x80);
+        value     >>= 7;
+    }
+    bytes[n++] = (unsigned char)value;
+
+    writeBytes(writer, bytes, n);
+}
@@ -0,0 +1,213 @@
+#define _POSIX_C_SOURCE 199309L
+#include <assert.h>
+#include <time.h>
+#include "derivationbudget.h"
+#include "memoryusage.h"
+#include "padkit/repeat.h"
+
+static uint64_t addSaturated(
+    uint64_t const a,
+    uint64_t const b
+);
+
+static DerivationCost altCost(
+    DerivationBudget const* const budget,
+    GrammarGraph const* const graph,
+    uint32_t exp_id
+);
+
+static bool isCheaper(
+    DerivationCost const* const a,
+    DerivationCost const* const b
+);
+
+static uint64_t addSaturated(
+    uint64_t const a,
+    uint64_t const b
+) {
+    return (a > DBUDGET_UNLIMITED - b) ? DBUDGET_UNLIMITED : a + b;
+}
+
+/* The cheapest completion of an alternative, given the current cheapest completion of every rule. */
+static DerivationCost altCost(
+    DerivationBudget const* const budget,
+    GrammarGraph const* const graph,
+    uint32_t exp_id
+) {
+    DerivationCost cost         = { 1, 0 };
+    ExpansionTerm const* exp    = NULL;
+
+    do {
+        exp = get_alist(graph->exp_list, exp_id++);
+        if (exp->is_terminal) {
+            cost.n_bytes = addSaturated(cost.n_bytes, get_chunk(graph->terminals, exp->rt_id).sz);
+        } else {
+            DerivationCost const* const child = minCost_dbudget(budget, exp->rt_id);
+            cost.n_decisions    = addSaturated(cost.n_decisions, child->n_decisions);
+            cost.n_bytes        = addSaturated(cost.n_bytes, child->n_bytes);
+        }
+    } while (exp->has_next);
+
+    return cost;
+}
+
+/*
+ * Relaxes every alternative until no rule gets cheaper. The cheapest
+ * derivation of a rule never repeats a rule along a path, so pass k settles
+ * every rule whose cheapest derivation is at most k levels deep. A pass
+ * without changes also leaves every alternative cost exact.
+ */
+void construct_dbudget(
+    DerivationBudget* const budget,
+    GrammarGraph const* const graph,
+    uint32_t const max_decisions,
+    uint32_t const max_bytes,
+    uint64_t const deadline_ns
+) {
+    DerivationCost const infinite   = { DBUDGET_UNLIMITED, DBUDGET_UNLIMITED };
+    uint32_t const n_rules          = graph->rule_list->len;
+    uint32_t n_alts                 = 0;
+    bool is_changed                 = 1;
+
+    assert(budget != NULL);
+    assert(isValid_ggraph(graph));
+
+    budget->max_decisions   = (max_decisions == 0) ? DBUDGET_UNLIMITED : max_decisions;
+    budget->max_bytes       = (max_bytes == 0) ? DBUDGET_UNLIMITED : max_bytes;
+    budget->deadline_ns     = deadline_ns;
+
+    constructEmpty_alist(budget->offset_list, sizeof(uint32_t), n_rules + 1);
+    constructEmpty_alist(budget->shortest_list, sizeof(uint32_t), n_rules + 1);
+    constructEmpty_alist(budget->cost_list, sizeof(DerivationCost), graph->exp_list->len + 1);
+
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+        RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+        uint32_t const shortest_id  = 0;
+
+        add_alist(budget->offset_list, &n_alts);
+        add_alist(budget->shortest_list, &shortest_id);
+        REPEAT(rule->alt_list->len) add_alist(budget->cost_list, &infinite);
+        n_alts += rule->alt_list->len;
+    }
+    add_alist(budget->offset_list, &n_alts);
+
+    while (is_changed) {
+        is_changed = 0;
+        for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+            RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+            uint32_t const offset       = *(uint32_t*)get_alist(budget->offset_list, rule_id);
+            uint32_t* const p_shortest  = get_alist(budget->shortest_list, rule_id);
+
+            for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+                uint32_t const exp_id           = *(uint32_t*)get_alist(rule->alt_list, alt_id);
+                DerivationCost const relaxed    = altCost(budget, graph, exp_id);
+                DerivationCost* const cost      = get_alist(budget->cost_list, offset + alt_id);
+
+                if (!isCheaper(&relaxed, cost)) continue;
+
+                *cost = relaxed;
+                if (isCheaper(cost, minCost_dbudget(budget, rule_id)) || alt_id == *p_shortest) {
+                    *p_shortest = alt_id;
+                    is_changed  = 1;
+                }
+            }
+        }
+    }
+}
+
+void destruct_dbudget(DerivationBudget* const budget) {
+    assert(isValid_dbudget(budget));
+
+    destruct_alist(budget->offset_list);
+    destruct_alist(budget->shortest_list);
+    destruct_alist(budget->cost_list);
+
+    *budget = NOT_A_DBUDGET;
+}
+
+bool fits_dbudget(
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    uint32_t const rule_id,
+    uint32_t const alt_id
+) {
+    uint32_t const offset                   = *(uint32_t*)get_alist(budget->offset_list, rule_id);
+    DerivationCost const* const min_cost    = minCost_dbudget(budget, rule_id);
+    DerivationCost const* const alt_cost    = get_alist(budget->cost_list, offset + alt_id);
+
+    if (alt_id == *(uint32_t*)get_alist(budget->shortest_list, rule_id))    return 1;
+    if (isUnlimited_dbudget(budget))                                        return 1;
+
+    if (addSaturated(reserved->n_decisions - min_cost->n_decisions, alt_cost->n_decisions) > budget->max_decisions)
+        return 0;
+    if (addSaturated(reserved->n_bytes - min_cost->n_bytes, alt_cost->n_bytes) > budget->max_bytes)
+        return 0;
+
+    return 1;
+}
+
+/* Fewer bytes first, then fewer decisions. */
+static bool isCheaper(
+    DerivationCost const* const a,
+    DerivationCost const* const b
+) {
+    if (a->n_bytes != b->n_bytes) return a->n_bytes < b->n_bytes;
+    return a->n_decisions < b->n_decisions;
+}
+
+bool isPastDeadline_dbudget(DerivationBudget const* const budget) {
+    assert(isValid_dbudget(budget));
+    return budget->deadline_ns != 0 && monotonicNs_dbudget() >= budget->deadline_ns;
+}
+
+bool isUnlimited_dbudget(DerivationBudget const* const budget) {
+    assert(isValid_dbudget(budget));
+    return budget->max_decisions == DBUDGET_UNLIMITED && budget->max_bytes == DBUDGET_UNLIMITED;
+}
+
+bool isValid_dbudget(DerivationBudget const* const budget) {
+    if (budget == NULL)                                                     return 0;
+    if (budget->max_decisions == 0)                                         return 0;
+    if (budget->max_bytes == 0)                                             return 0;
+    if (!isValid_alist(budget->offset_list))                                return 0;
+    if (!isValid_alist(budget->shortest_list))                              return 0;
+    if (!isValid_alist(budget->cost_list))                                  return 0;
+    if (budget->offset_list->len != budget->shortest_list->len + 1)         return 0;
+
+    return 1;
+}
+
+size_t memoryUsage_dbudget(DerivationBudget const* const budget) {
+    assert(isValid_dbudget(budget));
+    return MUSAGE_ALIST(budget->offset_list) + MUSAGE_ALIST(budget->shortest_list) + MUSAGE_ALIST(budget->cost_list);
+}
+
+DerivationCost const* minCost_dbudget(
+    DerivationBudget const* const budget,
+    uint32_t const rule_id
+) {
+    uint32_t const offset   = *(uint32_t*)get_alist(budget->offset_list, rule_id);
+    uint32_t const alt_id   = *(uint32_t*)get_alist(budget->shortest_list, rule_id);
+
+    return get_alist(budget->cost_list, offset + alt_id);
+}
+
+uint64_t monotonicNs_dbudget(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void spend_dbudget(
+    DerivationCost* const reserved,
+    DerivationBudget const* const budget,
+    uint32_t const rule_id,
+    uint32_t const alt_id
+) {
+    uint32_t const offset                   = *(uint32_t*)get_alist(budget->offset_list, rule_id);
+    DerivationCost const* const min_cost    = minCost_dbudget(budget, rule_id);
+    DerivationCost const* const alt_cost    = get_alist(budget->cost_list, offset + alt_id);
+
+    reserved->n_decisions   = addSaturated(reserved->n_decisions - min_cost->n_decisions, alt_cost->n_decisions);
+    reserved->n_bytes       = addSaturated(reserved->n_bytes - min_cost->n_bytes, alt_cost->n_bytes);
+}
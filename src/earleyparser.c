@@ -0,0 +1,797 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "earleyparser.h"
+#include "padkit/invalid.h"
+#include "padkit/memalloc.h"
+#include "padkit/repeat.h"
+
+static uint32_t addItem(
+    EarleyParser* const parser,
+    uint32_t const set_id,
+    uint32_t const dot,
+    uint32_t const origin
+);
+
+static uint32_t advanceDot(
+    EarleyParser const* const parser,
+    uint32_t const dot
+);
+
+static int extractDerivation(
+    ArrayList* const seq,
+    EarleyParser* const parser,
+    char const* const input,
+    uint32_t const len
+);
+
+static bool findItem(
+    EarleyParser const* const parser,
+    uint32_t const set_id,
+    uint32_t const dot,
+    uint32_t const origin
+);
+
+static EarleyWaiting* findWaiting(
+    EarleyParser* const parser,
+    uint32_t const set_id,
+    uint32_t const rule_id,
+    bool const insert
+);
+
+static uint32_t findProperAlternative(
+    EarleyParser* const parser,
+    char const* const input,
+    uint32_t const rule_id,
+    uint32_t const start,
+    uint32_t const end
+);
+
+static uint32_t findUnitChain(
+    EarleyParser* const parser,
+    char const* const input,
+    uint32_t const rule_id,
+    uint32_t const start,
+    uint32_t const end
+);
+
+static uint64_t hashTriple(
+    uint32_t const a,
+    uint32_t const b,
+    uint32_t const c
+);
+
+static bool isCompleted(
+    EarleyParser const* const parser,
+    uint32_t const rule_id,
+    uint32_t const start,
+    uint32_t const end
+);
+
+static bool isNullable(
+    EarleyParser const* const parser,
+    ExpansionTerm const* const exp
+);
+
+static bool leoItem(
+    uint32_t* const p_dot,
+    uint32_t* const p_origin,
+    EarleyParser* const parser,
+    uint32_t const set_id,
+    uint32_t const rule_id
+);
+
+static void predict(
+    EarleyParser* const parser,
+    uint32_t const set_id,
+    uint32_t const rule_id
+);
+
+static void reset(
+    EarleyParser* const parser,
+    uint32_t const len
+);
+
+static bool splitAlternative(
+    EarleyParser* const parser,
+    char const* const input,
+    EarleyExpInfo const* const info,
+    uint32_t const start,
+    uint32_t const end
+);
+
+static uint32_t addItem(
+    EarleyParser* const parser,
+    uint32_t const set_id,
+    uint32_t const dot,
+    uint32_t const origin
+) {
+    uint32_t const item_id  = parser->item_list->len;
+    EarleyItem* item        = NULL;
+    EarleySet* set          = NULL;
+    uint32_t mask           = parser->item_tbl_cap - 1;
+    uint32_t slot           = 0;
+
+    if (findItem(parser, set_id, dot, origin)) return INVALID_UINT32;
+
+    if (2 * (item_id + 1) > parser->item_tbl_cap) {
+        uint32_t const new_cap = 2 * parser->item_tbl_cap;
+        free(parser->item_tbl);
+        parser->item_tbl        = mem_alloc((size_t)new_cap * sizeof(uint32_t));
+        parser->item_tbl_cap    = new_cap;
+        memset(parser->item_tbl, 0xFF, (size_t)new_cap * sizeof(uint32_t));
+        mask = new_cap - 1;
+        for (uint32_t i = 0; i < item_id; i++) {
+            EarleyItem const* const old = get_alist(parser->item_list, i);
+            slot = (uint32_t)hashTriple(old->set_id, old->dot, old->origin) & mask;
+            while (parser->item_tbl[slot] != INVALID_UINT32) slot = (slot + 1) & mask;
+            parser->item_tbl[slot] = i;
+        }
+    }
+    slot = (uint32_t)hashTriple(set_id, dot, origin) & mask;
+    while (parser->item_tbl[slot] != INVALID_UINT32) slot = (slot + 1) & mask;
+    parser->item_tbl[slot] = item_id;
+
+    item                = addIndeterminate_alist(parser->item_list);
+    item->dot           = dot;
+    item->origin        = origin;
+    item->set_id        = set_id;
+    item->next_in_set   = INVALID_UINT32;
+    item->next_waiting  = INVALID_UINT32;
+
+    set = get_alist(parser->set_list, set_id);
+    if (set->tail == INVALID_UINT32) {
+        set->head = item_id;
+    } else {
+        EarleyItem* const tail = get_alist(parser->item_list, set->tail);
+        tail->next_in_set = item_id;
+    }
+    set->tail = item_id;
+
+    if (!(dot & EPARSER_DOT_COMPLETE)) {
+        ExpansionTerm const* const exp = get_alist(parser->graph->exp_list, dot);
+        if (!exp->is_terminal) {
+            EarleyWaiting* const waiting    = findWaiting(parser, set_id, exp->rt_id, 1);
+            item                            = get_alist(parser->item_list, item_id);
+            item->next_waiting              = waiting->head;
+            waiting->head                   = item_id;
+        }
+    }
+
+    return item_id;
+}
+
+static uint32_t advanceDot(
+    EarleyParser const* const parser,
+    uint32_t const dot
+) {
+    ExpansionTerm const* const exp = get_alist(parser->graph->exp_list, dot);
+    return exp->has_next ? dot + 1 : dot | EPARSER_DOT_COMPLETE;
+}
+
+void construct_eparser(
+    EarleyParser* const parser,
+    GrammarGraph const* const graph
+) {
+    assert(parser != NULL);
+    assert(isValid_ggraph(graph));
+
+    parser->graph = graph;
+
+    constructEmpty_alist(parser->info_list, sizeof(EarleyExpInfo), graph->exp_list->len + 1);
+    REPEAT(graph->exp_list->len) addIndeterminate_alist(parser->info_list);
+    for (uint32_t rule_id = 0; rule_id < graph->rule_list->len; rule_id++) {
+        RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+        uint32_t const* p_exp_id    = getFirst_alist(rule->alt_list);
+
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++, p_exp_id++) {
+            uint32_t last_exp_id            = *p_exp_id;
+            ExpansionTerm const* exp        = get_alist(graph->exp_list, last_exp_id);
+            while (exp->has_next) { exp++; last_exp_id++; }
+
+            for (uint32_t exp_id = *p_exp_id; exp_id <= last_exp_id; exp_id++) {
+                EarleyExpInfo* const info   = get_alist(parser->info_list, exp_id);
+                info->rule_id               = rule_id;
+                info->alt_id                = alt_id;
+                info->first_exp_id          = *p_exp_id;
+                info->last_exp_id           = last_exp_id;
+            }
+        }
+    }
+
+    constructEmpty_alist(parser->item_list, sizeof(EarleyItem), EPARSER_INITIAL_TBL_CAP);
+    constructEmpty_alist(parser->set_list, sizeof(EarleySet), EPARSER_INITIAL_TBL_CAP);
+    constructEmpty_alist(parser->task_list, sizeof(EarleyTask), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(parser->unit_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(parser->leo_list, sizeof(EarleyLeoStep), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(parser->split_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+
+    parser->empty_alts = mem_alloc((size_t)graph->rule_list->len * sizeof(uint32_t));
+    memset(parser->empty_alts, 0xFF, (size_t)graph->rule_list->len * sizeof(uint32_t));
+    for (bool is_changed = 1; is_changed;) {
+        is_changed = 0;
+        for (uint32_t rule_id = 0; rule_id < graph->rule_list->len; rule_id++) {
+            RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+            uint32_t const* p_exp_id    = getFirst_alist(rule->alt_list);
+
+            if (parser->empty_alts[rule_id] != INVALID_UINT32) continue;
+            for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++, p_exp_id++) {
+                ExpansionTerm const* exp = get_alist(graph->exp_list, *p_exp_id);
+                while (isNullable(parser, exp) && exp->has_next) exp++;
+                if (!isNullable(parser, exp)) continue;
+
+                parser->empty_alts[rule_id] = alt_id;
+                is_changed                  = 1;
+                break;
+            }
+        }
+    }
+
+    parser->item_tbl_cap    = EPARSER_INITIAL_TBL_CAP;
+    parser->item_tbl        = mem_alloc((size_t)parser->item_tbl_cap * sizeof(uint32_t));
+    parser->waiting_tbl_cap = EPARSER_INITIAL_TBL_CAP;
+    parser->waiting_tbl     = mem_alloc((size_t)parser->waiting_tbl_cap * sizeof(EarleyWaiting));
+    parser->n_waiting       = 0;
+    parser->unit_steps      = mem_calloc(graph->rule_list->len, sizeof(EarleyUnitStep));
+    parser->last_stamp      = 0;
+}
+
+void destruct_eparser(EarleyParser* const parser) {
+    assert(isValid_eparser(parser));
+
+    destruct_alist(parser->info_list);
+    destruct_alist(parser->item_list);
+    destruct_alist(parser->set_list);
+    destruct_alist(parser->task_list);
+    destruct_alist(parser->unit_list);
+    destruct_alist(parser->leo_list);
+    destruct_alist(parser->split_list);
+    free(parser->empty_alts);
+    free(parser->item_tbl);
+    free(parser->waiting_tbl);
+    free(parser->unit_steps);
+
+    *parser = NOT_AN_EPARSER;
+}
+
+/*
+ * Rebuilds the leftmost derivation top-down from the completed chart. Every
+ * item in set p with origin i proves that the symbols before its dot derive
+ * input[i..p), so any matching split point can be taken greedily. An empty
+ * span takes the rule's empty alternative. A split that hands the whole span
+ * to one rule would repeat the task, so when a rule has no other completed
+ * alternative, the shortest chain of such unit steps is searched
+ * breadth-first and only its first step is taken.
+ */
+static int extractDerivation(
+    ArrayList* const seq,
+    EarleyParser* const parser,
+    char const* const input,
+    uint32_t const len
+) {
+    GrammarGraph const* const graph = parser->graph;
+    EarleyTask task                 = { graph->root_rule_id, 0, len };
+
+    assert(parser->task_list->len == 0);
+
+    push_alist(parser->task_list, &task);
+    while (parser->task_list->len > 0) {
+        EarleyExpInfo const* info   = NULL;
+        uint32_t const* p_start     = NULL;
+        uint32_t alt_id             = INVALID_UINT32;
+        uint32_t unit_exp_id        = INVALID_UINT32;
+        uint32_t pos                = 0;
+
+        task = *(EarleyTask*)pop_alist(parser->task_list);
+        if (task.start == task.end) {
+            alt_id = parser->empty_alts[task.rule_id];
+            if (alt_id == INVALID_UINT32) return EPARSER_REJECT;
+        } else {
+            alt_id = findProperAlternative(parser, input, task.rule_id, task.start, task.end);
+            if (alt_id == INVALID_UINT32) {
+                uint32_t rule_id = findUnitChain(parser, input, task.rule_id, task.start, task.end);
+                if (rule_id == INVALID_UINT32) return EPARSER_REJECT;
+
+                while (parser->unit_steps[rule_id].prev_rule_id != task.rule_id)
+                    rule_id = parser->unit_steps[rule_id].prev_rule_id;
+                alt_id      = parser->unit_steps[rule_id].prev_alt_id;
+                unit_exp_id = parser->unit_steps[rule_id].prev_exp_id;
+            }
+        }
+        add_alist(seq, &alt_id);
+
+        info = get_alist(parser->info_list, *(uint32_t*)get_alist(
+            ((RuleTerm*)get_alist(graph->rule_list, task.rule_id))->alt_list, alt_id
+        ));
+        if (task.start == task.end || unit_exp_id != INVALID_UINT32) {
+            flush_alist(parser->split_list);
+            for (uint32_t exp_id = info->last_exp_id; ; exp_id--) {
+                uint32_t const start = (unit_exp_id != INVALID_UINT32 && exp_id > unit_exp_id) ? task.end : task.start;
+                push_alist(parser->split_list, &start);
+                if (exp_id == info->first_exp_id) break;
+            }
+        }
+
+        pos     = task.end;
+        p_start = getFirst_alist(parser->split_list);
+        for (uint32_t exp_id = info->last_exp_id; ; exp_id--, p_start++) {
+            ExpansionTerm const* const exp = get_alist(graph->exp_list, exp_id);
+            if (!exp->is_terminal) {
+                EarleyTask const child = { exp->rt_id, *p_start, pos };
+                push_alist(parser->task_list, &child);
+            }
+
+            pos = *p_start;
+            if (exp_id == info->first_exp_id) break;
+        }
+    }
+
+    return EPARSER_ACCEPT;
+}
+
+static bool findItem(
+    EarleyParser const* const parser,
+    uint32_t const set_id,
+    uint32_t const dot,
+    uint32_t const origin
+) {
+    uint32_t const mask = parser->item_tbl_cap - 1;
+    uint32_t slot       = (uint32_t)hashTriple(set_id, dot, origin) & mask;
+
+    while (parser->item_tbl[slot] != INVALID_UINT32) {
+        EarleyItem const* const item = get_alist(parser->item_list, parser->item_tbl[slot]);
+        if (item->set_id == set_id && item->dot == dot && item->origin == origin) return 1;
+        slot = (slot + 1) & mask;
+    }
+    return 0;
+}
+
+/* The first completed alternative that splits input[start..end) properly, leaving the split in split_list. */
+static uint32_t findProperAlternative(
+    EarleyParser* const parser,
+    char const* const input,
+    uint32_t const rule_id,
+    uint32_t const start,
+    uint32_t const end
+) {
+    RuleTerm const* const rule  = get_alist(parser->graph->rule_list, rule_id);
+    uint32_t const* p_exp_id    = getFirst_alist(rule->alt_list);
+
+    for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++, p_exp_id++) {
+        EarleyExpInfo const* const info = get_alist(parser->info_list, *p_exp_id);
+        if (!findItem(parser, end, info->last_exp_id | EPARSER_DOT_COMPLETE, start))   continue;
+        if (splitAlternative(parser, input, info, start, end))                          return alt_id;
+    }
+    return INVALID_UINT32;
+}
+
+/*
+ * A unit step may go to any rule of a completed alternative whose other terms
+ * are all nullable, and its target must have completed over the same span.
+ */
+static uint32_t findUnitChain(
+    EarleyParser* const parser,
+    char const* const input,
+    uint32_t const rule_id,
+    uint32_t const start,
+    uint32_t const end
+) {
+    ArrayList const* const exp_list = parser->graph->exp_list;
+    uint32_t const stamp            = ++(parser->last_stamp);
+    uint32_t head                   = 0;
+
+    flush_alist(parser->unit_list);
+    push_alist(parser->unit_list, &rule_id);
+    parser->unit_steps[rule_id].stamp = stamp;
+    while (head < parser->unit_list->len) {
+        uint32_t const parent_id    = *(uint32_t*)get_alist(parser->unit_list, head++);
+        RuleTerm const* const rule  = get_alist(parser->graph->rule_list, parent_id);
+        uint32_t const* p_exp_id    = getFirst_alist(rule->alt_list);
+
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++, p_exp_id++) {
+            EarleyExpInfo const* const info = get_alist(parser->info_list, *p_exp_id);
+            uint32_t solid_exp_id           = INVALID_UINT32;
+            uint32_t n_solid                = 0;
+
+            if (!findItem(parser, end, info->last_exp_id | EPARSER_DOT_COMPLETE, start)) continue;
+            for (uint32_t exp_id = info->first_exp_id; exp_id <= info->last_exp_id; exp_id++) {
+                if (isNullable(parser, get_alist(exp_list, exp_id))) continue;
+                solid_exp_id = exp_id;
+                n_solid++;
+            }
+            if (n_solid > 1) continue;
+
+            for (uint32_t exp_id = info->first_exp_id; exp_id <= info->last_exp_id; exp_id++) {
+                ExpansionTerm const* const exp  = get_alist(exp_list, exp_id);
+                uint32_t const child_id         = exp->rt_id;
+                if (exp->is_terminal)                                                           continue;
+                if (n_solid == 1 && exp_id != solid_exp_id)                                     continue;
+                if (parser->unit_steps[child_id].stamp == stamp)                                continue;
+                if (!isCompleted(parser, child_id, start, end))                                 continue;
+
+                parser->unit_steps[child_id] = (EarleyUnitStep){ stamp, parent_id, alt_id, exp_id };
+                if (findProperAlternative(parser, input, child_id, start, end) != INVALID_UINT32) return child_id;
+                push_alist(parser->unit_list, &child_id);
+            }
+        }
+    }
+    return INVALID_UINT32;
+}
+
+static EarleyWaiting* findWaiting(
+    EarleyParser* const parser,
+    uint32_t const set_id,
+    uint32_t const rule_id,
+    bool const insert
+) {
+    uint32_t mask = parser->waiting_tbl_cap - 1;
+    uint32_t slot = (uint32_t)hashTriple(set_id, rule_id, INVALID_UINT32) & mask;
+
+    while (parser->waiting_tbl[slot].set_id != INVALID_UINT32) {
+        EarleyWaiting* const waiting = parser->waiting_tbl + slot;
+        if (waiting->set_id == set_id && waiting->rule_id == rule_id) return waiting;
+        slot = (slot + 1) & mask;
+    }
+    if (!insert) return NULL;
+
+    if (2 * (parser->n_waiting + 1) > parser->waiting_tbl_cap) {
+        EarleyWaiting* const old_tbl    = parser->waiting_tbl;
+        uint32_t const old_cap          = parser->waiting_tbl_cap;
+
+        parser->waiting_tbl_cap = 2 * old_cap;
+        parser->waiting_tbl     = mem_alloc((size_t)parser->waiting_tbl_cap * sizeof(EarleyWaiting));
+        mask                    = parser->waiting_tbl_cap - 1;
+        for (uint32_t i = 0; i < parser->waiting_tbl_cap; i++) parser->waiting_tbl[i].set_id = INVALID_UINT32;
+        for (uint32_t i = 0; i < old_cap; i++) {
+            if (old_tbl[i].set_id == INVALID_UINT32) continue;
+            slot = (uint32_t)hashTriple(old_tbl[i].set_id, old_tbl[i].rule_id, INVALID_UINT32) & mask;
+            while (parser->waiting_tbl[slot].set_id != INVALID_UINT32) slot = (slot + 1) & mask;
+            parser->waiting_tbl[slot] = old_tbl[i];
+        }
+        free(old_tbl);
+
+        slot = (uint32_t)hashTriple(set_id, rule_id, INVALID_UINT32) & mask;
+        while (parser->waiting_tbl[slot].set_id != INVALID_UINT32) slot = (slot + 1) & mask;
+    }
+
+    parser->n_waiting++;
+    parser->waiting_tbl[slot] = (EarleyWaiting){
+        set_id, rule_id, INVALID_UINT32, 0, EPARSER_LEO_UNKNOWN, INVALID_UINT32
+    };
+    return parser->waiting_tbl + slot;
+}
+
+/* splitmix64 finalizer */
+static uint64_t hashTriple(
+    uint32_t const a,
+    uint32_t const b,
+    uint32_t const c
+) {
+    uint64_t h = (((uint64_t)a << 32) | b) ^ ((uint64_t)c * 0x9E3779B97F4A7C15ULL);
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+}
+
+static bool isCompleted(
+    EarleyParser const* const parser,
+    uint32_t const rule_id,
+    uint32_t const start,
+    uint32_t const end
+) {
+    RuleTerm const* const rule  = get_alist(parser->graph->rule_list, rule_id);
+    uint32_t const* p_exp_id    = getFirst_alist(rule->alt_list);
+
+    REPEAT(rule->alt_list->len) {
+        EarleyExpInfo const* const info = get_alist(parser->info_list, *(p_exp_id++));
+        if (findItem(parser, end, info->last_exp_id | EPARSER_DOT_COMPLETE, start)) return 1;
+    }
+    return 0;
+}
+
+static bool isNullable(
+    EarleyParser const* const parser,
+    ExpansionTerm const* const exp
+) {
+    if (exp->is_terminal)
+        return get_chunk(parser->graph->terminals, exp->rt_id).sz == 0;
+    else
+        return parser->empty_alts[exp->rt_id] != INVALID_UINT32;
+}
+
+bool isValid_eparser(EarleyParser const* const parser) {
+    if (parser == NULL)                                                 return 0;
+    if (!isValid_ggraph(parser->graph))                                 return 0;
+    if (!isValid_alist(parser->info_list))                              return 0;
+    if (!isValid_alist(parser->item_list))                              return 0;
+    if (!isValid_alist(parser->set_list))                               return 0;
+    if (!isValid_alist(parser->task_list))                              return 0;
+    if (!isValid_alist(parser->unit_list))                              return 0;
+    if (!isValid_alist(parser->leo_list))                               return 0;
+    if (!isValid_alist(parser->split_list))                             return 0;
+    if (parser->empty_alts == NULL)                                     return 0;
+    if (parser->info_list->len != parser->graph->exp_list->len)         return 0;
+    if (parser->item_tbl == NULL)                                       return 0;
+    if (parser->waiting_tbl == NULL)                                    return 0;
+    if (parser->unit_steps == NULL)                                     return 0;
+
+    return 1;
+}
+
+/*
+ * Walks up the chain of deterministic reductions starting from the items of
+ * set_id waiting for rule_id, and memoizes the topmost item for every link.
+ * Chains stop below the root rule, so an accepted input always keeps its
+ * completed root item, and unit cycles simply disable the optimization.
+ */
+static bool leoItem(
+    uint32_t* const p_dot,
+    uint32_t* const p_origin,
+    EarleyParser* const parser,
+    uint32_t const set_id,
+    uint32_t const rule_id
+) {
+    uint32_t const root_rule_id = parser->graph->root_rule_id;
+    EarleyLeoStep step          = { set_id, rule_id, INVALID_UINT32, INVALID_UINT32 };
+    uint32_t dot                = INVALID_UINT32;
+    uint32_t origin             = INVALID_UINT32;
+    bool is_cyclic              = 0;
+
+    flush_alist(parser->leo_list);
+    for (;;) {
+        EarleyWaiting* const waiting    = findWaiting(parser, step.set_id, step.rule_id, 0);
+        EarleyItem const* parent        = NULL;
+
+        if (waiting == NULL) break;
+        if (waiting->leo_dot == EPARSER_LEO_VISITING) {
+            is_cyclic = 1;
+            break;
+        }
+        if (waiting->leo_dot != EPARSER_LEO_UNKNOWN) {
+            dot     = waiting->leo_dot;
+            origin  = waiting->leo_origin;
+            break;
+        }
+
+        if (waiting->head == INVALID_UINT32) {
+            waiting->leo_dot = INVALID_UINT32;
+            break;
+        }
+
+        parent = get_alist(parser->item_list, waiting->head);
+        if (
+            parent->next_waiting != INVALID_UINT32 ||
+            ((ExpansionTerm*)get_alist(parser->graph->exp_list, parent->dot))->has_next
+        ) {
+            waiting->leo_dot = INVALID_UINT32;
+            break;
+        }
+
+        waiting->leo_dot    = EPARSER_LEO_VISITING;
+        step.dot            = parent->dot | EPARSER_DOT_COMPLETE;
+        step.origin         = parent->origin;
+        push_alist(parser->leo_list, &step);
+
+        step.set_id     = parent->origin;
+        step.rule_id    = ((EarleyExpInfo*)get_alist(parser->info_list, parent->dot))->rule_id;
+        if (step.set_id == 0 && step.rule_id == root_rule_id) break;
+    }
+
+    while (parser->leo_list->len > 0) {
+        EarleyLeoStep const* const link = pop_alist(parser->leo_list);
+        EarleyWaiting* const waiting    = findWaiting(parser, link->set_id, link->rule_id, 0);
+
+        if (is_cyclic) {
+            waiting->leo_dot = INVALID_UINT32;
+            continue;
+        }
+        if (dot == INVALID_UINT32) {
+            dot     = link->dot;
+            origin  = link->origin;
+        }
+        waiting->leo_dot    = dot;
+        waiting->leo_origin = origin;
+    }
+
+    if (is_cyclic || dot == INVALID_UINT32) return 0;
+
+    *p_dot      = dot;
+    *p_origin   = origin;
+    return 1;
+}
+
+int parse_eparser(
+    ArrayList* const seq,
+    EarleyParser* const parser,
+    char const* const input,
+    uint32_t const len
+) {
+    GrammarGraph const* const graph = parser->graph;
+    RuleTerm const* root            = NULL;
+    uint32_t max_set_id             = 0;
+    bool is_accepted                = 0;
+
+    assert(seq == NULL || isValid_alist(seq));
+    assert(seq == NULL || seq->sz_elem == sizeof(uint32_t));
+    assert(isValid_eparser(parser));
+    assert(input != NULL || len == 0);
+
+    reset(parser, len);
+    predict(parser, 0, graph->root_rule_id);
+
+    for (uint32_t set_id = 0; set_id <= len && set_id <= max_set_id; set_id++) {
+        uint32_t item_id = ((EarleySet*)get_alist(parser->set_list, set_id))->head;
+        while (item_id != INVALID_UINT32) {
+            EarleyItem const item = *(EarleyItem*)get_alist(parser->item_list, item_id);
+
+            if (item.dot & EPARSER_DOT_COMPLETE) {
+                EarleyExpInfo const* const info     = get_alist(parser->info_list, item.dot & ~EPARSER_DOT_COMPLETE);
+                EarleyWaiting const* waiting        = NULL;
+                uint32_t waiting_id                 = INVALID_UINT32;
+                uint32_t leo_dot                    = INVALID_UINT32;
+                uint32_t leo_origin                 = INVALID_UINT32;
+
+                /* Only finished sets have final waiting lists for Leo to memoize. */
+                if (
+                    seq == NULL && item.origin < set_id &&
+                    leoItem(&leo_dot, &leo_origin, parser, item.origin, info->rule_id)
+                ) {
+                    addItem(parser, set_id, leo_dot, leo_origin);
+                    item_id = ((EarleyItem*)get_alist(parser->item_list, item_id))->next_in_set;
+                    continue;
+                }
+
+                waiting     = findWaiting(parser, item.origin, info->rule_id, 0);
+                waiting_id  = (waiting == NULL) ? INVALID_UINT32 : waiting->head;
+                while (waiting_id != INVALID_UINT32) {
+                    EarleyItem const parent = *(EarleyItem*)get_alist(parser->item_list, waiting_id);
+                    addItem(parser, set_id, advanceDot(parser, parent.dot), parent.origin);
+                    waiting_id = parent.next_waiting;
+                }
+            } else {
+                ExpansionTerm const* const exp = get_alist(graph->exp_list, item.dot);
+                if (exp->is_terminal) {
+                    Item const terminal = get_chunk(graph->terminals, exp->rt_id);
+                    if (
+                        terminal.sz <= len - set_id &&
+                        (terminal.sz == 0 || memcmp(input + set_id, terminal.p, terminal.sz) == 0)
+                    ) {
+                        addItem(parser, set_id + terminal.sz, advanceDot(parser, item.dot), item.origin);
+                        if (set_id + terminal.sz > max_set_id) max_set_id = set_id + terminal.sz;
+                    }
+                } else {
+                    predict(parser, set_id, exp->rt_id);
+                    if (parser->empty_alts[exp->rt_id] != INVALID_UINT32)
+                        addItem(parser, set_id, advanceDot(parser, item.dot), item.origin);
+                }
+            }
+
+            item_id = ((EarleyItem*)get_alist(parser->item_list, item_id))->next_in_set;
+        }
+    }
+
+    if (max_set_id < len) return EPARSER_REJECT;
+
+    root = get_alist(graph->rule_list, graph->root_rule_id);
+    for (uint32_t alt_id = 0; !is_accepted && alt_id < root->alt_list->len; alt_id++) {
+        EarleyExpInfo const* const info = get_alist(parser->info_list, *(uint32_t*)get_alist(root->alt_list, alt_id));
+        is_accepted = findItem(parser, len, info->last_exp_id | EPARSER_DOT_COMPLETE, 0);
+    }
+    if (!is_accepted)   return EPARSER_REJECT;
+    if (seq == NULL)    return EPARSER_ACCEPT;
+
+    flush_alist(parser->task_list);
+    if (extractDerivation(seq, parser, input, len) != EPARSER_ACCEPT) {
+        flush_alist(parser->task_list);
+        return EPARSER_REJECT;
+    }
+    return EPARSER_ACCEPT;
+}
+
+static void predict(
+    EarleyParser* const parser,
+    uint32_t const set_id,
+    uint32_t const rule_id
+) {
+    EarleyWaiting* const waiting    = findWaiting(parser, set_id, rule_id, 1);
+    RuleTerm const* const rule      = get_alist(parser->graph->rule_list, rule_id);
+    uint32_t const* p_exp_id        = getFirst_alist(rule->alt_list);
+
+    if (waiting->is_predicted) return;
+    waiting->is_predicted = 1;
+
+    REPEAT(rule->alt_list->len) addItem(parser, set_id, *(p_exp_id++), set_id);
+}
+
+static void reset(
+    EarleyParser* const parser,
+    uint32_t const len
+) {
+    EarleySet const empty       = { INVALID_UINT32, INVALID_UINT32 };
+    uint32_t item_tbl_cap       = EPARSER_INITIAL_TBL_CAP;
+    uint32_t waiting_tbl_cap    = EPARSER_INITIAL_TBL_CAP;
+
+    /* Clearing costs O(capacity), so tables shrink back to what the last parse needed. */
+    while (item_tbl_cap < 2 * parser->item_list->len)   item_tbl_cap <<= 1;
+    while (waiting_tbl_cap < 2 * parser->n_waiting)     waiting_tbl_cap <<= 1;
+    if (item_tbl_cap < parser->item_tbl_cap) {
+        free(parser->item_tbl);
+        parser->item_tbl        = mem_alloc((size_t)item_tbl_cap * sizeof(uint32_t));
+        parser->item_tbl_cap    = item_tbl_cap;
+    }
+    if (waiting_tbl_cap < parser->waiting_tbl_cap) {
+        free(parser->waiting_tbl);
+        parser->waiting_tbl     = mem_alloc((size_t)waiting_tbl_cap * sizeof(EarleyWaiting));
+        parser->waiting_tbl_cap = waiting_tbl_cap;
+    }
+
+    flush_alist(parser->item_list);
+    flush_alist(parser->set_list);
+    for (uint32_t set_id = 0; set_id <= len; set_id++) add_alist(parser->set_list, &empty);
+
+    memset(parser->item_tbl, 0xFF, (size_t)parser->item_tbl_cap * sizeof(uint32_t));
+    for (uint32_t i = 0; i < parser->waiting_tbl_cap; i++) parser->waiting_tbl[i].set_id = INVALID_UINT32;
+    parser->n_waiting = 0;
+}
+
+/*
+ * Splits input[start..end) among the terms of an alternative from right to
+ * left, and lists the start of every term in split_list. Handing the whole
+ * span to a rule is improper, so while nothing right of a rule is matched,
+ * the rule prefers a shorter span, then the empty one, and fails otherwise.
+ */
+static bool splitAlternative(
+    EarleyParser* const parser,
+    char const* const input,
+    EarleyExpInfo const* const info,
+    uint32_t const start,
+    uint32_t const end
+) {
+    GrammarGraph const* const graph = parser->graph;
+    uint32_t pos                    = end;
+
+    flush_alist(parser->split_list);
+    for (uint32_t exp_id = info->last_exp_id; ; exp_id--) {
+        ExpansionTerm const* const exp  = get_alist(graph->exp_list, exp_id);
+        uint32_t term_start             = INVALID_UINT32;
+
+        if (exp->is_terminal) {
+            Item const terminal = get_chunk(graph->terminals, exp->rt_id);
+            if (terminal.sz > pos - start)                                                  return 0;
+            term_start = pos - terminal.sz;
+            if (terminal.sz > 0 && memcmp(input + term_start, terminal.p, terminal.sz) != 0) return 0;
+            if (exp_id == info->first_exp_id) {
+                if (term_start != start)                                                    return 0;
+            } else if (!findItem(parser, term_start, exp_id, start)) {
+                return 0;
+            }
+        } else if (exp_id == info->first_exp_id) {
+            if (pos == end) return 0;
+            term_start = start;
+        } else {
+            EarleySet const* const set  = get_alist(parser->set_list, pos);
+            uint32_t item_id            = set->head;
+            while (item_id != INVALID_UINT32) {
+                EarleyItem const* const item = get_alist(parser->item_list, item_id);
+                item_id = item->next_in_set;
+
+                if (!(item->dot & EPARSER_DOT_COMPLETE))    continue;
+                if (item->origin < start)                   continue;
+                if (pos == end && item->origin == start)    continue;
+                if (
+                    ((EarleyExpInfo*)get_alist(parser->info_list, item->dot & ~EPARSER_DOT_COMPLETE))->rule_id
+                    != exp->rt_id
+                ) continue;
+                if (!findItem(parser, item->origin, exp_id, start)) continue;
+
+                term_start = item->origin;
+                if (pos < end || item->origin < end) break;
+            }
+            if (term_start == INVALID_UINT32) return 0;
+        }
+
+        push_alist(parser->split_list, &term_start);
+        pos = term_start;
+        if (exp_id == info->first_exp_id) return 1;
+    }
+}
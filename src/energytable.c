@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <math.h>
+#include "energytable.h"
+#include "memoryusage.h"
+#include "padkit/invalid.h"
+#include "padkit/memalloc.h"
+#include "padkit/repeat.h"
+#include "padkit/size.h"
+
+void construct_etbl(
+    EnergyTable* const etbl,
+    GrammarGraph const* const graph,
+    WeightTable const* const base
+) {
+    assert(etbl != NULL);
+    assert(isValid_ggraph(graph));
+    assert(base == NULL || isValid_wtbl(base));
+
+    constructUniform_wtbl(etbl->wtbl, graph);
+    etbl->base              = base;
+    etbl->rebuilt_counts    = mem_calloc((size_t)graph->rule_list->len + 1, sizeof(uint32_t));
+    etbl->exp_credits       = mem_calloc((size_t)graph->exp_list->len + 1, sizeof(uint32_t));
+    etbl->n_credited        = 0;
+    etbl->n_rebuilds        = 0;
+    constructEmpty_alist(etbl->stack, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+
+    if (base == NULL) return;
+
+    for (uint32_t rule_id = 0; rule_id < graph->rule_list->len; rule_id++) {
+        RuleTerm const* const rule = get_alist(graph->rule_list, rule_id);
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++)
+            setWeight_wtbl(etbl->wtbl, rule_id, alt_id, getWeight_wtbl(base, rule_id, alt_id));
+    }
+    rebuildAllAliases_wtbl(etbl->wtbl);
+}
+
+/* Walks the decisions like generateSentence_ggraph, without rendering anything. */
+void credit_etbl(
+    EnergyTable* const etbl,
+    GrammarGraph const* const graph,
+    ArrayList const* const seq,
+    uint32_t const n_credits
+) {
+    uint32_t const* decisions = NULL;
+
+    assert(isValid_etbl(etbl));
+    assert(isValid_ggraph(graph));
+    assert(isValid_alist(seq));
+    assert(seq->sz_elem == sizeof(uint32_t));
+
+    if (n_credits == 0 || seq->len == 0) return;
+
+    flush_alist(etbl->stack);
+    push_alist(etbl->stack, &graph->root_rule_id);
+    decisions = getFirst_alist(seq);
+    for (uint32_t i = 0; i < seq->len; i++) {
+        uint32_t const rule_id      = *(uint32_t*)pop_alist(etbl->stack);
+        RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+        uint32_t const exp_id       = *(uint32_t*)get_alist(rule->alt_list, decisions[i]);
+        ExpansionTerm const* exp    = get_alist(graph->exp_list, exp_id);
+        uint32_t n_exps             = 1;
+
+        etbl->exp_credits[exp_id]       += n_credits;
+        etbl->rebuilt_counts[rule_id]   = 0;
+
+        while ((exp++)->has_next) n_exps++;
+        REPEAT(n_exps) {
+            exp--;
+            if (!exp->is_terminal) push_alist(etbl->stack, &(uint32_t){ exp->rt_id });
+        }
+    }
+
+    etbl->n_credited++;
+}
+
+void destruct_etbl(EnergyTable* const etbl) {
+    assert(isValid_etbl(etbl));
+
+    destruct_wtbl(etbl->wtbl);
+    free(etbl->rebuilt_counts);
+    free(etbl->exp_credits);
+    destruct_alist(etbl->stack);
+
+    *etbl = NOT_AN_ETBL;
+}
+
+bool isValid_etbl(EnergyTable const* const etbl) {
+    if (etbl == NULL)                                       return 0;
+    if (!isValid_wtbl(etbl->wtbl))                          return 0;
+    if (etbl->base != NULL && !isValid_wtbl(etbl->base))    return 0;
+    if (etbl->rebuilt_counts == NULL)                       return 0;
+    if (etbl->exp_credits == NULL)                          return 0;
+    if (!isValid_alist(etbl->stack))                        return 0;
+
+    return 1;
+}
+
+size_t memoryUsage_etbl(
+    EnergyTable const* const etbl,
+    GrammarGraph const* const graph
+) {
+    assert(isValid_etbl(etbl));
+    assert(isValid_ggraph(graph));
+    return memoryUsage_wtbl(etbl->wtbl) + MUSAGE_ALIST(etbl->stack)
+         + ((size_t)graph->rule_list->len + 1 + graph->exp_list->len + 1) * sizeof(uint32_t);
+}
+
+void refresh_etbl(
+    EnergyTable* const etbl,
+    Coverage const* const cov,
+    GrammarGraph const* const graph,
+    uint32_t const rule_id
+) {
+    RuleTerm const* rule        = NULL;
+    uint32_t const* p_exp_id    = NULL;
+    uint32_t count              = 0;
+    uint32_t rebuilt_count      = 0;
+    uint32_t min_count          = SZ32_MAX;
+    double max_productivity     = 0.0;
+
+    assert(isValid_etbl(etbl));
+    assert(isValid_cov(cov));
+    assert(isValid_ggraph(graph));
+    assert(cov->n_rules == graph->rule_list->len);
+    assert(rule_id < graph->rule_list->len);
+
+    rule            = get_alist(graph->rule_list, rule_id);
+    count           = cov->rule_counts[rule_id];
+    rebuilt_count   = etbl->rebuilt_counts[rule_id];
+    if (rule->alt_list->len < 2)                                            return;
+    if (count - rebuilt_count < rule->alt_list->len)                        return;
+    if ((double)(count - rebuilt_count) < ETBL_DRIFT_RATIO * rebuilt_count) return;
+
+    p_exp_id = getFirst_alist(rule->alt_list);
+    for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+        uint32_t const alt_count    = cov->exp_counts[p_exp_id[alt_id]];
+        double const productivity   = (1.0 + etbl->exp_credits[p_exp_id[alt_id]]) / (1.0 + alt_count);
+
+        if (alt_count < min_count) min_count = alt_count;
+        if (productivity > max_productivity) max_productivity = productivity;
+    }
+    for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+        double const ratio  = (1.0 + min_count) / (1.0 + cov->exp_counts[p_exp_id[alt_id]]);
+        double energy       = pow(ratio, ETBL_EXPONENT);
+
+        if (etbl->n_credited > 0) {
+            double const productivity =
+                (1.0 + etbl->exp_credits[p_exp_id[alt_id]]) / (1.0 + cov->exp_counts[p_exp_id[alt_id]]);
+            energy *= pow(productivity / max_productivity, ETBL_CREDIT_EXPONENT);
+        }
+
+        if (energy < 1.0 / ETBL_MAX_BOOST) energy = 1.0 / ETBL_MAX_BOOST;
+        if (etbl->base != NULL) energy *= getWeight_wtbl(etbl->base, rule_id, alt_id);
+        setWeight_wtbl(etbl->wtbl, rule_id, alt_id, energy);
+    }
+    rebuildAlias_wtbl(etbl->wtbl, rule_id);
+
+    etbl->rebuilt_counts[rule_id] = count;
+    etbl->n_rebuilds++;
+}
@@ -0,0 +1,465 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "derivationbudget.h"
+#include "executor.h"
+#include "padkit/memalloc.h"
+
+#define EXEC_INPUT_TEMPLATE "/gfuzzer-input-XXXXXX"
+
+static bool attachBitmap(Executor* const executor);
+
+static int classifyStatus(
+    Executor* const executor,
+    int const status,
+    bool const is_timeout
+);
+
+static void execTarget(
+    Executor const* const executor,
+    int const err_fd
+);
+
+static bool openErrorPipe(int err_pipe[2]);
+
+static bool readFully(
+    int const fd,
+    void* const buffer,
+    size_t const sz,
+    int const timeout_ms
+);
+
+static bool reportsExecError(int err_pipe[2]);
+
+static int runCold(Executor* const executor);
+
+static int runForkserver(Executor* const executor);
+
+static bool startForkserver(Executor* const executor);
+
+static bool attachBitmap(Executor* const executor) {
+    void* p = NULL;
+
+    executor->shm_id = shmget(IPC_PRIVATE, EXEC_MAP_SZ, IPC_CREAT | IPC_EXCL | 0600);
+    if (executor->shm_id < 0) return 0;
+
+    p = shmat(executor->shm_id, NULL, 0);
+    if (p == (void*)-1) {
+        shmctl(executor->shm_id, IPC_RMID, NULL);
+        executor->shm_id = -1;
+        return 0;
+    }
+    executor->trace_bits = p;
+    executor->seen_words = mem_calloc(EXEC_MAP_SZ / sizeof(uint64_t), sizeof(uint64_t));
+
+    return 1;
+}
+
+static int classifyStatus(
+    Executor* const executor,
+    int const status,
+    bool const is_timeout
+) {
+    executor->n_execs++;
+    executor->last_status = status;
+
+    if (is_timeout) {
+        executor->n_timeouts++;
+        return EXEC_RUN_TIMEOUT;
+    } else if (WIFSIGNALED(status)) {
+        int const sig = WTERMSIG(status);
+        executor->n_crashes++;
+        if (sig > 0 && sig < EXEC_MAX_SIGNAL) executor->n_crashes_by_signal[sig]++;
+        return EXEC_RUN_CRASH;
+    } else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        executor->n_nonzero_exits++;
+        return EXEC_RUN_NONZERO_EXIT;
+    }
+
+    return EXEC_RUN_OK;
+}
+
+int construct_exec(
+    Executor* const executor,
+    char* const* const target_argv,
+    uint32_t const timeout_ms,
+    bool const uses_bitmap
+) {
+    char const* tmp_dir = getenv("TMPDIR");
+    uint32_t n_args     = 0;
+
+    assert(executor != NULL);
+    assert(target_argv != NULL);
+    assert(timeout_ms > 0);
+
+    *executor = NOT_AN_EXEC;
+    if (target_argv[0] == NULL) return EXEC_CANNOT_START;
+    if (tmp_dir == NULL || tmp_dir[0] == '\0') tmp_dir = "/tmp";
+
+    executor->input_path = mem_alloc(strlen(tmp_dir) + sizeof(EXEC_INPUT_TEMPLATE));
+    strcpy(executor->input_path, tmp_dir);
+    strcat(executor->input_path, EXEC_INPUT_TEMPLATE);
+    executor->input_fd = mkstemp(executor->input_path);
+    if (executor->input_fd < 0) {
+        free(executor->input_path);
+        *executor = NOT_AN_EXEC;
+        return EXEC_CANNOT_START;
+    }
+
+    while (target_argv[n_args] != NULL) n_args++;
+    executor->argv          = mem_calloc(n_args + 1, sizeof(char*));
+    executor->uses_stdin    = 1;
+    for (uint32_t i = 0; i < n_args; i++) {
+        if (strcmp(target_argv[i], EXEC_INPUT_PLACEHOLDER) == 0) {
+            executor->argv[i]       = executor->input_path;
+            executor->uses_stdin    = 0;
+        } else {
+            executor->argv[i]       = target_argv[i];
+        }
+    }
+    executor->timeout_ms = timeout_ms;
+    if (uses_bitmap && !attachBitmap(executor)) {
+        destruct_exec(executor);
+        return EXEC_CANNOT_START;
+    }
+
+    /* A dead forkserver must fail a write, not kill the generator. */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!startForkserver(executor) && executor->last_status == EXIT_FAILURE) {
+        destruct_exec(executor);
+        return EXEC_CANNOT_START;
+    }
+
+    executor->start_ns = monotonicNs_dbudget();
+    return EXEC_OK;
+}
+
+/*
+ * A byte of the bitmap is an edge, so every word of it folds into one bit
+ * per taken edge, and the seen words keep the same bits. Most of the words
+ * of a run are zero, so this takes a few microseconds.
+ */
+uint32_t countNewEdges_exec(Executor* const executor) {
+    uint64_t const bytes_mask   = 0x0101010101010101;
+    uint32_t n_new              = 0;
+
+    assert(isValid_exec(executor));
+    assert(executor->trace_bits != NULL);
+
+    for (uint32_t word_id = 0; word_id < EXEC_MAP_SZ / sizeof(uint64_t); word_id++) {
+        uint64_t word = 0;
+        uint64_t new_bits = 0;
+
+        memcpy(&word, executor->trace_bits + word_id * sizeof(uint64_t), sizeof(uint64_t));
+        if (word == 0) continue;
+
+        word |= word >> 4;
+        word |= word >> 2;
+        word |= word >> 1;
+        word &= bytes_mask;
+        new_bits = word & ~executor->seen_words[word_id];
+        if (new_bits == 0) continue;
+
+        executor->seen_words[word_id] |= new_bits;
+        n_new += (uint32_t)((new_bits * bytes_mask) >> 56);
+    }
+    executor->n_edges += n_new;
+
+    return n_new;
+}
+
+void destruct_exec(Executor* const executor) {
+    assert(isValid_exec(executor));
+
+    if (executor->fsrv_pid > 0) {
+        kill(executor->fsrv_pid, SIGKILL);
+        waitpid(executor->fsrv_pid, NULL, 0);
+        close(executor->ctl_fd);
+        close(executor->st_fd);
+    }
+    if (executor->trace_bits != NULL) {
+        shmdt(executor->trace_bits);
+        shmctl(executor->shm_id, IPC_RMID, NULL);
+        free(executor->seen_words);
+    }
+    close(executor->input_fd);
+    unlink(executor->input_path);
+    free(executor->input_path);
+    free(executor->argv);
+
+    *executor = NOT_AN_EXEC;
+}
+
+/* Never returns. If the target cannot be executed, writes errno to err_fd, which closes on exec otherwise. */
+static void execTarget(
+    Executor const* const executor,
+    int const err_fd
+) {
+    int const null_fd   = open("/dev/null", O_RDWR);
+    int exec_errno      = 0;
+
+    if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (!executor->uses_stdin) dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+    }
+    if (executor->uses_stdin) dup2(executor->input_fd, STDIN_FILENO);
+    close(executor->input_fd);
+
+    /* Sanitizers should abort, so their findings show up as crash signals. */
+    setenv("ASAN_OPTIONS", "abort_on_error=1:symbolize=0:detect_leaks=0", 0);
+    setenv("UBSAN_OPTIONS", "halt_on_error=1:abort_on_error=1:symbolize=0", 0);
+    if (executor->shm_id >= 0) {
+        char shm_id_str[16];
+        sprintf(shm_id_str, "%d", executor->shm_id);
+        setenv(EXEC_SHM_ENV_VAR, shm_id_str, 1);
+    }
+
+    execvp(executor->argv[0], executor->argv);
+    exec_errno = errno;
+    while (write(err_fd, &exec_errno, sizeof(exec_errno)) < 0 && errno == EINTR);
+    _exit(EXIT_FAILURE);
+}
+
+double execsPerSecond_exec(Executor const* const executor) {
+    uint64_t const elapsed_ns = monotonicNs_dbudget() - executor->start_ns;
+    assert(isValid_exec(executor));
+    return (elapsed_ns == 0) ? 0.0 : (double)executor->n_execs * 1e9 / (double)elapsed_ns;
+}
+
+bool isUsingForkserver_exec(Executor const* const executor) {
+    assert(isValid_exec(executor));
+    return executor->fsrv_pid > 0;
+}
+
+/* Both ends close on exec, so a target that starts leaves the pipe empty. */
+static bool openErrorPipe(int err_pipe[2]) {
+    if (pipe(err_pipe) != 0) return 0;
+    if (fcntl(err_pipe[0], F_SETFD, FD_CLOEXEC) != 0 || fcntl(err_pipe[1], F_SETFD, FD_CLOEXEC) != 0) {
+        close(err_pipe[0]);
+        close(err_pipe[1]);
+        return 0;
+    }
+    return 1;
+}
+
+bool isValid_exec(Executor const* const executor) {
+    if (executor == NULL)               return 0;
+    if (executor->argv == NULL)         return 0;
+    if (executor->input_path == NULL)   return 0;
+    if (executor->input_fd < 0)         return 0;
+    if (executor->timeout_ms == 0)      return 0;
+
+    return 1;
+}
+
+/* A negative timeout_ms waits forever. */
+static bool readFully(
+    int const fd,
+    void* const buffer,
+    size_t const sz,
+    int const timeout_ms
+) {
+    char* p             = buffer;
+    size_t n_left       = sz;
+    struct pollfd pfd   = { fd, POLLIN, 0 };
+
+    while (n_left > 0) {
+        ssize_t n_read  = 0;
+        int const res   = poll(&pfd, 1, timeout_ms);
+
+        if (res < 0 && errno == EINTR)  continue;
+        if (res <= 0)                   return 0;
+
+        n_read = read(fd, p, n_left);
+        if (n_read < 0 && errno == EINTR)   continue;
+        if (n_read <= 0)                    return 0;
+        p       += n_read;
+        n_left  -= (size_t)n_read;
+    }
+
+    return 1;
+}
+
+/* Called by the parent after the fork, waits for the child to exec or to report why it could not. */
+static bool reportsExecError(int err_pipe[2]) {
+    int exec_errno  = 0;
+    bool is_error   = 0;
+
+    close(err_pipe[1]);
+    is_error = readFully(err_pipe[0], &exec_errno, sizeof(exec_errno), -1);
+    close(err_pipe[0]);
+
+    return is_error;
+}
+
+int run_exec(
+    Executor* const executor,
+    void const* const data,
+    uint32_t const sz
+) {
+    char const* p   = data;
+    size_t n_left   = sz;
+
+    assert(isValid_exec(executor));
+    assert(data != NULL || sz == 0);
+
+    if (lseek(executor->input_fd, 0, SEEK_SET) != 0)   return EXEC_RUN_ERROR;
+    while (n_left > 0) {
+        ssize_t const n_written = write(executor->input_fd, p, n_left);
+        if (n_written < 0 && errno == EINTR)    continue;
+        if (n_written <= 0)                     return EXEC_RUN_ERROR;
+        p       += n_written;
+        n_left  -= (size_t)n_written;
+    }
+    if (ftruncate(executor->input_fd, (off_t)sz) != 0)  return EXEC_RUN_ERROR;
+    if (lseek(executor->input_fd, 0, SEEK_SET) != 0)   return EXEC_RUN_ERROR;
+    if (executor->trace_bits != NULL) memset(executor->trace_bits, 0, EXEC_MAP_SZ);
+
+    return (executor->fsrv_pid > 0) ? runForkserver(executor) : runCold(executor);
+}
+
+/* Polls waitpid with a growing sleep, so short runs finish in microseconds. */
+static int runCold(Executor* const executor) {
+    uint64_t const deadline_ns  = monotonicNs_dbudget() + (uint64_t)executor->timeout_ms * 1000000;
+    struct timespec nap         = { 0, 1000 };
+    int status                  = 0;
+    int err_pipe[2]             = { -1, -1 };
+    pid_t pid                   = -1;
+
+    if (!openErrorPipe(err_pipe)) return EXEC_RUN_ERROR;
+    pid = fork();
+    if (pid < 0) {
+        close(err_pipe[0]);
+        close(err_pipe[1]);
+        return EXEC_RUN_ERROR;
+    }
+    if (pid == 0) {
+        close(err_pipe[0]);
+        execTarget(executor, err_pipe[1]);
+    }
+    if (reportsExecError(err_pipe)) {
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+        return EXEC_RUN_ERROR;
+    }
+
+    for (;;) {
+        pid_t const res = waitpid(pid, &status, WNOHANG);
+        if (res == pid)                             return classifyStatus(executor, status, 0);
+        if (res < 0 && errno != EINTR)              return EXEC_RUN_ERROR;
+        if (monotonicNs_dbudget() >= deadline_ns)   break;
+
+        nanosleep(&nap, NULL);
+        if (nap.tv_nsec < 1000000) nap.tv_nsec *= 2;
+    }
+
+    kill(pid, SIGKILL);
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    return classifyStatus(executor, status, 1);
+}
+
+/* The classic AFL protocol: send the was-killed flag, get the child pid, then its wait status. */
+static int runForkserver(Executor* const executor) {
+    int32_t const was_killed    = executor->was_killed;
+    int32_t child_pid           = 0;
+    int32_t status              = 0;
+    bool is_timeout             = 0;
+
+    executor->was_killed = 0;
+    if (write(executor->ctl_fd, &was_killed, sizeof(was_killed)) != sizeof(was_killed))
+        return EXEC_RUN_ERROR;
+    if (!readFully(executor->st_fd, &child_pid, sizeof(child_pid), -1) || child_pid <= 0)
+        return EXEC_RUN_ERROR;
+
+    if (!readFully(executor->st_fd, &status, sizeof(status), (int)executor->timeout_ms)) {
+        is_timeout              = 1;
+        executor->was_killed    = 1;
+        kill(child_pid, SIGKILL);
+        if (!readFully(executor->st_fd, &status, sizeof(status), -1)) return EXEC_RUN_ERROR;
+    }
+
+    return classifyStatus(executor, status, is_timeout);
+}
+
+/*
+ * Launches the target with the forkserver pipes, and keeps it if it says
+ * hello in time. Otherwise, the target is not instrumented, and runs cold.
+ * Sets last_status to EXIT_FAILURE if the target cannot be executed at all.
+ */
+static bool startForkserver(Executor* const executor) {
+    int ctl_pipe[2] = { -1, -1 };
+    int st_pipe[2]  = { -1, -1 };
+    int err_pipe[2] = { -1, -1 };
+    int32_t hello   = 0;
+    int status      = 0;
+    pid_t pid       = -1;
+
+    if (pipe(ctl_pipe) != 0) return 0;
+    if (pipe(st_pipe) != 0) {
+        close(ctl_pipe[0]);
+        close(ctl_pipe[1]);
+        return 0;
+    }
+    if (!openErrorPipe(err_pipe)) {
+        close(ctl_pipe[0]);
+        close(ctl_pipe[1]);
+        close(st_pipe[0]);
+        close(st_pipe[1]);
+        return 0;
+    }
+
+    pid = fork();
+    if (pid < 0) {
+        close(ctl_pipe[0]);
+        close(ctl_pipe[1]);
+        close(st_pipe[0]);
+        close(st_pipe[1]);
+        close(err_pipe[0]);
+        close(err_pipe[1]);
+        return 0;
+    }
+    if (pid == 0) {
+        if (dup2(ctl_pipe[0], EXEC_FORKSRV_FD) < 0 || dup2(st_pipe[1], EXEC_FORKSRV_FD + 1) < 0)
+            _exit(EXIT_FAILURE);
+        close(ctl_pipe[0]);
+        close(ctl_pipe[1]);
+        close(st_pipe[0]);
+        close(st_pipe[1]);
+        close(err_pipe[0]);
+        execTarget(executor, err_pipe[1]);
+    }
+    close(ctl_pipe[0]);
+    close(st_pipe[1]);
+
+    if (reportsExecError(err_pipe)) {
+        close(ctl_pipe[1]);
+        close(st_pipe[0]);
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+        executor->last_status = EXIT_FAILURE;
+        return 0;
+    }
+    if (readFully(st_pipe[0], &hello, sizeof(hello), EXEC_HANDSHAKE_MS)) {
+        executor->fsrv_pid  = pid;
+        executor->ctl_fd    = ctl_pipe[1];
+        executor->st_fd     = st_pipe[0];
+        return 1;
+    }
+
+    close(ctl_pipe[1]);
+    close(st_pipe[0]);
+    kill(pid, SIGKILL);
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    return 0;
+}
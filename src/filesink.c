@@ -0,0 +1,421 @@
+#define _POSIX_C_SOURCE 200809L
+#ifdef __linux__
+    #define _DEFAULT_SOURCE
+#endif
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "filesink.h"
+#include "padkit/memalloc.h"
+
+#if defined(__linux__) && !defined(FSINK_NO_IO_URING)
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #define FSINK_HAS_IO_URING
+#endif
+
+#define FSINK_FILE_FLAGS    (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC)
+#define FSINK_FILE_MODE     (0644)
+#define FSINK_DIR_MODE      (0755)
+#define FSINK_RING_LEN      (2 * FSINK_BATCH_LEN)
+#define FSINK_NO_RESULT     (INT_MIN)
+
+#ifdef FSINK_HAS_IO_URING
+    struct FileSinkRingBody {
+        int                     ring_fd;
+        void*                   sq_ptr;
+        size_t                  sq_sz;
+        void*                   cq_ptr;
+        size_t                  cq_sz;
+        struct io_uring_sqe*    sqes;
+        size_t                  sqes_sz;
+        unsigned*               sq_tail;
+        unsigned*               sq_mask;
+        unsigned*               sq_array;
+        unsigned*               cq_head;
+        unsigned*               cq_tail;
+        unsigned*               cq_mask;
+        struct io_uring_cqe*    cqes;
+        int                     results[FSINK_RING_LEN];
+    };
+
+    static void destructRing(struct FileSinkRingBody* const ring);
+
+    static int flushRing(FileSink* const sink);
+
+    static struct io_uring_sqe* nextSqe(
+        struct FileSinkRingBody* const ring,
+        unsigned const sqe_id
+    );
+
+    static bool runRing(
+        struct FileSinkRingBody* const ring,
+        unsigned const n_sqes
+    );
+
+    static struct FileSinkRingBody* setupRing(void);
+#endif
+
+static void flushSync(FileSink* const sink);
+
+static uint64_t hashContents(
+    void const* const data,
+    uint32_t const sz
+);
+
+int construct_fsink(
+    FileSink* const sink,
+    char const* const dir_path,
+    uint32_t const files_per_dir,
+    uint32_t const n_expected
+) {
+    assert(sink != NULL);
+    assert(dir_path != NULL);
+
+    *sink = NOT_A_FSINK;
+    if (mkdir(dir_path, FSINK_DIR_MODE) != 0 && errno != EEXIST)    return FSINK_CANNOT_OPEN;
+    sink->dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (sink->dir_fd < 0)                                           return FSINK_CANNOT_OPEN;
+
+    sink->files_per_dir = files_per_dir;
+    if (files_per_dir > 0) {
+        while (
+            sink->subdir_bits < FSINK_MAX_SUBDIR_BITS &&
+            ((uint64_t)files_per_dir << sink->subdir_bits) < n_expected
+        ) sink->subdir_bits++;
+        sink->made_subdirs = mem_calloc(((size_t)1 << sink->subdir_bits) / 8 + 1, 1);
+    }
+    sink->paths         = mem_alloc(FSINK_BATCH_LEN * sizeof(*(sink->paths)));
+    constructEmpty_chunk(sink->contents, CHUNK_RECOMMENDED_PARAMETERS);
+    #ifdef FSINK_HAS_IO_URING
+        sink->ring = setupRing();
+    #endif
+
+    return FSINK_OK;
+}
+
+int destruct_fsink(FileSink* const sink) {
+    int const flush_res = flush_fsink(sink);
+
+    #ifdef FSINK_HAS_IO_URING
+        if (sink->ring != NULL) destructRing(sink->ring);
+    #endif
+    close(sink->dir_fd);
+    free(sink->paths);
+    free(sink->made_subdirs);
+    destruct_chunk(sink->contents);
+
+    *sink = NOT_A_FSINK;
+    return flush_res;
+}
+
+#ifdef FSINK_HAS_IO_URING
+    static void destructRing(struct FileSinkRingBody* const ring) {
+        munmap(ring->sqes, ring->sqes_sz);
+        if (ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_sz);
+        munmap(ring->sq_ptr, ring->sq_sz);
+        close(ring->ring_fd);
+        free(ring);
+    }
+#endif
+
+int flush_fsink(FileSink* const sink) {
+    assert(isValid_fsink(sink));
+
+    if (sink->n_pending > 0) {
+        #ifdef FSINK_HAS_IO_URING
+            if (sink->ring == NULL || flushRing(sink) != FSINK_OK)
+                flushSync(sink);
+        #else
+            flushSync(sink);
+        #endif
+        sink->n_pending = 0;
+        flush_chunk(sink->contents);
+    }
+
+    return (sink->n_failed == 0) ? FSINK_OK : FSINK_CANNOT_WRITE;
+}
+
+#ifdef FSINK_HAS_IO_URING
+    /*
+     * Opens the whole batch in one submission, then writes and closes it in
+     * another. Every close hard-links to its write, so it runs even if the
+     * write fails. A kernel without these opcodes turns the ring off, after
+     * closing every file the batch opened and did not close yet.
+     */
+    static int flushRing(FileSink* const sink) {
+        struct FileSinkRingBody* const ring = sink->ring;
+        int fds[FSINK_BATCH_LEN];
+        unsigned n_sqes                     = 0;
+
+        for (uint32_t i = 0; i < sink->n_pending; i++) {
+            struct io_uring_sqe* const sqe = nextSqe(ring, n_sqes++);
+            sqe->opcode         = IORING_OP_OPENAT;
+            sqe->fd             = sink->dir_fd;
+            sqe->addr           = (uint64_t)(uintptr_t)sink->paths[i];
+            sqe->len            = FSINK_FILE_MODE;
+            sqe->open_flags     = FSINK_FILE_FLAGS;
+            sqe->user_data      = i;
+        }
+        if (!runRing(ring, n_sqes)) {
+            for (uint32_t i = 0; i < sink->n_pending; i++)
+                if (ring->results[i] >= 0) close(ring->results[i]);
+            destructRing(ring);
+            sink->ring = NULL;
+            return FSINK_CANNOT_WRITE;
+        }
+        for (uint32_t i = 0; i < sink->n_pending; i++) {
+            fds[i] = ring->results[i];
+            if (fds[i] != -EINVAL) continue;
+
+            for (uint32_t j = 0; j < sink->n_pending; j++)
+                if (ring->results[j] >= 0) close(ring->results[j]);
+            destructRing(ring);
+            sink->ring = NULL;
+            return FSINK_CANNOT_WRITE;
+        }
+
+        n_sqes = 0;
+        for (uint32_t i = 0; i < sink->n_pending; i++) {
+            Item const contents         = get_chunk(sink->contents, i);
+            struct io_uring_sqe* sqe    = NULL;
+
+            if (fds[i] < 0) {
+                sink->n_failed++;
+                continue;
+            }
+
+            sqe             = nextSqe(ring, n_sqes++);
+            sqe->opcode     = IORING_OP_WRITE;
+            sqe->flags      = IOSQE_IO_HARDLINK;
+            sqe->fd         = fds[i];
+            sqe->addr       = (uint64_t)(uintptr_t)contents.p;
+            sqe->len        = contents.sz;
+            sqe->user_data  = 2 * i;
+
+            sqe             = nextSqe(ring, n_sqes++);
+            sqe->opcode     = IORING_OP_CLOSE;
+            sqe->fd         = fds[i];
+            sqe->user_data  = 2 * i + 1;
+        }
+        if (!runRing(ring, n_sqes)) {
+            for (uint32_t i = 0; i < sink->n_pending; i++)
+                if (fds[i] >= 0 && ring->results[2 * i + 1] == FSINK_NO_RESULT) close(fds[i]);
+            destructRing(ring);
+            sink->ring = NULL;
+            return FSINK_CANNOT_WRITE;
+        }
+        for (uint32_t i = 0; i < sink->n_pending; i++) {
+            Item const contents = get_chunk(sink->contents, i);
+            if (fds[i] < 0) continue;
+            if (ring->results[2 * i] != (int)contents.sz || ring->results[2 * i + 1] != 0)
+                sink->n_failed++;
+        }
+
+        return FSINK_OK;
+    }
+#endif
+
+static void flushSync(FileSink* const sink) {
+    for (uint32_t i = 0; i < sink->n_pending; i++) {
+        Item const contents = get_chunk(sink->contents, i);
+        char const* p       = contents.p;
+        size_t n_left       = contents.sz;
+        int const fd        = openat(sink->dir_fd, sink->paths[i], FSINK_FILE_FLAGS, FSINK_FILE_MODE);
+
+        if (fd < 0) {
+            sink->n_failed++;
+            continue;
+        }
+        while (n_left > 0) {
+            ssize_t const n_written = write(fd, p, n_left);
+            if (n_written < 0 && errno == EINTR) continue;
+            if (n_written <= 0) break;
+            p       += n_written;
+            n_left  -= (size_t)n_written;
+        }
+        if (close(fd) != 0 || n_left > 0) sink->n_failed++;
+    }
+}
+
+/* 64-bit FNV-1a */
+static uint64_t hashContents(
+    void const* const data,
+    uint32_t const sz
+) {
+    unsigned char const* p  = data;
+    uint64_t hash           = 0xCBF29CE484222325;
+
+    for (uint32_t i = 0; i < sz; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001B3;
+    }
+
+    return hash;
+}
+
+bool isUsingRing_fsink(FileSink const* const sink) {
+    assert(isValid_fsink(sink));
+    return sink->ring != NULL;
+}
+
+bool isValid_fsink(FileSink const* const sink) {
+    if (sink == NULL)                                               return 0;
+    if (sink->dir_fd < 0)                                           return 0;
+    if (sink->paths == NULL)                                        return 0;
+    if (!isValid_chunk(sink->contents))                             return 0;
+    if (sink->n_pending > FSINK_BATCH_LEN)                          return 0;
+    if (sink->files_per_dir > 0 && sink->made_subdirs == NULL)      return 0;
+
+    return 1;
+}
+
+#ifdef FSINK_HAS_IO_URING
+    static struct io_uring_sqe* nextSqe(
+        struct FileSinkRingBody* const ring,
+        unsigned const sqe_id
+    ) {
+        struct io_uring_sqe* const sqe = ring->sqes + sqe_id;
+        memset(sqe, 0, sizeof(struct io_uring_sqe));
+        return sqe;
+    }
+
+    /*
+     * Submits sqes[0 .. n_sqes) and waits until all of them complete, results
+     * go by user_data. A failure leaves FSINK_NO_RESULT where none came back.
+     */
+    static bool runRing(
+        struct FileSinkRingBody* const ring,
+        unsigned const n_sqes
+    ) {
+        unsigned tail       = *(ring->sq_tail);
+        unsigned n_done     = 0;
+        unsigned n_queued   = 0;
+
+        for (unsigned i = 0; i < FSINK_RING_LEN; i++) ring->results[i] = FSINK_NO_RESULT;
+        for (unsigned i = 0; i < n_sqes; i++, tail++)
+            ring->sq_array[tail & *(ring->sq_mask)] = i;
+        __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+        while (n_done < n_sqes) {
+            long const n_submitted = syscall(
+                __NR_io_uring_enter, ring->ring_fd, n_sqes - n_queued, 1, IORING_ENTER_GETEVENTS, NULL, 0
+            );
+            unsigned head = *(ring->cq_head);
+
+            if (n_submitted < 0) {
+                if (errno == EINTR) continue;
+                return 0;
+            }
+            n_queued += (unsigned)n_submitted;
+
+            while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+                struct io_uring_cqe const* const cqe = ring->cqes + (head & *(ring->cq_mask));
+                ring->results[cqe->user_data] = cqe->res;
+                head++;
+                n_done++;
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        return 1;
+    }
+
+    /* Returns NULL if the kernel or a sandbox refuses io_uring. */
+    static struct FileSinkRingBody* setupRing(void) {
+        struct io_uring_params params;
+        struct FileSinkRingBody* const ring = mem_calloc(1, sizeof(struct FileSinkRingBody));
+
+        memset(&params, 0, sizeof(params));
+        ring->ring_fd = (int)syscall(__NR_io_uring_setup, FSINK_RING_LEN, &params);
+        if (ring->ring_fd < 0) {
+            free(ring);
+            return NULL;
+        }
+
+        ring->sq_sz     = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring->cq_sz     = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        ring->sqes_sz   = params.sq_entries * sizeof(struct io_uring_sqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            if (ring->cq_sz > ring->sq_sz) ring->sq_sz = ring->cq_sz;
+            ring->cq_sz = ring->sq_sz;
+        }
+
+        ring->sq_ptr = mmap(NULL, ring->sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED, ring->ring_fd, IORING_OFF_SQ_RING);
+        if (ring->sq_ptr == MAP_FAILED) {
+            close(ring->ring_fd);
+            free(ring);
+            return NULL;
+        }
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            ring->cq_ptr = ring->sq_ptr;
+        } else {
+            ring->cq_ptr = mmap(NULL, ring->cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED, ring->ring_fd, IORING_OFF_CQ_RING);
+            if (ring->cq_ptr == MAP_FAILED) {
+                munmap(ring->sq_ptr, ring->sq_sz);
+                close(ring->ring_fd);
+                free(ring);
+                return NULL;
+            }
+        }
+        ring->sqes = mmap(NULL, ring->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED, ring->ring_fd, IORING_OFF_SQES);
+        if (ring->sqes == MAP_FAILED) {
+            if (ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_sz);
+            munmap(ring->sq_ptr, ring->sq_sz);
+            close(ring->ring_fd);
+            free(ring);
+            return NULL;
+        }
+
+        ring->sq_tail   = (unsigned*)((char*)ring->sq_ptr + params.sq_off.tail);
+        ring->sq_mask   = (unsigned*)((char*)ring->sq_ptr + params.sq_off.ring_mask);
+        ring->sq_array  = (unsigned*)((char*)ring->sq_ptr + params.sq_off.array);
+        ring->cq_head   = (unsigned*)((char*)ring->cq_ptr + params.cq_off.head);
+        ring->cq_tail   = (unsigned*)((char*)ring->cq_ptr + params.cq_off.tail);
+        ring->cq_mask   = (unsigned*)((char*)ring->cq_ptr + params.cq_off.ring_mask);
+        ring->cqes      = (struct io_uring_cqe*)((char*)ring->cq_ptr + params.cq_off.cqes);
+
+        return ring;
+    }
+#endif
+
+int write_fsink(
+    FileSink* const sink,
+    void const* const data,
+    uint32_t const sz
+) {
+    uint64_t const hash = hashContents(data, sz);
+    char* const path    = sink->paths[sink->n_pending];
+
+    assert(isValid_fsink(sink));
+    assert(data != NULL || sz == 0);
+
+    if (sink->files_per_dir == 0) {
+        snprintf(path, FSINK_MAX_LEN_PATH, "%016"PRIx64, hash);
+    } else {
+        uint32_t const subdir_id = (sink->subdir_bits == 0) ? 0 : (uint32_t)(hash >> (64 - sink->subdir_bits));
+        snprintf(path, FSINK_MAX_LEN_PATH, "%04"PRIx32, subdir_id);
+        if (!(sink->made_subdirs[subdir_id / 8] & (1 << (subdir_id % 8)))) {
+            if (mkdirat(sink->dir_fd, path, FSINK_DIR_MODE) != 0 && errno != EEXIST) {
+                sink->n_failed++;
+                return FSINK_CANNOT_WRITE;
+            }
+            sink->made_subdirs[subdir_id / 8] |= (unsigned char)(1 << (subdir_id % 8));
+        }
+        snprintf(path, FSINK_MAX_LEN_PATH, "%04"PRIx32"/%016"PRIx64, subdir_id, hash);
+    }
+
+    add_chunk(sink->contents, data, sz);
+    sink->n_files++;
+    if (++sink->n_pending == FSINK_BATCH_LEN)
+        return flush_fsink(sink);
+    else
+        return (sink->n_failed == 0) ? FSINK_OK : FSINK_CANNOT_WRITE;
+}
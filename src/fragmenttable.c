@@ -0,0 +1,481 @@
+#include <assert.h>
+#include <inttypes.h>
+#include "fragmenttable.h"
+#include "memoryusage.h"
+#include "padkit/invalid.h"
+#include "padkit/memalloc.h"
+#include "padkit/repeat.h"
+#include "padkit/verbose.h"
+
+/*
+ * Enumerates the derivations of a rule in the order of their decisions.
+ * pending is a stack of the exp ids left to generate, and hit_list and
+ * byte_list hold what the derivation so far covered and rendered.
+ */
+typedef struct TrieBuilderBody {
+    FragmentTable*      ftbl;
+    GrammarGraph const* graph;
+    ArrayList           pending[1];
+    ArrayList           hit_list[1];
+    ArrayList           byte_list[1];
+    uint32_t            sz;
+} TrieBuilder;
+
+static uint32_t addFragment(TrieBuilder* const builder);
+
+static uint32_t addNode(
+    TrieBuilder* const builder,
+    uint32_t const rule_id,
+    uint32_t const bottom,
+    uint32_t const top
+);
+
+static void appendFragment(
+    Chunk* const str_builder,
+    Coverage* const cov,
+    FragmentTable const* const ftbl,
+    uint32_t const frag_id
+);
+
+static bool buildTrie(
+    TrieBuilder* const builder,
+    uint32_t const rule_id
+);
+
+static uint32_t continueDerivation(
+    TrieBuilder* const builder,
+    uint32_t const bottom,
+    uint32_t top
+);
+
+static void countDerivations(
+    uint32_t* const n_derivations,
+    GrammarGraph const* const graph
+);
+
+static void shrink(
+    ArrayList* const list,
+    uint32_t const len
+);
+
+/* Returns FTBL_LEAF | fragment id, or INVALID_UINT32 past FTBL_MAX_RULE_SZ. */
+static uint32_t addFragment(TrieBuilder* const builder) {
+    FragmentTable* const ftbl   = builder->ftbl;
+    Fragment* frag              = NULL;
+
+    builder->sz += builder->byte_list->len;
+    builder->sz += builder->hit_list->len * (uint32_t)sizeof(uint32_t);
+    builder->sz += (uint32_t)sizeof(Fragment);
+    if (builder->sz > FTBL_MAX_RULE_SZ) return INVALID_UINT32;
+
+    if (builder->byte_list->len == 0)
+        addIndeterminate_chunk(ftbl->fragments, 0);
+    else
+        add_chunk(ftbl->fragments, getFirst_alist(builder->byte_list), builder->byte_list->len);
+
+    frag                = addIndeterminate_alist(ftbl->frag_list);
+    frag->hit_offset    = ftbl->hit_list->len;
+    frag->n_hits        = builder->hit_list->len;
+    for (uint32_t i = 0; i < builder->hit_list->len; i++)
+        add_alist(ftbl->hit_list, get_alist(builder->hit_list, i));
+
+    return FTBL_LEAF | (ftbl->frag_list->len - 1);
+}
+
+/*
+ * Adds the node of the decision of rule_id, with pending[bottom .. top) to
+ * generate after it. Every alternative continues on a copy of them past the
+ * end of pending, so the nodes below never overwrite what the others need.
+ */
+static uint32_t addNode(
+    TrieBuilder* const builder,
+    uint32_t const rule_id,
+    uint32_t const bottom,
+    uint32_t const top
+) {
+    FragmentTable* const ftbl   = builder->ftbl;
+    RuleTerm const* const rule  = get_alist(builder->graph->rule_list, rule_id);
+    uint32_t const n_alts       = rule->alt_list->len;
+    uint32_t const node         = ftbl->trie_list->len;
+    uint32_t const frame        = builder->pending->len;
+
+    builder->sz += n_alts * (uint32_t)sizeof(uint32_t);
+    if (builder->sz > FTBL_MAX_RULE_SZ) return INVALID_UINT32;
+
+    REPEAT(n_alts) add_alist(ftbl->trie_list, &(uint32_t){ INVALID_UINT32 });
+
+    for (uint32_t alt_id = 0; alt_id < n_alts; alt_id++) {
+        uint32_t const n_hits   = builder->hit_list->len;
+        uint32_t const n_bytes  = builder->byte_list->len;
+        uint32_t exp_id         = *(uint32_t*)get_alist(rule->alt_list, alt_id);
+        uint32_t n_exps         = 1;
+        uint32_t slot           = 0;
+
+        while (((ExpansionTerm*)get_alist(builder->graph->exp_list, exp_id++))->has_next) n_exps++;
+
+        shrink(builder->pending, frame);
+        for (uint32_t i = bottom; i < top; i++)
+            add_alist(builder->pending, &(uint32_t){ *(uint32_t*)get_alist(builder->pending, i) });
+        REPEAT(n_exps) { exp_id--; add_alist(builder->pending, &exp_id); }
+
+        slot = continueDerivation(builder, frame, builder->pending->len);
+        shrink(builder->hit_list, n_hits);
+        shrink(builder->byte_list, n_bytes);
+        if (slot == INVALID_UINT32) return INVALID_UINT32;
+
+        *(uint32_t*)get_alist(ftbl->trie_list, node + alt_id) = slot;
+    }
+    shrink(builder->pending, frame);
+
+    return node;
+}
+
+static void appendFragment(
+    Chunk* const str_builder,
+    Coverage* const cov,
+    FragmentTable const* const ftbl,
+    uint32_t const frag_id
+) {
+    Item const bytes = get_chunk(ftbl->fragments, frag_id);
+
+    appendLast_chunk(str_builder, bytes.p, bytes.sz);
+
+    if (cov != NULL) {
+        Fragment const* const frag  = get_alist(ftbl->frag_list, frag_id);
+        uint32_t const* hit         = NULL;
+        if (frag->n_hits == 0) return;
+
+        hit = get_alist(ftbl->hit_list, frag->hit_offset);
+        REPEAT(frag->n_hits) {
+            if (FTBL_HIT_IS_RULE(*hit))
+                hitRule_cov(cov, FTBL_HIT_ID(*hit));
+            else
+                hitExp_cov(cov, FTBL_HIT_ID(*hit));
+            hit++;
+        }
+    }
+}
+
+/* Leaves the table as it was if the trie of rule_id gets larger than FTBL_MAX_RULE_SZ. */
+static bool buildTrie(
+    TrieBuilder* const builder,
+    uint32_t const rule_id
+) {
+    FragmentTable* const ftbl   = builder->ftbl;
+    uint32_t const n_fragments  = LEN_CHUNK(ftbl->fragments);
+    uint32_t const n_frags      = ftbl->frag_list->len;
+    uint32_t const n_hits       = ftbl->hit_list->len;
+    uint32_t const n_slots      = ftbl->trie_list->len;
+    uint32_t node               = 0;
+
+    builder->sz = 0;
+    flush_alist(builder->pending);
+    flush_alist(builder->hit_list);
+    flush_alist(builder->byte_list);
+
+    node = addNode(builder, rule_id, 0, 0);
+    if (node != INVALID_UINT32) {
+        ftbl->rule_tries[rule_id] = node;
+        return 1;
+    }
+
+    REPEAT(LEN_CHUNK(ftbl->fragments) - n_fragments) deleteLast_chunk(ftbl->fragments);
+    shrink(ftbl->frag_list, n_frags);
+    shrink(ftbl->hit_list, n_hits);
+    shrink(ftbl->trie_list, n_slots);
+
+    return 0;
+}
+
+void construct_ftbl(
+    FragmentTable* const ftbl,
+    GrammarGraph const* const graph
+) {
+    uint32_t const n_rules          = graph->rule_list->len;
+    uint32_t const n_exps           = graph->exp_list->len;
+    uint32_t* const n_derivations   = mem_alloc(((size_t)n_rules + 1) * sizeof(uint32_t));
+    bool* const is_queued           = mem_calloc((size_t)n_rules + 1, sizeof(bool));
+    uint32_t* const stack           = mem_alloc(((size_t)n_rules + 1) * sizeof(uint32_t));
+    uint32_t n_stack                = 0;
+    uint32_t n_tries                = 0;
+    TrieBuilder builder[1]          = {{ ftbl, graph, { NOT_AN_ALIST }, { NOT_AN_ALIST }, { NOT_AN_ALIST }, 0 }};
+
+    assert(ftbl != NULL);
+    assert(isValid_ggraph(graph));
+
+    constructEmpty_chunk(ftbl->fragments, CHUNK_RECOMMENDED_PARAMETERS);
+    constructEmpty_alist(ftbl->frag_list, sizeof(Fragment), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(ftbl->hit_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(ftbl->trie_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    ftbl->rule_tries    = mem_alloc(((size_t)n_rules + 1) * sizeof(uint32_t));
+    ftbl->exp_frags     = mem_alloc(((size_t)n_exps + 1) * sizeof(uint32_t));
+    ftbl->n_rules       = n_rules;
+    ftbl->n_exps        = n_exps;
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++)
+        ftbl->rule_tries[rule_id] = INVALID_UINT32;
+    for (uint32_t exp_id = 0; exp_id < n_exps; exp_id++)
+        ftbl->exp_frags[exp_id] = INVALID_UINT32;
+
+    constructEmpty_alist(builder->pending, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(builder->hit_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(builder->byte_list, sizeof(char), ALIST_RECOMMENDED_INITIAL_CAP);
+
+    countDerivations(n_derivations, graph);
+
+    /* A finite rule needs a trie of its own only if nothing above it renders it. */
+    if (n_derivations[graph->root_rule_id] != INVALID_UINT32) {
+        is_queued[graph->root_rule_id]  = 1;
+        stack[n_stack++]                = graph->root_rule_id;
+    }
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+        RuleTerm const* const rule = get_alist(graph->rule_list, rule_id);
+        if (n_derivations[rule_id] != INVALID_UINT32) continue;
+
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+            uint32_t exp_id             = *(uint32_t*)get_alist(rule->alt_list, alt_id);
+            ExpansionTerm const* exp    = NULL;
+            do {
+                exp = get_alist(graph->exp_list, exp_id++);
+                if (exp->is_terminal || is_queued[exp->rt_id]) continue;
+                if (n_derivations[exp->rt_id] == INVALID_UINT32) continue;
+
+                is_queued[exp->rt_id]   = 1;
+                stack[n_stack++]        = exp->rt_id;
+            } while (exp->has_next);
+        }
+    }
+    while (n_stack > 0) {
+        uint32_t const rule_id = stack[--n_stack];
+        if (buildTrie(builder, rule_id)) {
+            n_tries++;
+        } else {
+            RuleTerm const* const rule = get_alist(graph->rule_list, rule_id);
+            for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+                uint32_t exp_id             = *(uint32_t*)get_alist(rule->alt_list, alt_id);
+                ExpansionTerm const* exp    = NULL;
+                do {
+                    exp = get_alist(graph->exp_list, exp_id++);
+                    if (exp->is_terminal || is_queued[exp->rt_id]) continue;
+
+                    is_queued[exp->rt_id]   = 1;
+                    stack[n_stack++]        = exp->rt_id;
+                } while (exp->has_next);
+            }
+        }
+    }
+
+    /* The alternatives of two or more terminals that no trie renders. */
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+        RuleTerm const* const rule = get_alist(graph->rule_list, rule_id);
+        if (ftbl->rule_tries[rule_id] != INVALID_UINT32) continue;
+
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+            uint32_t const first_exp_id = *(uint32_t*)get_alist(rule->alt_list, alt_id);
+            uint32_t exp_id             = first_exp_id;
+            ExpansionTerm const* exp    = NULL;
+            Fragment* frag              = NULL;
+
+            do { exp = get_alist(graph->exp_list, exp_id++); } while (exp->is_terminal && exp->has_next);
+            if (!exp->is_terminal || exp_id - first_exp_id < 2) continue;
+
+            addIndeterminate_chunk(ftbl->fragments, 0);
+            frag                = addIndeterminate_alist(ftbl->frag_list);
+            frag->hit_offset    = ftbl->hit_list->len;
+            frag->n_hits        = exp_id - first_exp_id;
+            for (exp_id = first_exp_id; exp_id < first_exp_id + frag->n_hits; exp_id++) {
+                Item const terminal = get_chunk(graph->terminals, ((ExpansionTerm*)get_alist(graph->exp_list, exp_id))->rt_id);
+                appendLast_chunk(ftbl->fragments, terminal.p, terminal.sz);
+                add_alist(ftbl->hit_list, &(uint32_t){ FTBL_HIT(exp_id, 0) });
+            }
+            ftbl->exp_frags[first_exp_id] = ftbl->frag_list->len - 1;
+        }
+    }
+
+    fprintf_verbose(stderr, "# Rules Rendered by Tries = %"PRIu32, n_tries);
+    fprintf_verbose(stderr, "# Render Fragments = %"PRIu32, ftbl->frag_list->len);
+
+    destruct_alist(builder->pending);
+    destruct_alist(builder->hit_list);
+    destruct_alist(builder->byte_list);
+    free(n_derivations);
+    free(is_queued);
+    free(stack);
+}
+
+/* Generates pending[bottom .. top) up to the next decision. */
+static uint32_t continueDerivation(
+    TrieBuilder* const builder,
+    uint32_t const bottom,
+    uint32_t top
+) {
+    GrammarGraph const* const graph = builder->graph;
+
+    while (top > bottom) {
+        uint32_t const exp_id           = *(uint32_t*)get_alist(builder->pending, --top);
+        ExpansionTerm const* const exp  = get_alist(graph->exp_list, exp_id);
+
+        add_alist(builder->hit_list, &(uint32_t){ FTBL_HIT(exp_id, 0) });
+        if (exp->is_terminal) {
+            Item const terminal = get_chunk(graph->terminals, exp->rt_id);
+            char const* byte    = terminal.p;
+            REPEAT(terminal.sz) add_alist(builder->byte_list, byte++);
+        } else {
+            add_alist(builder->hit_list, &(uint32_t){ FTBL_HIT(exp->rt_id, 1) });
+            return addNode(builder, exp->rt_id, bottom, top);
+        }
+    }
+
+    return addFragment(builder);
+}
+
+/*
+ * n_derivations[rule_id] is the number of distinct derivations of rule_id,
+ * or INVALID_UINT32 if it is infinite or more than FTBL_MAX_DERIVATIONS. A
+ * rule is counted once every rule it expands into is, so no rule of a cycle
+ * ever is.
+ */
+static void countDerivations(
+    uint32_t* const n_derivations,
+    GrammarGraph const* const graph
+) {
+    uint32_t const n_rules      = graph->rule_list->len;
+    uint32_t const n_exps       = graph->exp_list->len;
+    uint32_t* const occ_offsets = mem_calloc((size_t)n_rules + 2, sizeof(uint32_t));
+    uint32_t* const occ_owners  = mem_alloc(((size_t)n_exps + 1) * sizeof(uint32_t));
+    uint32_t* const n_pending   = mem_calloc((size_t)n_rules + 1, sizeof(uint32_t));
+    uint32_t* const stack       = mem_alloc(((size_t)n_rules + 1) * sizeof(uint32_t));
+    uint32_t n_stack            = 0;
+
+    /* occ_owners[occ_offsets[r] .. occ_offsets[r + 1]) lists the rules that expand into r, once per occurrence. */
+    for (uint32_t exp_id = 0; exp_id < n_exps; exp_id++) {
+        ExpansionTerm const* const exp = get_alist(graph->exp_list, exp_id);
+        if (!exp->is_terminal) occ_offsets[exp->rt_id + 2]++;
+    }
+    for (uint32_t i = 2; i <= n_rules + 1; i++)
+        occ_offsets[i] += occ_offsets[i - 1];
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+        RuleTerm const* const rule = get_alist(graph->rule_list, rule_id);
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+            uint32_t exp_id             = *(uint32_t*)get_alist(rule->alt_list, alt_id);
+            ExpansionTerm const* exp    = NULL;
+            do {
+                exp = get_alist(graph->exp_list, exp_id++);
+                if (exp->is_terminal) continue;
+
+                occ_owners[occ_offsets[exp->rt_id + 1]++] = rule_id;
+                n_pending[rule_id]++;
+            } while (exp->has_next);
+        }
+        n_derivations[rule_id] = INVALID_UINT32;
+        if (n_pending[rule_id] == 0) stack[n_stack++] = rule_id;
+    }
+
+    while (n_stack > 0) {
+        uint32_t const rule_id      = stack[--n_stack];
+        RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+        uint64_t count              = 0;
+
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len && count <= FTBL_MAX_DERIVATIONS; alt_id++) {
+            uint32_t exp_id             = *(uint32_t*)get_alist(rule->alt_list, alt_id);
+            ExpansionTerm const* exp    = NULL;
+            uint64_t product            = 1;
+            do {
+                exp = get_alist(graph->exp_list, exp_id++);
+                if (exp->is_terminal) continue;
+
+                if (n_derivations[exp->rt_id] == INVALID_UINT32)
+                    product = FTBL_MAX_DERIVATIONS + 1;
+                else if (product <= FTBL_MAX_DERIVATIONS)
+                    product *= n_derivations[exp->rt_id];
+            } while (exp->has_next);
+            count += product;
+        }
+        if (count <= FTBL_MAX_DERIVATIONS) n_derivations[rule_id] = (uint32_t)count;
+
+        for (uint32_t occ_id = occ_offsets[rule_id]; occ_id < occ_offsets[rule_id + 1]; occ_id++) {
+            uint32_t const owner_id = occ_owners[occ_id];
+            if (--n_pending[owner_id] == 0) stack[n_stack++] = owner_id;
+        }
+    }
+
+    free(occ_offsets);
+    free(occ_owners);
+    free(n_pending);
+    free(stack);
+}
+
+void destruct_ftbl(FragmentTable* const ftbl) {
+    assert(isValid_ftbl(ftbl));
+
+    destruct_chunk(ftbl->fragments);
+    destruct_alist(ftbl->frag_list);
+    destruct_alist(ftbl->hit_list);
+    destruct_alist(ftbl->trie_list);
+    free(ftbl->rule_tries);
+    free(ftbl->exp_frags);
+
+    *ftbl = NOT_A_FTBL;
+}
+
+bool isValid_ftbl(FragmentTable const* const ftbl) {
+    if (ftbl == NULL)                                                   return 0;
+    if (!isValid_chunk(ftbl->fragments))                                return 0;
+    if (!isValid_alist(ftbl->frag_list))                                return 0;
+    if (!isValid_alist(ftbl->hit_list))                                 return 0;
+    if (!isValid_alist(ftbl->trie_list))                                return 0;
+    if (ftbl->rule_tries == NULL)                                       return 0;
+    if (ftbl->exp_frags == NULL)                                        return 0;
+    if (LEN_CHUNK(ftbl->fragments) != ftbl->frag_list->len)             return 0;
+
+    return 1;
+}
+
+size_t memoryUsage_ftbl(FragmentTable const* const ftbl) {
+    assert(isValid_ftbl(ftbl));
+    return MUSAGE_CHUNK(ftbl->fragments) + MUSAGE_ALIST(ftbl->frag_list) + MUSAGE_ALIST(ftbl->hit_list)
+         + MUSAGE_ALIST(ftbl->trie_list) + ((size_t)ftbl->n_rules + 1 + ftbl->n_exps + 1) * sizeof(uint32_t);
+}
+
+bool renderAlt_ftbl(
+    Chunk* const str_builder,
+    Coverage* const cov,
+    FragmentTable const* const ftbl,
+    uint32_t const exp_id
+) {
+    assert(exp_id < ftbl->n_exps);
+
+    if (ftbl->exp_frags[exp_id] == INVALID_UINT32) return 0;
+
+    appendFragment(str_builder, cov, ftbl, ftbl->exp_frags[exp_id]);
+    return 1;
+}
+
+bool renderRule_ftbl(
+    Chunk* const str_builder,
+    Coverage* const cov,
+    FragmentTable const* const ftbl,
+    uint32_t const rule_id,
+    uint32_t const** const p_decision
+) {
+    uint32_t const* trie    = NULL;
+    uint32_t slot           = 0;
+
+    assert(rule_id < ftbl->n_rules);
+
+    if (ftbl->rule_tries[rule_id] == INVALID_UINT32) return 0;
+
+    trie = getFirst_alist(ftbl->trie_list);
+    slot = ftbl->rule_tries[rule_id];
+    do { slot = trie[slot + *((*p_decision)++)]; } while (!(slot & FTBL_LEAF));
+
+    appendFragment(str_builder, cov, ftbl, slot & ~FTBL_LEAF);
+    return 1;
+}
+
+static void shrink(
+    ArrayList* const list,
+    uint32_t const len
+) {
+    assert(len <= list->len);
+    REPEAT(list->len - len) pop_alist(list);
+}
@@ -1,67 +1,594 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <inttypes.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <time.h>
+#include "bloomfilter.h"
 #include "bnf.h"
+#include "corpus.h"
+#include "decisionlog.h"
 #include "decisiontree.h"
-#include "padkit/implication.h"
+#include "executor.h"
+#include "filesink.h"
+#include "fragmenttable.h"
+#include "grammardiff.h"
+#include "harness.h"
+#include "memoryusage.h"
+#include "optimizedgrammar.h"
+#include "randomwalk.h"
+#include "reducer.h"
+#include "server.h"
+#include "sharedring.h"
+#include "spantree.h"
 #include "padkit/memalloc.h"
 #include "padkit/verbose.h"
 
 #define MAX_DEPTH           (4194304)
+#define MAX_EXEC_TIMEOUT    (3600000)
+#define MAX_FILES_PER_DIR   (1048576)
+#define MAX_JOBS            (CORPUS_MAX_JOBS)
+#define MAX_MEMORY          (1048576)
 #define MAX_N               (4194304)
+#define MAX_POOL            (1048576)
+#define MAX_SHARDS          (65536)
+#define MAX_TARGET_SIZE     (4194304)
 #define MAX_TIMEOUT         (604800)
 
-#define DEFAULT_COV_GUIDED  (1)
-#define DEFAULT_MIN_DEPTH   (0)
-#define DEFAULT_UNIQUE      (1)
-#define DEFAULT_SEED        (131077)
-#define DEFAULT_N           (0)
-#define DEFAULT_TIMEOUT     (0)
+#define DEFAULT_COV_GUIDED    (1)
+#define DEFAULT_EXEC_TIMEOUT  (1000)
+#define DEFAULT_FILES_PER_DIR (4096)
+#define DEFAULT_JOBS          (0)
+#define DEFAULT_MAX_BYTES     (0)
+#define DEFAULT_MAX_DECISIONS (0)
+#define DEFAULT_MAX_MEMORY    (0)
+#define DEFAULT_MIN_DEPTH     (0)
+#define DEFAULT_UNIQUE        (1)
+#define DEFAULT_SEED          (131077)
+#define DEFAULT_SHARD_ID      (0)
+#define DEFAULT_N_SHARDS      (1)
+#define DEFAULT_N             (0)
+#define DEFAULT_POOL_SZ       (0)
+#define DEFAULT_PREFIX_DEPTH  (0)
+#define DEFAULT_TARGET_SIZE   (0)
+#define DEFAULT_TIMEOUT       (0)
 
-static void generateAndPrintSentencesWithinTimeout(
+#ifndef WATCH_PERIOD_MS
+    #define WATCH_PERIOD_MS   (500)
+#endif
+
+/* The Bloom filter of -Q takes 1/MEMORY_FILTER_SHARE of the limit. */
+#ifndef MEMORY_FILTER_SHARE
+    #define MEMORY_FILTER_SHARE (8)
+#endif
+
+/* After this many duplicates in a row, the filter lets few unique sentences through. */
+#ifndef MEMORY_MAX_FILTERED_IN_A_ROW
+    #define MEMORY_MAX_FILTERED_IN_A_ROW (65536)
+#endif
+
+#define NOT_A_GENERATOR_OPTIONS ((GeneratorOptions){ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, NULL, 0, 0, 0, 0 })
+
+#define NOT_A_GENERATOR_OUTPUTS ((GeneratorOutputs){                        \
+    { NOT_A_DLOG }, { NOT_A_FSINK }, { NOT_AN_EXEC }, { NOT_A_HARNESS },    \
+    { NOT_A_SRING }, NULL, NULL, NULL, NULL, NULL                           \
+})
+
+/*
+ * What generateAndPrintSentencesWithinTimeout takes from the options. The
+ * grammar of watch_filename replaces the generated one whenever it changes.
+ */
+typedef struct GeneratorOptionsBody {
+    uint32_t    n;
+    uint32_t    t;
+    uint32_t    min_depth;
+    uint32_t    max_decisions;
+    uint32_t    max_bytes;
+    uint32_t    max_memory;
+    uint32_t    shard_id;
+    uint32_t    n_shards;
+    uint32_t    prefix_depth;
+    uint32_t    root_len;
+    char*       root_str;
+    char const* watch_filename;
+    bool        cov_guided;
+    bool        uses_energy;
+    bool        unique;
+    bool        prefix_frontier;
+} GeneratorOptions;
+
+/*
+ * Where the sentences go besides stdout, and where -A reads them from. An
+ * invalid member or a NULL file takes no part. closeOutputs releases all.
+ */
+typedef struct GeneratorOutputsBody {
+    DecisionLog dlog[1];
+    FileSink    sink[1];
+    Executor    executor[1];
+    Harness     harness[1];
+    SharedRing  ring[1];
+    FILE*       emit_fp;
+    FILE*       replay_fp;
+    FILE*       tree_fp;
+    FILE*       dump_fp;
+    FILE*       prefix_fp;
+} GeneratorOutputs;
+
+/*
+ * Loads the grammar again if its file changed since *p_st, and carries the
+ * coverage and the prefix tree of the unchanged rules over. Under -M or -B,
+ * the tree starts over, since which nodes close depends on every rule.
+ * Keeps the old grammar if the new one does not load.
+ */
+static bool reloadGrammar(
+    GrammarGraph* const graph,
+    Coverage* const cov,
+    DecisionTree* const dtree,
+    DerivationBudget* const budget,
+    EnergyTable* const etbl,
+    FragmentTable* const ftbl,
+    struct stat* const p_st,
+    char const* const filename,
+    char* const root_str,
+    uint32_t const root_len,
+    uint32_t const max_decisions,
+    uint32_t const max_bytes,
+    uint64_t const deadline_ns
+) {
+    GrammarGraph new_graph[1]   = { NOT_A_GGRAPH };
+    Coverage new_cov[1]         = { NOT_A_COV };
+    DecisionTree new_dtree[1]   = { NOT_A_DTREE };
+    GrammarDiff diff[1]         = { NOT_A_GDIFF };
+    struct stat st;
+    FILE* fp                    = NULL;
+    uint32_t n_carried          = 0;
+    int result                  = GRAMMAR_OK;
+
+    if (stat(filename, &st) != 0) return 0;
+    if (
+        st.st_mtim.tv_sec == p_st->st_mtim.tv_sec   &&
+        st.st_mtim.tv_nsec == p_st->st_mtim.tv_nsec &&
+        st.st_size == p_st->st_size                 &&
+        st.st_ino == p_st->st_ino
+    ) return 0;
+    *p_st = st;
+
+    fp = fopen(filename, "r");
+    if (fp == NULL) return 0;
+    result = construct_ggraph(new_graph, fp, root_str, root_len);
+    fclose(fp);
+    if (result != GRAMMAR_OK) {
+        fprintf_verbose(stderr, "Could not reload '%.*s', keeping the previous grammar!", FILENAME_MAX, filename);
+        return 0;
+    }
+
+    construct_gdiff(diff, graph, new_graph);
+    construct_cov(new_cov, new_graph);
+    migrateCoverage_gdiff(new_cov, diff, cov);
+    constructEmpty_dtree(new_dtree);
+    if (isUnlimited_dbudget(budget)) n_carried = migrate_dtree(new_dtree, diff, dtree);
+
+    fprintf_verbose(stderr, "Reloaded '%.*s'", FILENAME_MAX, filename);
+    fprintf_verbose(stderr, "# Rules (Kept) = %"PRIu32, diff->n_kept_rules);
+    fprintf_verbose(stderr, "# Rules (Changed) = %"PRIu32, diff->n_changed_rules);
+    fprintf_verbose(stderr, "# Rules (Added) = %"PRIu32, diff->n_added_rules);
+    fprintf_verbose(stderr, "# Rules (Removed) = %"PRIu32, diff->n_removed_rules);
+    fprintf_verbose(stderr, "# Prefix Tree Nodes (Carried Over) = %"PRIu32, n_carried);
+    destruct_gdiff(diff);
+
+    destruct_dtree(dtree);
+    *dtree = *new_dtree;
+    destruct_cov(cov);
+    *cov = *new_cov;
+    destruct_ggraph(graph);
+    *graph = *new_graph;
+
+    destruct_dbudget(budget);
+    construct_dbudget(budget, graph, max_decisions, max_bytes, deadline_ns);
+    if (isValid_etbl(etbl)) {
+        destruct_etbl(etbl);
+        construct_etbl(etbl, graph, NULL);
+    }
+    if (isValid_ftbl(ftbl)) {
+        destruct_ftbl(ftbl);
+        construct_ftbl(ftbl, graph);
+    }
+
+    return 1;
+}
+
+/* The subsystems that only change with the grammar. */
+static void measureGrammarMemory(
+    MemoryUsage* const mem,
+    GrammarGraph const* const graph,
+    Coverage const* const cov,
+    DerivationBudget const* const budget,
+    WeightTable const* const wtbl,
+    EnergyTable const* const etbl,
+    FragmentTable const* const ftbl
+) {
+    mem->bytes[MUSAGE_GRAMMAR]      = memoryUsage_ggraph(graph);
+    mem->bytes[MUSAGE_COVERAGE]     = memoryUsage_cov(cov);
+    mem->bytes[MUSAGE_BUDGET]       = memoryUsage_dbudget(budget);
+    mem->bytes[MUSAGE_WEIGHTS]      = (wtbl == NULL) ? 0 : memoryUsage_wtbl(wtbl);
+    mem->bytes[MUSAGE_FRAGMENTS]    = isValid_ftbl(ftbl) ? memoryUsage_ftbl(ftbl) : 0;
+    if (isValid_etbl(etbl)) mem->bytes[MUSAGE_WEIGHTS] += memoryUsage_etbl(etbl, graph);
+}
+
+/*
+ * Brings the memory in use back under soft_limit, in three steps: compacts
+ * the prefix tree, and if that frees too little, starts the tree over and
+ * leaves the sentences before it to the Bloom filter, which makes
+ * uniqueness approximate. Returns 0 once neither helps, and the generator
+ * should stop. Nothing it drops is saved, so a later run cannot resume.
+ */
+static bool relieveMemory(
+    MemoryUsage* const mem,
+    size_t const soft_limit,
+    DecisionTree* const dtree,
+    BloomFilter const* const bloom,
+    bool const unique,
+    bool* const p_approximate
+) {
+    if (unique) {
+        uint32_t const n_dropped = compact_dtree(dtree);
+
+        mem->bytes[MUSAGE_PREFIX_TREE] = memoryUsage_dtree(dtree);
+        fprintf_verbose(stderr, "Compacted the prefix tree, freeing %"PRIu32" nodes", n_dropped);
+        /* Too little room left means compacting again soon, and for less. */
+        if (total_musage(mem) <= soft_limit / 4 * 3) return 1;
+    }
+
+    if (unique && isValid_bloom(bloom)) {
+        destruct_dtree(dtree);
+        constructEmpty_dtree(dtree);
+        if (!*p_approximate)
+            fprintf_verbose(stderr, "Dropped the prefix tree, uniqueness is approximate from now on");
+        else
+            fprintf_verbose(stderr, "Dropped the prefix tree again");
+        *p_approximate = 1;
+
+        mem->bytes[MUSAGE_PREFIX_TREE] = memoryUsage_dtree(dtree);
+        if (total_musage(mem) <= soft_limit) return 1;
+    }
+
+    fprintf_verbose(stderr, "Stopped at the memory limit!");
+    return 0;
+}
+
+/* Returns the byte offset of a -A record that could not be replayed, or -1. */
+static long generateAndPrintSentencesWithinTimeout(
+    Coverage* const cov,
     GrammarGraph* const graph,
-    uint32_t n, uint32_t const t, uint32_t const min_depth,
-    bool cov_guided, bool unique,
-    FILE* const fp
+    WeightTable const* const wtbl,
+    GeneratorOptions const* const opts,
+    GeneratorOutputs* const outs
 ) {
-    Item sentence           = NOT_AN_ITEM;
-    Chunk str_builder[1]    = { NOT_A_CHUNK };
-    ArrayList seq[1]        = { NOT_AN_ALIST };
-    DecisionTree dtree[1]   = { NOT_A_DTREE };
-    time_t ts;
+    DecisionLog* const dlog     = isValid_dlog(outs->dlog) ? outs->dlog : NULL;
+    FileSink* const sink        = isValid_fsink(outs->sink) ? outs->sink : NULL;
+    Executor* const executor    = isValid_exec(outs->executor) ? outs->executor : NULL;
+    Harness* const harness      = isValid_harness(outs->harness) ? outs->harness : NULL;
+    SharedRing* const ring      = isValid_sring(outs->ring) ? outs->ring : NULL;
+    uint32_t n                  = opts->n;
+    Item sentence               = NOT_AN_ITEM;
+    Chunk builders[2]           = { NOT_A_CHUNK, NOT_A_CHUNK };
+    Chunk* str_builder          = builders;
+    Chunk* in_flight            = builders + 1;
+    ArrayList seq[1]            = { NOT_AN_ALIST };
+    DecisionTree dtree[1]       = { NOT_A_DTREE };
+    DerivationBudget budget[1]  = { NOT_A_DBUDGET };
+    EnergyTable etbl[1]         = { NOT_AN_ETBL };
+    FragmentTable ftbl[1]       = { NOT_A_FTBL };
+    RandomWalk walk[1]          = { NOT_A_RWALK };
+    SpanTree stree[1]           = { NOT_A_STREE };
+    BloomFilter bloom[1]        = { NOT_A_BLOOM };
+    MemoryUsage mem[1]          = { NOT_A_MUSAGE };
+    size_t const soft_limit     = (size_t)opts->max_memory * 1048576 / 2;
+    uint64_t const deadline_ns  = (opts->t == 0) ? 0 : monotonicNs_dbudget() + (uint64_t)opts->t * 1000000000;
+    uint64_t next_watch_ns      = 0;
+    uint64_t n_duplicates       = 0;
+    uint32_t n_filtered_in_a_row = 0;
+    bool approximate            = 0;
+    long bad_offset             = -1;
+    struct stat watch_st;
 
     assert(isValid_ggraph(graph));
-    assert(n <= MAX_N);
-    assert(t <= MAX_TIMEOUT);
-    assert(min_depth <= MAX_DEPTH);
+    assert(outs->replay_fp != NULL || n <= MAX_N);
+    assert(opts->t <= MAX_TIMEOUT);
+    assert(opts->min_depth <= MAX_DEPTH);
+    assert(opts->max_memory <= MAX_MEMORY);
 
     constructEmpty_chunk(str_builder, CHUNK_RECOMMENDED_PARAMETERS);
+    if (harness != NULL) constructEmpty_chunk(in_flight, CHUNK_RECOMMENDED_PARAMETERS);
     constructEmpty_alist(seq, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
     constructEmpty_dtree(dtree);
+    construct_dbudget(budget, graph, opts->max_decisions, opts->max_bytes, deadline_ns);
+    {
+        DerivationCost const* const root_cost = minCost_dbudget(budget, graph->root_rule_id);
+        if (root_cost->n_decisions > budget->max_decisions || root_cost->n_bytes > budget->max_bytes)
+            fprintf_verbose(stderr, "Even the shortest sentence exceeds -M or -B, so every sentence will!");
+    }
+    if (opts->uses_energy) construct_etbl(etbl, graph, wtbl);
+    if (outs->tree_fp != NULL) constructEmpty_stree(stree);
+    if (outs->tree_fp == NULL) construct_ftbl(ftbl, graph);
+    if (opts->n_shards > 1) restrictToShard_dtree(dtree, graph, budget, opts->shard_id, opts->n_shards);
+    /* Without uniqueness, only -p and -Y read the prefix tree. */
+    if (!opts->unique && outs->prefix_fp == NULL && outs->dump_fp == NULL) construct_rwalk(walk);
+    /*
+     * Under -Q, unique sentences also go into a Bloom filter from the start,
+     * so it can stand in for the dropped part of the prefix tree later,
+     * unless something else reads the tree: -p, -Y, and the shards of -k.
+     */
+    if (
+        opts->max_memory > 0 && opts->unique && opts->n_shards == 1 &&
+        outs->replay_fp == NULL && outs->prefix_fp == NULL && outs->dump_fp == NULL
+    )
+        construct_bloom(bloom, (size_t)opts->max_memory * 1048576 / MEMORY_FILTER_SHARE);
+    measureGrammarMemory(mem, graph, cov, budget, wtbl, etbl, ftbl);
+    if (isValid_bloom(bloom)) mem->bytes[MUSAGE_FILTER] = memoryUsage_bloom(bloom);
+    if (opts->watch_filename != NULL) {
+        if (stat(opts->watch_filename, &watch_st) != 0) memset(&watch_st, 0, sizeof(watch_st));
+        next_watch_ns = monotonicNs_dbudget() + (uint64_t)WATCH_PERIOD_MS * 1000000;
+    }
 
-    time(&ts);
-    while (n-- > 0 && IMPLIES(t != 0, t > difftime(time(NULL), ts))) {
-        switch (generateRandomDecisionSequence_dtree(seq, dtree, graph, min_depth, cov_guided, unique)) {
+    while (n-- > 0 && !isPastDeadline_dbudget(budget)) {
+        int result = DTREE_GENERATE_OK;
+        if (opts->watch_filename != NULL && monotonicNs_dbudget() >= next_watch_ns) {
+            if (reloadGrammar(
+                graph, cov, dtree, budget, etbl, ftbl, &watch_st,
+                opts->watch_filename, opts->root_str, opts->root_len, opts->max_decisions, opts->max_bytes, deadline_ns
+            )) measureGrammarMemory(mem, graph, cov, budget, wtbl, etbl, ftbl);
+            next_watch_ns = monotonicNs_dbudget() + (uint64_t)WATCH_PERIOD_MS * 1000000;
+        }
+        if (outs->replay_fp != NULL) {
+            long const offset       = ftell(outs->replay_fp);
+            int const read_result   = read_dlog(seq, dlog, outs->replay_fp);
+            if (read_result == DLOG_END) break;
+            if (read_result != DLOG_OK) {
+                bad_offset = offset;
+                break;
+            }
+        } else if (isValid_rwalk(walk)) {
+            result = generate_rwalk(
+                seq, walk, cov, isValid_etbl(etbl) ? etbl : NULL, graph, wtbl, budget, opts->min_depth, opts->cov_guided
+            );
+        } else {
+            result = generateRandomDecisionSequence_dtree(
+                seq, dtree, cov, isValid_etbl(etbl) ? etbl : NULL, graph, wtbl, budget, opts->min_depth, opts->cov_guided, opts->unique
+            );
+        }
+        /* A duplicate the filter catches costs no attempt, unless too many come in a row. */
+        if (result == DTREE_GENERATE_OK && isValid_bloom(bloom) && insert_bloom(bloom, seq) && approximate) {
+            result = DTREE_GENERATE_SHALLOW_SEQ;
+            n_duplicates++;
+            if (++n_filtered_in_a_row < MEMORY_MAX_FILTERED_IN_A_ROW) {
+                n++;
+            } else if (opts->watch_filename != NULL) {
+                /* As when the prefix tree runs out, only an edit of the grammar brings new sentences. */
+                result              = DTREE_GENERATE_NO_UNIQUE_SEQ_REMAINING;
+                n_filtered_in_a_row = 0;
+            } else {
+                fprintf_verbose(stderr, "Exhausted the unique sentences the filter lets through!");
+                n = 0;
+            }
+        } else if (result == DTREE_GENERATE_OK) {
+            n_filtered_in_a_row = 0;
+        }
+        switch (result) {
             case DTREE_GENERATE_NO_UNIQUE_SEQ_REMAINING:
                 fprintf_verbose(stderr, "Exhausted all unique sentences!");
+                if (opts->watch_filename == NULL) break;
+
+                /* Everything so far goes out first, since the wait may take long. */
+                fflush(stdout);
+                if (outs->emit_fp != NULL) fflush(outs->emit_fp);
+                if (outs->tree_fp != NULL) fflush(outs->tree_fp);
+                if (sink != NULL && flush_fsink(sink) != FSINK_OK) {
+                    fprintf_verbose(stderr, "Could not write a sentence file!");
+                    n = 0;
+                    break;
+                }
+                if (harness != NULL && LEN_CHUNK(str_builder) > 0) {
+                    Chunk* const rendered = str_builder;
+                    submit_harness(harness, rendered);
+                    str_builder = in_flight;
+                    in_flight   = rendered;
+                    flush_chunk(str_builder);
+                }
+
+                /* Only an edit of the grammar brings new sentences, and waiting for one takes no attempt. */
+                fprintf_verbose(stderr, "Waiting for '%.*s' to change...", FILENAME_MAX, opts->watch_filename);
+                while (!isPastDeadline_dbudget(budget)) {
+                    struct timespec const period = { WATCH_PERIOD_MS / 1000, (WATCH_PERIOD_MS % 1000) * 1000000L };
+                    if (reloadGrammar(
+                        graph, cov, dtree, budget, etbl, ftbl, &watch_st,
+                        opts->watch_filename, opts->root_str, opts->root_len, opts->max_decisions, opts->max_bytes, deadline_ns
+                    )) {
+                        measureGrammarMemory(mem, graph, cov, budget, wtbl, etbl, ftbl);
+                        break;
+                    }
+                    nanosleep(&period, NULL);
+                }
+                n++;
+                break;
+            case DTREE_GENERATE_TIMEOUT:
+                fprintf_verbose(stderr, "Timed out in the middle of a sentence!");
+                n = 0;
                 break;
             case DTREE_GENERATE_SHALLOW_SEQ:
                 break;
             case DTREE_GENERATE_OK:
             default:
-                generateSentence_ggraph(str_builder, graph, seq);
+                generateSentence_ggraph(
+                    str_builder, cov, isValid_stree(stree) ? stree : NULL, isValid_ftbl(ftbl) ? ftbl : NULL, graph, seq
+                );
                 sentence = getLast_chunk(str_builder);
-                printf("%.*s\n", (int)sentence.sz, (char*)sentence.p);
+                if (outs->emit_fp != NULL && !write_dlog(outs->emit_fp, dlog, seq)) {
+                    fprintf_verbose(stderr, "Could not write a decision sequence!");
+                    n = 0;
+                }
+                if (outs->tree_fp != NULL) {
+                    if (!write_stree(outs->tree_fp, stree)) {
+                        fprintf_verbose(stderr, "Could not write a derivation tree!");
+                        n = 0;
+                    }
+                    flush_stree(stree);
+                }
+                if (executor != NULL) {
+                    int const run_result = run_exec(executor, sentence.p, sentence.sz);
+                    switch (run_result) {
+                        case EXEC_RUN_CRASH:
+                            printf("CRASH %d\t%.*s\n", WTERMSIG(executor->last_status), (int)sentence.sz, (char*)sentence.p);
+                            break;
+                        case EXEC_RUN_TIMEOUT:
+                            printf("TIMEOUT\t%.*s\n", (int)sentence.sz, (char*)sentence.p);
+                            break;
+                        case EXEC_RUN_ERROR:
+                            fprintf_verbose(stderr, "Could not run the target!");
+                            n = 0;
+                            break;
+                        default:
+                            break;
+                    }
+                    /* The decisions of a sentence that took new edges earn one credit per edge. */
+                    if (run_result != EXEC_RUN_ERROR && executor->trace_bits != NULL && isValid_etbl(etbl))
+                        credit_etbl(etbl, graph, seq, countNewEdges_exec(executor));
+                }
+                if (ring != NULL) {
+                    switch (write_sring(ring, sentence.p, sentence.sz)) {
+                        case SRING_TOO_LARGE:
+                            fprintf_verbose(stderr, "Skipped a sentence larger than the ring!");
+                            break;
+                        case SRING_TIMEOUT:
+                            fprintf_verbose(stderr, "Timed out waiting for room in the ring!");
+                            n = 0;
+                            break;
+                        default:
+                            break;
+                    }
+                } else if (sink != NULL) {
+                    if (write_fsink(sink, sentence.p, sentence.sz) != FSINK_OK) {
+                        fprintf_verbose(stderr, "Could not write a sentence file!");
+                        n = 0;
+                    }
+                } else if (executor == NULL && harness == NULL) {
+                    printf("%.*s\n", (int)sentence.sz, (char*)sentence.p);
+                }
+        }
+        mem->bytes[MUSAGE_PREFIX_TREE]  = memoryUsage_dtree(dtree);
+        mem->bytes[MUSAGE_SENTENCES]    = MUSAGE_CHUNK(str_builder) + (harness == NULL ? 0 : MUSAGE_CHUNK(in_flight));
+        mem->bytes[MUSAGE_DECISIONS]    = MUSAGE_ALIST(seq) + (isValid_rwalk(walk) ? memoryUsage_rwalk(walk) : 0);
+        if (isValid_stree(stree)) mem->bytes[MUSAGE_SENTENCES] += memoryUsage_stree(stree);
+        if (total_musage(mem) > soft_limit && opts->max_memory > 0 && !relieveMemory(mem, soft_limit, dtree, bloom, opts->unique, &approximate))
+            n = 0;
+        /* The harness runs a whole batch of sentences in place while the next batch renders. */
+        if (harness == NULL) {
+            flush_chunk(str_builder);
+        } else if (LEN_CHUNK(str_builder) == HARNESS_BATCH_LEN) {
+            Chunk* const rendered = str_builder;
+            submit_harness(harness, rendered);
+            str_builder = in_flight;
+            in_flight   = rendered;
+            flush_chunk(str_builder);
         }
-        flush_chunk(str_builder);
         flush_alist(seq);
     }
-    if (fp) printDot_dtree(fp, dtree, graph);
+    if (harness != NULL) {
+        if (LEN_CHUNK(str_builder) > 0) submit_harness(harness, str_builder);
+        wait_harness(harness);
+        destruct_chunk(in_flight);
+    }
+    if (outs->prefix_fp != NULL) printDot_dtree(outs->prefix_fp, dtree, graph, opts->prefix_depth, opts->prefix_frontier);
+    if (outs->dump_fp != NULL && !dump_dtree(outs->dump_fp, dtree, graph))
+        fprintf_verbose(stderr, "Could not write the prefix tree dump!");
+    if (isValid_etbl(etbl)) {
+        fprintf_verbose(stderr, "# Energy Rebuilds = %"PRIu64, etbl->n_rebuilds);
+        if (executor != NULL && executor->trace_bits != NULL)
+            fprintf_verbose(stderr, "# Credited Sentences = %"PRIu64, etbl->n_credited);
+        destruct_etbl(etbl);
+    }
+    if (isValid_bloom(bloom)) {
+        fprintf_verbose(stderr, "# Duplicates (Filtered) = %"PRIu64, n_duplicates);
+        destruct_bloom(bloom);
+    }
+    report_musage(mem);
+    if (isValid_stree(stree)) destruct_stree(stree);
+    if (isValid_ftbl(ftbl)) destruct_ftbl(ftbl);
+    if (isValid_rwalk(walk)) destruct_rwalk(walk);
 
+    destruct_dbudget(budget);
     destruct_dtree(dtree);
     destruct_alist(seq);
     destruct_chunk(str_builder);
+
+    return bad_offset;
+}
+
+/* Returns 0 if a file could not be written or ring records went unclaimed. Leaves outs NOT_A_GENERATOR_OUTPUTS. */
+static bool closeOutputs(GeneratorOutputs* const outs) {
+    bool is_written = 1;
+
+    if (outs->prefix_fp != NULL) fclose(outs->prefix_fp);
+    if (outs->dump_fp != NULL && fclose(outs->dump_fp) != 0) {
+        fprintf_verbose(stderr, "Could not write the prefix tree dump!");
+        is_written = 0;
+    }
+    if (outs->tree_fp != NULL && fclose(outs->tree_fp) != 0) {
+        fprintf_verbose(stderr, "Could not write a derivation tree!");
+        is_written = 0;
+    }
+    if (outs->replay_fp != NULL) fclose(outs->replay_fp);
+    if (outs->emit_fp != NULL && fclose(outs->emit_fp) != 0) {
+        fprintf_verbose(stderr, "Could not write a decision sequence!");
+        is_written = 0;
+    }
+    if (isValid_dlog(outs->dlog)) destruct_dlog(outs->dlog);
+    if (isValid_harness(outs->harness)) destruct_harness(outs->harness);
+    if (isValid_exec(outs->executor)) destruct_exec(outs->executor);
+    if (isValid_fsink(outs->sink) && destruct_fsink(outs->sink) != FSINK_OK) is_written = 0;
+    if (isValid_sring(outs->ring) && destruct_sring(outs->ring) != SRING_OK) is_written = 0;
+
+    *outs = NOT_A_GENERATOR_OUTPUTS;
+    return is_written;
+}
+
+/* Counts only the files of -o flushed so far. */
+static void reportOutputs(GeneratorOutputs const* const outs) {
+    if (isValid_dlog(outs->dlog)) {
+        if (outs->replay_fp != NULL)
+            fprintf_verbose(stderr, "# Decision Sequences (Replayed) = %"PRIu64, outs->dlog->n_read);
+        if (outs->emit_fp != NULL) {
+            fprintf_verbose(stderr, "# Decision Sequences (Written) = %"PRIu64, outs->dlog->n_written);
+            fprintf_verbose(stderr, "# Decision Bytes (Written) = %"PRIu64, outs->dlog->n_written_bytes);
+        }
+    }
+    if (isValid_harness(outs->harness)) {
+        fprintf_verbose(stderr, "# Executions = %"PRIu64, outs->harness->n_execs);
+        fprintf_verbose(stderr, "# Executions (Rejected) = %"PRIu64, outs->harness->n_rejects);
+        fprintf_verbose(stderr, "Executions per Second = %.1f", execsPerSecond_harness(outs->harness));
+    }
+    if (isValid_exec(outs->executor)) {
+        Executor const* const executor = outs->executor;
+        fprintf_verbose(stderr, "# Executions = %"PRIu64, executor->n_execs);
+        fprintf_verbose(stderr, "# Executions (Nonzero Exit) = %"PRIu64, executor->n_nonzero_exits);
+        fprintf_verbose(stderr, "# Executions (Timed Out) = %"PRIu64, executor->n_timeouts);
+        fprintf_verbose(stderr, "# Executions (Crashed) = %"PRIu64, executor->n_crashes);
+        for (int sig = 1; sig < EXEC_MAX_SIGNAL; sig++)
+            if (executor->n_crashes_by_signal[sig] > 0)
+                fprintf_verbose(stderr, "# Crashes (Signal %d) = %"PRIu64, sig, executor->n_crashes_by_signal[sig]);
+        if (executor->trace_bits != NULL)
+            fprintf_verbose(stderr, "# Edges = %"PRIu32, executor->n_edges);
+        fprintf_verbose(stderr, "Executions per Second = %.1f", execsPerSecond_exec(executor));
+    }
+    if (isValid_fsink(outs->sink)) {
+        fprintf_verbose(stderr, "# Files Written = %"PRIu32, outs->sink->n_files - outs->sink->n_failed);
+        fprintf_verbose(stderr, "# Files Written (Failed) = %"PRIu32, outs->sink->n_failed);
+    }
+    if (isValid_sring(outs->ring)) {
+        fprintf_verbose(stderr, "# Ring Records = %"PRIu64, outs->ring->n_records);
+        fprintf_verbose(stderr, "# Ring Waits (Full) = %"PRIu64, outs->ring->n_waits);
+    }
 }
 
 
@@ -90,192 +617,641 @@ static void showErrorBadNumber(
     );
 }
 
-static void showErrorParameterTooLong(
-    char const* const parameter_name,
-    char const* const abbreviations,
-    size_t const max_len,
-    size_t const len
+static void showErrorBadDecisions(char const* const filename) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - Bad Format @ '%.*s' (or the decisions belong to another grammar)\n"
+        "\n",
+        FILENAME_MAX,
+        filename
+    );
+}
+
+static void showErrorBadRecord(
+    char const* const filename,
+    long const offset
 ) {
     fprintf(
         stderr,
         "\n"
-        "[ERROR] - %.1024s after %.1024s cannot be longer than %zu (given: %zu)\n"
+        "[ERROR] - Bad Record @ byte %ld of '%.*s' (truncated or corrupt)\n"
+        "\n",
+        offset,
+        FILENAME_MAX,
+        filename
+    );
+}
+
+static void showErrorCannotOpenCorpus(char const* const path) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - Cannot open corpus '%.*s'\n"
         "\n"
         "gfuzzer --help for more instructions\n"
         "\n",
-        parameter_name,
-        abbreviations,
-        max_len,
-        len
+        FILENAME_MAX,
+        path
     );
 }
 
-static void showErrorCannotOpenFile(char const* const filename) {
+static void showErrorCannotOpenRing(char const* const name) {
     fprintf(
         stderr,
         "\n"
-        "[ERROR] - Cannot open file '%.*s'\n"
+        "[ERROR] - Cannot open shared memory ring '%.*s'\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        SRING_MAX_LEN_NAME,
+        name
+    );
+}
+
+static void showErrorCannotOpenOutDir(char const* const path) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - Cannot open output directory '%.*s'\n"
         "\n"
         "gfuzzer --help for more instructions\n"
         "\n",
         FILENAME_MAX,
-        filename
+        path
     );
 }
 
-static void showErrorNoBNFFilenameGiven(void) {
-    fputs(
+static void showErrorCannotListen(char const* const path) {
+    fprintf(
+        stderr,
         "\n"
-        "[ERROR] - Must specify BNF file (-b or --bnf-file)\n"
+        "[ERROR] - Cannot listen on socket '%.*s'\n"
         "\n"
         "gfuzzer --help for more instructions\n"
         "\n",
-        stderr
+        FILENAME_MAX,
+        path
     );
 }
 
-static void showErrorNumberTooLarge(uint32_t const n) {
+static void showErrorCannotLoadHarness(char const* const lib_path) {
     fprintf(
         stderr,
         "\n"
-        "[ERROR] - NUMBER must NOT exceed %d (n = %"PRIu32")\n"
+        "[ERROR] - Cannot load "HARNESS_ENTRY_POINT" from '%.*s'\n"
         "\n"
         "gfuzzer --help for more instructions\n"
         "\n",
-        MAX_N, n
+        FILENAME_MAX,
+        lib_path
     );
 }
 
-static void showErrorParameterMissing(
-    char const* const parameter_name,
-    char const* const abbreviations
+static void showErrorCannotQuery(char const* const path) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - Cannot get sentences from socket '%.*s'\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        FILENAME_MAX,
+        path
+    );
+}
+
+static void showErrorCannotStartTarget(char const* const target) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - Cannot start target '%.*s'\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        FILENAME_MAX,
+        target
+    );
+}
+
+static void showErrorNotDerived(char const* const filename) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - The grammar does not derive '%.*s'\n"
+        "\n",
+        FILENAME_MAX,
+        filename
+    );
+}
+
+static void showErrorNotFailing(
+    char const* const target,
+    char const* const filename
 ) {
     fprintf(
         stderr,
         "\n"
-        "[ERROR] - %.1024s missing after %.1024s\n"
+        "[ERROR] - Target '%.*s' passes on '%.*s', so there is nothing to reduce\n"
+        "\n",
+        FILENAME_MAX,
+        target,
+        FILENAME_MAX,
+        filename
+    );
+}
+
+static void showErrorWithoutTarget(char const* const option) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - %s needs a target given by -x or --exec\n"
         "\n"
         "gfuzzer --help for more instructions\n"
         "\n",
-        parameter_name, abbreviations
+        option
     );
 }
 
-static void showErrorRootStrBadFormat(char const* const root_str) {
+static void showErrorWithoutServer(char const* const option) {
     fprintf(
         stderr,
         "\n"
-        "[ERROR] - Syntax Error @ \""BNF_STR_RULE_OPEN"RULE"BNF_STR_RULE_CLOSE"\" (%.*s)\n"
+        "[ERROR] - %s needs a server given by -u or --serve\n"
         "\n"
         "gfuzzer --help for more instructions\n"
         "\n",
-        BNF_MAX_LEN_TERM, root_str
+        option
     );
 }
 
-static void showErrorSyntax(void) {
-    fputs(
+static void showErrorCannotWriteOutDir(char const* const path) {
+    fprintf(
+        stderr,
         "\n"
-        "[ERROR] - Bad Syntax @ BNF\n"
+        "[ERROR] - Cannot write every sentence file under '%.*s'\n"
         "\n",
-        stderr
+        FILENAME_MAX,
+        path
     );
 }
 
-static void showErrorTimeoutTooLarge(uint32_t const t) {
+static void showErrorConflictingOptions(
+    char const* const abbreviations1,
+    char const* const abbreviations2
+) {
     fprintf(
         stderr,
         "\n"
-        "[ERROR] - Timeout NUMBER must NOT exceed %d (TIMEOUT = %"PRIu32")\n"
+        "[ERROR] - %.1024s cannot be used together with %.1024s\n"
         "\n"
         "gfuzzer --help for more instructions\n"
         "\n",
-        MAX_TIMEOUT, t
+        abbreviations1, abbreviations2
     );
 }
 
-static void showUsage(char const* const path) {
+static void showErrorExecTimeoutTooLarge(uint32_t const exec_timeout) {
     fprintf(
         stderr,
         "\n"
-        "gfuzzer-c: Grammar Fuzzer in C\n"
+        "[ERROR] - Exec timeout NUMBER must NOT exceed %d (EXEC_TIMEOUT = %"PRIu32")\n"
         "\n"
-        "Usage: gfuzzer -b <bnf-file> [options]\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        MAX_EXEC_TIMEOUT, exec_timeout
+    );
+}
+
+static void showErrorFilesPerDirTooLarge(uint32_t const files_per_dir) {
+    fprintf(
+        stderr,
         "\n"
-        "GENERAL OPTIONS:\n"
-        "  -b,--bnf FILENAME            (Mandatory) An input grammar in Backus-Naur Form\n"
-        "  -c,--cov-guided              Disable coverage guidance optimization (Default: Enabled)\n"
-        "  -C,--copyright               Output the copyright message and exit\n"
-        "  -d,--dot-file FILENAME       Output the BNF in DOT format (Default: Disabled)\n"
-        "  -h,--help                    Output this help message and exit\n"
-        "  -m,--min-depth NUMBER        The minimum depth, increase it to get longer sentences (Default: %d)\n"
-        "  -n,--number NUMBER           The number of sentences (Default: %d)\n"
-        "  -r,--root \""
-                      BNF_STR_RULE_OPEN
-                      "RULE"
-                          BNF_STR_RULE_CLOSE
-                          "\"           The root rule (Default: The top rule in the BNF file)\n"
-        "  -p,--prefix-tree FILENAME    Output the generated prefix tree in DOT format (Default: Disabled)\n"
-        "  -s,--seed NUMBER             Change the default random seed (Default: %d)\n"
-        "  -S,--same                    Allow the same sentence twice (Default: Do NOT allow / UNIQUE = true)\n"
-        "  -t,--timeout NUMBER          Terminate generating sentences after some seconds (Default: %d)\n"
-        "  -v,--verbose                 Timestamped status information (including term coverage) to stderr\n"
-        "  -V,--version                 Output version number and exit\n"
+        "[ERROR] - Files-per-dir NUMBER must NOT exceed %d (FILES_PER_DIR = %"PRIu32")\n"
         "\n"
-        BNF_STR_RULE_OPEN"RULE"BNF_STR_RULE_CLOSE" FORMAT:\n"
-        "  * Every rule name must begin with '"BNF_STR_RULE_OPEN"'.\n"
-        "  * Every rule name must end with '"BNF_STR_RULE_CLOSE"'.\n"
-        "  * Rule names cannot contain whitespace.\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        MAX_FILES_PER_DIR, files_per_dir
+    );
+}
+
+static void showErrorJobsTooLarge(uint32_t const n_jobs) {
+    fprintf(
+        stderr,
         "\n"
-        "EXAMPLE USES:\n"
-        "  %.*s -b bnf/numbers.bnf -m 10 -n 10\n"
+        "[ERROR] - Jobs NUMBER must NOT exceed %d (JOBS = %"PRIu32")\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
         "\n",
-        DEFAULT_MIN_DEPTH, DEFAULT_N, DEFAULT_SEED, DEFAULT_TIMEOUT, FILENAME_MAX, path
+        MAX_JOBS, n_jobs
     );
 }
 
-static void showVersion(void) {
-    fputs(
+static void showErrorMemoryTooLarge(uint32_t const max_memory) {
+    fprintf(
+        stderr,
         "\n"
-        "gfuzzer-c v1.0\n"
+        "[ERROR] - Memory limit NUMBER must NOT exceed %d (MAX_MEMORY = %"PRIu32")\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
         "\n",
-        stderr
+        MAX_MEMORY, max_memory
     );
 }
 
-#ifdef LITEQ
-    #undef LITEQ
-#endif
-#define LITEQ(str, lit)     (strncmp(str, lit, sizeof(lit)) == 0)
+static void showErrorPoolTooLarge(uint32_t const pool_sz) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - Pool NUMBER must NOT exceed %d (POOL_SZ = %"PRIu32")\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        MAX_POOL, pool_sz
+    );
+}
 
-#ifdef PROCESS_ARG
-    #undef PROCESS_ARG
-#endif
-#define PROCESS_ARG(abbr,name)                                                      \
-    for (int i = argc - 1; i > 0; i--)                                              \
-        if (!is_arg_processed[i] && (LITEQ(argv[i], abbr) || LITEQ(argv[i], name)))
+static void showErrorNotTunable(uint32_t const target_size) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - Cannot tune the grammar for an expected size of %"PRIu32"\n"
+        "\n",
+        target_size
+    );
+}
+
+static void showErrorParameterTooLong(
+    char const* const parameter_name,
+    char const* const abbreviations,
+    size_t const max_len,
+    size_t const len
+) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - %.1024s after %.1024s cannot be longer than %zu (given: %zu)\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        parameter_name,
+        abbreviations,
+        max_len,
+        len
+    );
+}
+
+static void showErrorBadShard(char const* const shard_str) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - Expected i/N with i < N <= %d @ '%.32s'\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        MAX_SHARDS, shard_str
+    );
+}
+
+static void showErrorCannotOpenFile(char const* const filename) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - Cannot open file '%.*s'\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        FILENAME_MAX,
+        filename
+    );
+}
+
+static void showErrorNoBNFFilenameGiven(void) {
+    fputs(
+        "\n"
+        "[ERROR] - Must specify BNF file (-b or --bnf-file)\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        stderr
+    );
+}
+
+static void showErrorNotServed(
+    char const* const path,
+    char const* const bnf_filename
+) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - '%.*s' does not serve '%.*s'\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        FILENAME_MAX,
+        path,
+        FILENAME_MAX,
+        bnf_filename
+    );
+}
+
+static void showErrorNumberTooLarge(uint32_t const n) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - NUMBER must NOT exceed %d (n = %"PRIu32")\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        MAX_N, n
+    );
+}
+
+static void showErrorParameterMissing(
+    char const* const parameter_name,
+    char const* const abbreviations
+) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - %.1024s missing after %.1024s\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        parameter_name, abbreviations
+    );
+}
+
+static void showErrorRootStrBadFormat(char const* const root_str) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - Syntax Error @ \""BNF_STR_RULE_OPEN"RULE"BNF_STR_RULE_CLOSE"\" (%.*s)\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        BNF_MAX_LEN_TERM, root_str
+    );
+}
+
+static void showErrorNoSentence(void) {
+    fputs(
+        "\n"
+        "[ERROR] - The root rule derives no finite sentence @ BNF\n"
+        "\n",
+        stderr
+    );
+}
+
+static void showErrorSyntax(void) {
+    fputs(
+        "\n"
+        "[ERROR] - Bad Syntax @ BNF\n"
+        "\n",
+        stderr
+    );
+}
+
+static void showErrorSyntaxWeights(void) {
+    fputs(
+        "\n"
+        "[ERROR] - Bad Syntax @ Weights (or the weights belong to another grammar)\n"
+        "\n",
+        stderr
+    );
+}
+
+static void showErrorTargetSizeTooLarge(uint32_t const target_size) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - Target size NUMBER must NOT exceed %d (TARGET_SIZE = %"PRIu32")\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        MAX_TARGET_SIZE, target_size
+    );
+}
+
+static void showErrorTimeoutTooLarge(uint32_t const t) {
+    fprintf(
+        stderr,
+        "\n"
+        "[ERROR] - Timeout NUMBER must NOT exceed %d (TIMEOUT = %"PRIu32")\n"
+        "\n"
+        "gfuzzer --help for more instructions\n"
+        "\n",
+        MAX_TIMEOUT, t
+    );
+}
+
+static void showUsage(char const* const path) {
+    fprintf(
+        stderr,
+        "\n"
+        "gfuzzer-c: Grammar Fuzzer in C\n"
+        "\n"
+        "Usage: gfuzzer -b <bnf-file> [options]\n"
+        "\n"
+        "GENERAL OPTIONS:\n"
+        "  -a,--emit-decisions FILENAME Output the decisions of every sentence in binary, packed by the alternatives of each rule (Default: Disabled)\n"
+        "  -A,--replay FILENAME         Render the decisions of a -a file again instead of generating sentences, up to -n if given (Default: Disabled)\n"
+        "  -b,--bnf FILENAME            (Mandatory) An input grammar in Backus-Naur Form\n"
+        "  -B,--max-bytes NUMBER        Finish every sentence on its shortest completion before it exceeds some bytes (Default: %d = Unlimited)\n"
+        "                               A sentence exceeds -B and -M anyway if even the shortest one does\n"
+        "  -c,--cov-guided              Disable coverage guidance optimization (Default: Enabled)\n"
+        "  -C,--copyright               Output the copyright message and exit\n"
+        "  -d,--dot-file FILENAME       Output the BNF in DOT format (Default: Disabled)\n"
+        "  -D,--derivations             Also output the decision sequence of every input accepted by -P (Default: Disabled)\n"
+        "  -E,--emit-tree FILENAME      Output the byte span of every rule and terminal of every sentence in binary (Default: Disabled)\n"
+        "  -e,--energy                  Weight alternatives by the inverse of their hit counts instead of preferring uncovered ones (Default: Disabled)\n"
+        "  -f,--files-per-dir NUMBER    About the number of files in every subdirectory of -o for -n sentences, 0 puts all files in DIR (Default: %d)\n"
+        "  -F,--prefix-frontier         Collapse every fully explored subtree of -p into a box of its size (Default: Disabled)\n"
+        "  -g,--shm NAME                Hand every sentence to -G readers through a shared memory ring instead of printing it (Default: Disabled)\n"
+        "  -G,--shm-read NAME           Output the sentences of a running -g until it finishes, needs no -b\n"
+        "  -h,--help                    Output this help message and exit\n"
+        "  -H,--harness FILENAME        Call "HARNESS_ENTRY_POINT" of a shared object on every sentence instead of printing it (Default: Disabled)\n"
+        "  -I,--reduce FILENAME         Shrink a sentence subtree by subtree while -x ends the same way on it, and output it (Default: Disabled)\n"
+        "  -j,--jobs NUMBER             The number of threads that parse files for -l and -P, or run -H or -I (Default: %d = All CPUs)\n"
+        "  -k,--shard i/N               Generate only the i-th of N disjoint parts of the unique sentences, 0 <= i < N (Default: 0/1)\n"
+        "  -K,--feedback                Give the target of -x an AFL bitmap, and favor the alternatives of sentences that hit new edges, implies -e (Default: Disabled)\n"
+        "  -l,--learn PATH              Learn alternative weights from a corpus directory of sample inputs (Default: Disabled)\n"
+        "  -L,--prefix-depth NUMBER     Collapse every subtree of -p below some decisions into a box of its size (Default: %d = Unlimited)\n",
+        DEFAULT_MAX_BYTES, DEFAULT_FILES_PER_DIR, DEFAULT_JOBS, DEFAULT_PREFIX_DEPTH
+    );
+    fprintf(
+        stderr,
+        "  -m,--min-depth NUMBER        The minimum depth, increase it to get longer sentences (Default: %d)\n"
+        "  -M,--max-decisions NUMBER    Finish every sentence on its shortest completion before it exceeds some decisions (Default: %d = Unlimited)\n"
+        "  -n,--number NUMBER           The number of sentences (Default: %d)\n"
+        "  -N,--pool NUMBER             Keep up to some sentences of every grammar of -u ready in a background thread (Default: %d = Disabled)\n"
+        "  -o,--out-dir DIR             Write every sentence to its own content-hashed file under DIR instead of stdout (Default: Disabled)\n"
+        "  -O,--optimize                Inline trivial rules and fuse adjacent terminals before generating (Default: Disabled)\n"
+        "  -r,--root \""
+                      BNF_STR_RULE_OPEN
+                      "RULE"
+                          BNF_STR_RULE_CLOSE
+                          "\"           The root rule (Default: The top rule in the BNF file)\n"
+        "  -p,--prefix-tree FILENAME    Output the generated prefix tree in DOT format (Default: Disabled)\n"
+        "  -P,--parse PATH              Validate a file, or every file under a directory, against the grammar (Default: Disabled)\n"
+        "  -q,--query SOCKET            Get -n sentences of the -b grammar from a server started by -u and output them (Default: Disabled)\n"
+        "  -Q,--max-memory NUMBER       Keep the generator within some MiB: compact the prefix tree, then make uniqueness approximate, then stop (Default: %d = Unlimited)\n"
+        "  -R,--watch                   Reload the -b grammar whenever it changes, keeping the coverage and prefix tree of unchanged rules (Default: Disabled)\n"
+        "  -s,--seed NUMBER             Change the default random seed (Default: %d)\n"
+        "  -S,--same                    Allow the same sentence twice (Default: Do NOT allow / UNIQUE = true)\n"
+        "  -t,--timeout NUMBER          Terminate generating sentences after some seconds (Default: %d)\n"
+        "  -T,--exec-timeout NUMBER     Kill a target run by -x after some milliseconds (Default: %d)\n"
+        "  -u,--serve SOCKET            Serve sentences of every -b grammar to -q clients over a Unix socket until -t or a signal (Default: Disabled)\n"
+        "  -v,--verbose                 Timestamped status information (including term coverage) to stderr\n"
+        "  -V,--version                 Output version number and exit\n"
+        "  -w,--weights FILENAME        Load alternative weights from a file (Default: Disabled)\n"
+        "  -W,--save-weights FILENAME   Save the alternative weights to a file (Default: Disabled)\n"
+        "  -x,--exec PROGRAM [ARGS]     Run a program on every sentence instead of printing it, must be the last option (Default: Disabled)\n"
+        "                               The sentence replaces every @@ argument, or goes to stdin if there is none\n"
+        "                               Crashes and timeouts are printed as \"CRASH <signal>\" or \"TIMEOUT\", a tab, and the sentence\n"
+        "  -Y,--prefix-dump FILENAME    Output the generated prefix tree in binary (Default: Disabled)\n"
+        "  -z,--target-size NUMBER      Tune alternative probabilities for an expected sentence size in bytes (Default: %d = Uniform)\n"
+        "\n"
+        BNF_STR_RULE_OPEN"RULE"BNF_STR_RULE_CLOSE" FORMAT:\n"
+        "  * Every rule name must begin with '"BNF_STR_RULE_OPEN"'.\n"
+        "  * Every rule name must end with '"BNF_STR_RULE_CLOSE"'.\n"
+        "  * Rule names cannot contain whitespace.\n"
+        "\n"
+        "EXAMPLE USES:\n"
+        "  %.*s -b bnf/numbers.bnf -m 10 -n 10\n"
+        "  %.*s -b bnf/numbers.bnf -n 1000 -x ./target @@\n"
+        "\n",
+        DEFAULT_MIN_DEPTH, DEFAULT_MAX_DECISIONS, DEFAULT_N, DEFAULT_POOL_SZ, DEFAULT_MAX_MEMORY, DEFAULT_SEED, DEFAULT_TIMEOUT, DEFAULT_EXEC_TIMEOUT, DEFAULT_TARGET_SIZE, FILENAME_MAX, path, FILENAME_MAX, path
+    );
+}
+
+static void showVersion(void) {
+    fputs(
+        "\n"
+        "gfuzzer-c v1.0\n"
+        "\n",
+        stderr
+    );
+}
+
+/* Loads one more grammar into the server, returns 0 after showing the error. */
+static bool serveGrammar(
+    Server* const srv,
+    char const* const bnf_filename,
+    char* const root_str,
+    size_t const root_len,
+    uint32_t const max_decisions,
+    uint32_t const max_bytes
+) {
+    FILE* const fp = fopen(bnf_filename, "r");
+    if (fp == NULL) {
+        showErrorCannotOpenFile(bnf_filename);
+        return 0;
+    }
+    switch (addGrammar_srv(srv, bnf_filename, fp, root_str, (uint32_t)root_len, max_decisions, max_bytes)) {
+        case GRAMMAR_OK:
+            break;
+        case GRAMMAR_NO_SENTENCE:
+            showErrorNoSentence();
+            fclose(fp);
+            return 0;
+        case GRAMMAR_SYNTAX_ERROR:
+        default:
+            showErrorSyntax();
+            fclose(fp);
+            return 0;
+    }
+    fclose(fp);
+
+    return 1;
+}
+
+#ifdef LITEQ
+    #undef LITEQ
+#endif
+#define LITEQ(str, lit)     (strncmp(str, lit, sizeof(lit)) == 0)
+
+#ifdef PROCESS_ARG
+    #undef PROCESS_ARG
+#endif
+#define PROCESS_ARG(abbr,name)                                                      \
+    for (int i = argc - 1; i > 0; i--)                                              \
+        if (!is_arg_processed[i] && (LITEQ(argv[i], abbr) || LITEQ(argv[i], name)))
 
 int main(
     int argc,
     char* argv[]
 ) {
     GrammarGraph graph[1]           = { NOT_A_GGRAPH };
+    Coverage cov[1]                 = { NOT_A_COV };
+    WeightTable wtbl[1]             = { NOT_A_WTBL };
+    GeneratorOptions opts[1]        = { NOT_A_GENERATOR_OPTIONS };
+    GeneratorOutputs outs[1]        = { NOT_A_GENERATOR_OUTPUTS };
+    char* const* target_argv        = NULL;
     FILE* fp                        = NULL;
     char const* bnf_filename        = NULL;
     size_t bnf_filename_len         = 0;
     char const* dot_filename        = NULL;
     size_t dot_filename_len         = 0;
+    char const* corpus_path         = NULL;
+    size_t corpus_path_len          = 0;
+    char const* parse_path          = NULL;
+    size_t parse_path_len           = 0;
+    char const* harness_filename    = NULL;
+    size_t harness_filename_len     = 0;
+    char const* out_dir             = NULL;
+    size_t out_dir_len              = 0;
     char const* pre_filename        = NULL;
     size_t pre_filename_len         = 0;
+    char const* query_path          = NULL;
+    size_t query_path_len           = 0;
+    char const* serve_path          = NULL;
+    size_t serve_path_len           = 0;
+    char const* shm_name            = NULL;
+    size_t shm_name_len             = 0;
+    char const* dump_filename       = NULL;
+    size_t dump_filename_len        = 0;
+    char const* wtbl_filename       = NULL;
+    size_t wtbl_filename_len        = 0;
+    char const* save_filename       = NULL;
+    size_t save_filename_len        = 0;
+    char const* tree_filename       = NULL;
+    size_t tree_filename_len        = 0;
+    char const* emit_filename       = NULL;
+    size_t emit_filename_len        = 0;
+    char const* replay_filename     = NULL;
+    size_t replay_filename_len      = 0;
+    char const* reduce_filename     = NULL;
+    size_t reduce_filename_len      = 0;
     char* root_str                  = NULL;
     size_t root_len                 = 0;
     bool* const is_arg_processed    = mem_calloc((size_t)argc, sizeof(bool));
     bool cov_guided                 = DEFAULT_COV_GUIDED;
+    bool uses_energy                = 0;
+    bool uses_feedback              = 0;
+    bool prints_derivations         = 0;
+    bool has_failures               = 0;
+    bool is_ready                   = 1;
+    bool optimizes                  = 0;
+    bool watches                    = 0;
+    bool prefix_frontier            = 0;
     bool unique                     = DEFAULT_UNIQUE;
+    uint32_t exec_timeout           = DEFAULT_EXEC_TIMEOUT;
+    uint32_t files_per_dir          = DEFAULT_FILES_PER_DIR;
+    uint32_t n_jobs                 = DEFAULT_JOBS;
     uint32_t min_depth              = DEFAULT_MIN_DEPTH;
+    uint32_t max_decisions          = DEFAULT_MAX_DECISIONS;
+    uint32_t max_bytes              = DEFAULT_MAX_BYTES;
+    uint32_t max_memory             = DEFAULT_MAX_MEMORY;
     uint32_t n                      = DEFAULT_N;
+    uint32_t pool_sz                = DEFAULT_POOL_SZ;
+    uint32_t prefix_depth           = DEFAULT_PREFIX_DEPTH;
     uint32_t seed                   = DEFAULT_SEED;
+    uint32_t shard_id               = DEFAULT_SHARD_ID;
+    uint32_t n_shards               = DEFAULT_N_SHARDS;
     uint32_t t                      = DEFAULT_TIMEOUT;
+    uint32_t target_size            = DEFAULT_TARGET_SIZE;
+    long bad_offset                 = -1;
 
     if (argc <= 1) {
         showUsage(argv[0]);
@@ -283,6 +1259,20 @@ int main(
         return EXIT_SUCCESS;
     }
 
+    /* Everything after -x belongs to the target, so no other option may see it. */
+    for (int i = 1; i < argc; i++) {
+        if (!LITEQ(argv[i], "-x") && !LITEQ(argv[i], "--exec")) continue;
+
+        if (i == argc - 1) {
+            showErrorParameterMissing("PROGRAM", "-x or --exec");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        target_argv = argv + i + 1;
+        argc        = i;
+        break;
+    }
+
     PROCESS_ARG("-C", "--copyright") {
         showCopyright();
         free(is_arg_processed);
@@ -313,88 +1303,670 @@ int main(
         break;
     }
 
-    PROCESS_ARG("-b", "--bnf") {
-        if (i == argc - 1 || (bnf_filename = argv[i + 1])[0] == '-') {
-            showErrorParameterMissing("FILENAME", "-b or --bnf");
+    /* A reader needs no grammar, it outputs whatever the writer of the ring generates. */
+    PROCESS_ARG("-G", "--shm-read") {
+        SharedRing reader[1]    = { NOT_A_SRING };
+        Item record             = NOT_AN_ITEM;
+        char const* const name  = (i == argc - 1) ? NULL : argv[i + 1];
+        if (name == NULL || name[0] == '-') {
+            showErrorParameterMissing("NAME", "-G or --shm-read");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (strlen(name) > SRING_MAX_LEN_NAME) {
+            showErrorParameterTooLong("NAME", "-G or --shm-read", SRING_MAX_LEN_NAME, strlen(name));
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (open_sring(reader, name) != SRING_OK) {
+            showErrorCannotOpenRing(name);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        while (claim_sring(reader, &record) == SRING_OK) {
+            printf("%.*s\n", (int)record.sz, (char*)record.p);
+            release_sring(reader, &record);
+        }
+        fprintf_verbose(stderr, "# Sentences Received = %"PRIu64, reader->n_records);
+        fprintf_verbose(stderr, "# Ring Waits (Empty) = %"PRIu64, reader->n_waits);
+        fprintf_verbose(stderr, "Finished.");
+        destruct_sring(reader);
+        free(is_arg_processed);
+        return EXIT_SUCCESS;
+    }
+
+    PROCESS_ARG("-a", "--emit-decisions") {
+        if (i == argc - 1 || (emit_filename = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("FILENAME", "-a or --emit-decisions");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        emit_filename_len = strlen(emit_filename);
+        if (emit_filename_len > FILENAME_MAX) {
+            showErrorParameterTooLong("FILENAME", "-a or --emit-decisions", FILENAME_MAX, emit_filename_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Decisions File = %.*s", FILENAME_MAX, emit_filename);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-A", "--replay") {
+        if (i == argc - 1 || (replay_filename = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("FILENAME", "-A or --replay");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        replay_filename_len = strlen(replay_filename);
+        if (replay_filename_len > FILENAME_MAX) {
+            showErrorParameterTooLong("FILENAME", "-A or --replay", FILENAME_MAX, replay_filename_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Replay File = %.*s", FILENAME_MAX, replay_filename);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-b", "--bnf") {
+        if (i == argc - 1 || (bnf_filename = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("FILENAME", "-b or --bnf");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        bnf_filename_len = strlen(bnf_filename);
+        if (bnf_filename_len > FILENAME_MAX) {
+            showErrorParameterTooLong("FILENAME", "-b or --bnf", FILENAME_MAX, bnf_filename_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "BNF File = %.*s", FILENAME_MAX, bnf_filename);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+    if (bnf_filename == NULL) {
+        showErrorNoBNFFilenameGiven();
+        free(is_arg_processed);
+        return EXIT_FAILURE;
+    }
+
+    PROCESS_ARG("-B", "--max-bytes") {
+        if (i == argc - 1) {
+            showErrorParameterMissing("NUMBER", "-B or --max-bytes");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (sscanf(argv[i + 1], "%"SCNu32, &max_bytes) != 1) {
+            showErrorBadNumber(argv[i], argv[i + 1]);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+    fprintf_verbose(stderr, "MAX_BYTES = %"PRIu32, max_bytes);
+
+    PROCESS_ARG("-c", "--cov-guided") {
+        cov_guided          = !DEFAULT_COV_GUIDED;
+        is_arg_processed[i] = 1;
+        break;
+    }
+    if (cov_guided)
+        fprintf_verbose(stderr, "COV_GUIDANCE = Enabled");
+    else
+        fprintf_verbose(stderr, "COV_GUIDANCE = Disabled");
+
+    PROCESS_ARG("-e", "--energy") {
+        if (!cov_guided) {
+            showErrorConflictingOptions("-e or --energy", "-c or --cov-guided");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        uses_energy         = 1;
+        is_arg_processed[i] = 1;
+        break;
+    }
+
+    /* Credit only reweights alternatives, so feedback runs on top of energy. */
+    PROCESS_ARG("-K", "--feedback") {
+        if (!cov_guided) {
+            showErrorConflictingOptions("-K or --feedback", "-c or --cov-guided");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (target_argv == NULL) {
+            showErrorWithoutTarget("-K or --feedback");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        uses_energy         = 1;
+        uses_feedback       = 1;
+        is_arg_processed[i] = 1;
+        break;
+    }
+    if (uses_feedback)
+        fprintf_verbose(stderr, "FEEDBACK = Enabled");
+    else
+        fprintf_verbose(stderr, "FEEDBACK = Disabled");
+    if (uses_energy)
+        fprintf_verbose(stderr, "ENERGY = Enabled");
+    else
+        fprintf_verbose(stderr, "ENERGY = Disabled");
+
+    PROCESS_ARG("-E", "--emit-tree") {
+        if (i == argc - 1 || (tree_filename = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("FILENAME", "-E or --emit-tree");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        tree_filename_len = strlen(tree_filename);
+        if (tree_filename_len > FILENAME_MAX) {
+            showErrorParameterTooLong("FILENAME", "-E or --emit-tree", FILENAME_MAX, tree_filename_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Derivation Tree File = %.*s", FILENAME_MAX, tree_filename);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-d", "--dot-file") {
+        if (i == argc - 1 || (dot_filename = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("FILENAME", "-d or --dot-file");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        dot_filename_len = strlen(dot_filename);
+        if (dot_filename_len > FILENAME_MAX) {
+            showErrorParameterTooLong("FILENAME", "-d or --dot-file", FILENAME_MAX, dot_filename_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (dot_filename != NULL)
+            fprintf_verbose(stderr, "DOT File = %.*s", FILENAME_MAX, dot_filename);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-D", "--derivations") {
+        prints_derivations  = 1;
+        is_arg_processed[i] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-f", "--files-per-dir") {
+        if (i == argc - 1) {
+            showErrorParameterMissing("NUMBER", "-f or --files-per-dir");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (sscanf(argv[i + 1], "%"SCNu32, &files_per_dir) != 1) {
+            showErrorBadNumber(argv[i], argv[i + 1]);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (files_per_dir > MAX_FILES_PER_DIR) {
+            showErrorFilesPerDirTooLarge(files_per_dir);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+    fprintf_verbose(stderr, "FILES_PER_DIR = %"PRIu32, files_per_dir);
+
+    PROCESS_ARG("-F", "--prefix-frontier") {
+        prefix_frontier     = 1;
+        is_arg_processed[i] = 1;
+        break;
+    }
+    if (prefix_frontier)
+        fprintf_verbose(stderr, "PREFIX_FRONTIER = Enabled");
+    else
+        fprintf_verbose(stderr, "PREFIX_FRONTIER = Disabled");
+
+    PROCESS_ARG("-g", "--shm") {
+        if (i == argc - 1 || (shm_name = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("NAME", "-g or --shm");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        shm_name_len = strlen(shm_name);
+        if (shm_name_len > SRING_MAX_LEN_NAME) {
+            showErrorParameterTooLong("NAME", "-g or --shm", SRING_MAX_LEN_NAME, shm_name_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Shared Memory Ring = %.*s", SRING_MAX_LEN_NAME, shm_name);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-H", "--harness") {
+        if (i == argc - 1 || (harness_filename = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("FILENAME", "-H or --harness");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        harness_filename_len = strlen(harness_filename);
+        if (harness_filename_len > FILENAME_MAX) {
+            showErrorParameterTooLong("FILENAME", "-H or --harness", FILENAME_MAX, harness_filename_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (target_argv != NULL) {
+            showErrorConflictingOptions("-H or --harness", "-x or --exec");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Harness File = %.*s", FILENAME_MAX, harness_filename);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-I", "--reduce") {
+        if (i == argc - 1 || (reduce_filename = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("FILENAME", "-I or --reduce");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        reduce_filename_len = strlen(reduce_filename);
+        if (reduce_filename_len > FILENAME_MAX) {
+            showErrorParameterTooLong("FILENAME", "-I or --reduce", FILENAME_MAX, reduce_filename_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Reduce File = %.*s", FILENAME_MAX, reduce_filename);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-j", "--jobs") {
+        if (i == argc - 1) {
+            showErrorParameterMissing("NUMBER", "-j or --jobs");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (sscanf(argv[i + 1], "%"SCNu32, &n_jobs) != 1) {
+            showErrorBadNumber(argv[i], argv[i + 1]);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (n_jobs > MAX_JOBS) {
+            showErrorJobsTooLarge(n_jobs);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+    fprintf_verbose(stderr, "JOBS = %"PRIu32, n_jobs);
+
+    PROCESS_ARG("-l", "--learn") {
+        if (i == argc - 1 || (corpus_path = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("PATH", "-l or --learn");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        corpus_path_len = strlen(corpus_path);
+        if (corpus_path_len > FILENAME_MAX) {
+            showErrorParameterTooLong("PATH", "-l or --learn", FILENAME_MAX, corpus_path_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Corpus = %.*s", FILENAME_MAX, corpus_path);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-L", "--prefix-depth") {
+        if (i == argc - 1) {
+            showErrorParameterMissing("NUMBER", "-L or --prefix-depth");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (sscanf(argv[i + 1], "%"SCNu32, &prefix_depth) != 1) {
+            showErrorBadNumber(argv[i], argv[i + 1]);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+    fprintf_verbose(stderr, "PREFIX_DEPTH = %"PRIu32, prefix_depth);
+
+    PROCESS_ARG("-m", "--min-depth") {
+        if (i == argc - 1) {
+            showErrorParameterMissing("NUMBER", "-m or --min-depth");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (sscanf(argv[i + 1], "%"SCNu32, &min_depth) != 1) {
+            showErrorBadNumber(argv[i], argv[i + 1]);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+    fprintf_verbose(stderr, "MIN_DEPTH = %"PRIu32, min_depth);
+
+    PROCESS_ARG("-M", "--max-decisions") {
+        if (i == argc - 1) {
+            showErrorParameterMissing("NUMBER", "-M or --max-decisions");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (sscanf(argv[i + 1], "%"SCNu32, &max_decisions) != 1) {
+            showErrorBadNumber(argv[i], argv[i + 1]);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+    fprintf_verbose(stderr, "MAX_DECISIONS = %"PRIu32, max_decisions);
+
+    PROCESS_ARG("-n", "--number") {
+        if (i == argc - 1) {
+            showErrorParameterMissing("NUMBER", "-n or --number");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (sscanf(argv[i + 1], "%"SCNu32, &n) != 1) {
+            showErrorBadNumber(argv[i], argv[i + 1]);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (n > MAX_N) {
+            showErrorNumberTooLarge(n);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+    fprintf_verbose(stderr, "# SENTENCES = %"PRIu32, n);
+
+    PROCESS_ARG("-N", "--pool") {
+        if (i == argc - 1) {
+            showErrorParameterMissing("NUMBER", "-N or --pool");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (sscanf(argv[i + 1], "%"SCNu32, &pool_sz) != 1) {
+            showErrorBadNumber(argv[i], argv[i + 1]);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (pool_sz > MAX_POOL) {
+            showErrorPoolTooLarge(pool_sz);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+    fprintf_verbose(stderr, "POOL_SZ = %"PRIu32, pool_sz);
+
+    PROCESS_ARG("-o", "--out-dir") {
+        if (i == argc - 1 || (out_dir = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("DIR", "-o or --out-dir");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        out_dir_len = strlen(out_dir);
+        if (out_dir_len > FILENAME_MAX) {
+            showErrorParameterTooLong("DIR", "-o or --out-dir", FILENAME_MAX, out_dir_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Output Directory = %.*s", FILENAME_MAX, out_dir);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-O", "--optimize") {
+        optimizes           = 1;
+        is_arg_processed[i] = 1;
+        break;
+    }
+    if (optimizes && tree_filename != NULL) {
+        showErrorConflictingOptions("-O or --optimize", "-E or --emit-tree");
+        free(is_arg_processed);
+        return EXIT_FAILURE;
+    }
+    if (optimizes)
+        fprintf_verbose(stderr, "OPTIMIZE = true");
+    else
+        fprintf_verbose(stderr, "OPTIMIZE = false");
+
+    PROCESS_ARG("-p", "--prefix-tree") {
+        if (i == argc - 1 || (pre_filename = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("FILENAME", "-p or --prefix-tree");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        pre_filename_len = strlen(pre_filename);
+        if (pre_filename_len > FILENAME_MAX) {
+            showErrorParameterTooLong("FILENAME", "-p or --prefix-tree", FILENAME_MAX, pre_filename_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (pre_filename != NULL)
+            fprintf_verbose(stderr, "Prefix Tree File = %.*s", FILENAME_MAX, pre_filename);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-P", "--parse") {
+        if (i == argc - 1 || (parse_path = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("PATH", "-P or --parse");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        parse_path_len = strlen(parse_path);
+        if (parse_path_len > FILENAME_MAX) {
+            showErrorParameterTooLong("PATH", "-P or --parse", FILENAME_MAX, parse_path_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Parse Path = %.*s", FILENAME_MAX, parse_path);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-q", "--query") {
+        if (i == argc - 1 || (query_path = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("SOCKET", "-q or --query");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        query_path_len = strlen(query_path);
+        if (query_path_len > FILENAME_MAX) {
+            showErrorParameterTooLong("SOCKET", "-q or --query", FILENAME_MAX, query_path_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Query Socket = %.*s", FILENAME_MAX, query_path);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-Q", "--max-memory") {
+        if (i == argc - 1) {
+            showErrorParameterMissing("NUMBER", "-Q or --max-memory");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (sscanf(argv[i + 1], "%"SCNu32, &max_memory) != 1) {
+            showErrorBadNumber(argv[i], argv[i + 1]);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (max_memory > MAX_MEMORY) {
+            showErrorMemoryTooLarge(max_memory);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+    fprintf_verbose(stderr, "MAX_MEMORY = %"PRIu32" MiB", max_memory);
+
+    PROCESS_ARG("-r", "--root") {
+        root_str = argv[i + 1];
+        if (root_str[0] == '-') {
+            showErrorParameterMissing(BNF_STR_RULE_OPEN"RULE"BNF_STR_RULE_CLOSE, "-r or --root");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        root_len = strlen(root_str);
+        if (root_len > BNF_MAX_LEN_TERM) {
+            showErrorParameterTooLong(
+                BNF_STR_RULE_OPEN"RULE"BNF_STR_RULE_CLOSE,
+                "-r or --root",
+                BNF_MAX_LEN_TERM,
+                root_len
+            );
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (!isRuleNameWellFormed_bnf(root_str, root_len)) {
+            showErrorRootStrBadFormat(root_str);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
+        break;
+    }
+
+    PROCESS_ARG("-R", "--watch") {
+        watches             = 1;
+        is_arg_processed[i] = 1;
+        break;
+    }
+    if (watches)
+        fprintf_verbose(stderr, "WATCH = true");
+    else
+        fprintf_verbose(stderr, "WATCH = false");
+
+    PROCESS_ARG("-s", "--seed") {
+        if (i == argc - 1) {
+            showErrorParameterMissing("NUMBER", "-s or --seed");
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        bnf_filename_len = strlen(bnf_filename);
-        if (bnf_filename_len > FILENAME_MAX) {
-            showErrorParameterTooLong("FILENAME", "-b or --bnf", FILENAME_MAX, bnf_filename_len);
+        if (sscanf(argv[i + 1], "%"SCNu32, &seed) != 1) {
+            showErrorBadNumber(argv[i], argv[i + 1]);
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        fprintf_verbose(stderr, "BNF File = %.*s", FILENAME_MAX, bnf_filename);
         is_arg_processed[i]     = 1;
         is_arg_processed[i + 1] = 1;
         break;
     }
-    if (bnf_filename == NULL) {
-        showErrorNoBNFFilenameGiven();
-        free(is_arg_processed);
-        return EXIT_FAILURE;
-    }
+    srand(seed);
+    fprintf_verbose(stderr, "seed = %"PRIu32, seed);
 
-    PROCESS_ARG("-c", "--cov-guided") {
-        cov_guided          = !DEFAULT_COV_GUIDED;
+    PROCESS_ARG("-S", "--same") {
+        unique              = 0;
         is_arg_processed[i] = 1;
         break;
     }
-    if (cov_guided)
-        fprintf_verbose(stderr, "COV_GUIDANCE = Enabled");
+    if (unique)
+        fprintf_verbose(stderr, "UNIQUE = true");
     else
-        fprintf_verbose(stderr, "COV_GUIDANCE = Disabled");
+        fprintf_verbose(stderr, "UNIQUE = false");
 
-    PROCESS_ARG("-d", "--dot-file") {
-        if (i == argc - 1 || (dot_filename = argv[i + 1])[0] == '-') {
-            showErrorParameterMissing("FILENAME", "-d or --dot-file");
+    PROCESS_ARG("-k", "--shard") {
+        char end = '\0';
+        if (i == argc - 1) {
+            showErrorParameterMissing("i/N", "-k or --shard");
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        dot_filename_len = strlen(dot_filename);
-        if (dot_filename_len > FILENAME_MAX) {
-            showErrorParameterTooLong("FILENAME", "-d or --dot-file", FILENAME_MAX, dot_filename_len);
+        if (
+            sscanf(argv[i + 1], "%"SCNu32"/%"SCNu32"%c", &shard_id, &n_shards, &end) != 2 ||
+            n_shards == 0 || n_shards > MAX_SHARDS || shard_id >= n_shards
+        ) {
+            showErrorBadShard(argv[i + 1]);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (!unique) {
+            showErrorConflictingOptions("-k or --shard", "-S or --same");
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        if (dot_filename != NULL)
-            fprintf_verbose(stderr, "DOT File = %.*s", FILENAME_MAX, dot_filename);
         is_arg_processed[i]     = 1;
         is_arg_processed[i + 1] = 1;
         break;
     }
+    fprintf_verbose(stderr, "SHARD = %"PRIu32"/%"PRIu32, shard_id, n_shards);
 
-    PROCESS_ARG("-m", "--min-depth") {
+    PROCESS_ARG("-t", "--timeout") {
         if (i == argc - 1) {
-            showErrorParameterMissing("NUMBER", "-m or --min-depth");
+            showErrorParameterMissing("NUMBER", "-t or --timeout");
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        if (sscanf(argv[i + 1], "%"SCNu32, &min_depth) != 1) {
+        if (sscanf(argv[i + 1], "%"PRIu32, &t) != 1) {
             showErrorBadNumber(argv[i], argv[i + 1]);
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
+        if (t > MAX_TIMEOUT) {
+            showErrorTimeoutTooLarge(t);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
         is_arg_processed[i]     = 1;
         is_arg_processed[i + 1] = 1;
         break;
     }
-    fprintf_verbose(stderr, "MIN_DEPTH = %"PRIu32, min_depth);
+    if (t == 1)
+        fprintf_verbose(stderr, "TIMEOUT = %"PRIu32" second", t);
+    else
+        fprintf_verbose(stderr, "TIMEOUT = %"PRIu32" seconds", t);
 
-    PROCESS_ARG("-n", "--number") {
+    PROCESS_ARG("-T", "--exec-timeout") {
         if (i == argc - 1) {
-            showErrorParameterMissing("NUMBER", "-n or --number");
+            showErrorParameterMissing("NUMBER", "-T or --exec-timeout");
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        if (sscanf(argv[i + 1], "%"SCNu32, &n) != 1) {
+        if (sscanf(argv[i + 1], "%"SCNu32, &exec_timeout) != 1 || exec_timeout == 0) {
             showErrorBadNumber(argv[i], argv[i + 1]);
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        if (n > MAX_N) {
-            showErrorNumberTooLarge(n);
+        if (exec_timeout > MAX_EXEC_TIMEOUT) {
+            showErrorExecTimeoutTooLarge(exec_timeout);
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
@@ -402,96 +1974,103 @@ int main(
         is_arg_processed[i + 1] = 1;
         break;
     }
-    fprintf_verbose(stderr, "# SENTENCES = %"PRIu32, n);
+    fprintf_verbose(stderr, "EXEC_TIMEOUT = %"PRIu32" ms", exec_timeout);
 
-    PROCESS_ARG("-p", "--prefix-tree") {
-        if (i == argc - 1 || (pre_filename = argv[i + 1])[0] == '-') {
-            showErrorParameterMissing("FILENAME", "-p or --prefix-tree");
+    PROCESS_ARG("-u", "--serve") {
+        if (i == argc - 1 || (serve_path = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("SOCKET", "-u or --serve");
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        pre_filename_len = strlen(pre_filename);
-        if (pre_filename_len > FILENAME_MAX) {
-            showErrorParameterTooLong("FILENAME", "-p or --prefix-tree", FILENAME_MAX, pre_filename_len);
+        serve_path_len = strlen(serve_path);
+        if (serve_path_len > FILENAME_MAX) {
+            showErrorParameterTooLong("SOCKET", "-u or --serve", FILENAME_MAX, serve_path_len);
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        if (pre_filename != NULL)
-            fprintf_verbose(stderr, "Prefix Tree File = %.*s", FILENAME_MAX, pre_filename);
+        if (query_path != NULL) {
+            showErrorConflictingOptions("-u or --serve", "-q or --query");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Serve Socket = %.*s", FILENAME_MAX, serve_path);
         is_arg_processed[i]     = 1;
         is_arg_processed[i + 1] = 1;
         break;
     }
 
-    PROCESS_ARG("-r", "--root") {
-        root_str = argv[i + 1];
-        if (root_str[0] == '-') {
-            showErrorParameterMissing(BNF_STR_RULE_OPEN"RULE"BNF_STR_RULE_CLOSE, "-r or --root");
-            free(is_arg_processed);
-            return EXIT_FAILURE;
-        }
-        root_len = strlen(root_str);
-        if (root_len > BNF_MAX_LEN_TERM) {
-            showErrorParameterTooLong(
-                BNF_STR_RULE_OPEN"RULE"BNF_STR_RULE_CLOSE,
-                "-r or --root",
-                BNF_MAX_LEN_TERM,
-                root_len
-            );
+    PROCESS_ARG("-w", "--weights") {
+        if (i == argc - 1 || (wtbl_filename = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("FILENAME", "-w or --weights");
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        if (!isRuleNameWellFormed_bnf(root_str, root_len)) {
-            showErrorRootStrBadFormat(root_str);
+        wtbl_filename_len = strlen(wtbl_filename);
+        if (wtbl_filename_len > FILENAME_MAX) {
+            showErrorParameterTooLong("FILENAME", "-w or --weights", FILENAME_MAX, wtbl_filename_len);
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
+        fprintf_verbose(stderr, "Weights File = %.*s", FILENAME_MAX, wtbl_filename);
         is_arg_processed[i]     = 1;
         is_arg_processed[i + 1] = 1;
         break;
     }
+    if (wtbl_filename != NULL && corpus_path != NULL) {
+        showErrorConflictingOptions("-w or --weights", "-l or --learn");
+        free(is_arg_processed);
+        return EXIT_FAILURE;
+    }
 
-    PROCESS_ARG("-s", "--seed") {
-        if (i == argc - 1) {
-            showErrorParameterMissing("NUMBER", "-s or --seed");
+    PROCESS_ARG("-W", "--save-weights") {
+        if (i == argc - 1 || (save_filename = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("FILENAME", "-W or --save-weights");
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        if (sscanf(argv[i + 1], "%"SCNu32, &seed) != 1) {
-            showErrorBadNumber(argv[i], argv[i + 1]);
+        save_filename_len = strlen(save_filename);
+        if (save_filename_len > FILENAME_MAX) {
+            showErrorParameterTooLong("FILENAME", "-W or --save-weights", FILENAME_MAX, save_filename_len);
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
+        fprintf_verbose(stderr, "Save Weights File = %.*s", FILENAME_MAX, save_filename);
         is_arg_processed[i]     = 1;
         is_arg_processed[i + 1] = 1;
         break;
     }
-    srand(seed);
-    fprintf_verbose(stderr, "seed = %"PRIu32, seed);
 
-    PROCESS_ARG("-S", "--same") {
-        unique              = 0;
-        is_arg_processed[i] = 1;
+    PROCESS_ARG("-Y", "--prefix-dump") {
+        if (i == argc - 1 || (dump_filename = argv[i + 1])[0] == '-') {
+            showErrorParameterMissing("FILENAME", "-Y or --prefix-dump");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        dump_filename_len = strlen(dump_filename);
+        if (dump_filename_len > FILENAME_MAX) {
+            showErrorParameterTooLong("FILENAME", "-Y or --prefix-dump", FILENAME_MAX, dump_filename_len);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Prefix Dump File = %.*s", FILENAME_MAX, dump_filename);
+        is_arg_processed[i]     = 1;
+        is_arg_processed[i + 1] = 1;
         break;
     }
-    if (unique)
-        fprintf_verbose(stderr, "UNIQUE = true");
-    else
-        fprintf_verbose(stderr, "UNIQUE = false");
 
-    PROCESS_ARG("-t", "--timeout") {
+    PROCESS_ARG("-z", "--target-size") {
         if (i == argc - 1) {
-            showErrorParameterMissing("NUMBER", "-t or --timeout");
+            showErrorParameterMissing("NUMBER", "-z or --target-size");
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        if (sscanf(argv[i + 1], "%"PRIu32, &t) != 1) {
+        if (sscanf(argv[i + 1], "%"SCNu32, &target_size) != 1) {
             showErrorBadNumber(argv[i], argv[i + 1]);
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
-        if (t > MAX_TIMEOUT) {
-            showErrorTimeoutTooLarge(t);
+        if (target_size > MAX_TARGET_SIZE) {
+            showErrorTargetSizeTooLarge(target_size);
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
@@ -499,10 +2078,188 @@ int main(
         is_arg_processed[i + 1] = 1;
         break;
     }
-    if (t == 1)
-        fprintf_verbose(stderr, "TIMEOUT = %"PRIu32" second", t);
-    else
-        fprintf_verbose(stderr, "TIMEOUT = %"PRIu32" seconds", t);
+    fprintf_verbose(stderr, "TARGET_SIZE = %"PRIu32, target_size);
+    if (target_size > 0 && (wtbl_filename != NULL || corpus_path != NULL)) {
+        showErrorConflictingOptions("-z or --target-size", wtbl_filename != NULL ? "-w or --weights" : "-l or --learn");
+        free(is_arg_processed);
+        return EXIT_FAILURE;
+    }
+
+    if (shm_name != NULL) {
+        char const* conflict = NULL;
+        if (target_argv != NULL)            conflict = "-x or --exec";
+        else if (harness_filename != NULL)  conflict = "-H or --harness";
+        else if (out_dir != NULL)           conflict = "-o or --out-dir";
+        else if (serve_path != NULL)        conflict = "-u or --serve";
+        else if (query_path != NULL)        conflict = "-q or --query";
+        if (conflict != NULL) {
+            showErrorConflictingOptions("-g or --shm", conflict);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (serve_path != NULL || query_path != NULL) {
+        char const* conflict = NULL;
+        if (target_argv != NULL)            conflict = "-x or --exec";
+        else if (harness_filename != NULL)  conflict = "-H or --harness";
+        else if (out_dir != NULL)           conflict = "-o or --out-dir";
+        else if (parse_path != NULL)        conflict = "-P or --parse";
+        else if (corpus_path != NULL)       conflict = "-l or --learn";
+        else if (wtbl_filename != NULL)     conflict = "-w or --weights";
+        else if (save_filename != NULL)     conflict = "-W or --save-weights";
+        else if (target_size > 0)           conflict = "-z or --target-size";
+        else if (tree_filename != NULL)     conflict = "-E or --emit-tree";
+        else if (optimizes)                 conflict = "-O or --optimize";
+        else if (n_shards > 1)              conflict = "-k or --shard";
+        else if (pre_filename != NULL)      conflict = "-p or --prefix-tree";
+        else if (dump_filename != NULL)     conflict = "-Y or --prefix-dump";
+        else if (dot_filename != NULL)      conflict = "-d or --dot-file";
+        else if (watches)                   conflict = "-R or --watch";
+        else if (emit_filename != NULL)     conflict = "-a or --emit-decisions";
+        else if (replay_filename != NULL)   conflict = "-A or --replay";
+        else if (reduce_filename != NULL)   conflict = "-I or --reduce";
+        else if (max_memory > 0)            conflict = "-Q or --max-memory";
+        if (conflict != NULL) {
+            showErrorConflictingOptions(serve_path != NULL ? "-u or --serve" : "-q or --query", conflict);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+    }
+    /* Only the server keeps sentences ready. */
+    if (pool_sz > 0 && serve_path == NULL) {
+        showErrorWithoutServer("-N or --pool");
+        free(is_arg_processed);
+        return EXIT_FAILURE;
+    }
+    /* Weights, the optimized grammar, shards and span trees all number the terms of one version of the grammar. */
+    if (watches) {
+        char const* conflict = NULL;
+        if (corpus_path != NULL)            conflict = "-l or --learn";
+        else if (wtbl_filename != NULL)     conflict = "-w or --weights";
+        else if (save_filename != NULL)     conflict = "-W or --save-weights";
+        else if (target_size > 0)           conflict = "-z or --target-size";
+        else if (tree_filename != NULL)     conflict = "-E or --emit-tree";
+        else if (optimizes)                 conflict = "-O or --optimize";
+        else if (n_shards > 1)              conflict = "-k or --shard";
+        else if (emit_filename != NULL)     conflict = "-a or --emit-decisions";
+        else if (replay_filename != NULL)   conflict = "-A or --replay";
+        if (conflict != NULL) {
+            showErrorConflictingOptions("-R or --watch", conflict);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+    }
+    /* Reducing runs the target of -x on its own candidates, and outputs nothing else. */
+    if (reduce_filename != NULL) {
+        char const* conflict = NULL;
+        if (target_argv == NULL) {
+            showErrorWithoutTarget("-I or --reduce");
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (harness_filename != NULL)       conflict = "-H or --harness";
+        else if (out_dir != NULL)           conflict = "-o or --out-dir";
+        else if (shm_name != NULL)          conflict = "-g or --shm";
+        else if (watches)                   conflict = "-R or --watch";
+        else if (emit_filename != NULL)     conflict = "-a or --emit-decisions";
+        else if (replay_filename != NULL)   conflict = "-A or --replay";
+        else if (uses_feedback)             conflict = "-K or --feedback";
+        else if (max_memory > 0)            conflict = "-Q or --max-memory";
+        if (conflict != NULL) {
+            showErrorConflictingOptions("-I or --reduce", conflict);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+    }
+    /* Decision files number the alternatives of the grammar as written. */
+    if (optimizes && (emit_filename != NULL || replay_filename != NULL)) {
+        showErrorConflictingOptions("-O or --optimize", emit_filename != NULL ? "-a or --emit-decisions" : "-A or --replay");
+        free(is_arg_processed);
+        return EXIT_FAILURE;
+    }
+    /* Replaying explores no prefix tree, and renders the whole file unless -n limits it. */
+    if (replay_filename != NULL) {
+        char const* conflict = NULL;
+        if (n_shards > 1)                   conflict = "-k or --shard";
+        else if (pre_filename != NULL)      conflict = "-p or --prefix-tree";
+        else if (dump_filename != NULL)     conflict = "-Y or --prefix-dump";
+        if (conflict != NULL) {
+            showErrorConflictingOptions("-A or --replay", conflict);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (n == 0) n = UINT32_MAX;
+    }
+
+    if (query_path != NULL) {
+        uint32_t n_received = 0;
+        int const result    = query_srv(stdout, &n_received, query_path, bnf_filename, n);
+
+        free(is_arg_processed);
+        fprintf_verbose(stderr, "# Sentences Received = %"PRIu32, n_received);
+        switch (result) {
+            case SRV_OK:
+                break;
+            case SRV_EXHAUSTED:
+                fprintf_verbose(stderr, "Exhausted all unique sentences!");
+                break;
+            case SRV_NOT_SERVED:
+                showErrorNotServed(query_path, bnf_filename);
+                return EXIT_FAILURE;
+            case SRV_CANNOT_CONNECT:
+            case SRV_BAD_RESPONSE:
+            default:
+                showErrorCannotQuery(query_path);
+                return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "Finished.");
+        return EXIT_SUCCESS;
+    }
+
+    if (serve_path != NULL) {
+        Server srv[1] = { NOT_A_SRV };
+
+        if (construct_srv(srv, serve_path, min_depth, cov_guided, uses_energy, unique, pool_sz) != SRV_OK) {
+            showErrorCannotListen(serve_path);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (!serveGrammar(srv, bnf_filename, root_str, root_len, max_decisions, max_bytes)) {
+            destruct_srv(srv);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        /* Every other -b is served too, under its own FILENAME. */
+        PROCESS_ARG("-b", "--bnf") {
+            char const* other_filename = NULL;
+            if (i == argc - 1 || (other_filename = argv[i + 1])[0] == '-') {
+                showErrorParameterMissing("FILENAME", "-b or --bnf");
+                destruct_srv(srv);
+                free(is_arg_processed);
+                return EXIT_FAILURE;
+            }
+            if (strlen(other_filename) > FILENAME_MAX) {
+                showErrorParameterTooLong("FILENAME", "-b or --bnf", FILENAME_MAX, strlen(other_filename));
+                destruct_srv(srv);
+                free(is_arg_processed);
+                return EXIT_FAILURE;
+            }
+            if (!serveGrammar(srv, other_filename, root_str, root_len, max_decisions, max_bytes)) {
+                destruct_srv(srv);
+                free(is_arg_processed);
+                return EXIT_FAILURE;
+            }
+            is_arg_processed[i]     = 1;
+            is_arg_processed[i + 1] = 1;
+        }
+
+        run_srv(srv, t);
+        destruct_srv(srv);
+        free(is_arg_processed);
+        fprintf_verbose(stderr, "Finished.");
+        return EXIT_SUCCESS;
+    }
 
     fp = fopen(bnf_filename, "r");
     if (fp == NULL) {
@@ -513,6 +2270,11 @@ int main(
     switch (construct_ggraph(graph, fp, root_str, (uint32_t)root_len)) {
         case GRAMMAR_OK:
             break;
+        case GRAMMAR_NO_SENTENCE:
+            showErrorNoSentence();
+            fclose(fp);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
         case GRAMMAR_SYNTAX_ERROR:
         default:
             showErrorSyntax();
@@ -523,43 +2285,292 @@ int main(
     fclose(fp);
     fp = NULL;
 
-    if (pre_filename != NULL) {
-        fp = fopen(pre_filename, "w");
+    if (reduce_filename != NULL) {
+        Reducer reducer[1]          = { NOT_A_REDUCER };
+        uint64_t const deadline_ns  = (t == 0) ? 0 : monotonicNs_dbudget() + (uint64_t)t * 1000000000;
+        Item reduced                = NOT_AN_ITEM;
+
+        if (construct_reducer(reducer, graph, target_argv, exec_timeout, n_jobs) != REDUCER_OK) {
+            showErrorCannotStartTarget(target_argv[0]);
+            destruct_ggraph(graph);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "# Reducer Workers = %"PRIu32, reducer->n_workers);
+        switch (reduce_reducer(reducer, reduce_filename, deadline_ns)) {
+            case REDUCER_OK:
+                break;
+            case REDUCER_CANNOT_OPEN:
+                showErrorCannotOpenFile(reduce_filename);
+                has_failures = 1;
+                break;
+            case REDUCER_REJECTED:
+                showErrorNotDerived(reduce_filename);
+                has_failures = 1;
+                break;
+            case REDUCER_NOT_FAILING:
+                showErrorNotFailing(target_argv[0], reduce_filename);
+                has_failures = 1;
+                break;
+            case REDUCER_CANNOT_RUN:
+            default:
+                showErrorCannotStartTarget(target_argv[0]);
+                has_failures = 1;
+        }
+        if (!has_failures) {
+            reduced = getLast_chunk(reducer->best);
+            fwrite(reduced.p, 1, reduced.sz, stdout);
+            fprintf_verbose(stderr, "Input Size = %"PRIu32" bytes", reducer->input_sz);
+            fprintf_verbose(stderr, "Reduced Size = %"PRIu32" bytes", reduced.sz);
+            fprintf_verbose(stderr, "# Reductions = %"PRIu64, reducer->n_reductions);
+        }
+        fprintf_verbose(stderr, "# Tests = %"PRIu64, reducer->n_tests);
+        fprintf_verbose(stderr, "Tests per Second = %.1f", testsPerSecond_reducer(reducer));
+        fprintf_verbose(stderr, "Finished.");
+
+        destruct_reducer(reducer);
+        destruct_ggraph(graph);
+        free(is_arg_processed);
+        return has_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (parse_path != NULL) {
+        Corpus corpus[1]    = { NOT_A_CORPUS };
+        uint32_t n_accepted = 0;
+        if (construct_corpus(corpus, parse_path) != CORPUS_OK) {
+            showErrorCannotOpenCorpus(parse_path);
+            destruct_ggraph(graph);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        n_accepted  = parse_corpus(stdout, corpus, graph, n_jobs, prints_derivations);
+        has_failures = (n_accepted < LEN_CHUNK(corpus->paths));
+        fprintf_verbose(stderr, "# Parsed Files (Accepted) = %"PRIu32, n_accepted);
+        fprintf_verbose(stderr, "# Parsed Files (Rejected) = %"PRIu32, LEN_CHUNK(corpus->paths) - n_accepted);
+        destruct_corpus(corpus);
+    }
+
+    if (corpus_path != NULL) {
+        Corpus corpus[1]    = { NOT_A_CORPUS };
+        uint32_t n_accepted = 0;
+        if (construct_corpus(corpus, corpus_path) != CORPUS_OK) {
+            showErrorCannotOpenCorpus(corpus_path);
+            destruct_ggraph(graph);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fprintf_verbose(stderr, "# Corpus Files = %"PRIu32, LEN_CHUNK(corpus->paths));
+        n_accepted = learnWeights_corpus(wtbl, corpus, graph, n_jobs);
+        fprintf_verbose(stderr, "# Corpus Files (Parsed) = %"PRIu32, n_accepted);
+        fprintf_verbose(stderr, "# Corpus Files (Rejected) = %"PRIu32, LEN_CHUNK(corpus->paths) - n_accepted);
+        destruct_corpus(corpus);
+    } else if (wtbl_filename != NULL) {
+        fp = fopen(wtbl_filename, "r");
         if (fp == NULL) {
-            showErrorCannotOpenFile(pre_filename);
+            showErrorCannotOpenFile(wtbl_filename);
+            destruct_ggraph(graph);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (load_wtbl(wtbl, fp, graph) != WTBL_OK) {
+            showErrorSyntaxWeights();
+            fclose(fp);
+            destruct_ggraph(graph);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        fclose(fp);
+        fp = NULL;
+    } else if (target_size > 0) {
+        double expected_size = 0.0;
+        if (constructBoltzmann_wtbl(wtbl, &expected_size, graph, (double)target_size) != WTBL_OK) {
+            showErrorNotTunable(target_size);
+            if (isValid_wtbl(wtbl)) destruct_wtbl(wtbl);
             destruct_ggraph(graph);
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
+        fprintf_verbose(stderr, "Expected Size = %.1f bytes", expected_size);
     }
-    generateAndPrintSentencesWithinTimeout(graph, n, t, min_depth, cov_guided, unique, fp);
-    if (fp != NULL) {
+
+    if (save_filename != NULL) {
+        fp = fopen(save_filename, "w");
+        if (fp == NULL) {
+            showErrorCannotOpenFile(save_filename);
+            if (isValid_wtbl(wtbl)) destruct_wtbl(wtbl);
+            destruct_ggraph(graph);
+            free(is_arg_processed);
+            return EXIT_FAILURE;
+        }
+        if (!isValid_wtbl(wtbl)) constructUniform_wtbl(wtbl, graph);
+        save_wtbl(fp, wtbl, graph);
         fclose(fp);
         fp = NULL;
     }
 
+    if (pre_filename != NULL) {
+        outs->prefix_fp = fopen(pre_filename, "w");
+        if (outs->prefix_fp == NULL) {
+            showErrorCannotOpenFile(pre_filename);
+            is_ready = 0;
+        }
+    }
+    if (is_ready && dump_filename != NULL) {
+        outs->dump_fp = fopen(dump_filename, "wb");
+        if (outs->dump_fp == NULL) {
+            showErrorCannotOpenFile(dump_filename);
+            is_ready = 0;
+        }
+    }
+    if (is_ready && tree_filename != NULL) {
+        outs->tree_fp = fopen(tree_filename, "wb");
+        if (outs->tree_fp == NULL || !writeHeader_stree(outs->tree_fp, graph)) {
+            showErrorCannotOpenFile(tree_filename);
+            is_ready = 0;
+        }
+    }
+    if (is_ready && (emit_filename != NULL || replay_filename != NULL)) construct_dlog(outs->dlog, graph);
+    if (is_ready && emit_filename != NULL) {
+        outs->emit_fp = fopen(emit_filename, "wb");
+        if (outs->emit_fp == NULL || !writeHeader_dlog(outs->emit_fp, outs->dlog)) {
+            showErrorCannotOpenFile(emit_filename);
+            is_ready = 0;
+        }
+    }
+    if (is_ready && replay_filename != NULL) {
+        outs->replay_fp = fopen(replay_filename, "rb");
+        if (outs->replay_fp == NULL) {
+            showErrorCannotOpenFile(replay_filename);
+            is_ready = 0;
+        } else if (readHeader_dlog(outs->dlog, outs->replay_fp) != DLOG_OK) {
+            showErrorBadDecisions(replay_filename);
+            is_ready = 0;
+        }
+    }
+    if (is_ready && harness_filename != NULL) {
+        if (construct_harness(outs->harness, harness_filename, n_jobs) != HARNESS_OK) {
+            showErrorCannotLoadHarness(harness_filename);
+            is_ready = 0;
+        } else {
+            fprintf_verbose(stderr, "# Harness Instances = %"PRIu32, outs->harness->n_workers);
+        }
+    }
+    if (is_ready && target_argv != NULL) {
+        if (construct_exec(outs->executor, target_argv, exec_timeout, uses_feedback) != EXEC_OK) {
+            showErrorCannotStartTarget(target_argv[0]);
+            is_ready = 0;
+        } else {
+            fprintf_verbose(stderr, "Target = %.*s", FILENAME_MAX, target_argv[0]);
+            if (isUsingForkserver_exec(outs->executor))
+                fprintf_verbose(stderr, "Target Mode = Forkserver");
+            else
+                fprintf_verbose(stderr, "Target Mode = Fork & Exec");
+        }
+    }
+    if (is_ready && out_dir != NULL) {
+        if (construct_fsink(outs->sink, out_dir, files_per_dir, n) != FSINK_OK) {
+            showErrorCannotOpenOutDir(out_dir);
+            is_ready = 0;
+        } else if (isUsingRing_fsink(outs->sink)) {
+            fprintf_verbose(stderr, "Output Directory I/O = io_uring");
+        } else {
+            fprintf_verbose(stderr, "Output Directory I/O = System Calls");
+        }
+    }
+    if (is_ready && shm_name != NULL) {
+        uint64_t const deadline_ns = (t == 0) ? 0 : monotonicNs_dbudget() + (uint64_t)t * 1000000000;
+        if (construct_sring(outs->ring, shm_name, deadline_ns) != SRING_OK) {
+            showErrorCannotOpenRing(shm_name);
+            is_ready = 0;
+        }
+    }
+    if (!is_ready) {
+        closeOutputs(outs);
+        if (isValid_wtbl(wtbl)) destruct_wtbl(wtbl);
+        destruct_ggraph(graph);
+        free(is_arg_processed);
+        return EXIT_FAILURE;
+    }
+
+    opts->n                 = n;
+    opts->t                 = t;
+    opts->min_depth         = min_depth;
+    opts->max_decisions     = max_decisions;
+    opts->max_bytes         = max_bytes;
+    opts->max_memory        = max_memory;
+    opts->shard_id          = shard_id;
+    opts->n_shards          = n_shards;
+    opts->prefix_depth      = prefix_depth;
+    opts->root_len          = (uint32_t)root_len;
+    opts->root_str          = root_str;
+    opts->watch_filename    = watches ? bnf_filename : NULL;
+    opts->cov_guided        = cov_guided;
+    opts->uses_energy       = uses_energy;
+    opts->unique            = unique;
+    opts->prefix_frontier   = prefix_frontier;
+    construct_cov(cov, graph);
+    if (optimizes) {
+        OptimizedGrammar ogrammar[1]    = { NOT_AN_OGRAMMAR };
+        WeightTable opt_wtbl[1]         = { NOT_A_WTBL };
+        Coverage opt_cov[1]             = { NOT_A_COV };
+
+        construct_ogrammar(ogrammar, graph);
+        construct_cov(opt_cov, ogrammar->graph);
+        if (isValid_wtbl(wtbl)) {
+            projectWeights_ogrammar(opt_wtbl, ogrammar, wtbl);
+            destruct_wtbl(wtbl);
+        }
+        /* -O conflicts with -R, -a and -A, so nothing in opts or outs numbers the grammar as written. */
+        bad_offset = generateAndPrintSentencesWithinTimeout(
+            opt_cov, ogrammar->graph, isValid_wtbl(opt_wtbl) ? opt_wtbl : NULL, opts, outs
+        );
+        projectCoverage_ogrammar(cov, ogrammar, opt_cov);
+        if (isValid_wtbl(opt_wtbl)) destruct_wtbl(opt_wtbl);
+        destruct_cov(opt_cov);
+        destruct_ogrammar(ogrammar);
+    } else {
+        bad_offset = generateAndPrintSentencesWithinTimeout(
+            cov, graph, isValid_wtbl(wtbl) ? wtbl : NULL, opts, outs
+        );
+        if (isValid_wtbl(wtbl)) destruct_wtbl(wtbl);
+    }
+    if (bad_offset >= 0) {
+        showErrorBadRecord(replay_filename, bad_offset);
+        has_failures = 1;
+    }
+    /* The last batch of -o goes out before reportOutputs, so its failed files count. */
+    if (isValid_fsink(outs->sink) && flush_fsink(outs->sink) != FSINK_OK) {
+        showErrorCannotWriteOutDir(out_dir);
+        has_failures = 1;
+    }
+    if (isValid_exec(outs->executor) && outs->executor->n_crashes > 0) has_failures = 1;
+    reportOutputs(outs);
+    if (!closeOutputs(outs)) has_failures = 1;
+
     if (dot_filename != NULL) {
         fp = fopen(dot_filename, "w");
         if (fp == NULL) {
             showErrorCannotOpenFile(dot_filename);
+            destruct_cov(cov);
             destruct_ggraph(graph);
             free(is_arg_processed);
             return EXIT_FAILURE;
         }
 
-        printDot_ggraph(fp, graph);
+        printDot_ggraph(fp, graph, cov);
         fclose(fp);
         fp = NULL;
     }
 
-    fprintf_verbose(stderr, "# Terms (Covered-Once) = %"PRIu32, graph->n_cov);
+    fprintf_verbose(stderr, "# Terms (Covered-Once) = %"PRIu32, cov->n_cov);
     fprintf_verbose(stderr, "# Terms (Total) = %"PRIu32, nTerms_ggraph(graph));
-    fprintf_verbose(stderr, "Term Coverage = %"PRIu32"%%", termCov_ggraph(graph));
+    fprintf_verbose(stderr, "Term Coverage = %"PRIu32"%%", termCov_cov(cov));
     fprintf_verbose(stderr, "Finished.");
 
+    destruct_cov(cov);
     destruct_ggraph(graph);
     free(is_arg_processed);
-    return EXIT_SUCCESS;
+    return has_failures ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 #undef PROCESS_ARG
 #undef LITEQ
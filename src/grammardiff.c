@@ -0,0 +1,291 @@
+#include <assert.h>
+#include "grammardiff.h"
+#include "padkit/chunktable.h"
+#include "padkit/invalid.h"
+#include "padkit/memalloc.h"
+#include "padkit/repeat.h"
+
+static bool addAltKey(
+    Chunk* const alt_keys,
+    GrammarGraph const* const graph,
+    uint32_t const* const rule_targets,
+    uint32_t const* const terminal_targets,
+    uint32_t const rule_id,
+    uint32_t const first_exp_id
+);
+
+/*
+ * The key is the new rule id followed by every (rt_id << 1 | is_terminal)
+ * of the alternative in new ids. Without targets, the ids are already new.
+ * Returns 0, and adds nothing, if a term has no counterpart.
+ */
+static bool addAltKey(
+    Chunk* const alt_keys,
+    GrammarGraph const* const graph,
+    uint32_t const* const rule_targets,
+    uint32_t const* const terminal_targets,
+    uint32_t const rule_id,
+    uint32_t const first_exp_id
+) {
+    ExpansionTerm const* exp = get_alist(graph->exp_list, first_exp_id);
+
+    add_chunk(alt_keys, &rule_id, sizeof(uint32_t));
+    do {
+        uint32_t rt_id = exp->rt_id;
+
+        if (rule_targets != NULL)
+            rt_id = exp->is_terminal ? terminal_targets[rt_id] : rule_targets[rt_id];
+        if (rt_id == INVALID_UINT32) {
+            deleteLast_chunk(alt_keys);
+            return 0;
+        }
+
+        rt_id = (rt_id << 1) | exp->is_terminal;
+        appendLast_chunk(alt_keys, &rt_id, sizeof(uint32_t));
+    } while ((exp++)->has_next);
+
+    return 1;
+}
+
+uint32_t altTarget_gdiff(
+    GrammarDiff const* const diff,
+    uint32_t const old_rule_id,
+    uint32_t const old_alt_id
+) {
+    assert(isValid_gdiff(diff));
+    assert(old_rule_id + 1 < diff->alt_offsets->len);
+    {
+        uint32_t const offset = *(uint32_t*)get_alist(diff->alt_offsets, old_rule_id);
+        assert(offset + old_alt_id < *(uint32_t*)get_alist(diff->alt_offsets, old_rule_id + 1));
+        return *(uint32_t*)get_alist(diff->alt_targets, offset + old_alt_id);
+    }
+}
+
+void construct_gdiff(
+    GrammarDiff* const diff,
+    GrammarGraph const* const old_graph,
+    GrammarGraph const* const new_graph
+) {
+    uint32_t const n_old_rules          = old_graph->rule_list->len;
+    uint32_t const n_new_rules          = new_graph->rule_list->len;
+    uint32_t const n_old_terminals      = LEN_CHUNK(old_graph->terminals);
+    uint32_t* const rule_targets        = mem_alloc(((size_t)n_old_rules + 1) * sizeof(uint32_t));
+    uint32_t* const terminal_targets    = mem_alloc(((size_t)n_old_terminals + 1) * sizeof(uint32_t));
+    bool* const is_rule_matched         = mem_calloc((size_t)n_new_rules + 1, sizeof(bool));
+    bool* const is_alt_taken            = mem_calloc((size_t)new_graph->exp_list->len + 1, sizeof(bool));
+    Chunk alt_keys[1]                   = { NOT_A_CHUNK };
+    ChunkTable rule_tbl[1]              = { NOT_A_CTBL };
+    ChunkTable terminal_tbl[1]          = { NOT_A_CTBL };
+    ChunkTable alt_tbl[1]               = { NOT_A_CTBL };
+    ChunkMapping const* mapping         = NULL;
+    uint32_t const invalid              = INVALID_UINT32;
+    uint32_t n_alts                     = 0;
+
+    assert(diff != NULL);
+    assert(isValid_ggraph(old_graph));
+    assert(isValid_ggraph(new_graph));
+
+    diff->old_graph         = old_graph;
+    diff->new_graph         = new_graph;
+    diff->n_kept_rules      = 0;
+    diff->n_changed_rules   = 0;
+    diff->n_added_rules     = 0;
+    diff->n_removed_rules   = 0;
+    constructEmpty_alist(diff->rule_targets, sizeof(uint32_t), n_old_rules + 1);
+    constructEmpty_alist(diff->alt_offsets, sizeof(uint32_t), n_old_rules + 1);
+    constructEmpty_alist(diff->alt_targets, sizeof(uint32_t), old_graph->exp_list->len + 1);
+    constructEmpty_alist(diff->exp_targets, sizeof(uint32_t), old_graph->exp_list->len + 1);
+
+    constructEmpty_chunk(alt_keys, CHUNK_RECOMMENDED_PARAMETERS);
+    constructEmpty_ctbl(rule_tbl, CTBL_RECOMMENDED_PARAMETERS);
+    constructEmpty_ctbl(terminal_tbl, CTBL_RECOMMENDED_PARAMETERS);
+    constructEmpty_ctbl(alt_tbl, CTBL_RECOMMENDED_PARAMETERS);
+
+    for (uint32_t rule_id = 0; rule_id < n_new_rules; rule_id++) {
+        RuleTerm const* const rule = get_alist(new_graph->rule_list, rule_id);
+        searchInsert_ctbl(
+            NULL, rule_tbl, get_chunk(new_graph->rule_names, rule->name_id), rule_id, CTBL_MODE_INSERT_RESPECT
+        );
+    }
+    for (uint32_t terminal_id = 0; terminal_id < LEN_CHUNK(new_graph->terminals); terminal_id++)
+        searchInsert_ctbl(
+            NULL, terminal_tbl, get_chunk(new_graph->terminals, terminal_id), terminal_id, CTBL_MODE_INSERT_RESPECT
+        );
+
+    for (uint32_t rule_id = 0; rule_id < n_old_rules; rule_id++) {
+        RuleTerm const* const rule = get_alist(old_graph->rule_list, rule_id);
+        mapping = searchInsert_ctbl(
+            NULL, rule_tbl, get_chunk(old_graph->rule_names, rule->name_id), invalid, CTBL_MODE_SEARCH
+        );
+        rule_targets[rule_id] = (mapping == NULL) ? INVALID_UINT32 : mapping->value;
+        add_alist(diff->rule_targets, rule_targets + rule_id);
+        if (mapping != NULL) is_rule_matched[mapping->value] = 1;
+    }
+    for (uint32_t terminal_id = 0; terminal_id < n_old_terminals; terminal_id++) {
+        mapping = searchInsert_ctbl(
+            NULL, terminal_tbl, get_chunk(old_graph->terminals, terminal_id), invalid, CTBL_MODE_SEARCH
+        );
+        terminal_targets[terminal_id] = (mapping == NULL) ? INVALID_UINT32 : mapping->value;
+    }
+
+    /* Identical alternatives of a new rule keep the first one. */
+    for (uint32_t rule_id = 0; rule_id < n_new_rules; rule_id++) {
+        RuleTerm const* const rule = get_alist(new_graph->rule_list, rule_id);
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+            addAltKey(alt_keys, new_graph, NULL, NULL, rule_id, *(uint32_t*)get_alist(rule->alt_list, alt_id));
+            mapping = searchInsert_ctbl(NULL, alt_tbl, getLast_chunk(alt_keys), alt_id, CTBL_MODE_INSERT_RESPECT);
+            if (mapping->value != alt_id) deleteLast_chunk(alt_keys);
+        }
+    }
+
+    REPEAT(old_graph->exp_list->len) add_alist(diff->exp_targets, &invalid);
+    for (uint32_t rule_id = 0; rule_id < n_old_rules; rule_id++) {
+        RuleTerm const* const rule  = get_alist(old_graph->rule_list, rule_id);
+        uint32_t const target_id    = rule_targets[rule_id];
+        RuleTerm const* target      = NULL;
+        uint32_t n_matched          = 0;
+
+        add_alist(diff->alt_offsets, &n_alts);
+        n_alts += rule->alt_list->len;
+        if (target_id == INVALID_UINT32) {
+            REPEAT(rule->alt_list->len) add_alist(diff->alt_targets, &invalid);
+            diff->n_removed_rules++;
+            continue;
+        }
+
+        target = get_alist(new_graph->rule_list, target_id);
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+            uint32_t const exp_id   = *(uint32_t*)get_alist(rule->alt_list, alt_id);
+            uint32_t alt_target     = INVALID_UINT32;
+
+            if (addAltKey(alt_keys, old_graph, rule_targets, terminal_targets, target_id, exp_id)) {
+                mapping = searchInsert_ctbl(NULL, alt_tbl, getLast_chunk(alt_keys), invalid, CTBL_MODE_SEARCH);
+                deleteLast_chunk(alt_keys);
+                if (mapping != NULL) alt_target = mapping->value;
+            }
+            if (alt_target != INVALID_UINT32) {
+                uint32_t const new_exp_id = *(uint32_t*)get_alist(target->alt_list, alt_target);
+
+                if (is_alt_taken[new_exp_id]) {
+                    alt_target = INVALID_UINT32;
+                } else {
+                    ExpansionTerm const* exp = get_alist(old_graph->exp_list, exp_id);
+
+                    is_alt_taken[new_exp_id] = 1;
+                    for (uint32_t i = 0; ; i++) {
+                        *(uint32_t*)get_alist(diff->exp_targets, exp_id + i) = new_exp_id + i;
+                        if (!(exp++)->has_next) break;
+                    }
+                    n_matched++;
+                }
+            }
+            add_alist(diff->alt_targets, &alt_target);
+        }
+
+        if (n_matched == rule->alt_list->len && n_matched == target->alt_list->len)
+            diff->n_kept_rules++;
+        else
+            diff->n_changed_rules++;
+    }
+    add_alist(diff->alt_offsets, &n_alts);
+
+    for (uint32_t rule_id = 0; rule_id < n_new_rules; rule_id++)
+        diff->n_added_rules += !is_rule_matched[rule_id];
+
+    free(rule_targets);
+    free(terminal_targets);
+    free(is_rule_matched);
+    free(is_alt_taken);
+    destruct_chunk(alt_keys);
+    destruct_ctbl(rule_tbl);
+    destruct_ctbl(terminal_tbl);
+    destruct_ctbl(alt_tbl);
+}
+
+void destruct_gdiff(GrammarDiff* const diff) {
+    assert(isValid_gdiff(diff));
+
+    destruct_alist(diff->rule_targets);
+    destruct_alist(diff->alt_offsets);
+    destruct_alist(diff->alt_targets);
+    destruct_alist(diff->exp_targets);
+
+    *diff = NOT_A_GDIFF;
+}
+
+bool isKeptRule_gdiff(
+    GrammarDiff const* const diff,
+    uint32_t const old_rule_id
+) {
+    RuleTerm const* rule        = NULL;
+    RuleTerm const* target      = NULL;
+    uint32_t const target_id    = ruleTarget_gdiff(diff, old_rule_id);
+
+    if (target_id == INVALID_UINT32) return 0;
+
+    rule    = get_alist(diff->old_graph->rule_list, old_rule_id);
+    target  = get_alist(diff->new_graph->rule_list, target_id);
+    if (rule->alt_list->len != target->alt_list->len) return 0;
+
+    for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++)
+        if (altTarget_gdiff(diff, old_rule_id, alt_id) == INVALID_UINT32) return 0;
+
+    return 1;
+}
+
+bool isValid_gdiff(GrammarDiff const* const diff) {
+    if (diff == NULL)                                                       return 0;
+    if (!isValid_ggraph(diff->old_graph))                                   return 0;
+    if (!isValid_ggraph(diff->new_graph))                                   return 0;
+    if (!isValid_alist(diff->rule_targets))                                 return 0;
+    if (diff->rule_targets->len != diff->old_graph->rule_list->len)         return 0;
+    if (!isValid_alist(diff->alt_offsets))                                  return 0;
+    if (diff->alt_offsets->len != diff->rule_targets->len + 1)              return 0;
+    if (!isValid_alist(diff->alt_targets))                                  return 0;
+    if (!isValid_alist(diff->exp_targets))                                  return 0;
+    if (diff->exp_targets->len != diff->old_graph->exp_list->len)           return 0;
+
+    return 1;
+}
+
+void migrateCoverage_gdiff(
+    Coverage* const cov,
+    GrammarDiff const* const diff,
+    Coverage const* const old_cov
+) {
+    assert(isValid_cov(cov));
+    assert(isValid_gdiff(diff));
+    assert(isValid_cov(old_cov));
+    assert(cov->n_rules == diff->new_graph->rule_list->len);
+    assert(cov->n_exps == diff->new_graph->exp_list->len);
+    assert(old_cov->n_rules == diff->old_graph->rule_list->len);
+    assert(old_cov->n_exps == diff->old_graph->exp_list->len);
+
+    for (uint32_t rule_id = 0; rule_id < cov->n_rules; rule_id++)
+        cov->rule_counts[rule_id] = 0;
+    for (uint32_t exp_id = 0; exp_id < cov->n_exps; exp_id++)
+        cov->exp_counts[exp_id] = 0;
+
+    for (uint32_t rule_id = 0; rule_id < old_cov->n_rules; rule_id++)
+        if (isKeptRule_gdiff(diff, rule_id))
+            cov->rule_counts[ruleTarget_gdiff(diff, rule_id)] = old_cov->rule_counts[rule_id];
+    for (uint32_t exp_id = 0; exp_id < old_cov->n_exps; exp_id++) {
+        uint32_t const target_id = *(uint32_t*)get_alist(diff->exp_targets, exp_id);
+        if (target_id != INVALID_UINT32) cov->exp_counts[target_id] = old_cov->exp_counts[exp_id];
+    }
+
+    cov->n_cov = 0;
+    for (uint32_t rule_id = 0; rule_id < cov->n_rules; rule_id++)
+        cov->n_cov += (cov->rule_counts[rule_id] > 0);
+    for (uint32_t exp_id = 0; exp_id < cov->n_exps; exp_id++)
+        cov->n_cov += (cov->exp_counts[exp_id] > 0);
+}
+
+uint32_t ruleTarget_gdiff(
+    GrammarDiff const* const diff,
+    uint32_t const old_rule_id
+) {
+    assert(isValid_gdiff(diff));
+    assert(old_rule_id < diff->rule_targets->len);
+    return *(uint32_t*)get_alist(diff->rule_targets, old_rule_id);
+}
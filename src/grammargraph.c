@@ -3,9 +3,14 @@
 #include <inttypes.h>
 #include <string.h>
 #include "bnf.h"
+#include "coverage.h"
+#include "fragmenttable.h"
 #include "grammargraph.h"
+#include "memoryusage.h"
+#include "spantree.h"
 #include "padkit/chunktable.h"
 #include "padkit/invalid.h"
+#include "padkit/memalloc.h"
 #include "padkit/repeat.h"
 #include "padkit/size.h"
 #include "padkit/swap.h"
@@ -59,6 +64,16 @@ static int determineRootRule(
     uint32_t const root_len
 );
 
+static void expandRule(
+    ArrayList* const stack,
+    Chunk* const str_builder,
+    Coverage* const cov,
+    FragmentTable const* const ftbl,
+    GrammarGraph const* const graph,
+    uint32_t const rule_id,
+    uint32_t const** const p_decision
+);
+
 static int load_ggraph(
     GrammarGraph* const graph,
     ChunkTable* const rule_tbl,
@@ -68,6 +83,8 @@ static int load_ggraph(
     uint32_t const root_len
 );
 
+static int pruneUselessTerms(GrammarGraph* const graph);
+
 static int skipEquiv(
     char const* const line_begin,
     uint32_t const line_sz,
@@ -104,7 +121,6 @@ static int addExpansions(
             exp                 = addIndeterminate_alist(graph->exp_list);
             exp->is_terminal    = 0;
             exp->rt_id          = child_id;
-            exp->cov_count      = 0;
             exp->has_next       = 1;
         } else if (LITEQ(line_begin + *i, BNF_STR_TERMINAL_OPEN)) {
             uint32_t const terminal_id = addTerminal(graph, terminal_tbl, line_begin, line_sz, i);
@@ -113,7 +129,6 @@ static int addExpansions(
             exp                 = addIndeterminate_alist(graph->exp_list);
             exp->is_terminal    = 1;
             exp->rt_id          = terminal_id;
-            exp->cov_count      = 0;
             exp->has_next       = 1;
         } else if (LITEQ(line_begin + *i, BNF_STR_ALTERNATIVE)) {
             int const result = skipSpaces(line_begin, line_sz, i);
@@ -164,7 +179,6 @@ static uint32_t addRule(
     if (ins_result == CTBL_RESPECT_UNIQUE) {
         RuleTerm* const parent  = addIndeterminate_alist(graph->rule_list);
         parent->name_id         = LEN_CHUNK(graph->rule_names) - 1;
-        parent->cov_count       = 0;
         parent->alt_list[0]     = NOT_AN_ALIST;
         constructEmpty_alist(parent->alt_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
     } else {
@@ -231,8 +245,15 @@ int construct_ggraph(
     constructEmpty_alist(graph->exp_list, sizeof(ExpansionTerm), ALIST_RECOMMENDED_INITIAL_CAP);
 
     construct_res = load_ggraph(graph, rule_tbl, terminal_tbl, lines, root_str, root_len);
+    if (construct_res == GRAMMAR_OK)
+        construct_res = pruneUselessTerms(graph);
 
     if (construct_res != GRAMMAR_OK) {
+        RuleTerm* rule = getFirst_alist(graph->rule_list);
+        REPEAT(graph->rule_list->len) {
+            destruct_alist(rule->alt_list);
+            rule++;
+        }
         destruct_chunk(graph->rule_names);
         destruct_chunk(graph->terminals);
         destruct_alist(graph->rule_list);
@@ -287,85 +308,108 @@ static int determineRootRule(
     }
 }
 
-void fillCovMtx_ggraph(
-    BitMatrix* const cov_mtx,
+/*
+ * Pushes the alternative of rule_id that *p_decision picks, or renders the
+ * whole rule or alternative at once if ftbl has a fragment for it.
+ */
+static void expandRule(
+    ArrayList* const stack,
+    Chunk* const str_builder,
+    Coverage* const cov,
+    FragmentTable const* const ftbl,
     GrammarGraph const* const graph,
-    uint32_t const rule_id
+    uint32_t const rule_id,
+    uint32_t const** const p_decision
 ) {
-    RuleTerm const* rule        = NULL;
-    uint32_t const* p_exp_id    = NULL;
+    RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+    uint32_t exp_id             = 0;
     ExpansionTerm const* exp    = NULL;
+    uint32_t n_exps             = 1;
 
-    assert(isValid_bmtx(cov_mtx));
-    assert(isValid_ggraph(graph));
-    assert(rule_id < graph->rule_list->len);
-
-    rule        = get_alist(graph->rule_list, rule_id);
-    p_exp_id    = getFirst_alist(rule->alt_list);
-    for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
-        exp = get_alist(graph->exp_list, *(p_exp_id++));
-        if (exp->cov_count == 0)
-            unset_bmtx(cov_mtx, 0, alt_id);
-        else
-            set_bmtx(cov_mtx, 0, alt_id);
+    if (ftbl != NULL && renderRule_ftbl(str_builder, cov, ftbl, rule_id, p_decision)) return;
 
-        while (exp->has_next) exp++;
-    }
+    exp_id = *(uint32_t*)get_alist(rule->alt_list, *((*p_decision)++));
+    if (ftbl != NULL && renderAlt_ftbl(str_builder, cov, ftbl, exp_id)) return;
+
+    exp = get_alist(graph->exp_list, exp_id);
+    while ((exp++)->has_next) n_exps++;
+    REPEAT(n_exps) { exp--; push_alist(stack, &exp); }
 }
 
+/*
+ * With a SpanTree, every rule pushes a NULL below its expansion, and popping
+ * it closes the span of the rule, which open_list holds innermost last. The
+ * spans need every term, so fragments render only without one.
+ */
 void generateSentence_ggraph(
     Chunk* const str_builder,
-    GrammarGraph* const graph,
+    Coverage* const cov,
+    SpanTree* const stree,
+    FragmentTable const* const ftbl,
+    GrammarGraph const* const graph,
     ArrayList const* const seq
 ) {
-    ArrayList stack[1]          = { NOT_AN_ALIST };
-    Item terminal               = NOT_AN_ITEM;
-    RuleTerm* rule              = NULL;
-    uint32_t const* p_decision  = NULL;
-    uint32_t const* p_exp_id    = NULL;
-    ExpansionTerm* exp          = NULL;
-    uint32_t n_exps             = 0;
+    ArrayList stack[1]                  = { NOT_AN_ALIST };
+    ArrayList open_list[1]              = { NOT_AN_ALIST };
+    Item terminal                       = NOT_AN_ITEM;
+    FragmentTable const* const frags    = (stree == NULL) ? ftbl : NULL;
+    uint32_t const* p_decision          = NULL;
+    ExpansionTerm const* const first    = getFirst_alist(graph->exp_list);
+    ExpansionTerm const* const close    = NULL;
+    ExpansionTerm const* exp            = NULL;
+    uint32_t sz                         = 0;
+    uint32_t span_id                    = 0;
 
     assert(isValid_chunk(str_builder));
+    assert(cov == NULL || isValid_cov(cov));
+    assert(stree == NULL || isValid_stree(stree));
+    assert(ftbl == NULL || isValid_ftbl(ftbl));
     assert(isValid_ggraph(graph));
+    assert(cov == NULL || cov->n_exps == graph->exp_list->len);
+    assert(ftbl == NULL || ftbl->n_exps == graph->exp_list->len);
     assert(isValid_alist(seq));
     assert(seq->len > 0);
 
-    p_decision  = getFirst_alist(seq);
-    rule        = get_alist(graph->rule_list, graph->root_rule_id);
-    if (rule->cov_count == 0)       graph->n_cov++;
-    if (rule->cov_count < SZ32_MAX) rule->cov_count++;
+    p_decision = getFirst_alist(seq);
+    if (cov != NULL) hitRule_cov(cov, graph->root_rule_id);
 
-    constructEmpty_alist(stack, sizeof(ExpansionTerm*), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(stack, sizeof(ExpansionTerm const*), ALIST_RECOMMENDED_INITIAL_CAP);
     addIndeterminate_chunk(str_builder, 0);
+    if (stree != NULL) {
+        constructEmpty_alist(open_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+        span_id = add_stree(stree, STREE_TERM(graph->root_rule_id, 0), 0);
+        push_alist(open_list, &span_id);
+        push_alist(stack, &close);
+    }
 
-    p_exp_id    = get_alist(rule->alt_list, *(p_decision++));
-    exp         = get_alist(graph->exp_list, *p_exp_id);
-    n_exps      = 1;
-    while ((exp++)->has_next) n_exps++;
-    REPEAT(n_exps) { exp--; push_alist(stack, &exp); }
-
-    do {
-        exp = *(ExpansionTerm**)pop_alist(stack);
+    expandRule(stack, str_builder, cov, frags, graph, graph->root_rule_id, &p_decision);
 
-        if (exp->cov_count == 0)        graph->n_cov++;
-        if (exp->cov_count < SZ32_MAX)  exp->cov_count++;
+    while (stack->len > 0) {
+        exp = *(ExpansionTerm const**)pop_alist(stack);
+        if (exp == NULL) {
+            close_stree(stree, *(uint32_t*)pop_alist(open_list), sz);
+            continue;
+        }
+        if (cov != NULL) hitExp_cov(cov, (uint32_t)(exp - first));
 
         if (exp->is_terminal) {
             terminal = get_chunk(graph->terminals, exp->rt_id);
             appendLast_chunk(str_builder, terminal.p, terminal.sz);
+            if (stree != NULL) close_stree(stree, add_stree(stree, STREE_TERM(exp->rt_id, 1), sz), sz + terminal.sz);
+            sz += terminal.sz;
         } else {
-            rule = get_alist(graph->rule_list, exp->rt_id);
-            if (rule->cov_count == 0)       graph->n_cov++;
-            if (rule->cov_count < SZ32_MAX) rule->cov_count++;
-
-            p_exp_id    = get_alist(rule->alt_list, *(p_decision++));
-            exp         = get_alist(graph->exp_list, *p_exp_id);
-            n_exps      = 1;
-            while ((exp++)->has_next) n_exps++;
-            REPEAT(n_exps) { exp--; push_alist(stack, &exp); }
+            if (cov != NULL) hitRule_cov(cov, exp->rt_id);
+            if (stree != NULL) {
+                span_id = add_stree(stree, STREE_TERM(exp->rt_id, 0), sz);
+                push_alist(open_list, &span_id);
+                push_alist(stack, &close);
+            }
+            expandRule(stack, str_builder, cov, frags, graph, exp->rt_id, &p_decision);
         }
-    } while (stack->len > 0);
+    }
+
+    if (stree != NULL) destruct_alist(open_list);
+    destruct_alist(stack);
 }
 
 bool isValid_ggraph(GrammarGraph const* const graph) {
@@ -375,11 +419,24 @@ bool isValid_ggraph(GrammarGraph const* const graph) {
     if (!isValid_alist(graph->rule_list))                               return 0;
     if (!isValid_alist(graph->exp_list))                                return 0;
     if (graph->root_rule_id >= graph->rule_list->len)                   return 0;
-    if (graph->n_cov > graph->rule_list->len + graph->exp_list->len)    return 0;
 
     return 1;
 }
 
+size_t memoryUsage_ggraph(GrammarGraph const* const graph) {
+    RuleTerm const* rule    = NULL;
+    size_t n_bytes          = 0;
+
+    assert(isValid_ggraph(graph));
+
+    n_bytes = MUSAGE_CHUNK(graph->rule_names) + MUSAGE_CHUNK(graph->terminals)
+            + MUSAGE_ALIST(graph->rule_list) + MUSAGE_ALIST(graph->exp_list);
+    rule = getFirst_alist(graph->rule_list);
+    for (uint32_t i = 0; i < graph->rule_list->len; i++) n_bytes += MUSAGE_ALIST(rule[i].alt_list);
+
+    return n_bytes;
+}
+
 static int load_ggraph(
     GrammarGraph* const graph,
     ChunkTable* const rule_tbl,
@@ -436,10 +493,12 @@ uint32_t nTerms_ggraph(GrammarGraph const* const graph) {
 
 void printDot_ggraph(
     FILE* const output,
-    GrammarGraph const* const graph
+    GrammarGraph const* const graph,
+    Coverage const* const cov
 ) {
     assert(output != NULL);
     assert(isValid_ggraph(graph));
+    assert(cov == NULL || isValid_cov(cov));
 
     fprintf(output,
         "digraph GrammarGraph {\n"
@@ -457,7 +516,7 @@ void printDot_ggraph(
             rule_id, (int)rule_name.sz, (char*)rule_name.p
         );
 
-        if (rule->cov_count == 0)
+        if (cov == NULL || cov->rule_counts[rule_id] == 0)
             fprintf(output, "];\n");
         else
             fprintf(output, ",style=\"filled\"];\n");
@@ -467,7 +526,8 @@ void printDot_ggraph(
         uint32_t const* p_exp_id    = getFirst_alist(rule->alt_list);
 
         for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
-            ExpansionTerm const* exp    = get_alist(graph->exp_list, *(p_exp_id++));
+            uint32_t exp_id             = *(p_exp_id++);
+            ExpansionTerm const* exp    = get_alist(graph->exp_list, exp_id);
             uint32_t port_id            = 0;
             bool is_covered             = 0;
 
@@ -492,7 +552,8 @@ void printDot_ggraph(
                 }
                 port_id++;
                 if (exp->has_next) fprintf(output, "|");
-                is_covered = is_covered || exp->cov_count > 0;
+                if (cov != NULL && cov->exp_counts[exp_id] > 0) is_covered = 1;
+                exp_id++;
             } while ((exp++)->has_next);
             fprintf(output, "\",shape=\"record\"");
             if (is_covered)
@@ -529,6 +590,174 @@ void printDot_ggraph(
     fprintf(output, "}\n");
 }
 
+/*
+ * Shrinks the graph to the root's subgrammar. A rule survives if it derives a
+ * finite sentence and the root reaches it, an alternative survives if all of
+ * its rules do. Productivity is a worklist fixpoint: an alternative becomes
+ * productive once its last pending rule does, and so does its owner.
+ */
+static int pruneUselessTerms(GrammarGraph* const graph) {
+    uint32_t const n_rules          = graph->rule_list->len;
+    uint32_t const n_exps           = graph->exp_list->len;
+    uint32_t* const alt_offsets     = mem_alloc(((size_t)n_rules + 1) * sizeof(uint32_t));
+    uint32_t* const occ_offsets     = mem_calloc((size_t)n_rules + 2, sizeof(uint32_t));
+    uint32_t* const occ_alts        = mem_alloc(((size_t)n_exps + 1) * sizeof(uint32_t));
+    uint32_t* const stack           = mem_alloc(((size_t)n_rules + 1) * sizeof(uint32_t));
+    uint32_t* const rule_map        = mem_alloc(((size_t)n_rules + 1) * sizeof(uint32_t));
+    bool* const is_productive       = mem_calloc((size_t)n_rules + 1, sizeof(bool));
+    bool* const is_reachable        = mem_calloc((size_t)n_rules + 1, sizeof(bool));
+    uint32_t* alt_owners            = NULL;
+    uint32_t* n_pending             = NULL;
+    uint32_t n_alts                 = 0;
+    uint32_t n_useful_alts          = 0;
+    uint32_t n_kept_rules           = 0;
+    uint32_t n_stack                = 0;
+    ArrayList exp_list[1]           = { NOT_AN_ALIST };
+
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+        alt_offsets[rule_id] = n_alts;
+        n_alts += ((RuleTerm*)get_alist(graph->rule_list, rule_id))->alt_list->len;
+    }
+    alt_offsets[n_rules]    = n_alts;
+    alt_owners              = mem_alloc(((size_t)n_alts + 1) * sizeof(uint32_t));
+    n_pending               = mem_calloc((size_t)n_alts + 1, sizeof(uint32_t));
+
+    /* occ_alts[occ_offsets[r] .. occ_offsets[r + 1]) lists the alternatives that expand into r, once per occurrence. */
+    for (uint32_t exp_id = 0; exp_id < n_exps; exp_id++) {
+        ExpansionTerm const* const exp = get_alist(graph->exp_list, exp_id);
+        if (!exp->is_terminal) occ_offsets[exp->rt_id + 2]++;
+    }
+    for (uint32_t i = 2; i <= n_rules + 1; i++)
+        occ_offsets[i] += occ_offsets[i - 1];
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+        RuleTerm const* const rule = get_alist(graph->rule_list, rule_id);
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+            uint32_t const g_alt_id     = alt_offsets[rule_id] + alt_id;
+            uint32_t exp_id             = *(uint32_t*)get_alist(rule->alt_list, alt_id);
+            ExpansionTerm const* exp    = NULL;
+
+            alt_owners[g_alt_id] = rule_id;
+            do {
+                exp = get_alist(graph->exp_list, exp_id++);
+                if (exp->is_terminal) continue;
+
+                occ_alts[occ_offsets[exp->rt_id + 1]++] = g_alt_id;
+                n_pending[g_alt_id]++;
+            } while (exp->has_next);
+        }
+    }
+
+    for (uint32_t g_alt_id = 0; g_alt_id < n_alts; g_alt_id++) {
+        uint32_t const rule_id = alt_owners[g_alt_id];
+        if (n_pending[g_alt_id] > 0 || is_productive[rule_id]) continue;
+
+        is_productive[rule_id]  = 1;
+        stack[n_stack++]        = rule_id;
+    }
+    while (n_stack > 0) {
+        uint32_t const rule_id = stack[--n_stack];
+        for (uint32_t occ_id = occ_offsets[rule_id]; occ_id < occ_offsets[rule_id + 1]; occ_id++) {
+            uint32_t const g_alt_id = occ_alts[occ_id];
+            uint32_t const owner_id = alt_owners[g_alt_id];
+            if (--n_pending[g_alt_id] > 0 || is_productive[owner_id]) continue;
+
+            is_productive[owner_id] = 1;
+            stack[n_stack++]        = owner_id;
+        }
+    }
+
+    if (is_productive[graph->root_rule_id]) {
+        is_reachable[graph->root_rule_id]   = 1;
+        stack[n_stack++]                    = graph->root_rule_id;
+    }
+    while (n_stack > 0) {
+        uint32_t const rule_id      = stack[--n_stack];
+        RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+            uint32_t exp_id             = *(uint32_t*)get_alist(rule->alt_list, alt_id);
+            ExpansionTerm const* exp    = NULL;
+
+            if (n_pending[alt_offsets[rule_id] + alt_id] > 0) continue;
+
+            n_useful_alts++;
+            do {
+                exp = get_alist(graph->exp_list, exp_id++);
+                if (exp->is_terminal || is_reachable[exp->rt_id]) continue;
+
+                is_reachable[exp->rt_id]    = 1;
+                stack[n_stack++]            = exp->rt_id;
+            } while (exp->has_next);
+        }
+    }
+
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+        if (is_reachable[rule_id])
+            rule_map[rule_id] = n_kept_rules++;
+        else
+            rule_map[rule_id] = INVALID_UINT32;
+    }
+
+    if (n_kept_rules > 0 && (n_kept_rules < n_rules || n_useful_alts < n_alts)) {
+        constructEmpty_alist(exp_list, sizeof(ExpansionTerm), n_exps + 1);
+        for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+            RuleTerm rule               = *(RuleTerm*)get_alist(graph->rule_list, rule_id);
+            Item const name             = get_chunk(graph->rule_names, rule.name_id);
+            ArrayList alt_list[1]       = { NOT_AN_ALIST };
+
+            if (rule_map[rule_id] == INVALID_UINT32) {
+                if (is_productive[rule_id])
+                    fprintf_verbose(stderr, "Unreachable Rule = %.*s", (int)name.sz, (char const*)name.p);
+                else
+                    fprintf_verbose(stderr, "Unproductive Rule = %.*s", (int)name.sz, (char const*)name.p);
+                destruct_alist(rule.alt_list);
+                continue;
+            }
+
+            constructEmpty_alist(alt_list, sizeof(uint32_t), rule.alt_list->len + 1);
+            for (uint32_t alt_id = 0; alt_id < rule.alt_list->len; alt_id++) {
+                uint32_t exp_id             = *(uint32_t*)get_alist(rule.alt_list, alt_id);
+                ExpansionTerm const* exp    = NULL;
+
+                if (n_pending[alt_offsets[rule_id] + alt_id] > 0) continue;
+
+                add_alist(alt_list, &(exp_list->len));
+                do {
+                    ExpansionTerm* const copy = addIndeterminate_alist(exp_list);
+
+                    exp     = get_alist(graph->exp_list, exp_id++);
+                    *copy   = *exp;
+                    if (!exp->is_terminal) copy->rt_id = rule_map[exp->rt_id];
+                } while (exp->has_next);
+            }
+            destruct_alist(rule.alt_list);
+            rule.alt_list[0] = alt_list[0];
+
+            /* rule_map never exceeds rule_id, so no rule ahead is overwritten. */
+            *(RuleTerm*)get_alist(graph->rule_list, rule_map[rule_id]) = rule;
+        }
+        REPEAT(n_rules - n_kept_rules) pop_alist(graph->rule_list);
+
+        destruct_alist(graph->exp_list);
+        graph->exp_list[0]  = exp_list[0];
+        graph->root_rule_id = rule_map[graph->root_rule_id];
+
+        fprintf_verbose(stderr, "# Rules (Pruned) = %"PRIu32, n_rules - n_kept_rules);
+        fprintf_verbose(stderr, "# Expansion Terms (Pruned) = %"PRIu32, n_exps - graph->exp_list->len);
+    }
+
+    free(alt_offsets);
+    free(occ_offsets);
+    free(occ_alts);
+    free(stack);
+    free(rule_map);
+    free(is_productive);
+    free(is_reachable);
+    free(alt_owners);
+    free(n_pending);
+
+    return (n_kept_rules > 0) ? GRAMMAR_OK : GRAMMAR_NO_SENTENCE;
+}
+
 static int skipSpaces(
     char const* const line_begin,
     uint32_t const line_sz,
@@ -550,17 +779,6 @@ static int skipEquiv(
     return GRAMMAR_OK;
 }
 
-uint32_t termCov_ggraph(GrammarGraph const* const graph) {
-    assert(isValid_ggraph(graph));
-    {
-        uint32_t const n_total      = nTerms_ggraph(graph);
-        uint32_t const n_cov_x_100  = 100 * graph->n_cov;
-        assert(n_cov_x_100 / 100 == graph->n_cov);
-
-        return n_cov_x_100 / n_total;
-    }
-}
-
 #undef LITEQ
 #undef LITNEQ
 #undef IS_COMMENT_OR_EMPTY
@@ -0,0 +1,354 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <dlfcn.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "derivationbudget.h"
+#include "harness.h"
+#include "padkit/memalloc.h"
+
+#define HARNESS_COPY_TEMPLATE "/gfuzzer-harness-XXXXXX"
+
+typedef int (*HarnessEntryPoint)(uint8_t const* const data, size_t const sz);
+
+typedef int (*HarnessInitPoint)(int* const argc, char*** const argv);
+
+typedef struct HarnessWorkerBody {
+    Harness*            harness;
+    void*               handle;
+    HarnessEntryPoint   entry;
+    Item                current;
+    uint64_t            n_execs;
+    uint64_t            n_rejects;
+} HarnessWorker;
+
+static int const crash_signals[] = { SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV };
+
+static Harness* crashing_harness = NULL;
+
+static char* copyLibrary(char const* const lib_path);
+
+static bool loadInstance(
+    HarnessWorker* const worker,
+    char const* const lib_path,
+    bool const is_copy
+);
+
+static void reportCrash(int const sig);
+
+static void runBatch(
+    HarnessWorker* const worker,
+    Chunk const* const batch
+);
+
+static void* work(void* const arg);
+
+/* A second dlopen of the same path returns the same instance, but a copy of the file does not. */
+static char* copyLibrary(char const* const lib_path) {
+    char const* tmp_dir = getenv("TMPDIR");
+    char* copy_path     = NULL;
+    FILE* src           = NULL;
+    FILE* dst           = NULL;
+    char buffer[BUFSIZ];
+    size_t n_read       = 0;
+    bool is_copied      = 1;
+    int fd              = -1;
+
+    if (tmp_dir == NULL || tmp_dir[0] == '\0') tmp_dir = "/tmp";
+    copy_path = mem_alloc(strlen(tmp_dir) + sizeof(HARNESS_COPY_TEMPLATE));
+    strcpy(copy_path, tmp_dir);
+    strcat(copy_path, HARNESS_COPY_TEMPLATE);
+
+    if ((fd = mkstemp(copy_path)) < 0) {
+        free(copy_path);
+        return NULL;
+    }
+    if ((src = fopen(lib_path, "rb")) == NULL || (dst = fdopen(fd, "wb")) == NULL) {
+        if (src != NULL) fclose(src);
+        close(fd);
+        unlink(copy_path);
+        free(copy_path);
+        return NULL;
+    }
+
+    while ((n_read = fread(buffer, 1, sizeof(buffer), src)) > 0)
+        if (fwrite(buffer, 1, n_read, dst) != n_read) is_copied = 0;
+    if (ferror(src)) is_copied = 0;
+    fclose(src);
+    if (fclose(dst) != 0) is_copied = 0;
+
+    if (!is_copied) {
+        unlink(copy_path);
+        free(copy_path);
+        return NULL;
+    }
+    return copy_path;
+}
+
+int construct_harness(
+    Harness* const harness,
+    char const* const lib_path,
+    uint32_t const n_jobs
+) {
+    uint32_t n_workers = n_jobs;
+
+    assert(harness != NULL);
+    assert(lib_path != NULL);
+
+    if (n_workers == 0) {
+        long const n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = (n_cpus > 0) ? (uint32_t)n_cpus : 1;
+    }
+    if (n_workers > HARNESS_MAX_JOBS) n_workers = HARNESS_MAX_JOBS;
+
+    *harness            = NOT_A_HARNESS;
+    harness->workers    = mem_calloc(n_workers, sizeof(HarnessWorker));
+    for (uint32_t i = 0; i < n_workers; i++) {
+        harness->workers[i].harness = harness;
+        if (loadInstance(harness->workers + i, lib_path, i > 0)) continue;
+
+        while (i-- > 0) dlclose(harness->workers[i].handle);
+        free(harness->workers);
+        *harness = NOT_A_HARNESS;
+        return HARNESS_CANNOT_LOAD;
+    }
+    harness->n_workers = n_workers;
+
+    if (n_workers > 1) {
+        uint32_t n_started = 0;
+
+        harness->threads = mem_calloc(n_workers, sizeof(pthread_t));
+        while (n_started < n_workers && pthread_create(harness->threads + n_started, NULL, work, harness->workers + n_started) == 0)
+            n_started++;
+
+        /* If no thread could start, the calling thread runs the first instance. */
+        if (n_started == 0) {
+            free(harness->threads);
+            harness->threads = NULL;
+            for (uint32_t i = 1; i < n_workers; i++) dlclose(harness->workers[i].handle);
+            harness->n_workers = 1;
+        } else {
+            for (uint32_t i = n_started; i < n_workers; i++) dlclose(harness->workers[i].handle);
+            harness->n_workers = n_started;
+        }
+    }
+
+    crashing_harness = harness;
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++)
+        signal(crash_signals[i], reportCrash);
+
+    harness->start_ns = monotonicNs_dbudget();
+    return HARNESS_OK;
+}
+
+void destruct_harness(Harness* const harness) {
+    assert(isValid_harness(harness));
+
+    wait_harness(harness);
+    if (harness->threads != NULL) {
+        pthread_mutex_lock(&harness->mutex);
+        harness->is_stopping = 1;
+        pthread_cond_broadcast(&harness->batch_ready);
+        pthread_mutex_unlock(&harness->mutex);
+        for (uint32_t i = 0; i < harness->n_workers; i++) pthread_join(harness->threads[i], NULL);
+        free(harness->threads);
+    }
+
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++)
+        signal(crash_signals[i], SIG_DFL);
+    crashing_harness = NULL;
+
+    for (uint32_t i = 0; i < harness->n_workers; i++) dlclose(harness->workers[i].handle);
+    free(harness->workers);
+    pthread_mutex_destroy(&harness->mutex);
+    pthread_cond_destroy(&harness->batch_ready);
+    pthread_cond_destroy(&harness->batch_done);
+
+    *harness = NOT_A_HARNESS;
+}
+
+double execsPerSecond_harness(Harness const* const harness) {
+    uint64_t const elapsed_ns = monotonicNs_dbudget() - harness->start_ns;
+    assert(isValid_harness(harness));
+    return (elapsed_ns == 0) ? 0.0 : (double)harness->n_execs * 1e9 / (double)elapsed_ns;
+}
+
+bool isValid_harness(Harness const* const harness) {
+    if (harness == NULL)                        return 0;
+    if (harness->n_workers == 0)                return 0;
+    if (harness->n_workers > HARNESS_MAX_JOBS)  return 0;
+    if (harness->workers == NULL)               return 0;
+
+    return 1;
+}
+
+static bool loadInstance(
+    HarnessWorker* const worker,
+    char const* const lib_path,
+    bool const is_copy
+) {
+    char* const copy_path   = is_copy ? copyLibrary(lib_path) : NULL;
+    HarnessInitPoint init   = NULL;
+    char* init_argv[]       = { (char*)lib_path, NULL };
+    char** p_init_argv      = init_argv;
+    int init_argc           = 1;
+
+    if (is_copy && copy_path == NULL) return 0;
+
+    /* A path without a slash would be searched in the library path instead. */
+    if (strchr(lib_path, '/') == NULL && !is_copy) {
+        char* const local_path = mem_alloc(strlen(lib_path) + 3);
+        strcpy(local_path, "./");
+        strcat(local_path, lib_path);
+        worker->handle = dlopen(local_path, RTLD_NOW | RTLD_LOCAL);
+        free(local_path);
+    } else {
+        worker->handle = dlopen(is_copy ? copy_path : lib_path, RTLD_NOW | RTLD_LOCAL);
+    }
+    if (copy_path != NULL) {
+        unlink(copy_path);
+        free(copy_path);
+    }
+    if (worker->handle == NULL) return 0;
+
+    *(void**)(&worker->entry)   = dlsym(worker->handle, HARNESS_ENTRY_POINT);
+    *(void**)(&init)            = dlsym(worker->handle, HARNESS_INIT_POINT);
+    if (worker->entry == NULL) {
+        dlclose(worker->handle);
+        worker->handle = NULL;
+        return 0;
+    }
+    if (init != NULL) init(&init_argc, &p_init_argv);
+
+    return 1;
+}
+
+/* Prints the sentence that crashed the calling thread like the executor does, using only async-signal-safe calls. */
+static void reportCrash(int const sig) {
+    Harness const* const harness    = crashing_harness;
+    char prefix[32]                 = "CRASH ";
+    size_t len                      = 6;
+    char digits[16];
+    size_t n_digits                 = 0;
+
+    for (int n = sig; n > 0 || n_digits == 0; n /= 10) digits[n_digits++] = (char)('0' + n % 10);
+    while (n_digits > 0) prefix[len++] = digits[--n_digits];
+    prefix[len++] = '\t';
+
+    if (harness != NULL) {
+        for (uint32_t i = 0; i < harness->n_workers; i++) {
+            HarnessWorker const* const worker = harness->workers + i;
+            ssize_t res                         = 0;
+            if (harness->threads != NULL && !pthread_equal(harness->threads[i], pthread_self())) continue;
+            if (worker->current.p == NULL) continue;
+
+            res = write(STDOUT_FILENO, prefix, len);
+            if (res >= 0) res = write(STDOUT_FILENO, worker->current.p, worker->current.sz);
+            if (res >= 0) res = write(STDOUT_FILENO, "\n", 1);
+            break;
+        }
+    }
+
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void runBatch(
+    HarnessWorker* const worker,
+    Chunk const* const batch
+) {
+    for (uint32_t id = 0; id < LEN_CHUNK(batch); id++) {
+        worker->current = get_chunk(batch, id);
+        if (worker->entry(worker->current.p, worker->current.sz) != 0) worker->n_rejects++;
+        worker->n_execs++;
+    }
+    worker->current = NOT_AN_ITEM;
+}
+
+void submit_harness(
+    Harness* const harness,
+    Chunk const* const batch
+) {
+    assert(isValid_harness(harness));
+    assert(isValid_chunk(batch));
+
+    if (harness->threads == NULL) {
+        HarnessWorker* const worker = harness->workers;
+        runBatch(worker, batch);
+        harness->n_execs    = worker->n_execs;
+        harness->n_rejects  = worker->n_rejects;
+        return;
+    }
+
+    wait_harness(harness);
+    pthread_mutex_lock(&harness->mutex);
+    harness->batch      = batch;
+    harness->next_id    = 0;
+    harness->n_done     = 0;
+    harness->batch_no++;
+    pthread_cond_broadcast(&harness->batch_ready);
+    pthread_mutex_unlock(&harness->mutex);
+}
+
+void wait_harness(Harness* const harness) {
+    assert(isValid_harness(harness));
+
+    if (harness->threads == NULL) return;
+
+    pthread_mutex_lock(&harness->mutex);
+    while (harness->batch != NULL && harness->n_done < LEN_CHUNK(harness->batch))
+        pthread_cond_wait(&harness->batch_done, &harness->mutex);
+    harness->batch      = NULL;
+    harness->n_execs    = 0;
+    harness->n_rejects  = 0;
+    for (uint32_t i = 0; i < harness->n_workers; i++) {
+        harness->n_execs    += harness->workers[i].n_execs;
+        harness->n_rejects  += harness->workers[i].n_rejects;
+    }
+    pthread_mutex_unlock(&harness->mutex);
+}
+
+/* Claims shrinking slices of the batch, so the lock stays cold and a slow sentence cannot hold up much work. */
+static void* work(void* const arg) {
+    HarnessWorker* const worker = arg;
+    Harness* const harness      = worker->harness;
+    uint64_t batch_no           = 0;
+
+    pthread_mutex_lock(&harness->mutex);
+    for (;;) {
+        Chunk const* batch = NULL;
+
+        while (!harness->is_stopping && (harness->batch == NULL || harness->batch_no == batch_no))
+            pthread_cond_wait(&harness->batch_ready, &harness->mutex);
+        if (harness->is_stopping) break;
+
+        batch_no    = harness->batch_no;
+        batch       = harness->batch;
+        while (harness->next_id < LEN_CHUNK(batch)) {
+            uint32_t const first_id = harness->next_id;
+            uint32_t n_claimed      = (LEN_CHUNK(batch) - first_id) / (2 * harness->n_workers);
+
+            if (n_claimed == 0) n_claimed = 1;
+            harness->next_id += n_claimed;
+            pthread_mutex_unlock(&harness->mutex);
+
+            for (uint32_t id = first_id; id < first_id + n_claimed; id++) {
+                worker->current = get_chunk(batch, id);
+                if (worker->entry(worker->current.p, worker->current.sz) != 0) worker->n_rejects++;
+                worker->n_execs++;
+            }
+            worker->current = NOT_AN_ITEM;
+
+            pthread_mutex_lock(&harness->mutex);
+            harness->n_done += n_claimed;
+            if (harness->n_done == LEN_CHUNK(batch))
+                pthread_cond_signal(&harness->batch_done);
+        }
+    }
+    pthread_mutex_unlock(&harness->mutex);
+
+    return NULL;
+}
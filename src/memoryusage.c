@@ -0,0 +1,35 @@
+#include <assert.h>
+#include <stdio.h>
+#include "memoryusage.h"
+#include "padkit/verbose.h"
+
+static char const* const subsystem_names[MUSAGE_N_SUBSYSTEMS] = {
+    "Grammar",
+    "Coverage",
+    "Budget",
+    "Weights",
+    "Fragments",
+    "Prefix Tree",
+    "Sentences",
+    "Decisions",
+    "Uniqueness Filter"
+};
+
+void report_musage(MemoryUsage const* const mem) {
+    assert(mem != NULL);
+
+    for (uint32_t i = 0; i < MUSAGE_N_SUBSYSTEMS; i++)
+        fprintf_verbose(stderr, "Memory (%s) = %zu bytes", subsystem_names[i], mem->bytes[i]);
+    fprintf_verbose(stderr, "Memory (Peak) = %zu bytes", mem->peak_bytes);
+}
+
+size_t total_musage(MemoryUsage* const mem) {
+    size_t total = 0;
+
+    assert(mem != NULL);
+
+    for (uint32_t i = 0; i < MUSAGE_N_SUBSYSTEMS; i++) total += mem->bytes[i];
+    if (total > mem->peak_bytes) mem->peak_bytes = total;
+
+    return total;
+}
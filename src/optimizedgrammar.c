@@ -0,0 +1,414 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+#include "optimizedgrammar.h"
+#include "padkit/chunktable.h"
+#include "padkit/invalid.h"
+#include "padkit/memalloc.h"
+#include "padkit/repeat.h"
+#include "padkit/size.h"
+#include "padkit/verbose.h"
+
+#define INLINE_STATE_UNKNOWN    (0)
+#define INLINE_STATE_VISITING   (1)
+#define INLINE_STATE_INLINED    (2)
+#define INLINE_STATE_KEPT       (3)
+
+/*
+ * A symbol of a flattened alternative. The original terms since the end of
+ * the previous symbol, [origin_begin, origin_end) of the origin scratch list,
+ * all collapse into it.
+ */
+typedef struct FlatSymbolBody {
+    uint32_t    is_terminal;
+    uint32_t    id;
+    uint32_t    origin_begin;
+    uint32_t    origin_end;
+} FlatSymbol;
+
+typedef struct OptimizerBody {
+    GrammarGraph const* graph;
+    uint32_t*           inline_states;
+    uint32_t*           inline_lens;
+    ArrayList           symbol_list[1];
+    ArrayList           origin_list[1];
+    Chunk               alt_keys[1];
+    ChunkTable          alt_tbl[1];
+    ChunkTable          terminal_tbl[1];
+} Optimizer;
+
+static void emitAlternative(
+    OptimizedGrammar* const ogrammar,
+    Optimizer* const opt,
+    uint32_t const opt_rule_id,
+    uint32_t const orig_alt_target_id
+);
+
+static void flatten(
+    Optimizer* const opt,
+    uint32_t const first_exp_id
+);
+
+static bool isInlinable(
+    Optimizer* const opt,
+    uint32_t const rule_id
+);
+
+void construct_ogrammar(
+    OptimizedGrammar* const ogrammar,
+    GrammarGraph const* const graph
+) {
+    GrammarGraph* const opt_graph   = ogrammar->graph;
+    uint32_t const n_rules          = graph->rule_list->len;
+    Optimizer opt[1];
+    uint32_t n_alts                 = 0;
+    uint32_t n_opt_rules            = 0;
+
+    assert(ogrammar != NULL);
+    assert(isValid_ggraph(graph));
+
+    opt->graph          = graph;
+    opt->inline_states  = mem_calloc(n_rules, sizeof(uint32_t));
+    opt->inline_lens    = mem_calloc(n_rules, sizeof(uint32_t));
+    constructEmpty_alist(opt->symbol_list, sizeof(FlatSymbol), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(opt->origin_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_chunk(opt->alt_keys, CHUNK_RECOMMENDED_PARAMETERS);
+    constructEmpty_ctbl(opt->alt_tbl, CTBL_RECOMMENDED_PARAMETERS);
+    constructEmpty_ctbl(opt->terminal_tbl, CTBL_RECOMMENDED_PARAMETERS);
+
+    constructEmpty_chunk(opt_graph->rule_names, CHUNK_RECOMMENDED_PARAMETERS);
+    constructEmpty_chunk(opt_graph->terminals, CHUNK_RECOMMENDED_PARAMETERS);
+    constructEmpty_alist(opt_graph->rule_list, sizeof(RuleTerm), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(opt_graph->exp_list, sizeof(ExpansionTerm), graph->exp_list->len + 1);
+
+    constructEmpty_alist(ogrammar->rule_targets, sizeof(uint32_t), n_rules + 1);
+    constructEmpty_alist(ogrammar->alt_offsets, sizeof(uint32_t), n_rules + 1);
+    constructEmpty_alist(ogrammar->alt_targets, sizeof(uint32_t), graph->exp_list->len + 1);
+    constructEmpty_alist(ogrammar->origin_list, sizeof(OriginPair), graph->exp_list->len + 1);
+
+    /* The surviving rules keep their names and their relative order. */
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+        RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+        uint32_t target_id          = INVALID_UINT32;
+
+        add_alist(ogrammar->alt_offsets, &n_alts);
+        n_alts += rule->alt_list->len;
+
+        if (!isInlinable(opt, rule_id)) {
+            Item const name             = get_chunk(graph->rule_names, rule->name_id);
+            RuleTerm* const opt_rule    = addIndeterminate_alist(opt_graph->rule_list);
+
+            add_chunk(opt_graph->rule_names, name.p, name.sz);
+            opt_rule->name_id       = LEN_CHUNK(opt_graph->rule_names) - 1;
+            opt_rule->alt_list[0]   = NOT_AN_ALIST;
+            constructEmpty_alist(opt_rule->alt_list, sizeof(uint32_t), rule->alt_list->len);
+            target_id = n_opt_rules++;
+        }
+        add_alist(ogrammar->rule_targets, &target_id);
+    }
+    add_alist(ogrammar->alt_offsets, &n_alts);
+    opt_graph->root_rule_id = *(uint32_t*)get_alist(ogrammar->rule_targets, graph->root_rule_id);
+
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+        RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+        uint32_t const opt_rule_id  = *(uint32_t*)get_alist(ogrammar->rule_targets, rule_id);
+        uint32_t const* p_exp_id    = getFirst_alist(rule->alt_list);
+
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++, p_exp_id++) {
+            uint32_t const target_id = ogrammar->alt_targets->len;
+            add_alist(ogrammar->alt_targets, &opt_rule_id);
+            if (opt_rule_id == INVALID_UINT32) continue;
+
+            flush_alist(opt->symbol_list);
+            flush_alist(opt->origin_list);
+            flatten(opt, *p_exp_id);
+            emitAlternative(ogrammar, opt, opt_rule_id, target_id);
+        }
+    }
+
+    fprintf_verbose(stderr, "# Rules (Optimized) = %"PRIu32, opt_graph->rule_list->len);
+    fprintf_verbose(stderr, "# Expansion Terms (Optimized) = %"PRIu32, opt_graph->exp_list->len);
+
+    free(opt->inline_states);
+    free(opt->inline_lens);
+    destruct_alist(opt->symbol_list);
+    destruct_alist(opt->origin_list);
+    destruct_chunk(opt->alt_keys);
+    destruct_ctbl(opt->alt_tbl);
+    destruct_ctbl(opt->terminal_tbl);
+}
+
+void destruct_ogrammar(OptimizedGrammar* const ogrammar) {
+    assert(isValid_ogrammar(ogrammar));
+
+    destruct_ggraph(ogrammar->graph);
+    destruct_alist(ogrammar->rule_targets);
+    destruct_alist(ogrammar->alt_offsets);
+    destruct_alist(ogrammar->alt_targets);
+    destruct_alist(ogrammar->origin_list);
+
+    *ogrammar = NOT_AN_OGRAMMAR;
+}
+
+/*
+ * Fuses adjacent terminals of the flattened alternative into single
+ * ExpansionTerms, then drops the alternative again if the rule already has
+ * an identical one, redirecting its origins to the survivor.
+ */
+static void emitAlternative(
+    OptimizedGrammar* const ogrammar,
+    Optimizer* const opt,
+    uint32_t const opt_rule_id,
+    uint32_t const orig_alt_target_id
+) {
+    GrammarGraph* const opt_graph   = ogrammar->graph;
+    GrammarGraph const* const graph = opt->graph;
+    RuleTerm* const opt_rule        = get_alist(opt_graph->rule_list, opt_rule_id);
+    uint32_t const first_exp_id     = opt_graph->exp_list->len;
+    uint32_t const first_origin_id  = ogrammar->origin_list->len;
+    uint32_t const n_symbols        = opt->symbol_list->len;
+    uint32_t const new_alt_id       = opt_rule->alt_list->len;
+    ExpansionTerm* exp              = NULL;
+    ChunkMapping const* mapping     = NULL;
+    Item key                        = NOT_AN_ITEM;
+
+    for (uint32_t i = 0; i < n_symbols; ) {
+        FlatSymbol const* const symbol  = get_alist(opt->symbol_list, i);
+        uint32_t const opt_exp_id       = opt_graph->exp_list->len;
+        uint32_t const origin_begin     = symbol->origin_begin;
+        uint32_t origin_end             = symbol->origin_end;
+        uint32_t rt_id                  = INVALID_UINT32;
+
+        if (symbol->is_terminal) {
+            Item terminal = get_chunk(graph->terminals, symbol->id);
+            add_chunk(opt_graph->terminals, terminal.p, terminal.sz);
+            for (i++; i < n_symbols; i++) {
+                FlatSymbol const* const next = get_alist(opt->symbol_list, i);
+                if (!next->is_terminal) break;
+
+                terminal    = get_chunk(graph->terminals, next->id);
+                appendLast_chunk(opt_graph->terminals, terminal.p, terminal.sz);
+                origin_end  = next->origin_end;
+            }
+
+            mapping = searchInsert_ctbl(
+                NULL, opt->terminal_tbl, getLast_chunk(opt_graph->terminals),
+                LEN_CHUNK(opt_graph->terminals) - 1, CTBL_MODE_INSERT_RESPECT
+            );
+            if (mapping->value != LEN_CHUNK(opt_graph->terminals) - 1)
+                deleteLast_chunk(opt_graph->terminals);
+            rt_id = mapping->value;
+        } else {
+            rt_id = *(uint32_t*)get_alist(ogrammar->rule_targets, symbol->id);
+            i++;
+        }
+
+        exp                 = addIndeterminate_alist(opt_graph->exp_list);
+        exp->rt_id          = rt_id;
+        exp->is_terminal    = symbol->is_terminal;
+        exp->has_next       = 1;
+
+        for (uint32_t origin_id = origin_begin; origin_id < origin_end; origin_id++) {
+            OriginPair const pair = { opt_exp_id, *(uint32_t*)get_alist(opt->origin_list, origin_id) };
+            add_alist(ogrammar->origin_list, &pair);
+        }
+    }
+    exp->has_next = 0;
+
+    /* The key is the rule id followed by every (rt_id, is_terminal) of the alternative. */
+    key = add_chunk(opt->alt_keys, &opt_rule_id, sizeof(uint32_t));
+    for (uint32_t exp_id = first_exp_id; exp_id < opt_graph->exp_list->len; exp_id++) {
+        ExpansionTerm const* const e    = get_alist(opt_graph->exp_list, exp_id);
+        uint32_t const code             = ((uint32_t)e->rt_id << 1) | e->is_terminal;
+        key = appendLast_chunk(opt->alt_keys, &code, sizeof(uint32_t));
+    }
+    mapping = searchInsert_ctbl(NULL, opt->alt_tbl, key, new_alt_id, CTBL_MODE_INSERT_RESPECT);
+
+    if (mapping->value == new_alt_id) {
+        add_alist(opt_rule->alt_list, &first_exp_id);
+    } else {
+        uint32_t const kept_exp_id  = *(uint32_t*)get_alist(opt_rule->alt_list, mapping->value);
+        uint32_t const n_exps       = opt_graph->exp_list->len - first_exp_id;
+
+        deleteLast_chunk(opt->alt_keys);
+        REPEAT(n_exps) pop_alist(opt_graph->exp_list);
+        for (uint32_t origin_id = first_origin_id; origin_id < ogrammar->origin_list->len; origin_id++) {
+            OriginPair* const pair = get_alist(ogrammar->origin_list, origin_id);
+            pair->opt_exp_id = kept_exp_id + (pair->opt_exp_id - first_exp_id);
+        }
+    }
+    *(uint32_t*)get_alist(ogrammar->alt_targets, orig_alt_target_id) = mapping->value;
+}
+
+/* Appends the symbols of an original alternative, expanding inlinable rules in place. */
+static void flatten(
+    Optimizer* const opt,
+    uint32_t const first_exp_id
+) {
+    GrammarGraph const* const graph = opt->graph;
+    uint32_t const n_rules          = graph->rule_list->len;
+    uint32_t exp_id                 = first_exp_id;
+    ExpansionTerm const* exp        = NULL;
+
+    do {
+        uint32_t const term_id = n_rules + exp_id;
+
+        exp = get_alist(graph->exp_list, exp_id++);
+        add_alist(opt->origin_list, &term_id);
+        if (!exp->is_terminal && isInlinable(opt, exp->rt_id)) {
+            RuleTerm const* const child = get_alist(graph->rule_list, exp->rt_id);
+            uint32_t const child_id     = exp->rt_id;
+            add_alist(opt->origin_list, &child_id);
+            flatten(opt, *(uint32_t*)getFirst_alist(child->alt_list));
+        } else {
+            FlatSymbol symbol;
+            symbol.is_terminal  = exp->is_terminal;
+            symbol.id           = exp->rt_id;
+            symbol.origin_begin = (opt->symbol_list->len == 0)
+                                ? 0
+                                : ((FlatSymbol*)getLast_alist(opt->symbol_list))->origin_end;
+            symbol.origin_end   = opt->origin_list->len;
+            add_alist(opt->symbol_list, &symbol);
+        }
+    } while (exp->has_next);
+}
+
+/* A rule is inlined if it has one alternative, is not the root, and does not expand into itself. */
+static bool isInlinable(
+    Optimizer* const opt,
+    uint32_t const rule_id
+) {
+    GrammarGraph const* const graph = opt->graph;
+    RuleTerm const* const rule      = get_alist(graph->rule_list, rule_id);
+    uint32_t exp_id                 = INVALID_UINT32;
+    ExpansionTerm const* exp        = NULL;
+    uint32_t len                    = 0;
+
+    switch (opt->inline_states[rule_id]) {
+        case INLINE_STATE_INLINED:
+            return 1;
+        case INLINE_STATE_VISITING:
+        case INLINE_STATE_KEPT:
+            return 0;
+        case INLINE_STATE_UNKNOWN:
+        default:
+            break;
+    }
+
+    if (rule_id == graph->root_rule_id || rule->alt_list->len != 1) {
+        opt->inline_states[rule_id] = INLINE_STATE_KEPT;
+        return 0;
+    }
+
+    opt->inline_states[rule_id] = INLINE_STATE_VISITING;
+    exp_id = *(uint32_t*)getFirst_alist(rule->alt_list);
+    do {
+        exp = get_alist(graph->exp_list, exp_id++);
+        if (exp->is_terminal) {
+            len++;
+        } else if (exp->rt_id == rule_id || opt->inline_states[exp->rt_id] == INLINE_STATE_VISITING) {
+            opt->inline_states[rule_id] = INLINE_STATE_KEPT;
+            return 0;
+        } else if (isInlinable(opt, exp->rt_id)) {
+            len += opt->inline_lens[exp->rt_id];
+        } else {
+            len++;
+        }
+    } while (exp->has_next && len <= OGRAMMAR_MAX_INLINE_LEN);
+
+    if (len > OGRAMMAR_MAX_INLINE_LEN) {
+        opt->inline_states[rule_id] = INLINE_STATE_KEPT;
+        return 0;
+    }
+
+    opt->inline_lens[rule_id]   = len;
+    opt->inline_states[rule_id] = INLINE_STATE_INLINED;
+    return 1;
+}
+
+bool isValid_ogrammar(OptimizedGrammar const* const ogrammar) {
+    if (ogrammar == NULL)                                                       return 0;
+    if (!isValid_ggraph(ogrammar->graph))                                       return 0;
+    if (!isValid_alist(ogrammar->rule_targets))                                 return 0;
+    if (!isValid_alist(ogrammar->alt_offsets))                                  return 0;
+    if (!isValid_alist(ogrammar->alt_targets))                                  return 0;
+    if (!isValid_alist(ogrammar->origin_list))                                  return 0;
+    if (ogrammar->alt_offsets->len != ogrammar->rule_targets->len + 1)          return 0;
+
+    return 1;
+}
+
+void projectCoverage_ogrammar(
+    Coverage* const cov,
+    OptimizedGrammar const* const ogrammar,
+    Coverage const* const opt_cov
+) {
+    uint32_t const n_rules  = cov->n_rules;
+    OriginPair const* pair  = NULL;
+
+    assert(isValid_cov(cov));
+    assert(isValid_ogrammar(ogrammar));
+    assert(isValid_cov(opt_cov));
+    assert(ogrammar->rule_targets->len == n_rules);
+
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+        uint32_t const target_id = *(uint32_t*)get_alist(ogrammar->rule_targets, rule_id);
+        cov->rule_counts[rule_id] = (target_id == INVALID_UINT32) ? 0 : opt_cov->rule_counts[target_id];
+    }
+    for (uint32_t exp_id = 0; exp_id < cov->n_exps; exp_id++)
+        cov->exp_counts[exp_id] = 0;
+
+    pair = getFirst_alist(ogrammar->origin_list);
+    REPEAT(ogrammar->origin_list->len) {
+        uint64_t const opt_count    = opt_cov->exp_counts[pair->opt_exp_id];
+        uint32_t* const p_count     = (pair->orig_term_id < n_rules)
+                                    ? cov->rule_counts + pair->orig_term_id
+                                    : cov->exp_counts + (pair->orig_term_id - n_rules);
+        uint64_t const count        = *p_count + opt_count;
+
+        *p_count = (count < SZ32_MAX) ? (uint32_t)count : SZ32_MAX;
+        pair++;
+    }
+
+    cov->n_cov = 0;
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++)
+        cov->n_cov += (cov->rule_counts[rule_id] > 0);
+    for (uint32_t exp_id = 0; exp_id < cov->n_exps; exp_id++)
+        cov->n_cov += (cov->exp_counts[exp_id] > 0);
+}
+
+void projectWeights_ogrammar(
+    WeightTable* const opt_wtbl,
+    OptimizedGrammar const* const ogrammar,
+    WeightTable const* const wtbl
+) {
+    GrammarGraph const* const opt_graph = ogrammar->graph;
+    uint32_t const n_rules              = ogrammar->rule_targets->len;
+
+    assert(opt_wtbl != NULL);
+    assert(isValid_ogrammar(ogrammar));
+    assert(isValid_wtbl(wtbl));
+    assert(wtbl->offset_list->len == n_rules + 1);
+
+    constructUniform_wtbl(opt_wtbl, opt_graph);
+    for (uint32_t opt_rule_id = 0; opt_rule_id < opt_graph->rule_list->len; opt_rule_id++) {
+        for (uint32_t alt_id = 0; alt_id < nAlternatives_wtbl(opt_wtbl, opt_rule_id); alt_id++)
+            setWeight_wtbl(opt_wtbl, opt_rule_id, alt_id, 0.0);
+    }
+
+    for (uint32_t rule_id = 0; rule_id < n_rules; rule_id++) {
+        uint32_t const opt_rule_id  = *(uint32_t*)get_alist(ogrammar->rule_targets, rule_id);
+        uint32_t const offset       = *(uint32_t*)get_alist(ogrammar->alt_offsets, rule_id);
+
+        if (opt_rule_id == INVALID_UINT32) continue;
+
+        for (uint32_t alt_id = 0; alt_id < nAlternatives_wtbl(wtbl, rule_id); alt_id++) {
+            uint32_t const opt_alt_id = *(uint32_t*)get_alist(ogrammar->alt_targets, offset + alt_id);
+            setWeight_wtbl(
+                opt_wtbl, opt_rule_id, opt_alt_id,
+                getWeight_wtbl(opt_wtbl, opt_rule_id, opt_alt_id) + getWeight_wtbl(wtbl, rule_id, alt_id)
+            );
+        }
+    }
+    rebuildAllAliases_wtbl(opt_wtbl);
+}
@@ -0,0 +1,202 @@
+#include <assert.h>
+#include <stdlib.h>
+#include "memoryusage.h"
+#include "randomwalk.h"
+#include "padkit/implication.h"
+#include "padkit/invalid.h"
+#include "padkit/repeat.h"
+
+static uint32_t chooseAlternative(
+    RandomWalk* const walk,
+    Coverage const* const cov,
+    EnergyTable* const etbl,
+    GrammarGraph const* const graph,
+    uint32_t const rule_id,
+    WeightTable const* const wtbl,
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    bool const cov_guided
+);
+
+static uint32_t collectCandidates(
+    ArrayList* const pool,
+    Coverage const* const cov,
+    RuleTerm const* const rule,
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    uint32_t const rule_id,
+    bool const uncovered_only
+);
+
+/* The same cases in the same order as partiallyExploreNode_dtree, so rand() is drawn alike. */
+static uint32_t chooseAlternative(
+    RandomWalk* const walk,
+    Coverage const* const cov,
+    EnergyTable* const etbl,
+    GrammarGraph const* const graph,
+    uint32_t const rule_id,
+    WeightTable const* const wtbl,
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    bool const cov_guided
+) {
+    RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+    uint32_t const n_choices    = rule->alt_list->len;
+    WeightTable const* sampler  = wtbl;
+    uint32_t n_candidates       = 0;
+    uint32_t n_uncovered        = 0;
+    uint32_t n_pool             = 0;
+
+    if (isUnlimited_dbudget(budget))
+        n_candidates = n_choices;
+    else
+        n_candidates = collectCandidates(NULL, cov, rule, budget, reserved, rule_id, 0);
+    assert(n_candidates > 0);
+
+    if (etbl != NULL) {
+        refresh_etbl(etbl, cov, graph, rule_id);
+        sampler = etbl->wtbl;
+    } else if (cov_guided) {
+        n_uncovered = collectCandidates(NULL, cov, rule, budget, reserved, rule_id, 1);
+    }
+    n_pool = (n_uncovered > 0) ? n_uncovered : n_candidates;
+
+    if (n_pool == n_choices)
+        return (sampler == NULL) ? (uint32_t)rand() % n_pool : sample_wtbl(sampler, rule_id);
+
+    if (etbl != NULL) {
+        REPEAT(DTREE_ENERGY_MAX_DRAWS) {
+            uint32_t const choice = sample_wtbl(sampler, rule_id);
+            if (fits_dbudget(budget, reserved, rule_id, choice)) return choice;
+        }
+    }
+
+    collectCandidates(walk->pool, cov, rule, budget, reserved, rule_id, n_uncovered > 0);
+    assert(walk->pool->len == n_pool);
+    if (sampler == NULL)
+        return *(uint32_t*)get_alist(walk->pool, (uint32_t)rand() % n_pool);
+    else
+        return sampleSubset_wtbl(sampler, rule_id, getFirst_alist(walk->pool), n_pool);
+}
+
+/* Counts the alternatives within the budget, and lists them in pool unless it is NULL. */
+static uint32_t collectCandidates(
+    ArrayList* const pool,
+    Coverage const* const cov,
+    RuleTerm const* const rule,
+    DerivationBudget const* const budget,
+    DerivationCost const* const reserved,
+    uint32_t const rule_id,
+    bool const uncovered_only
+) {
+    uint32_t n = 0;
+
+    if (pool != NULL) flush_alist(pool);
+    for (uint32_t choice = 0; choice < rule->alt_list->len; choice++) {
+        if (!fits_dbudget(budget, reserved, rule_id, choice)) continue;
+        if (uncovered_only && cov->exp_counts[*(uint32_t*)get_alist(rule->alt_list, choice)] > 0) continue;
+        if (pool != NULL) add_alist(pool, &choice);
+        n++;
+    }
+
+    return n;
+}
+
+void construct_rwalk(RandomWalk* const walk) {
+    assert(walk != NULL);
+    constructEmpty_alist(walk->stack, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(walk->taken_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(walk->pool, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+}
+
+void destruct_rwalk(RandomWalk* const walk) {
+    assert(isValid_rwalk(walk));
+    destruct_alist(walk->stack);
+    destruct_alist(walk->taken_list);
+    destruct_alist(walk->pool);
+    *walk = NOT_A_RWALK;
+}
+
+int generate_rwalk(
+    ArrayList* const seq,
+    RandomWalk* const walk,
+    Coverage* const cov,
+    EnergyTable* const etbl,
+    GrammarGraph const* const graph,
+    WeightTable const* const wtbl,
+    DerivationBudget const* const budget,
+    uint32_t const min_depth,
+    bool const cov_guided
+) {
+    DerivationCost reserved = { 0, 0 };
+    int result              = DTREE_GENERATE_OK;
+
+    assert(isValid_alist(seq));
+    assert(seq->len == 0);
+    assert(seq->sz_elem == sizeof(uint32_t));
+    assert(isValid_rwalk(walk));
+    assert(IMPLIES(cov_guided, isValid_cov(cov)));
+    assert(IMPLIES(etbl != NULL, cov_guided && isValid_etbl(etbl)));
+    assert(isValid_ggraph(graph));
+    assert(wtbl == NULL || isValid_wtbl(wtbl));
+    assert(isValid_dbudget(budget));
+
+    flush_alist(walk->stack);
+    flush_alist(walk->taken_list);
+    push_alist(walk->stack, &(graph->root_rule_id));
+    reserved = *minCost_dbudget(budget, graph->root_rule_id);
+    do {
+        uint32_t rule_id            = INVALID_UINT32;
+        uint32_t decision           = INVALID_UINT32;
+        uint32_t exp_id             = INVALID_UINT32;
+        uint32_t n_exps             = 1;
+        RuleTerm const* rule        = NULL;
+        ExpansionTerm const* exp    = NULL;
+
+        if (seq->len % DBUDGET_CLOCK_PERIOD == 0 && isPastDeadline_dbudget(budget)) {
+            result = DTREE_GENERATE_TIMEOUT;
+            break;
+        }
+
+        rule_id     = *(uint32_t*)pop_alist(walk->stack);
+        decision    = chooseAlternative(walk, cov, etbl, graph, rule_id, wtbl, budget, &reserved, cov_guided);
+        add_alist(seq, &decision);
+        spend_dbudget(&reserved, budget, rule_id, decision);
+        rule        = get_alist(graph->rule_list, rule_id);
+        exp_id      = *(uint32_t*)get_alist(rule->alt_list, decision);
+        exp         = get_alist(graph->exp_list, exp_id);
+
+        /* Covered for the rest of the derivation, as in generateRandomDecisionSequence_dtree. */
+        if (cov_guided && etbl == NULL && cov->exp_counts[exp_id] == 0) {
+            cov->exp_counts[exp_id] = 1;
+            add_alist(walk->taken_list, &exp_id);
+        }
+
+        while ((exp++)->has_next) n_exps++;
+        REPEAT(n_exps) {
+            exp--;
+            if (!exp->is_terminal) push_alist(walk->stack, &(uint32_t){ exp->rt_id });
+        }
+    } while (walk->stack->len > 0);
+    for (uint32_t i = 0; i < walk->taken_list->len; i++)
+        cov->exp_counts[*(uint32_t*)get_alist(walk->taken_list, i)] = 0;
+
+    if (result == DTREE_GENERATE_OK && seq->len < min_depth)
+        result = DTREE_GENERATE_SHALLOW_SEQ;
+
+    return result;
+}
+
+bool isValid_rwalk(RandomWalk const* const walk) {
+    if (walk == NULL)                       return 0;
+    if (!isValid_alist(walk->stack))        return 0;
+    if (!isValid_alist(walk->taken_list))   return 0;
+    if (!isValid_alist(walk->pool))         return 0;
+
+    return 1;
+}
+
+size_t memoryUsage_rwalk(RandomWalk const* const walk) {
+    assert(isValid_rwalk(walk));
+    return MUSAGE_ALIST(walk->stack) + MUSAGE_ALIST(walk->taken_list) + MUSAGE_ALIST(walk->pool);
+}
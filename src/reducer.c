@@ -0,0 +1,649 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "earleyparser.h"
+#include "executor.h"
+#include "reducer.h"
+#include "padkit/invalid.h"
+#include "padkit/memalloc.h"
+#include "padkit/repeat.h"
+#include "padkit/size.h"
+
+#define REDUCER_INITIAL_BUFFER_SZ   (65536)
+
+/* A rule waiting for its decision, under the decision of parent_id. */
+typedef struct ReducerPendingBody {
+    uint32_t    rule_id;
+    uint32_t    parent_id;
+    uint32_t    depth;
+} ReducerPending;
+
+/* The decision of the same index in the sequence, whose subtree ends before end. */
+typedef struct ReducerNodeBody {
+    uint32_t    rule_id;
+    uint32_t    parent_id;
+    uint32_t    end;
+    uint32_t    depth;
+    uint64_t    n_bytes;
+} ReducerNode;
+
+/* A subtree to replace with the subtree of its descendant of the same rule. */
+typedef struct ReducerHoistBody {
+    uint32_t    node_id;
+    uint32_t    descendant_id;
+} ReducerHoist;
+
+/* Every worker runs its own candidate on its own target, so workers share nothing. */
+typedef struct ReducerWorkerBody {
+    Executor        executor[1];
+    char* const*    target_argv;
+    uint32_t        timeout_ms;
+    ArrayList       seq[1];
+    Chunk           str_builder[1];
+    int             result;
+    int             status;
+} ReducerWorker;
+
+static uint32_t analyze(Reducer* const reducer);
+
+static void appendShortest(
+    ArrayList* const seq,
+    Reducer* const reducer,
+    uint32_t const rule_id
+);
+
+static void buildCandidate(
+    ArrayList* const seq,
+    Reducer* const reducer,
+    uint32_t const* const replaced,
+    uint32_t const n_replaced
+);
+
+static void collectCandidates(
+    Reducer* const reducer,
+    uint32_t const depth
+);
+
+static void collectHoists(
+    Reducer* const reducer,
+    uint32_t const depth,
+    uint32_t const first_id
+);
+
+static bool isInteresting(
+    Reducer const* const reducer,
+    ReducerWorker const* const worker
+);
+
+static bool isPastDeadline(uint64_t const deadline_ns);
+
+static char* readInput(
+    uint32_t* const p_sz,
+    char const* const input_path
+);
+
+static bool reduceLevel(
+    Reducer* const reducer,
+    uint32_t const depth,
+    uint64_t const deadline_ns
+);
+
+static void runWorkers(
+    ReducerWorker* const workers,
+    uint32_t const n_workers,
+    void* (*run)(void* const)
+);
+
+static void* start(void* const arg);
+
+static uint32_t takeFirstInteresting(
+    Reducer* const reducer,
+    uint32_t const n_batch
+);
+
+static bool testChunks(
+    Reducer* const reducer,
+    uint32_t const n_chunks,
+    uint64_t const deadline_ns
+);
+
+static uint32_t testHoists(
+    Reducer* const reducer,
+    uint64_t const deadline_ns
+);
+
+static void* work(void* const arg);
+
+/* Rebuilds node_list from seq, and returns the deepest level. */
+static uint32_t analyze(Reducer* const reducer) {
+    GrammarGraph const* const graph = reducer->graph;
+    uint32_t const* const decisions = getFirst_alist(reducer->seq);
+    ReducerNode* node               = NULL;
+    uint32_t max_depth              = 0;
+
+    flush_alist(reducer->node_list);
+    flush_alist(reducer->stack);
+    push_alist(reducer->stack, &(ReducerPending){ graph->root_rule_id, INVALID_UINT32, 0 });
+    for (uint32_t node_id = 0; node_id < reducer->seq->len; node_id++) {
+        ReducerPending const pending    = *(ReducerPending*)pop_alist(reducer->stack);
+        RuleTerm const* const rule      = get_alist(graph->rule_list, pending.rule_id);
+        uint32_t const exp_id           = *(uint32_t*)get_alist(rule->alt_list, decisions[node_id]);
+        ExpansionTerm const* exp        = get_alist(graph->exp_list, exp_id);
+        uint32_t n_exps                 = 1;
+
+        node            = addIndeterminate_alist(reducer->node_list);
+        node->rule_id   = pending.rule_id;
+        node->parent_id = pending.parent_id;
+        node->end       = node_id + 1;
+        node->depth     = pending.depth;
+        node->n_bytes   = 0;
+        if (pending.depth > max_depth) max_depth = pending.depth;
+
+        while ((exp++)->has_next) n_exps++;
+        REPEAT(n_exps) {
+            exp--;
+            if (exp->is_terminal)
+                node->n_bytes += get_chunk(graph->terminals, exp->rt_id).sz;
+            else
+                push_alist(reducer->stack, &(ReducerPending){ exp->rt_id, node_id, pending.depth + 1 });
+        }
+    }
+    assert(reducer->stack->len == 0);
+
+    /* Children come after their parents, so backwards every node is complete before its parent reads it. */
+    for (uint32_t node_id = reducer->node_list->len - 1; node_id > 0; node_id--) {
+        ReducerNode* parent = NULL;
+
+        node    = get_alist(reducer->node_list, node_id);
+        parent  = get_alist(reducer->node_list, node->parent_id);
+        parent->n_bytes += node->n_bytes;
+        if (node->end > parent->end) parent->end = node->end;
+    }
+
+    return max_depth;
+}
+
+static void appendShortest(
+    ArrayList* const seq,
+    Reducer* const reducer,
+    uint32_t const rule_id
+) {
+    GrammarGraph const* const graph = reducer->graph;
+
+    flush_alist(reducer->stack);
+    push_alist(reducer->stack, &(ReducerPending){ rule_id, INVALID_UINT32, 0 });
+    while (reducer->stack->len > 0) {
+        ReducerPending const pending    = *(ReducerPending*)pop_alist(reducer->stack);
+        RuleTerm const* const rule      = get_alist(graph->rule_list, pending.rule_id);
+        uint32_t const alt_id           = *(uint32_t*)get_alist(reducer->budget->shortest_list, pending.rule_id);
+        uint32_t const exp_id           = *(uint32_t*)get_alist(rule->alt_list, alt_id);
+        ExpansionTerm const* exp        = get_alist(graph->exp_list, exp_id);
+        uint32_t n_exps                 = 1;
+
+        add_alist(seq, &alt_id);
+        while ((exp++)->has_next) n_exps++;
+        REPEAT(n_exps) {
+            exp--;
+            if (!exp->is_terminal) push_alist(reducer->stack, &(ReducerPending){ exp->rt_id, INVALID_UINT32, 0 });
+        }
+    }
+}
+
+/* replaced are disjoint subtrees in preorder, so every one starts after the previous one ends. */
+static void buildCandidate(
+    ArrayList* const seq,
+    Reducer* const reducer,
+    uint32_t const* const replaced,
+    uint32_t const n_replaced
+) {
+    uint32_t const* const decisions = getFirst_alist(reducer->seq);
+    uint32_t next_id                = 0;
+
+    flush_alist(seq);
+    for (uint32_t i = 0; i < n_replaced; i++) {
+        ReducerNode const* const node = get_alist(reducer->node_list, replaced[i]);
+
+        assert(replaced[i] >= next_id);
+        for (; next_id < replaced[i]; next_id++) add_alist(seq, decisions + next_id);
+        appendShortest(seq, reducer, node->rule_id);
+        next_id = node->end;
+    }
+    for (; next_id < reducer->seq->len; next_id++) add_alist(seq, decisions + next_id);
+}
+
+/* The nodes of one level whose subtrees are longer than the shortest of their rules. */
+static void collectCandidates(
+    Reducer* const reducer,
+    uint32_t const depth
+) {
+    ReducerNode const* node = NULL;
+
+    analyze(reducer);
+    flush_alist(reducer->cand_list);
+
+    node = getFirst_alist(reducer->node_list);
+    for (uint32_t node_id = 0; node_id < reducer->node_list->len; node++, node_id++) {
+        if (node->depth != depth) continue;
+        if (node->n_bytes <= minCost_dbudget(reducer->budget, node->rule_id)->n_bytes) continue;
+
+        add_alist(reducer->cand_list, &node_id);
+    }
+}
+
+/* The nearest descendants of the same rule under every node of one level from first_id on, if they are shorter. */
+static void collectHoists(
+    Reducer* const reducer,
+    uint32_t const depth,
+    uint32_t const first_id
+) {
+    ReducerNode const* const nodes = getFirst_alist(reducer->node_list);
+
+    analyze(reducer);
+    flush_alist(reducer->hoist_list);
+
+    for (uint32_t node_id = first_id; node_id < reducer->node_list->len; node_id++) {
+        ReducerNode const* const node = nodes + node_id;
+
+        if (node->depth != depth) continue;
+
+        for (uint32_t descendant_id = node_id + 1; descendant_id < node->end; descendant_id++) {
+            ReducerNode const* const descendant = nodes + descendant_id;
+
+            if (descendant->rule_id != node->rule_id) continue;
+
+            if (descendant->n_bytes < node->n_bytes)
+                add_alist(reducer->hoist_list, &(ReducerHoist){ node_id, descendant_id });
+            descendant_id = descendant->end - 1;
+        }
+    }
+}
+
+int construct_reducer(
+    Reducer* const reducer,
+    GrammarGraph const* const graph,
+    char* const* const target_argv,
+    uint32_t const timeout_ms,
+    uint32_t const n_jobs
+) {
+    uint32_t n_workers = n_jobs;
+
+    assert(reducer != NULL);
+    assert(isValid_ggraph(graph));
+    assert(target_argv != NULL);
+    assert(timeout_ms > 0);
+
+    if (n_workers == 0) {
+        long const n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = (n_cpus > 0) ? (uint32_t)n_cpus : 1;
+    }
+    if (n_workers > REDUCER_MAX_JOBS) n_workers = REDUCER_MAX_JOBS;
+
+    *reducer            = NOT_A_REDUCER;
+    reducer->workers    = mem_calloc(n_workers, sizeof(ReducerWorker));
+    for (uint32_t i = 0; i < n_workers; i++) {
+        reducer->workers[i].target_argv = target_argv;
+        reducer->workers[i].timeout_ms  = timeout_ms;
+    }
+
+    /* A target that is not instrumented takes the whole handshake timeout to tell, so every worker waits at once. */
+    runWorkers(reducer->workers, n_workers, start);
+    for (uint32_t i = 0; i < n_workers; i++) {
+        if (isValid_exec(reducer->workers[i].executor)) continue;
+
+        for (uint32_t j = 0; j < n_workers; j++)
+            if (isValid_exec(reducer->workers[j].executor)) destruct_exec(reducer->workers[j].executor);
+        free(reducer->workers);
+        *reducer = NOT_A_REDUCER;
+        return REDUCER_CANNOT_START;
+    }
+
+    for (uint32_t i = 0; i < n_workers; i++) {
+        constructEmpty_alist(reducer->workers[i].seq, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+        constructEmpty_chunk(reducer->workers[i].str_builder, CHUNK_RECOMMENDED_PARAMETERS);
+    }
+    reducer->graph      = graph;
+    reducer->n_workers  = n_workers;
+    construct_dbudget(reducer->budget, graph, 0, 0, 0);
+    constructEmpty_alist(reducer->seq, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(reducer->node_list, sizeof(ReducerNode), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(reducer->cand_list, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(reducer->hoist_list, sizeof(ReducerHoist), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(reducer->stack, sizeof(ReducerPending), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_chunk(reducer->best, CHUNK_RECOMMENDED_PARAMETERS);
+    reducer->start_ns   = monotonicNs_dbudget();
+
+    return REDUCER_OK;
+}
+
+void destruct_reducer(Reducer* const reducer) {
+    assert(isValid_reducer(reducer));
+
+    for (uint32_t i = 0; i < reducer->n_workers; i++) {
+        destruct_exec(reducer->workers[i].executor);
+        destruct_alist(reducer->workers[i].seq);
+        destruct_chunk(reducer->workers[i].str_builder);
+    }
+    free(reducer->workers);
+    destruct_dbudget(reducer->budget);
+    destruct_alist(reducer->seq);
+    destruct_alist(reducer->node_list);
+    destruct_alist(reducer->cand_list);
+    destruct_alist(reducer->hoist_list);
+    destruct_alist(reducer->stack);
+    destruct_chunk(reducer->best);
+
+    *reducer = NOT_A_REDUCER;
+}
+
+/* The same way as the input: the same kind of ending, with the same exit status or signal. */
+static bool isInteresting(
+    Reducer const* const reducer,
+    ReducerWorker const* const worker
+) {
+    if (worker->result != reducer->expected_result) return 0;
+
+    switch (worker->result) {
+        case EXEC_RUN_CRASH:
+            return WTERMSIG(worker->status) == WTERMSIG(reducer->expected_status);
+        case EXEC_RUN_NONZERO_EXIT:
+            return WEXITSTATUS(worker->status) == WEXITSTATUS(reducer->expected_status);
+        case EXEC_RUN_ERROR:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+static bool isPastDeadline(uint64_t const deadline_ns) {
+    return deadline_ns != 0 && monotonicNs_dbudget() >= deadline_ns;
+}
+
+bool isValid_reducer(Reducer const* const reducer) {
+    if (reducer == NULL)                        return 0;
+    if (!isValid_ggraph(reducer->graph))        return 0;
+    if (reducer->workers == NULL)               return 0;
+    if (reducer->n_workers == 0)                return 0;
+    if (!isValid_dbudget(reducer->budget))      return 0;
+    if (!isValid_alist(reducer->seq))           return 0;
+    if (!isValid_alist(reducer->node_list))     return 0;
+    if (!isValid_alist(reducer->cand_list))     return 0;
+    if (!isValid_alist(reducer->hoist_list))    return 0;
+    if (!isValid_alist(reducer->stack))         return 0;
+    if (!isValid_chunk(reducer->best))          return 0;
+
+    return 1;
+}
+
+static char* readInput(
+    uint32_t* const p_sz,
+    char const* const input_path
+) {
+    FILE* const fp  = fopen(input_path, "rb");
+    size_t cap      = REDUCER_INITIAL_BUFFER_SZ;
+    size_t sz       = 0;
+    size_t n_read   = 0;
+    char* buffer    = NULL;
+
+    if (fp == NULL) return NULL;
+
+    buffer = mem_alloc(cap);
+    while ((n_read = fread(buffer + sz, 1, cap - sz, fp)) > 0) {
+        sz += n_read;
+        if (sz < cap) continue;
+        if (cap >= SZ32_MAX) break;
+
+        cap   <<= 1;
+        buffer  = mem_realloc(buffer, cap);
+    }
+    if (ferror(fp) || sz >= SZ32_MAX) {
+        fclose(fp);
+        free(buffer);
+        return NULL;
+    }
+
+    fclose(fp);
+    *p_sz = (uint32_t)sz;
+    return buffer;
+}
+
+int reduce_reducer(
+    Reducer* const reducer,
+    char const* const input_path,
+    uint64_t const deadline_ns
+) {
+    EarleyParser parser[1]      = { NOT_AN_EPARSER };
+    ReducerWorker* const first  = reducer->workers;
+    char* input                 = NULL;
+    uint32_t input_sz           = 0;
+    Item sentence               = NOT_AN_ITEM;
+    bool is_reduced             = 1;
+    int parse_result            = EPARSER_REJECT;
+
+    assert(isValid_reducer(reducer));
+    assert(input_path != NULL);
+
+    input = readInput(&input_sz, input_path);
+    if (input == NULL) return REDUCER_CANNOT_OPEN;
+
+    construct_eparser(parser, reducer->graph);
+    flush_alist(reducer->seq);
+    parse_result = parse_eparser(reducer->seq, parser, input, input_sz);
+    destruct_eparser(parser);
+    free(input);
+    if (parse_result != EPARSER_ACCEPT) return REDUCER_REJECTED;
+
+    reducer->input_sz = input_sz;
+    flush_chunk(reducer->best);
+    generateSentence_ggraph(reducer->best, NULL, NULL, NULL, reducer->graph, reducer->seq);
+
+    sentence        = getLast_chunk(reducer->best);
+    first->result   = run_exec(first->executor, sentence.p, sentence.sz);
+    first->status   = first->executor->last_status;
+    reducer->n_tests++;
+    /* A failed exec is an error here, not a nonzero exit to preserve. */
+    if (first->result == EXEC_RUN_ERROR) return REDUCER_CANNOT_RUN;
+    if (first->result == EXEC_RUN_OK) return REDUCER_NOT_FAILING;
+    reducer->expected_result = first->result;
+    reducer->expected_status = first->status;
+
+    while (is_reduced) {
+        is_reduced = 0;
+        for (uint32_t depth = 0; depth <= analyze(reducer); depth++) {
+            if (isPastDeadline(deadline_ns)) return REDUCER_OK;
+            if (reduceLevel(reducer, depth, deadline_ns)) is_reduced = 1;
+        }
+    }
+
+    return REDUCER_OK;
+}
+
+/*
+ * ddmin over the candidates of one level, where removing a candidate means
+ * shortening its subtree, and then hoisting. The nodes before a hoisted one
+ * stay as they were, so hoisting goes on from there.
+ */
+static bool reduceLevel(
+    Reducer* const reducer,
+    uint32_t const depth,
+    uint64_t const deadline_ns
+) {
+    uint32_t n_chunks   = 1;
+    uint32_t first_id   = 0;
+    bool is_reduced     = 0;
+
+    for (;;) {
+        uint32_t n_cands = 0;
+
+        collectCandidates(reducer, depth);
+        n_cands = reducer->cand_list->len;
+        if (n_cands == 0) break;
+        if (n_chunks > n_cands) n_chunks = n_cands;
+
+        if (testChunks(reducer, n_chunks, deadline_ns)) {
+            is_reduced = 1;
+            if (n_chunks > 1) n_chunks--;
+        } else if (n_chunks == n_cands || isPastDeadline(deadline_ns)) {
+            break;
+        } else {
+            n_chunks = (n_chunks < n_cands - n_chunks) ? 2 * n_chunks : n_cands;
+        }
+    }
+
+    for (;;) {
+        collectHoists(reducer, depth, first_id);
+        if (reducer->hoist_list->len == 0) break;
+
+        first_id = testHoists(reducer, deadline_ns);
+        if (first_id == INVALID_UINT32) break;
+        is_reduced = 1;
+    }
+
+    return is_reduced;
+}
+
+/* Whatever could not start a thread runs on the calling thread. */
+static void runWorkers(
+    ReducerWorker* const workers,
+    uint32_t const n_workers,
+    void* (*run)(void* const)
+) {
+    if (n_workers == 1) {
+        run(workers);
+    } else {
+        pthread_t* const threads    = mem_calloc(n_workers, sizeof(pthread_t));
+        uint32_t n_started          = 0;
+
+        while (n_started < n_workers && pthread_create(threads + n_started, NULL, run, workers + n_started) == 0)
+            n_started++;
+        for (uint32_t i = n_started; i < n_workers; i++) run(workers + i);
+        for (uint32_t i = 0; i < n_started; i++) pthread_join(threads[i], NULL);
+
+        free(threads);
+    }
+}
+
+static void* start(void* const arg) {
+    ReducerWorker* const worker = arg;
+    construct_exec(worker->executor, worker->target_argv, worker->timeout_ms, 0);
+    return NULL;
+}
+
+/*
+ * Keeps the first interesting candidate of a batch, and hands the old
+ * sequence and sentence to its worker. Returns the worker, INVALID_UINT32 if
+ * none.
+ */
+static uint32_t takeFirstInteresting(
+    Reducer* const reducer,
+    uint32_t const n_batch
+) {
+    for (uint32_t i = 0; i < n_batch; i++) {
+        ReducerWorker* const worker = reducer->workers + i;
+        ArrayList const seq         = *(reducer->seq);
+        Chunk const best            = *(reducer->best);
+
+        if (!isInteresting(reducer, worker)) continue;
+
+        *(reducer->seq)         = *(worker->seq);
+        *(worker->seq)          = seq;
+        *(reducer->best)        = *(worker->str_builder);
+        *(worker->str_builder)  = best;
+        reducer->n_reductions++;
+        return i;
+    }
+
+    return INVALID_UINT32;
+}
+
+/*
+ * Tests shortening every chunk of the candidates, a batch of one chunk per
+ * worker at a time, and keeps the first chunk in order that stays
+ * interesting. Every candidate is a subtree longer than the shortest of
+ * its rule, so every chunk shrinks the sentence.
+ */
+static bool testChunks(
+    Reducer* const reducer,
+    uint32_t const n_chunks,
+    uint64_t const deadline_ns
+) {
+    uint32_t const n_cands          = reducer->cand_list->len;
+    uint32_t const* const cands     = getFirst_alist(reducer->cand_list);
+    uint32_t chunk_id               = 0;
+
+    while (chunk_id < n_chunks) {
+        uint32_t n_batch = 0;
+
+        if (isPastDeadline(deadline_ns)) return 0;
+
+        for (; chunk_id < n_chunks && n_batch < reducer->n_workers; chunk_id++) {
+            ReducerWorker* const worker = reducer->workers + n_batch++;
+            uint32_t const begin        = (uint32_t)((uint64_t)chunk_id * n_cands / n_chunks);
+            uint32_t const end          = (uint32_t)((uint64_t)(chunk_id + 1) * n_cands / n_chunks);
+
+            buildCandidate(worker->seq, reducer, cands + begin, end - begin);
+            flush_chunk(worker->str_builder);
+            generateSentence_ggraph(worker->str_builder, NULL, NULL, NULL, reducer->graph, worker->seq);
+        }
+        runWorkers(reducer->workers, n_batch, work);
+        reducer->n_tests += n_batch;
+        if (takeFirstInteresting(reducer, n_batch) != INVALID_UINT32) return 1;
+    }
+
+    return 0;
+}
+
+/* Tests the hoists in batches, and returns the node of the first interesting one, INVALID_UINT32 if none. */
+static uint32_t testHoists(
+    Reducer* const reducer,
+    uint64_t const deadline_ns
+) {
+    ReducerHoist const* const hoists    = getFirst_alist(reducer->hoist_list);
+    uint32_t const* const decisions     = getFirst_alist(reducer->seq);
+    uint32_t hoist_id                   = 0;
+
+    while (hoist_id < reducer->hoist_list->len) {
+        uint32_t const first_hoist_id   = hoist_id;
+        uint32_t n_batch                = 0;
+        uint32_t worker_id              = 0;
+
+        if (isPastDeadline(deadline_ns)) return INVALID_UINT32;
+
+        for (; hoist_id < reducer->hoist_list->len && n_batch < reducer->n_workers; hoist_id++) {
+            ReducerWorker* const worker             = reducer->workers + n_batch++;
+            ReducerHoist const* const hoist         = hoists + hoist_id;
+            ReducerNode const* const node           = get_alist(reducer->node_list, hoist->node_id);
+            ReducerNode const* const descendant     = get_alist(reducer->node_list, hoist->descendant_id);
+
+            flush_alist(worker->seq);
+            for (uint32_t i = 0; i < hoist->node_id; i++)                       add_alist(worker->seq, decisions + i);
+            for (uint32_t i = hoist->descendant_id; i < descendant->end; i++)   add_alist(worker->seq, decisions + i);
+            for (uint32_t i = node->end; i < reducer->seq->len; i++)            add_alist(worker->seq, decisions + i);
+            flush_chunk(worker->str_builder);
+            generateSentence_ggraph(worker->str_builder, NULL, NULL, NULL, reducer->graph, worker->seq);
+        }
+        runWorkers(reducer->workers, n_batch, work);
+        reducer->n_tests += n_batch;
+
+        worker_id = takeFirstInteresting(reducer, n_batch);
+        if (worker_id != INVALID_UINT32) return hoists[first_hoist_id + worker_id].node_id;
+    }
+
+    return INVALID_UINT32;
+}
+
+double testsPerSecond_reducer(Reducer const* const reducer) {
+    uint64_t const elapsed_ns = monotonicNs_dbudget() - reducer->start_ns;
+    assert(isValid_reducer(reducer));
+    return (elapsed_ns == 0) ? 0.0 : (double)reducer->n_tests * 1e9 / (double)elapsed_ns;
+}
+
+static void* work(void* const arg) {
+    ReducerWorker* const worker = arg;
+    Item const sentence         = getLast_chunk(worker->str_builder);
+
+    worker->result = run_exec(worker->executor, sentence.p, sentence.sz);
+    worker->status = worker->executor->last_status;
+    return NULL;
+}
@@ -0,0 +1,926 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.h"
+#include "padkit/memalloc.h"
+#include "padkit/verbose.h"
+
+/* A client with unsent output waits for POLLOUT, and its next requests stay unread until the output is gone. */
+typedef struct ServerClientBody {
+    int             fd;
+    uint32_t        len;
+    unsigned char   request[SRV_MAX_REQUEST_SZ];
+    char*           output;
+    size_t          output_sz;
+    size_t          n_sent;
+} ServerClient;
+
+static volatile sig_atomic_t is_stopping = 0;
+
+static void acceptClient(Server* const srv);
+
+static bool answerRequests(
+    Server* const srv,
+    ServerClient* const client
+);
+
+static int connectTo(char const* const path);
+
+static uint32_t decodeU32(unsigned char const* const bytes);
+
+static void dropClient(
+    Server* const srv,
+    uint32_t const client_id
+);
+
+static void encodeU32(
+    unsigned char* const bytes,
+    uint32_t const value
+);
+
+static ServedGrammar* findGrammar(
+    Server const* const srv,
+    unsigned char const* const name,
+    uint32_t const name_len
+);
+
+static int generateNext(
+    ServedGrammar* const sg,
+    Chunk* const str_builder,
+    ArrayList* const seq
+);
+
+static uint64_t latencyAt(
+    Server const* const srv,
+    uint32_t const permille
+);
+
+static bool readFully(
+    int const fd,
+    void* const buffer,
+    size_t const sz
+);
+
+
+static bool receiveRequests(
+    Server* const srv,
+    uint32_t const client_id
+);
+
+static void recordLatency(
+    Server* const srv,
+    uint64_t const ns
+);
+
+static void* refill(void* const arg);
+
+static bool respond(
+    Server* const srv,
+    ServerClient* const client,
+    unsigned char const* const payload,
+    uint32_t const payload_len
+);
+
+static bool sendOutput(ServerClient* const client);
+
+static void stop(int const sig);
+
+static bool takeSentence(
+    ServedGrammar* const sg,
+    Item* const sentence,
+    uint32_t* const p_n_attempts
+);
+
+static bool writeAvailable(
+    size_t* const p_n_written,
+    int const fd,
+    void const* const buffer,
+    size_t const sz
+);
+
+static bool writeFully(
+    int const fd,
+    void const* const buffer,
+    size_t const sz
+);
+
+static void acceptClient(Server* const srv) {
+    ServerClient* client    = NULL;
+    int const fd            = accept(srv->listen_fd, NULL, NULL);
+
+    if (fd < 0) return;
+    if (srv->client_list->len == SRV_MAX_CLIENTS) {
+        fprintf_verbose(stderr, "Refused a client, %d are connected!", SRV_MAX_CLIENTS);
+        close(fd);
+        return;
+    }
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        close(fd);
+        return;
+    }
+
+    client              = addIndeterminate_alist(srv->client_list);
+    client->fd          = fd;
+    client->len         = 0;
+    client->output      = NULL;
+    client->output_sz   = 0;
+    client->n_sent      = 0;
+}
+
+/* Answers every complete request in the buffer until a response cannot go out at once, returns 0 if the client must go. */
+static bool answerRequests(
+    Server* const srv,
+    ServerClient* const client
+) {
+    while (client->output == NULL && client->len >= SRV_HEADER_SZ) {
+        uint32_t const payload_len = decodeU32(client->request);
+
+        if (payload_len > SRV_MAX_REQUEST_SZ - SRV_HEADER_SZ)                       return 0;
+        if (client->len < SRV_HEADER_SZ + payload_len)                              break;
+        if (!respond(srv, client, client->request + SRV_HEADER_SZ, payload_len))    return 0;
+
+        client->len -= SRV_HEADER_SZ + payload_len;
+        memmove(client->request, client->request + SRV_HEADER_SZ + payload_len, client->len);
+    }
+
+    return 1;
+}
+
+int addGrammar_srv(
+    Server* const srv,
+    char const* const name,
+    FILE* const bnf_file,
+    char* const root_str,
+    uint32_t const root_len,
+    uint32_t const max_decisions,
+    uint32_t const max_bytes
+) {
+    ServedGrammar* sg   = NULL;
+    int result          = GRAMMAR_OK;
+
+    assert(isValid_srv(srv));
+    assert(name != NULL);
+    assert(bnf_file != NULL);
+
+    sg      = mem_alloc(sizeof(ServedGrammar));
+    result  = construct_ggraph(sg->graph, bnf_file, root_str, root_len);
+    if (result != GRAMMAR_OK) {
+        free(sg);
+        return result;
+    }
+
+    sg->name            = name;
+    sg->srv             = srv;
+    sg->n_sentences     = 0;
+    sg->is_exhausted    = 0;
+    sg->has_refiller    = 0;
+    sg->is_stopping     = 0;
+    sg->pool[0]         = NOT_A_CHUNK;
+    sg->pool[1]         = NOT_A_CHUNK;
+    sg->serving         = sg->pool;
+    sg->filling         = sg->pool + 1;
+    sg->n_served        = 0;
+    sg->n_misses        = 0;
+    pthread_mutex_init(&sg->mutex, NULL);
+    pthread_cond_init(&sg->has_room, NULL);
+    pthread_cond_init(&sg->has_sentences, NULL);
+    construct_cov(sg->cov, sg->graph);
+    construct_ftbl(sg->ftbl, sg->graph);
+    constructEmpty_dtree(sg->dtree);
+    if (srv->unique)
+        *(sg->walk) = NOT_A_RWALK;
+    else
+        construct_rwalk(sg->walk);
+    construct_dbudget(sg->budget, sg->graph, max_decisions, max_bytes, 0);
+    if (srv->uses_energy)
+        construct_etbl(sg->etbl, sg->graph, NULL);
+    else
+        *(sg->etbl) = NOT_AN_ETBL;
+
+    if (srv->pool_sz > 0) {
+        sigset_t all_signals;
+        sigset_t old_signals;
+
+        constructEmpty_chunk(sg->pool, CHUNK_RECOMMENDED_PARAMETERS);
+        constructEmpty_chunk(sg->pool + 1, CHUNK_RECOMMENDED_PARAMETERS);
+
+        /* The signals that stop the server have to wake poll() up, not the refill thread. */
+        sigfillset(&all_signals);
+        pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+        sg->has_refiller = (pthread_create(&sg->refiller, NULL, refill, sg) == 0);
+        pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+        if (!sg->has_refiller)
+            fprintf_verbose(stderr, "Could not start the refill thread of '%.*s'!", FILENAME_MAX, name);
+    }
+
+    add_alist(srv->grammar_list, &sg);
+    fprintf_verbose(stderr, "Serving '%.*s'", FILENAME_MAX, name);
+
+    return GRAMMAR_OK;
+}
+
+/* Returns a connected socket, or -1. */
+static int connectTo(char const* const path) {
+    struct sockaddr_un addr;
+    int fd = -1;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr const*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int construct_srv(
+    Server* const srv,
+    char const* const path,
+    uint32_t const min_depth,
+    bool const cov_guided,
+    bool const uses_energy,
+    bool const unique,
+    uint32_t const pool_sz
+) {
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd = -1;
+
+    assert(srv != NULL);
+    assert(path != NULL);
+
+    *srv = NOT_A_SRV;
+    if (strlen(path) >= sizeof(addr.sun_path)) return SRV_CANNOT_LISTEN;
+
+    /* A socket file nobody listens on is left over from a server that did not finish. */
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode))  return SRV_CANNOT_LISTEN;
+
+        fd = connectTo(path);
+        if (fd >= 0) {
+            close(fd);
+            return SRV_CANNOT_LISTEN;
+        }
+        if (unlink(path) != 0)      return SRV_CANNOT_LISTEN;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return SRV_CANNOT_LISTEN;
+    if (
+        bind(fd, (struct sockaddr const*)&addr, sizeof(addr)) != 0 ||
+        listen(fd, SRV_MAX_CLIENTS) != 0
+    ) {
+        close(fd);
+        return SRV_CANNOT_LISTEN;
+    }
+
+    srv->path           = path;
+    srv->listen_fd      = fd;
+    srv->min_depth      = min_depth;
+    srv->cov_guided     = cov_guided;
+    srv->uses_energy    = uses_energy;
+    srv->unique         = unique;
+    srv->pool_sz        = pool_sz;
+    srv->n_requests     = 0;
+    srv->max_latency_ns = 0;
+    memset(srv->latency_counts, 0, sizeof(srv->latency_counts));
+    constructEmpty_alist(srv->grammar_list, sizeof(ServedGrammar*), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_alist(srv->client_list, sizeof(ServerClient), ALIST_RECOMMENDED_INITIAL_CAP);
+    constructEmpty_chunk(srv->str_builder, CHUNK_RECOMMENDED_PARAMETERS);
+    constructEmpty_chunk(srv->response, CHUNK_RECOMMENDED_PARAMETERS);
+    constructEmpty_alist(srv->seq, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+
+    return SRV_OK;
+}
+
+static uint32_t decodeU32(unsigned char const* const bytes) {
+    return (uint32_t)bytes[0]
+        | ((uint32_t)bytes[1] << 8)
+        | ((uint32_t)bytes[2] << 16)
+        | ((uint32_t)bytes[3] << 24);
+}
+
+void destruct_srv(Server* const srv) {
+    assert(isValid_srv(srv));
+
+    for (uint32_t i = 0; i < srv->client_list->len; i++) {
+        ServerClient* const client = get_alist(srv->client_list, i);
+        close(client->fd);
+        free(client->output);
+    }
+    close(srv->listen_fd);
+    unlink(srv->path);
+
+    fprintf_verbose(stderr, "# Requests = %"PRIu64, srv->n_requests);
+    if (srv->n_requests > 0) {
+        fprintf_verbose(stderr, "Latency (p50) = %.1f us", (double)latencyAt(srv, 500) / 1000.0);
+        fprintf_verbose(stderr, "Latency (p99) = %.1f us", (double)latencyAt(srv, 990) / 1000.0);
+        fprintf_verbose(stderr, "Latency (Max) = %.1f us", (double)srv->max_latency_ns / 1000.0);
+    }
+    for (uint32_t i = 0; i < srv->grammar_list->len; i++) {
+        ServedGrammar* const sg = *(ServedGrammar**)get_alist(srv->grammar_list, i);
+
+        if (sg->has_refiller) {
+            pthread_mutex_lock(&sg->mutex);
+            sg->is_stopping = 1;
+            pthread_cond_signal(&sg->has_room);
+            pthread_mutex_unlock(&sg->mutex);
+            pthread_join(sg->refiller, NULL);
+        }
+
+        fprintf_verbose(stderr, "Grammar = %.*s", FILENAME_MAX, sg->name);
+        fprintf_verbose(stderr, "# Sentences = %"PRIu64, sg->n_sentences);
+        fprintf_verbose(stderr, "Term Coverage = %"PRIu32"%%", termCov_cov(sg->cov));
+
+        if (isValid_etbl(sg->etbl)) destruct_etbl(sg->etbl);
+        destruct_dbudget(sg->budget);
+        destruct_dtree(sg->dtree);
+        if (isValid_rwalk(sg->walk)) destruct_rwalk(sg->walk);
+        destruct_ftbl(sg->ftbl);
+        destruct_cov(sg->cov);
+        destruct_ggraph(sg->graph);
+        if (isValid_chunk(sg->pool + 1))    destruct_chunk(sg->pool + 1);
+        if (isValid_chunk(sg->pool))        destruct_chunk(sg->pool);
+        pthread_cond_destroy(&sg->has_sentences);
+        pthread_cond_destroy(&sg->has_room);
+        pthread_mutex_destroy(&sg->mutex);
+        free(sg);
+    }
+
+    destruct_alist(srv->seq);
+    destruct_chunk(srv->response);
+    destruct_chunk(srv->str_builder);
+    destruct_alist(srv->client_list);
+    destruct_alist(srv->grammar_list);
+    *srv = NOT_A_SRV;
+}
+
+/* Moves the last client into the place of client_id. */
+static void dropClient(
+    Server* const srv,
+    uint32_t const client_id
+) {
+    ServerClient* const client  = get_alist(srv->client_list, client_id);
+    ServerClient* const last    = getLast_alist(srv->client_list);
+
+    close(client->fd);
+    free(client->output);
+    if (client != last) memcpy(client, last, sizeof(ServerClient));
+    removeLast_alist(srv->client_list);
+}
+
+static void encodeU32(
+    unsigned char* const bytes,
+    uint32_t const value
+) {
+    bytes[0] = (unsigned char)value;
+    bytes[1] = (unsigned char)(value >> 8);
+    bytes[2] = (unsigned char)(value >> 16);
+    bytes[3] = (unsigned char)(value >> 24);
+}
+
+static ServedGrammar* findGrammar(
+    Server const* const srv,
+    unsigned char const* const name,
+    uint32_t const name_len
+) {
+    for (uint32_t i = 0; i < srv->grammar_list->len; i++) {
+        ServedGrammar* const sg = *(ServedGrammar**)get_alist(srv->grammar_list, i);
+        if (strlen(sg->name) == name_len && memcmp(sg->name, name, name_len) == 0) return sg;
+    }
+
+    return NULL;
+}
+
+/* Returns a DTREE_GENERATE_ result, and the sentence is the last item of str_builder if it is OK. */
+static int generateNext(
+    ServedGrammar* const sg,
+    Chunk* const str_builder,
+    ArrayList* const seq
+) {
+    Server const* const srv = sg->srv;
+    EnergyTable* const etbl = isValid_etbl(sg->etbl) ? sg->etbl : NULL;
+    int const result        = isValid_rwalk(sg->walk)
+        ? generate_rwalk(seq, sg->walk, sg->cov, etbl, sg->graph, NULL, sg->budget, srv->min_depth, srv->cov_guided)
+        : generateRandomDecisionSequence_dtree(
+            seq, sg->dtree, sg->cov, etbl, sg->graph, NULL, sg->budget,
+            srv->min_depth, srv->cov_guided, srv->unique
+        );
+
+    if (result == DTREE_GENERATE_OK)
+        generateSentence_ggraph(str_builder, sg->cov, NULL, sg->ftbl, sg->graph, seq);
+    else if (result == DTREE_GENERATE_NO_UNIQUE_SEQ_REMAINING)
+        fprintf_verbose(stderr, "Exhausted all unique sentences of '%.*s'!", FILENAME_MAX, sg->name);
+    flush_alist(seq);
+
+    return result;
+}
+
+bool isValid_srv(Server const* const srv) {
+    if (srv == NULL)                                                return 0;
+    if (srv->path == NULL)                                          return 0;
+    if (srv->listen_fd < 0)                                         return 0;
+    if (!isValid_alist(srv->grammar_list))                          return 0;
+    if (srv->grammar_list->sz_elem != sizeof(ServedGrammar*))       return 0;
+    if (!isValid_alist(srv->client_list))                           return 0;
+    if (srv->client_list->sz_elem != sizeof(ServerClient))          return 0;
+    if (!isValid_chunk(srv->str_builder))                           return 0;
+    if (!isValid_chunk(srv->response))                              return 0;
+    if (!isValid_alist(srv->seq))                                   return 0;
+
+    return 1;
+}
+
+/* The upper end of the histogram bucket that holds the request at permille of them, capped by the slowest one. */
+static uint64_t latencyAt(
+    Server const* const srv,
+    uint32_t const permille
+) {
+    uint64_t const rank = (srv->n_requests * permille + 999) / 1000;
+    uint64_t n_seen     = 0;
+
+    for (uint32_t bucket = 0; bucket < SRV_LATENCY_BUCKETS; bucket++) {
+        uint64_t upper_ns = bucket;
+
+        n_seen += srv->latency_counts[bucket];
+        if (n_seen < rank || n_seen == 0) continue;
+
+        if (bucket >= (1 << SRV_LATENCY_SUB_BITS)) {
+            uint32_t const shift    = (bucket >> SRV_LATENCY_SUB_BITS) - 1;
+            uint64_t const mantissa = (1 << SRV_LATENCY_SUB_BITS) | (bucket & ((1 << SRV_LATENCY_SUB_BITS) - 1));
+            upper_ns = ((mantissa + 1) << shift) - 1;
+        }
+        return (upper_ns < srv->max_latency_ns) ? upper_ns : srv->max_latency_ns;
+    }
+
+    return srv->max_latency_ns;
+}
+
+int query_srv(
+    FILE* const output,
+    uint32_t* const p_n_received,
+    char const* const path,
+    char const* const name,
+    uint32_t n
+) {
+    unsigned char request[SRV_MAX_REQUEST_SZ];
+    unsigned char header[SRV_HEADER_SZ + 8];
+    Chunk sentences[1]      = { NOT_A_CHUNK };
+    size_t const name_len   = strlen(name);
+    int result              = SRV_OK;
+    int fd                  = -1;
+
+    assert(output != NULL);
+    assert(p_n_received != NULL);
+    assert(path != NULL);
+
+    *p_n_received = 0;
+    if (name_len > SRV_MAX_NAME_LEN) return SRV_NOT_SERVED;
+
+    fd = connectTo(path);
+    if (fd < 0) return SRV_CANNOT_CONNECT;
+
+    constructEmpty_chunk(sentences, CHUNK_RECOMMENDED_PARAMETERS);
+    encodeU32(request, (uint32_t)(4 + name_len));
+    memcpy(request + SRV_HEADER_SZ + 4, name, name_len);
+    while (n > 0 && result == SRV_OK) {
+        uint32_t const batch_sz = (n < SRV_MAX_BATCH) ? n : SRV_MAX_BATCH;
+        uint32_t count          = 0;
+
+        encodeU32(request + SRV_HEADER_SZ, batch_sz);
+        if (
+            !writeFully(fd, request, SRV_HEADER_SZ + 4 + name_len)  ||
+            !readFully(fd, header, sizeof(header))                  ||
+            decodeU32(header) != 8
+        ) {
+            result = SRV_BAD_RESPONSE;
+            break;
+        }
+
+        switch (decodeU32(header + SRV_HEADER_SZ)) {
+            case SRV_STATUS_OK:
+                break;
+            case SRV_STATUS_EXHAUSTED:
+                result = SRV_EXHAUSTED;
+                break;
+            case SRV_STATUS_NOT_SERVED:
+                result = SRV_NOT_SERVED;
+                break;
+            default:
+                result = SRV_BAD_RESPONSE;
+        }
+
+        count = decodeU32(header + SRV_HEADER_SZ + 4);
+        if (count > batch_sz) {
+            result = SRV_BAD_RESPONSE;
+            break;
+        }
+        while (count-- > 0) {
+            unsigned char len_bytes[SRV_HEADER_SZ];
+            Item sentence = NOT_AN_ITEM;
+
+            if (!readFully(fd, len_bytes, SRV_HEADER_SZ)) {
+                result = SRV_BAD_RESPONSE;
+                break;
+            }
+            sentence = addIndeterminate_chunk(sentences, decodeU32(len_bytes));
+            if (!readFully(fd, sentence.p, sentence.sz)) {
+                result = SRV_BAD_RESPONSE;
+                break;
+            }
+            fprintf(output, "%.*s\n", (int)sentence.sz, (char*)sentence.p);
+            flush_chunk(sentences);
+            (*p_n_received)++;
+        }
+        n -= batch_sz;
+    }
+
+    destruct_chunk(sentences);
+    close(fd);
+
+    return result;
+}
+
+/* A negative result of read() or write() that is not EINTR means the peer is gone. */
+static bool readFully(
+    int const fd,
+    void* const buffer,
+    size_t const sz
+) {
+    char* p         = buffer;
+    size_t n_left   = sz;
+
+    while (n_left > 0) {
+        ssize_t const n_read = read(fd, p, n_left);
+        if (n_read < 0 && errno == EINTR)   continue;
+        if (n_read <= 0)                    return 0;
+        p       += n_read;
+        n_left  -= (size_t)n_read;
+    }
+
+    return 1;
+}
+
+/* Reads what the client sent and answers it, returns 0 if the client must go. */
+static bool receiveRequests(
+    Server* const srv,
+    uint32_t const client_id
+) {
+    ServerClient* const client  = get_alist(srv->client_list, client_id);
+    ssize_t n_read              = 0;
+
+    do {
+        n_read = read(client->fd, client->request + client->len, SRV_MAX_REQUEST_SZ - client->len);
+    } while (n_read < 0 && errno == EINTR);
+    if (n_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))    return 1;
+    if (n_read <= 0)                                                return 0;
+    client->len += (uint32_t)n_read;
+
+    return answerRequests(srv, client);
+}
+
+/* Buckets keep the top SRV_LATENCY_SUB_BITS bits below the leading one, and small values exactly. */
+static void recordLatency(
+    Server* const srv,
+    uint64_t const ns
+) {
+    uint32_t bucket = (uint32_t)ns;
+
+    if (ns >= (1 << SRV_LATENCY_SUB_BITS)) {
+        uint32_t msb = SRV_LATENCY_SUB_BITS;
+        while (ns >> (msb + 1)) msb++;
+        bucket = ((msb - SRV_LATENCY_SUB_BITS + 1) << SRV_LATENCY_SUB_BITS)
+               | (uint32_t)((ns >> (msb - SRV_LATENCY_SUB_BITS)) & ((1 << SRV_LATENCY_SUB_BITS) - 1));
+    }
+
+    srv->latency_counts[bucket]++;
+    if (ns > srv->max_latency_ns) srv->max_latency_ns = ns;
+}
+
+/* Keeps the filling Chunk of a pool at pool_sz sentences until the grammar is exhausted or the server stops. */
+static void* refill(void* const arg) {
+    ServedGrammar* const sg = arg;
+    Chunk str_builder[1]    = { NOT_A_CHUNK };
+    ArrayList seq[1]        = { NOT_AN_ALIST };
+
+    constructEmpty_chunk(str_builder, CHUNK_RECOMMENDED_PARAMETERS);
+    constructEmpty_alist(seq, sizeof(uint32_t), ALIST_RECOMMENDED_INITIAL_CAP);
+
+    pthread_mutex_lock(&sg->mutex);
+    while (!sg->is_stopping && !sg->is_exhausted) {
+        int result = DTREE_GENERATE_OK;
+
+        if (LEN_CHUNK(sg->filling) >= sg->srv->pool_sz) {
+            pthread_cond_wait(&sg->has_room, &sg->mutex);
+            continue;
+        }
+
+        pthread_mutex_unlock(&sg->mutex);
+        result = generateNext(sg, str_builder, seq);
+        pthread_mutex_lock(&sg->mutex);
+
+        if (result == DTREE_GENERATE_OK) {
+            Item const sentence = getLast_chunk(str_builder);
+            add_chunk(sg->filling, sentence.p, sentence.sz);
+            flush_chunk(str_builder);
+            pthread_cond_signal(&sg->has_sentences);
+        } else if (result == DTREE_GENERATE_NO_UNIQUE_SEQ_REMAINING) {
+            sg->is_exhausted = 1;
+            pthread_cond_signal(&sg->has_sentences);
+        } else {
+            sg->n_misses++;
+            pthread_cond_signal(&sg->has_sentences);
+        }
+    }
+    pthread_mutex_unlock(&sg->mutex);
+
+    destruct_alist(seq);
+    destruct_chunk(str_builder);
+
+    return NULL;
+}
+
+/*
+ * Generates the requested sentences into the response, or takes them from
+ * the pool, and sends what the socket takes. The rest waits in the output
+ * of the client.
+ */
+static bool respond(
+    Server* const srv,
+    ServerClient* const client,
+    unsigned char const* const payload,
+    uint32_t const payload_len
+) {
+    uint64_t const start_ns = monotonicNs_dbudget();
+    ServedGrammar* sg       = NULL;
+    Item response           = NOT_AN_ITEM;
+    size_t n_written        = 0;
+    uint32_t status         = SRV_STATUS_OK;
+    uint32_t count          = 0;
+    uint32_t n              = 0;
+    bool is_sent            = 0;
+
+    srv->n_requests++;
+    flush_chunk(srv->response);
+    addIndeterminate_chunk(srv->response, SRV_HEADER_SZ + 8);
+
+    if (payload_len < 4 || (n = decodeU32(payload)) > SRV_MAX_BATCH) {
+        status = SRV_STATUS_BAD_REQUEST;
+    } else if ((sg = findGrammar(srv, payload + 4, payload_len - 4)) == NULL) {
+        status = SRV_STATUS_NOT_SERVED;
+    } else if (sg->has_refiller) {
+        /* Only a pool that runs dry makes the request wait, and only until the next sentence. */
+        while (n > 0) {
+            unsigned char len_bytes[SRV_HEADER_SZ];
+            Item sentence = NOT_AN_ITEM;
+
+            if (!takeSentence(sg, &sentence, &n)) {
+                if (n > 0) status = SRV_STATUS_EXHAUSTED;
+                break;
+            }
+            encodeU32(len_bytes, sentence.sz);
+            appendLast_chunk(srv->response, len_bytes, SRV_HEADER_SZ);
+            appendLast_chunk(srv->response, sentence.p, sentence.sz);
+            sg->n_sentences++;
+            count++;
+            n--;
+        }
+    } else {
+        while (n-- > 0 && !sg->is_exhausted) {
+            switch (generateNext(sg, srv->str_builder, srv->seq)) {
+                case DTREE_GENERATE_NO_UNIQUE_SEQ_REMAINING:
+                    sg->is_exhausted = 1;
+                    break;
+                case DTREE_GENERATE_SHALLOW_SEQ:
+                case DTREE_GENERATE_TIMEOUT:
+                    break;
+                case DTREE_GENERATE_OK:
+                default: {
+                    unsigned char len_bytes[SRV_HEADER_SZ];
+                    Item const sentence = getLast_chunk(srv->str_builder);
+
+                    encodeU32(len_bytes, sentence.sz);
+                    appendLast_chunk(srv->response, len_bytes, SRV_HEADER_SZ);
+                    appendLast_chunk(srv->response, sentence.p, sentence.sz);
+                    flush_chunk(srv->str_builder);
+                    sg->n_sentences++;
+                    count++;
+                }
+            }
+        }
+        if (sg->is_exhausted) status = SRV_STATUS_EXHAUSTED;
+    }
+
+    response = getLast_chunk(srv->response);
+    encodeU32(response.p, 8);
+    encodeU32((unsigned char*)response.p + SRV_HEADER_SZ, status);
+    encodeU32((unsigned char*)response.p + SRV_HEADER_SZ + 4, count);
+
+    is_sent = writeAvailable(&n_written, client->fd, response.p, response.sz);
+    if (is_sent && n_written < response.sz) {
+        client->output_sz   = response.sz - n_written;
+        client->output      = mem_alloc(client->output_sz);
+        client->n_sent      = 0;
+        memcpy(client->output, (char*)response.p + n_written, client->output_sz);
+    }
+    recordLatency(srv, monotonicNs_dbudget() - start_ns);
+
+    return is_sent;
+}
+
+int run_srv(
+    Server* const srv,
+    uint32_t const t
+) {
+    struct sigaction action;
+    struct sigaction old_int;
+    struct sigaction old_term;
+    struct sigaction old_pipe;
+    struct pollfd* const pfds   = mem_alloc((SRV_MAX_CLIENTS + 1) * sizeof(struct pollfd));
+    uint64_t const deadline_ns  = (t == 0) ? 0 : monotonicNs_dbudget() + (uint64_t)t * 1000000000;
+
+    assert(isValid_srv(srv));
+
+    /* No SA_RESTART, so a signal wakes poll() up. */
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = stop;
+    is_stopping = 0;
+    sigaction(SIGINT, &action, &old_int);
+    sigaction(SIGTERM, &action, &old_term);
+    /* A client that hangs up in the middle of a response must not kill the server. */
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, &old_pipe);
+
+    fprintf_verbose(stderr, "Listening on '%.*s'", FILENAME_MAX, srv->path);
+    while (!is_stopping) {
+        uint32_t const n_clients    = srv->client_list->len;
+        int timeout_ms              = -1;
+        int res                     = 0;
+
+        if (deadline_ns != 0) {
+            uint64_t const now_ns = monotonicNs_dbudget();
+            if (now_ns >= deadline_ns) break;
+            timeout_ms = (int)((deadline_ns - now_ns + 999999) / 1000000);
+        }
+
+        pfds[0] = (struct pollfd){ srv->listen_fd, POLLIN, 0 };
+        for (uint32_t i = 0; i < n_clients; i++) {
+            ServerClient const* const client = get_alist(srv->client_list, i);
+            pfds[i + 1] = (struct pollfd){ client->fd, (client->output == NULL) ? POLLIN : POLLOUT, 0 };
+        }
+
+        res = poll(pfds, n_clients + 1, timeout_ms);
+        if (res < 0 && errno == EINTR)  continue;
+        if (res < 0)                    break;
+
+        /* Backwards, so dropping a client leaves the ids of the unvisited ones alone. */
+        for (uint32_t i = n_clients; i > 0; i--) {
+            ServerClient* const client  = get_alist(srv->client_list, i - 1);
+            bool is_kept                = 1;
+
+            if (pfds[i].revents == 0) continue;
+            if (client->output == NULL)
+                is_kept = receiveRequests(srv, i - 1);
+            else
+                is_kept = sendOutput(client) && answerRequests(srv, client);
+            if (!is_kept) dropClient(srv, i - 1);
+        }
+        if (pfds[0].revents & POLLIN) acceptClient(srv);
+    }
+
+    sigaction(SIGPIPE, &old_pipe, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    sigaction(SIGINT, &old_int, NULL);
+    free(pfds);
+
+    return SRV_OK;
+}
+
+/* Sends what the socket takes of the pending output, and frees it once it is all gone. */
+static bool sendOutput(ServerClient* const client) {
+    size_t n_written = 0;
+
+    if (!writeAvailable(&n_written, client->fd, client->output + client->n_sent, client->output_sz - client->n_sent))
+        return 0;
+
+    client->n_sent += n_written;
+    if (client->n_sent == client->output_sz) {
+        free(client->output);
+        client->output      = NULL;
+        client->output_sz   = 0;
+        client->n_sent      = 0;
+    }
+
+    return 1;
+}
+
+static void stop(int const sig) {
+    (void)sig;
+    is_stopping = 1;
+}
+
+/*
+ * Swaps in the sentences of the refill thread once the serving ones run
+ * out. Like the attempts of a request without a pool, every shallow or
+ * timed out sequence generated while waiting uses up one of the
+ * attempts, so 0 with attempts left means the grammar is exhausted.
+ */
+static bool takeSentence(
+    ServedGrammar* const sg,
+    Item* const sentence,
+    uint32_t* const p_n_attempts
+) {
+    if (sg->n_served == LEN_CHUNK(sg->serving)) {
+        Chunk* const served = sg->serving;
+        uint64_t n_misses   = 0;
+
+        pthread_mutex_lock(&sg->mutex);
+        n_misses = sg->n_misses;
+        while (LEN_CHUNK(sg->filling) == 0 && !sg->is_exhausted) {
+            if (sg->n_misses - n_misses >= *p_n_attempts) {
+                *p_n_attempts = 0;
+                break;
+            }
+            pthread_cond_wait(&sg->has_sentences, &sg->mutex);
+        }
+        if (LEN_CHUNK(sg->filling) == 0) {
+            pthread_mutex_unlock(&sg->mutex);
+            return 0;
+        }
+        /* A sentence that came with the last miss still gets taken. */
+        n_misses        = sg->n_misses - n_misses;
+        *p_n_attempts   = (n_misses < *p_n_attempts) ? *p_n_attempts - (uint32_t)n_misses : 1;
+
+        flush_chunk(served);
+        sg->serving     = sg->filling;
+        sg->filling     = served;
+        sg->n_served    = 0;
+        pthread_cond_signal(&sg->has_room);
+        pthread_mutex_unlock(&sg->mutex);
+    }
+
+    *sentence = get_chunk(sg->serving, sg->n_served++);
+    return 1;
+}
+
+/* Writes until a non-blocking fd would block, returns 0 if the peer is gone. */
+static bool writeAvailable(
+    size_t* const p_n_written,
+    int const fd,
+    void const* const buffer,
+    size_t const sz
+) {
+    char const* const p = buffer;
+
+    *p_n_written = 0;
+    while (*p_n_written < sz) {
+        ssize_t const n_written = write(fd, p + *p_n_written, sz - *p_n_written);
+        if (n_written < 0 && errno == EINTR)                                continue;
+        if (n_written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))     break;
+        if (n_written <= 0)                                                 return 0;
+        *p_n_written += (size_t)n_written;
+    }
+
+    return 1;
+}
+
+static bool writeFully(
+    int const fd,
+    void const* const buffer,
+    size_t const sz
+) {
+    char const* p   = buffer;
+    size_t n_left   = sz;
+
+    while (n_left > 0) {
+        ssize_t const n_written = write(fd, p, n_left);
+        if (n_written < 0 && errno == EINTR)    continue;
+        if (n_written <= 0)                     return 0;
+        p       += n_written;
+        n_left  -= (size_t)n_written;
+    }
+
+    return 1;
+}
@@ -0,0 +1,505 @@
+#define _POSIX_C_SOURCE 200809L
+#ifdef __linux__
+    #define _DEFAULT_SOURCE
+#endif
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "derivationbudget.h"
+#include "padkit/verbose.h"
+#include "sharedring.h"
+
+#if defined(__linux__) && !defined(SRING_NO_FUTEX)
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+    #define SRING_HAS_FUTEX
+#endif
+
+#if SRING_CAPACITY < 64 || (SRING_CAPACITY & (SRING_CAPACITY - 1)) != 0
+    #error "SRING_CAPACITY must be a power of two, at least 64"
+#endif
+
+#define SRING_HEADER_SZ             (4096)
+#define SRING_LINE_SZ               (64)
+#define SRING_MODE                  (0600)
+
+#define SRING_PAD                   (UINT32_MAX)
+#define SRING_RECORD_READY          (0)
+#define SRING_RECORD_RELEASED       (1)
+
+#define SRING_RECORD_SZ(len)        (((uint64_t)sizeof(SharedRecord) + (uint64_t)(len) + 7) & ~(uint64_t)7)
+
+/*
+ * Every position is a byte offset that only grows, the data offset being
+ * position & (capacity - 1). [tail, claim) is claimed by readers or
+ * released, [claim, head) is ready to claim. The fields each side writes
+ * sit on their own cache lines.
+ */
+struct SharedRingHeaderBody {
+    char            magic[SRING_MAGIC_LEN];
+    uint32_t        is_closed;
+    uint64_t        capacity;
+    int64_t         writer_pid;
+    unsigned char   line0[SRING_LINE_SZ - 24];
+    uint64_t        head;
+    uint32_t        head_seq;
+    unsigned char   line1[SRING_LINE_SZ - 12];
+    uint64_t        claim;
+    unsigned char   line2[SRING_LINE_SZ - 8];
+    uint64_t        tail;
+    unsigned char   line3[SRING_LINE_SZ - 8];
+    uint32_t        release_seq;
+    uint32_t        n_waiting_readers;
+    uint32_t        is_writer_waiting;
+};
+
+typedef struct SharedRecordBody {
+    uint32_t    len;
+    uint32_t    state;
+} SharedRecord;
+
+static uint64_t countUnclaimed(SharedRing const* const ring);
+
+static void drain(SharedRing* const ring);
+
+static void publish(
+    SharedRing* const ring,
+    uint64_t const head
+);
+
+static void reclaim(SharedRing* const ring);
+
+static bool reserve(
+    SharedRing* const ring,
+    uint64_t const sz
+);
+
+static bool setName(
+    SharedRing* const ring,
+    char const* const name
+);
+
+static void sleepOn(
+    uint32_t* const word,
+    uint32_t const seen
+);
+
+static void wakeAll(uint32_t* const word);
+
+int claim_sring(
+    SharedRing* const ring,
+    Item* const record
+) {
+    struct SharedRingHeaderBody* const header = ring->header;
+
+    assert(isValid_sring(ring));
+    assert(!ring->is_writer);
+    assert(record != NULL);
+
+    while (1) {
+        uint64_t claim          = __atomic_load_n(&(header->claim), __ATOMIC_ACQUIRE);
+        uint64_t const head     = __atomic_load_n(&(header->head), __ATOMIC_ACQUIRE);
+        uint64_t const offset   = claim & (header->capacity - 1);
+        SharedRecord* rec       = NULL;
+        uint32_t len            = 0;
+        uint64_t sz             = 0;
+
+        if (claim == head) {
+            uint32_t const seen = __atomic_load_n(&(header->head_seq), __ATOMIC_SEQ_CST);
+
+            /* The writer closes only after its last record, so a closed ring is final. */
+            if (
+                __atomic_load_n(&(header->is_closed), __ATOMIC_SEQ_CST) &&
+                __atomic_load_n(&(header->head), __ATOMIC_SEQ_CST) == claim
+            ) return SRING_END;
+
+            __atomic_add_fetch(&(header->n_waiting_readers), 1, __ATOMIC_SEQ_CST);
+            if (
+                __atomic_load_n(&(header->head), __ATOMIC_SEQ_CST) == claim &&
+                !__atomic_load_n(&(header->is_closed), __ATOMIC_SEQ_CST)
+            ) {
+                sleepOn(&(header->head_seq), seen);
+                ring->n_waits++;
+            }
+            __atomic_sub_fetch(&(header->n_waiting_readers), 1, __ATOMIC_SEQ_CST);
+
+            /* A writer that died never closes its ring. */
+            if (kill((pid_t)header->writer_pid, 0) != 0 && errno == ESRCH) return SRING_END;
+            continue;
+        }
+
+        rec = (SharedRecord*)(ring->data + offset);
+        len = __atomic_load_n(&(rec->len), __ATOMIC_RELAXED);
+        sz  = (len == SRING_PAD) ? header->capacity - offset : SRING_RECORD_SZ(len);
+        if (!__atomic_compare_exchange_n(
+            &(header->claim), &claim, claim + sz, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE
+        )) continue;
+        if (len == SRING_PAD) continue;
+
+        record->p       = rec + 1;
+        record->sz      = len;
+        record->type    = 0;
+        ring->n_records++;
+        return SRING_OK;
+    }
+}
+
+int construct_sring(
+    SharedRing* const ring,
+    char const* const name,
+    uint64_t const deadline_ns
+) {
+    struct SharedRingHeaderBody* header = NULL;
+    void* map                           = MAP_FAILED;
+    int fd                              = -1;
+
+    assert(ring != NULL);
+    assert(name != NULL);
+
+    *ring = NOT_A_SRING;
+    if (!setName(ring, name)) return SRING_CANNOT_OPEN;
+
+    fd = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, SRING_MODE);
+    if (fd < 0 && errno == EEXIST) {
+        /* A ring whose writer died is left over, but a live writer keeps its ring. */
+        struct stat st;
+        int const old_fd = shm_open(ring->name, O_RDONLY, 0);
+        bool is_stale = 0;
+
+        if (old_fd < 0) return SRING_CANNOT_OPEN;
+        if (fstat(old_fd, &st) == 0 && st.st_size >= SRING_HEADER_SZ) {
+            void* const old_map = mmap(NULL, SRING_HEADER_SZ, PROT_READ, MAP_SHARED, old_fd, 0);
+            if (old_map != MAP_FAILED) {
+                struct SharedRingHeaderBody const* const old = old_map;
+                is_stale = memcmp(old->magic, SRING_MAGIC, SRING_MAGIC_LEN) == 0 &&
+                    kill((pid_t)old->writer_pid, 0) != 0 && errno == ESRCH;
+                munmap(old_map, SRING_HEADER_SZ);
+            }
+        }
+        close(old_fd);
+        if (!is_stale || shm_unlink(ring->name) != 0) return SRING_CANNOT_OPEN;
+
+        fd = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, SRING_MODE);
+    }
+    if (fd < 0) return SRING_CANNOT_OPEN;
+
+    if (ftruncate(fd, (off_t)SRING_HEADER_SZ + SRING_CAPACITY) == 0)
+        map = mmap(NULL, (size_t)SRING_HEADER_SZ + SRING_CAPACITY, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(ring->name);
+        return SRING_CANNOT_OPEN;
+    }
+
+    header              = map;
+    header->capacity    = SRING_CAPACITY;
+    header->writer_pid  = (int64_t)getpid();
+    /* Readers check the magic, so it goes in last. */
+    __atomic_store_n(&(header->is_closed), 0, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    memcpy(header->magic, SRING_MAGIC, SRING_MAGIC_LEN);
+
+    ring->header        = header;
+    ring->data          = (unsigned char*)map + SRING_HEADER_SZ;
+    ring->deadline_ns   = deadline_ns;
+    ring->is_writer     = 1;
+
+    return SRING_OK;
+}
+
+/* Counts the records in [claim, head), skipping padding. */
+static uint64_t countUnclaimed(SharedRing const* const ring) {
+    struct SharedRingHeaderBody const* const header = ring->header;
+    uint64_t const head                             = header->head;
+    uint64_t claim                                  = __atomic_load_n(&(header->claim), __ATOMIC_ACQUIRE);
+    uint64_t n_unclaimed                            = 0;
+
+    while (claim < head) {
+        uint64_t const offset           = claim & (header->capacity - 1);
+        SharedRecord const* const rec   = (SharedRecord const*)(ring->data + offset);
+
+        if (rec->len == SRING_PAD) {
+            claim += header->capacity - offset;
+        } else {
+            claim += SRING_RECORD_SZ(rec->len);
+            n_unclaimed++;
+        }
+    }
+
+    return n_unclaimed;
+}
+
+int destruct_sring(SharedRing* const ring) {
+    struct SharedRingHeaderBody* const header   = ring->header;
+    uint64_t n_unclaimed                        = 0;
+
+    assert(isValid_sring(ring));
+
+    if (ring->is_writer) {
+        __atomic_store_n(&(header->is_closed), 1, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&(header->head_seq), 1, __ATOMIC_SEQ_CST);
+        wakeAll(&(header->head_seq));
+
+        drain(ring);
+        n_unclaimed = countUnclaimed(ring);
+        shm_unlink(ring->name);
+        if (n_unclaimed > 0)
+            fprintf_verbose(stderr, "# Ring Records (Unclaimed) = %"PRIu64, n_unclaimed);
+    }
+    munmap(header, (size_t)SRING_HEADER_SZ + header->capacity);
+
+    *ring = NOT_A_SRING;
+
+    return (n_unclaimed == 0) ? SRING_OK : SRING_UNCLAIMED;
+}
+
+/*
+ * Waits for a first claim until the deadline, or for SRING_DRAIN_MS without
+ * one, then for the readers to release every record, as long as they claim
+ * or release something every SRING_DRAIN_MS.
+ */
+static void drain(SharedRing* const ring) {
+    struct SharedRingHeaderBody* const header   = ring->header;
+    uint64_t const deadline_ns                  = ring->deadline_ns;
+    uint64_t const attach_ns                    = (deadline_ns != 0)
+        ? deadline_ns
+        : monotonicNs_dbudget() + (uint64_t)SRING_DRAIN_MS * 1000000;
+
+    while (
+        __atomic_load_n(&(header->claim), __ATOMIC_ACQUIRE) == 0 &&
+        header->head > 0 &&
+        monotonicNs_dbudget() < attach_ns
+    ) {
+        sleepOn(&(header->release_seq), __atomic_load_n(&(header->release_seq), __ATOMIC_SEQ_CST));
+        ring->n_waits++;
+    }
+    if (__atomic_load_n(&(header->claim), __ATOMIC_ACQUIRE) == 0) return;
+
+    while (!ring->is_timed_out) {
+        uint64_t const claim    = __atomic_load_n(&(header->claim), __ATOMIC_ACQUIRE);
+        uint64_t const tail     = header->tail;
+        uint64_t const idle_ns  = monotonicNs_dbudget() + (uint64_t)SRING_DRAIN_MS * 1000000;
+
+        ring->deadline_ns = (deadline_ns != 0 && deadline_ns < idle_ns) ? deadline_ns : idle_ns;
+        if (reserve(ring, header->capacity)) break;
+        if (deadline_ns != 0 && monotonicNs_dbudget() >= deadline_ns) break;
+        if (__atomic_load_n(&(header->claim), __ATOMIC_ACQUIRE) == claim && header->tail == tail) break;
+        ring->is_timed_out = 0;
+    }
+    ring->deadline_ns = deadline_ns;
+}
+
+bool isValid_sring(SharedRing const* const ring) {
+    if (ring == NULL)           return 0;
+    if (ring->header == NULL)   return 0;
+    if (ring->data == NULL)     return 0;
+
+    return 1;
+}
+
+int open_sring(
+    SharedRing* const ring,
+    char const* const name
+) {
+    struct SharedRingHeaderBody const* header   = NULL;
+    struct stat st;
+    void* map                                   = MAP_FAILED;
+    int fd                                      = -1;
+
+    assert(ring != NULL);
+    assert(name != NULL);
+
+    *ring = NOT_A_SRING;
+    if (!setName(ring, name)) return SRING_CANNOT_OPEN;
+
+    fd = shm_open(ring->name, O_RDWR, 0);
+    if (fd < 0) return SRING_CANNOT_OPEN;
+    if (fstat(fd, &st) == 0 && st.st_size > SRING_HEADER_SZ)
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return SRING_CANNOT_OPEN;
+
+    header = map;
+    if (
+        memcmp(header->magic, SRING_MAGIC, SRING_MAGIC_LEN) != 0                ||
+        (uint64_t)st.st_size != SRING_HEADER_SZ + header->capacity              ||
+        (header->capacity & (header->capacity - 1)) != 0
+    ) {
+        munmap(map, (size_t)st.st_size);
+        return SRING_CANNOT_OPEN;
+    }
+
+    ring->header    = map;
+    ring->data      = (unsigned char*)map + SRING_HEADER_SZ;
+
+    return SRING_OK;
+}
+
+/* Makes [old head, head) claimable, and wakes the readers if any sleep. */
+static void publish(
+    SharedRing* const ring,
+    uint64_t const head
+) {
+    struct SharedRingHeaderBody* const header = ring->header;
+
+    __atomic_store_n(&(header->head), head, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&(header->head_seq), 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&(header->n_waiting_readers), __ATOMIC_SEQ_CST) > 0)
+        wakeAll(&(header->head_seq));
+}
+
+/* Moves the tail past the released records, stopping at the first one still claimed. */
+static void reclaim(SharedRing* const ring) {
+    struct SharedRingHeaderBody* const header   = ring->header;
+    uint64_t const claim                        = __atomic_load_n(&(header->claim), __ATOMIC_ACQUIRE);
+    uint64_t tail                               = header->tail;
+
+    while (tail < claim) {
+        uint64_t const offset           = tail & (header->capacity - 1);
+        SharedRecord const* const rec   = (SharedRecord const*)(ring->data + offset);
+
+        if (rec->len == SRING_PAD) {
+            tail += header->capacity - offset;
+        } else if (__atomic_load_n(&(rec->state), __ATOMIC_ACQUIRE) == SRING_RECORD_RELEASED) {
+            tail += SRING_RECORD_SZ(rec->len);
+        } else {
+            break;
+        }
+    }
+    __atomic_store_n(&(header->tail), tail, __ATOMIC_RELEASE);
+}
+
+void release_sring(
+    SharedRing* const ring,
+    Item const* const record
+) {
+    struct SharedRingHeaderBody* const header   = ring->header;
+    SharedRecord* const rec                     = (SharedRecord*)record->p - 1;
+
+    assert(isValid_sring(ring));
+    assert(!ring->is_writer);
+
+    __atomic_store_n(&(rec->state), SRING_RECORD_RELEASED, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&(header->release_seq), 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&(header->is_writer_waiting), __ATOMIC_SEQ_CST))
+        wakeAll(&(header->release_seq));
+}
+
+/* Waits until sz bytes past the head are free, returns 0 past the deadline. */
+static bool reserve(
+    SharedRing* const ring,
+    uint64_t const sz
+) {
+    struct SharedRingHeaderBody* const header = ring->header;
+
+    while (1) {
+        uint32_t seen = 0;
+
+        reclaim(ring);
+        if (header->capacity - (header->head - header->tail) >= sz) return 1;
+        if (ring->is_timed_out) return 0;
+        if (ring->deadline_ns != 0 && monotonicNs_dbudget() >= ring->deadline_ns) {
+            ring->is_timed_out = 1;
+            return 0;
+        }
+
+        seen = __atomic_load_n(&(header->release_seq), __ATOMIC_SEQ_CST);
+        __atomic_store_n(&(header->is_writer_waiting), 1, __ATOMIC_SEQ_CST);
+        reclaim(ring);
+        if (header->capacity - (header->head - header->tail) < sz) {
+            sleepOn(&(header->release_seq), seen);
+            ring->n_waits++;
+        }
+        __atomic_store_n(&(header->is_writer_waiting), 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+/* Shared memory names start with one slash. */
+static bool setName(
+    SharedRing* const ring,
+    char const* const name
+) {
+    size_t const len = strlen(name);
+
+    if (len == 0 || len > SRING_MAX_LEN_NAME) return 0;
+
+    if (name[0] == '/') {
+        memcpy(ring->name, name, len + 1);
+    } else {
+        ring->name[0] = '/';
+        memcpy(ring->name + 1, name, len + 1);
+    }
+
+    return 1;
+}
+
+/* Sleeps until *word is no longer seen, SRING_WAIT_MS at most. */
+static void sleepOn(
+    uint32_t* const word,
+    uint32_t const seen
+) {
+    #ifdef SRING_HAS_FUTEX
+        struct timespec const timeout = { SRING_WAIT_MS / 1000, (SRING_WAIT_MS % 1000) * 1000000L };
+        syscall(SYS_futex, word, FUTEX_WAIT, seen, &timeout, NULL, 0);
+    #else
+        struct timespec const nap = { 0, 1000000L };
+        (void)word;
+        (void)seen;
+        nanosleep(&nap, NULL);
+    #endif
+}
+
+static void wakeAll(uint32_t* const word) {
+    #ifdef SRING_HAS_FUTEX
+        syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    #else
+        (void)word;
+    #endif
+}
+
+int write_sring(
+    SharedRing* const ring,
+    void const* const data,
+    uint32_t const sz
+) {
+    struct SharedRingHeaderBody* const header   = ring->header;
+    uint64_t const record_sz                    = SRING_RECORD_SZ(sz);
+    uint64_t offset                             = 0;
+    SharedRecord* rec                           = NULL;
+
+    assert(isValid_sring(ring));
+    assert(ring->is_writer);
+    assert(data != NULL || sz == 0);
+
+    if (record_sz > header->capacity) return SRING_TOO_LARGE;
+
+    offset = header->head & (header->capacity - 1);
+    if (offset + record_sz > header->capacity) {
+        if (!reserve(ring, header->capacity - offset)) return SRING_TIMEOUT;
+
+        rec = (SharedRecord*)(ring->data + offset);
+        __atomic_store_n(&(rec->len), SRING_PAD, __ATOMIC_RELAXED);
+        __atomic_store_n(&(rec->state), SRING_RECORD_RELEASED, __ATOMIC_RELAXED);
+        publish(ring, header->head + header->capacity - offset);
+        offset = 0;
+    }
+    if (!reserve(ring, record_sz)) return SRING_TIMEOUT;
+
+    rec = (SharedRecord*)(ring->data + offset);
+    __atomic_store_n(&(rec->len), sz, __ATOMIC_RELAXED);
+    __atomic_store_n(&(rec->state), SRING_RECORD_READY, __ATOMIC_RELAXED);
+    if (sz > 0) memcpy(rec + 1, data, sz);
+    publish(ring, header->head + record_sz);
+    ring->n_records++;
+
+    return SRING_OK;
+}
@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <string.h>
+#include "memoryusage.h"
+#include "spantree.h"
+#include "padkit/repeat.h"
+
+static bool writeItem(
+    FILE* const fp,
+    Item const item
+);
+
+static uint32_t writeVarint(
+    unsigned char* const buffer,
+    uint32_t value
+);
+
+uint32_t add_stree(
+    SpanTree* const stree,
+    uint32_t const term,
+    uint32_t const start
+) {
+    Span* span = NULL;
+
+    assert(isValid_stree(stree));
+
+    span        = addIndeterminate_alist(stree->span_list);
+    span->term  = term;
+    span->start = start;
+    span->len   = 0;
+
+    return stree->span_list->len - 1;
+}
+
+void close_stree(
+    SpanTree* const stree,
+    uint32_t const span_id,
+    uint32_t const end
+) {
+    Span* span = NULL;
+
+    assert(isValid_stree(stree));
+    assert(span_id < stree->span_list->len);
+
+    span        = get_alist(stree->span_list, span_id);
+    assert(end >= span->start);
+    span->len   = end - span->start;
+}
+
+void constructEmpty_stree(SpanTree* const stree) {
+    assert(stree != NULL);
+    constructEmpty_alist(stree->span_list, sizeof(Span), ALIST_RECOMMENDED_INITIAL_CAP);
+}
+
+void destruct_stree(SpanTree* const stree) {
+    assert(isValid_stree(stree));
+    destruct_alist(stree->span_list);
+    *stree = NOT_A_STREE;
+}
+
+void flush_stree(SpanTree* const stree) {
+    assert(isValid_stree(stree));
+    flush_alist(stree->span_list);
+}
+
+bool isValid_stree(SpanTree const* const stree) {
+    if (stree == NULL)                              return 0;
+    if (!isValid_alist(stree->span_list))           return 0;
+    if (stree->span_list->sz_elem != sizeof(Span))  return 0;
+
+    return 1;
+}
+
+size_t memoryUsage_stree(SpanTree const* const stree) {
+    assert(isValid_stree(stree));
+    return MUSAGE_ALIST(stree->span_list);
+}
+
+bool write_stree(
+    FILE* const fp,
+    SpanTree const* const stree
+) {
+    unsigned char buffer[3 * STREE_MAX_VARINT_LEN];
+    Span const* span    = NULL;
+    uint32_t n          = 0;
+
+    assert(fp != NULL);
+    assert(isValid_stree(stree));
+
+    n = writeVarint(buffer, stree->span_list->len);
+    if (fwrite(buffer, 1, n, fp) != n) return 0;
+
+    if (stree->span_list->len == 0) return 1;
+
+    span = getFirst_alist(stree->span_list);
+    REPEAT(stree->span_list->len) {
+        n  = writeVarint(buffer, span->term);
+        n += writeVarint(buffer + n, span->start);
+        n += writeVarint(buffer + n, span->len);
+        if (fwrite(buffer, 1, n, fp) != n) return 0;
+        span++;
+    }
+
+    return 1;
+}
+
+bool writeHeader_stree(
+    FILE* const fp,
+    GrammarGraph const* const graph
+) {
+    unsigned char buffer[STREE_MAX_VARINT_LEN];
+    RuleTerm const* rule    = NULL;
+    uint32_t n              = 0;
+
+    assert(fp != NULL);
+    assert(isValid_ggraph(graph));
+
+    if (fwrite(STREE_MAGIC, 1, STREE_MAGIC_LEN, fp) != STREE_MAGIC_LEN) return 0;
+
+    n = writeVarint(buffer, graph->rule_list->len);
+    if (fwrite(buffer, 1, n, fp) != n) return 0;
+    rule = getFirst_alist(graph->rule_list);
+    REPEAT(graph->rule_list->len) {
+        if (!writeItem(fp, get_chunk(graph->rule_names, (rule++)->name_id))) return 0;
+    }
+
+    n = writeVarint(buffer, LEN_CHUNK(graph->terminals));
+    if (fwrite(buffer, 1, n, fp) != n) return 0;
+    for (uint32_t terminal_id = 0; terminal_id < LEN_CHUNK(graph->terminals); terminal_id++) {
+        if (!writeItem(fp, get_chunk(graph->terminals, terminal_id))) return 0;
+    }
+
+    return 1;
+}
+
+/* Its length as a varint, then its bytes. */
+static bool writeItem(
+    FILE* const fp,
+    Item const item
+) {
+    unsigned char buffer[STREE_MAX_VARINT_LEN];
+    uint32_t const n = writeVarint(buffer, item.sz);
+
+    if (fwrite(buffer, 1, n, fp) != n) return 0;
+    return item.sz == 0 || fwrite(item.p, 1, item.sz, fp) == item.sz;
+}
+
+static uint32_t writeVarint(
+    unsigned char* const buffer,
+    uint32_t value
+) {
+    uint32_t n = 0;
+
+    while (value >= 0x80) {
+        buffer[n++] = (unsigned char)(value | 0x80);
+        value     >>= 7;
+    }
+    buffer[n++] = (unsigned char)value;
+
+    return n;
+}
@@ -0,0 +1,865 @@
+#include <assert.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bnf.h"
+#include "memoryusage.h"
+#include "weighttable.h"
+#include "padkit/chunktable.h"
+#include "padkit/invalid.h"
+#include "padkit/memalloc.h"
+#include "padkit/repeat.h"
+
+#define WTBL_DIVERGENCE_LIMIT   (1e150)
+#define WTBL_NEWTON_ITERATIONS  (256)
+#define WTBL_LOG_X_MAX          (20.0)
+#define WTBL_LOG_X_STEP         (0.5)
+#define WTBL_TOLERANCE          (1e-12)
+
+#define WTBL_MAX_LEN_WEIGHT    (64)
+
+#define RAND_UNIT()             ((double)rand() / ((double)RAND_MAX + 1.0))
+
+#ifdef LITEQ
+    #undef LITEQ
+#endif
+#define LITEQ(str, lit)         (strncmp(str, lit, sizeof(lit) - 1) == 0)
+
+/*
+ * The grammar, viewed as a system of generating functions:
+ *
+ *     F_r(x) = SUM_{alt a of r} x^{n_bytes(a)} * PRODUCT_{child rule c of a} F_c(x)
+ *
+ * Choosing every alternative with probability x^{n_bytes(a)} * PRODUCT F_c / F_r
+ * (a Boltzmann sampler) yields sentences whose expected size is x * F_r' / F_r,
+ * which grows monotonically with x. Sizes are measured in terminal bytes.
+ *
+ * To avoid underflow, F_r is divided by x^{min_size(r)}, so every alternative
+ * is weighted by x raised to its excess over the shortest sentence of its rule.
+ *
+ * Near the singularity plain fixpoint iteration crawls, so grammars with at
+ * most WTBL_BOLTZMANN_MAX_DENSE_RULES reachable rules are solved with Newton
+ * steps and dense linear solves instead.
+ */
+typedef struct BoltzmannSystemBody {
+    uint32_t    n_rules;
+    uint32_t    n_alts;
+    uint32_t*   alt_offsets;
+    double*     n_bytes;
+    double*     excess;
+    double*     min_size;
+    uint32_t*   child_offsets;
+    uint32_t*   children;
+    bool*       is_reachable;
+    uint32_t    n_dense;
+    uint32_t*   dense_ids;
+    double*     A;
+    double*     b;
+    double*     x_pow;
+    double*     F;
+    double*     E;
+} BoltzmannSystem;
+
+static void constructSystem(
+    BoltzmannSystem* const sys,
+    WeightTable const* const wtbl,
+    GrammarGraph const* const graph
+);
+
+static void destructSystem(BoltzmannSystem* const sys);
+
+static bool solveLinearSystem(
+    double* const A,
+    double* const b,
+    uint32_t const n
+);
+
+static uint32_t parseRuleName(
+    ChunkTable* const rule_tbl,
+    char const* const line_begin,
+    uint32_t const line_sz,
+    uint32_t* const i
+);
+
+static int parseWeight(
+    double* const p_weight,
+    char const* const line_begin,
+    uint32_t const line_sz,
+    uint32_t* const i
+);
+
+static double productOfChildren(
+    BoltzmannSystem const* const sys,
+    double const* const values,
+    uint32_t const alt
+);
+
+static void skipSpaces(
+    char const* const line_begin,
+    uint32_t const line_sz,
+    uint32_t* const i
+);
+
+static bool solveExpectedSizes(BoltzmannSystem* const sys);
+
+static bool solveGeneratingFunctions(
+    BoltzmannSystem* const sys,
+    double const x
+);
+
+static bool solveSystem(
+    double* const p_expected_size,
+    BoltzmannSystem* const sys,
+    uint32_t const root_rule_id,
+    double const x
+);
+
+static void constructSystem(
+    BoltzmannSystem* const sys,
+    WeightTable const* const wtbl,
+    GrammarGraph const* const graph
+) {
+    uint32_t n_children = 0;
+    uint32_t* stack     = NULL;
+    uint32_t stack_len  = 0;
+
+    sys->n_rules        = graph->rule_list->len;
+    sys->n_alts         = wtbl->weight_list->len;
+    sys->alt_offsets    = getFirst_alist(wtbl->offset_list);
+    sys->n_bytes        = mem_calloc(sys->n_alts, sizeof(double));
+    sys->excess         = mem_calloc(sys->n_alts, sizeof(double));
+    sys->min_size       = mem_calloc(sys->n_rules, sizeof(double));
+    sys->child_offsets  = mem_calloc((size_t)sys->n_alts + 1, sizeof(uint32_t));
+    sys->is_reachable   = mem_calloc(sys->n_rules, sizeof(bool));
+    sys->x_pow          = mem_calloc(sys->n_alts, sizeof(double));
+    sys->F              = mem_calloc(sys->n_rules, sizeof(double));
+    sys->E              = mem_calloc(sys->n_rules, sizeof(double));
+
+    for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) {
+        RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+        uint32_t const* p_exp_id    = getFirst_alist(rule->alt_list);
+        uint32_t alt                = sys->alt_offsets[rule_id];
+
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++, alt++) {
+            ExpansionTerm const* exp = get_alist(graph->exp_list, *(p_exp_id++));
+            sys->child_offsets[alt] = n_children;
+            do {
+                if (exp->is_terminal)
+                    sys->n_bytes[alt] += (double)get_chunk(graph->terminals, exp->rt_id).sz;
+                else
+                    n_children++;
+            } while ((exp++)->has_next);
+        }
+    }
+    sys->child_offsets[sys->n_alts] = n_children;
+    sys->children                   = mem_calloc(n_children + 1, sizeof(uint32_t));
+
+    n_children = 0;
+    for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) {
+        RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+        uint32_t const* p_exp_id    = getFirst_alist(rule->alt_list);
+
+        REPEAT(rule->alt_list->len) {
+            ExpansionTerm const* exp = get_alist(graph->exp_list, *(p_exp_id++));
+            do {
+                if (!exp->is_terminal) sys->children[n_children++] = exp->rt_id;
+            } while ((exp++)->has_next);
+        }
+    }
+
+    stack                               = mem_calloc(sys->n_rules, sizeof(uint32_t));
+    stack[stack_len++]                  = graph->root_rule_id;
+    sys->is_reachable[graph->root_rule_id] = 1;
+    while (stack_len > 0) {
+        uint32_t const rule_id = stack[--stack_len];
+        for (uint32_t alt = sys->alt_offsets[rule_id]; alt < sys->alt_offsets[rule_id + 1]; alt++) {
+            for (uint32_t i = sys->child_offsets[alt]; i < sys->child_offsets[alt + 1]; i++) {
+                uint32_t const child_id = sys->children[i];
+                if (sys->is_reachable[child_id]) continue;
+                sys->is_reachable[child_id] = 1;
+                stack[stack_len++]          = child_id;
+            }
+        }
+    }
+    free(stack);
+
+    sys->n_dense    = 0;
+    sys->dense_ids  = mem_calloc(sys->n_rules, sizeof(uint32_t));
+    for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++)
+        sys->dense_ids[rule_id] = sys->is_reachable[rule_id] ? sys->n_dense++ : INVALID_UINT32;
+    if (sys->n_dense > WTBL_BOLTZMANN_MAX_DENSE_RULES) {
+        sys->n_dense    = 0;
+        sys->A          = NULL;
+        sys->b          = NULL;
+    } else {
+        sys->A          = mem_calloc((size_t)sys->n_dense * sys->n_dense, sizeof(double));
+        sys->b          = mem_calloc(sys->n_dense, sizeof(double));
+    }
+
+    for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) sys->min_size[rule_id] = INFINITY;
+    for (bool changed = 1; changed;) {
+        changed = 0;
+        for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) {
+            if (!sys->is_reachable[rule_id]) continue;
+            for (uint32_t alt = sys->alt_offsets[rule_id]; alt < sys->alt_offsets[rule_id + 1]; alt++) {
+                double size = sys->n_bytes[alt];
+                for (uint32_t i = sys->child_offsets[alt]; i < sys->child_offsets[alt + 1]; i++)
+                    size += sys->min_size[sys->children[i]];
+                if (size < sys->min_size[rule_id]) {
+                    sys->min_size[rule_id]  = size;
+                    changed                 = 1;
+                }
+            }
+        }
+    }
+    for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) {
+        for (uint32_t alt = sys->alt_offsets[rule_id]; alt < sys->alt_offsets[rule_id + 1]; alt++) {
+            double size = sys->n_bytes[alt];
+            for (uint32_t i = sys->child_offsets[alt]; i < sys->child_offsets[alt + 1]; i++)
+                size += sys->min_size[sys->children[i]];
+            sys->excess[alt] = isinf(size) ? INFINITY : size - sys->min_size[rule_id];
+        }
+    }
+}
+
+int constructBoltzmann_wtbl(
+    WeightTable* const wtbl,
+    double* const p_expected_size,
+    GrammarGraph const* const graph,
+    double const target_size
+) {
+    BoltzmannSystem sys[1];
+    double expected_size    = 0.0;
+    double log_lo           = -WTBL_LOG_X_MAX;
+    double log_hi           = log_lo;
+    int result              = WTBL_OK;
+
+    assert(p_expected_size != NULL);
+    assert(isValid_ggraph(graph));
+    assert(target_size > 0.0);
+
+    constructUniform_wtbl(wtbl, graph);
+    constructSystem(sys, wtbl, graph);
+
+    if (!solveSystem(&expected_size, sys, graph->root_rule_id, exp(log_lo))) {
+        result = WTBL_NOT_TUNABLE;
+    } else if (expected_size < target_size) {
+        /* Find a bracket [lo, hi] around the target, then bisect in log-space. */
+        while (log_hi < WTBL_LOG_X_MAX) {
+            double const log_next = log_hi + WTBL_LOG_X_STEP;
+            bool const is_convergent = solveSystem(&expected_size, sys, graph->root_rule_id, exp(log_next));
+            log_hi = log_next;
+            if (!is_convergent || expected_size >= target_size) break;
+            log_lo = log_hi;
+        }
+        if (log_hi > log_lo) {
+            REPEAT(WTBL_BOLTZMANN_N_BISECTIONS) {
+                double const log_mid = (log_lo + log_hi) / 2.0;
+                if (solveSystem(&expected_size, sys, graph->root_rule_id, exp(log_mid)) && expected_size < target_size)
+                    log_lo = log_mid;
+                else
+                    log_hi = log_mid;
+            }
+        }
+        /* The lower end of the bracket is always convergent. */
+        solveSystem(&expected_size, sys, graph->root_rule_id, exp(log_lo));
+    }
+
+    if (result == WTBL_OK) {
+        double* p_weight = getFirst_alist(wtbl->weight_list);
+        for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) {
+            if (!sys->is_reachable[rule_id] || sys->F[rule_id] <= 0.0) continue;
+
+            for (uint32_t alt = sys->alt_offsets[rule_id]; alt < sys->alt_offsets[rule_id + 1]; alt++)
+                p_weight[alt] = sys->x_pow[alt] * productOfChildren(sys, sys->F, alt) / sys->F[rule_id];
+        }
+        rebuildAllAliases_wtbl(wtbl);
+        *p_expected_size = expected_size;
+    }
+
+    destructSystem(sys);
+    return result;
+}
+
+void constructUniform_wtbl(
+    WeightTable* const wtbl,
+    GrammarGraph const* const graph
+) {
+    uint32_t n_alts = 0;
+
+    assert(wtbl != NULL);
+    assert(isValid_ggraph(graph));
+
+    constructEmpty_alist(wtbl->offset_list, sizeof(uint32_t), graph->rule_list->len + 1);
+    for (uint32_t rule_id = 0; rule_id < graph->rule_list->len; rule_id++) {
+        RuleTerm const* const rule = get_alist(graph->rule_list, rule_id);
+        add_alist(wtbl->offset_list, &n_alts);
+        n_alts += rule->alt_list->len;
+    }
+    add_alist(wtbl->offset_list, &n_alts);
+
+    constructEmpty_alist(wtbl->weight_list, sizeof(double), n_alts + 1);
+    constructEmpty_alist(wtbl->prob_list, sizeof(double), n_alts + 1);
+    constructEmpty_alist(wtbl->alias_list, sizeof(uint32_t), n_alts + 1);
+    for (uint32_t rule_id = 0; rule_id < graph->rule_list->len; rule_id++) {
+        RuleTerm const* const rule = get_alist(graph->rule_list, rule_id);
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+            double const one = 1.0;
+            add_alist(wtbl->weight_list, &one);
+            add_alist(wtbl->prob_list, &one);
+            add_alist(wtbl->alias_list, &alt_id);
+        }
+    }
+}
+
+void destruct_wtbl(WeightTable* const wtbl) {
+    assert(isValid_wtbl(wtbl));
+
+    destruct_alist(wtbl->offset_list);
+    destruct_alist(wtbl->weight_list);
+    destruct_alist(wtbl->prob_list);
+    destruct_alist(wtbl->alias_list);
+
+    *wtbl = NOT_A_WTBL;
+}
+
+static void destructSystem(BoltzmannSystem* const sys) {
+    free(sys->n_bytes);
+    free(sys->excess);
+    free(sys->min_size);
+    free(sys->child_offsets);
+    free(sys->children);
+    free(sys->is_reachable);
+    free(sys->dense_ids);
+    free(sys->A);
+    free(sys->b);
+    free(sys->x_pow);
+    free(sys->F);
+    free(sys->E);
+}
+
+double getWeight_wtbl(
+    WeightTable const* const wtbl,
+    uint32_t const rule_id,
+    uint32_t const alt_id
+) {
+    assert(isValid_wtbl(wtbl));
+    assert(alt_id < nAlternatives_wtbl(wtbl, rule_id));
+    {
+        uint32_t const offset = *(uint32_t*)get_alist(wtbl->offset_list, rule_id);
+        return *(double*)get_alist(wtbl->weight_list, offset + alt_id);
+    }
+}
+
+bool isValid_wtbl(WeightTable const* const wtbl) {
+    if (wtbl == NULL)                                           return 0;
+    if (!isValid_alist(wtbl->offset_list))                      return 0;
+    if (!isValid_alist(wtbl->weight_list))                      return 0;
+    if (!isValid_alist(wtbl->prob_list))                        return 0;
+    if (!isValid_alist(wtbl->alias_list))                       return 0;
+    if (wtbl->offset_list->len == 0)                            return 0;
+    if (wtbl->prob_list->len != wtbl->weight_list->len)         return 0;
+    if (wtbl->alias_list->len != wtbl->weight_list->len)        return 0;
+
+    return 1;
+}
+
+size_t memoryUsage_wtbl(WeightTable const* const wtbl) {
+    assert(isValid_wtbl(wtbl));
+    return MUSAGE_ALIST(wtbl->offset_list) + MUSAGE_ALIST(wtbl->weight_list)
+         + MUSAGE_ALIST(wtbl->prob_list) + MUSAGE_ALIST(wtbl->alias_list);
+}
+
+/*
+ * Reads lines of the form "<rule> ::= w_0 | w_1 | ... | w_n", one weight per
+ * alternative in BNF order, as written by save_wtbl(). Rules without a line
+ * keep uniform weights.
+ */
+int load_wtbl(
+    WeightTable* const wtbl,
+    FILE* const weight_file,
+    GrammarGraph const* const graph
+) {
+    Chunk lines[1]          = { NOT_A_CHUNK };
+    ChunkTable rule_tbl[1]  = { NOT_A_CTBL };
+    int load_res            = WTBL_OK;
+
+    assert(wtbl != NULL);
+    assert(weight_file != NULL);
+    assert(isValid_ggraph(graph));
+
+    constructEmpty_chunk(lines, CHUNK_RECOMMENDED_PARAMETERS);
+    constructEmpty_ctbl(rule_tbl, CTBL_RECOMMENDED_PARAMETERS);
+    for (uint32_t rule_id = 0; rule_id < graph->rule_list->len; rule_id++) {
+        RuleTerm const* const rule = get_alist(graph->rule_list, rule_id);
+        searchInsert_ctbl(
+            NULL, rule_tbl, get_chunk(graph->rule_names, rule->name_id), rule_id, CTBL_MODE_INSERT_RESPECT
+        );
+    }
+
+    addF_chunk(lines, weight_file, BNF_MAX_SZ_FILE, BNF_MAX_SZ_FILE);
+    cutByDelimLast_chunk(lines, "\n");
+
+    constructUniform_wtbl(wtbl, graph);
+    for (uint32_t line_id = 0; load_res == WTBL_OK && line_id < LEN_CHUNK(lines); line_id++) {
+        Item const line                 = get_chunk(lines, line_id);
+        char const* const line_begin    = line.p;
+        uint32_t i                      = 0;
+        uint32_t rule_id                = INVALID_UINT32;
+        uint32_t n_alts                 = 0;
+
+        skipSpaces(line_begin, line.sz, &i);
+        if (i == line.sz || line_begin[i] == '\0' || LITEQ(line_begin + i, BNF_STR_LINE_COMMENT)) continue;
+
+        rule_id = parseRuleName(rule_tbl, line_begin, line.sz, &i);
+        if (rule_id == INVALID_UINT32) {
+            load_res = WTBL_SYNTAX_ERROR;
+            break;
+        }
+
+        skipSpaces(line_begin, line.sz, &i);
+        if (line.sz - i < sizeof(BNF_STR_EQUIV) - 1 || !LITEQ(line_begin + i, BNF_STR_EQUIV)) {
+            load_res = WTBL_SYNTAX_ERROR;
+            break;
+        }
+        i += sizeof(BNF_STR_EQUIV) - 1;
+
+        for (uint32_t alt_id = 0; ; alt_id++) {
+            double weight = 0.0;
+
+            if (alt_id == nAlternatives_wtbl(wtbl, rule_id))                    { load_res = WTBL_SYNTAX_ERROR; break; }
+            if (parseWeight(&weight, line_begin, line.sz, &i) != WTBL_OK)       { load_res = WTBL_SYNTAX_ERROR; break; }
+            setWeight_wtbl(wtbl, rule_id, alt_id, weight);
+            n_alts++;
+
+            skipSpaces(line_begin, line.sz, &i);
+            if (i == line.sz || line_begin[i] == '\0') break;
+            if (!LITEQ(line_begin + i, BNF_STR_ALTERNATIVE))                    { load_res = WTBL_SYNTAX_ERROR; break; }
+            i += sizeof(BNF_STR_ALTERNATIVE) - 1;
+        }
+        if (load_res == WTBL_OK && n_alts != nAlternatives_wtbl(wtbl, rule_id))
+            load_res = WTBL_SYNTAX_ERROR;
+    }
+
+    if (load_res == WTBL_OK)
+        rebuildAllAliases_wtbl(wtbl);
+    else
+        destruct_wtbl(wtbl);
+
+    destruct_chunk(lines);
+    destruct_ctbl(rule_tbl);
+
+    return load_res;
+}
+
+uint32_t nAlternatives_wtbl(
+    WeightTable const* const wtbl,
+    uint32_t const rule_id
+) {
+    assert(isValid_wtbl(wtbl));
+    assert(rule_id + 1 < wtbl->offset_list->len);
+    {
+        uint32_t const* const offsets = get_alist(wtbl->offset_list, rule_id);
+        return offsets[1] - offsets[0];
+    }
+}
+
+static uint32_t parseRuleName(
+    ChunkTable* const rule_tbl,
+    char const* const line_begin,
+    uint32_t const line_sz,
+    uint32_t* const i
+) {
+    ChunkMapping const* mapping = NULL;
+    uint32_t j                  = *i;
+
+    if (!LITEQ(line_begin + j, BNF_STR_RULE_OPEN)) return INVALID_UINT32;
+    while (j < line_sz && line_begin[j] != '\0' && !isspace((unsigned char)line_begin[j])) j++;
+    {
+        Item const name = { (char*)line_begin + *i, j - *i, 0 };
+        if (!isRuleNameWellFormed_bnf(name.p, name.sz)) return INVALID_UINT32;
+
+        mapping = searchInsert_ctbl(NULL, rule_tbl, name, INVALID_UINT32, CTBL_MODE_SEARCH);
+        if (mapping == NULL) return INVALID_UINT32;
+    }
+
+    *i = j;
+    return mapping->value;
+}
+
+static int parseWeight(
+    double* const p_weight,
+    char const* const line_begin,
+    uint32_t const line_sz,
+    uint32_t* const i
+) {
+    char str[WTBL_MAX_LEN_WEIGHT + 1];
+    char* end   = NULL;
+    uint32_t j  = 0;
+
+    skipSpaces(line_begin, line_sz, i);
+    while (
+        *i + j < line_sz                                    &&
+        line_begin[*i + j] != '\0'                          &&
+        !isspace((unsigned char)line_begin[*i + j])         &&
+        !LITEQ(line_begin + *i + j, BNF_STR_ALTERNATIVE)
+    ) {
+        if (j == WTBL_MAX_LEN_WEIGHT) return WTBL_SYNTAX_ERROR;
+        str[j] = line_begin[*i + j];
+        j++;
+    }
+    if (j == 0) return WTBL_SYNTAX_ERROR;
+    str[j] = '\0';
+
+    *p_weight = strtod(str, &end);
+    if (*end != '\0' || !isfinite(*p_weight) || *p_weight < 0.0) return WTBL_SYNTAX_ERROR;
+
+    *i += j;
+    return WTBL_OK;
+}
+
+static double productOfChildren(
+    BoltzmannSystem const* const sys,
+    double const* const values,
+    uint32_t const alt
+) {
+    double product = 1.0;
+    for (uint32_t i = sys->child_offsets[alt]; i < sys->child_offsets[alt + 1]; i++)
+        product *= values[sys->children[i]];
+    return product;
+}
+
+/* Vose's alias method. */
+void rebuildAlias_wtbl(
+    WeightTable* const wtbl,
+    uint32_t const rule_id
+) {
+    uint32_t const n        = nAlternatives_wtbl(wtbl, rule_id);
+    uint32_t const offset   = *(uint32_t*)get_alist(wtbl->offset_list, rule_id);
+    double const* weight    = NULL;
+    double* prob            = NULL;
+    uint32_t* alias         = NULL;
+    uint32_t* small         = NULL;
+    uint32_t* large         = NULL;
+    uint32_t n_small        = 0;
+    uint32_t n_large        = 0;
+    double sum              = 0.0;
+
+    if (n == 0) return;
+
+    weight  = get_alist(wtbl->weight_list, offset);
+    prob    = get_alist(wtbl->prob_list, offset);
+    alias   = get_alist(wtbl->alias_list, offset);
+
+    for (uint32_t i = 0; i < n; i++) sum += weight[i];
+    if (!(sum > 0.0) || !isfinite(sum)) {
+        for (uint32_t i = 0; i < n; i++) { prob[i] = 1.0; alias[i] = i; }
+        return;
+    }
+
+    small = mem_calloc(n, sizeof(uint32_t));
+    large = mem_calloc(n, sizeof(uint32_t));
+    for (uint32_t i = 0; i < n; i++) {
+        prob[i]     = weight[i] * (double)n / sum;
+        alias[i]    = i;
+        if (prob[i] < 1.0)
+            small[n_small++] = i;
+        else
+            large[n_large++] = i;
+    }
+    while (n_small > 0 && n_large > 0) {
+        uint32_t const s = small[--n_small];
+        uint32_t const l = large[n_large - 1];
+        alias[s]    = l;
+        prob[l]     = (prob[l] + prob[s]) - 1.0;
+        if (prob[l] < 1.0) {
+            n_large--;
+            small[n_small++] = l;
+        }
+    }
+    while (n_large > 0) prob[large[--n_large]] = 1.0;
+    while (n_small > 0) prob[small[--n_small]] = 1.0;
+
+    free(small);
+    free(large);
+}
+
+void rebuildAllAliases_wtbl(WeightTable* const wtbl) {
+    assert(isValid_wtbl(wtbl));
+    for (uint32_t rule_id = 0; rule_id + 1 < wtbl->offset_list->len; rule_id++)
+        rebuildAlias_wtbl(wtbl, rule_id);
+}
+
+uint32_t sample_wtbl(
+    WeightTable const* const wtbl,
+    uint32_t const rule_id
+) {
+    uint32_t const n = nAlternatives_wtbl(wtbl, rule_id);
+    assert(n > 0);
+    {
+        uint32_t const offset   = *(uint32_t*)get_alist(wtbl->offset_list, rule_id);
+        uint32_t const column   = (uint32_t)rand() % n;
+        double const prob       = *(double*)get_alist(wtbl->prob_list, offset + column);
+
+        if (RAND_UNIT() < prob)
+            return column;
+        else
+            return *(uint32_t*)get_alist(wtbl->alias_list, offset + column);
+    }
+}
+
+uint32_t sampleSubset_wtbl(
+    WeightTable const* const wtbl,
+    uint32_t const rule_id,
+    uint32_t const* const alt_ids,
+    uint32_t const n_alt_ids
+) {
+    uint32_t const offset   = *(uint32_t*)get_alist(wtbl->offset_list, rule_id);
+    double const* weight    = get_alist(wtbl->weight_list, offset);
+    double sum              = 0.0;
+    double r                = 0.0;
+
+    assert(alt_ids != NULL);
+    assert(n_alt_ids > 0);
+
+    for (uint32_t i = 0; i < n_alt_ids; i++) sum += weight[alt_ids[i]];
+    if (!(sum > 0.0) || !isfinite(sum)) return alt_ids[(uint32_t)rand() % n_alt_ids];
+
+    r = RAND_UNIT() * sum;
+    for (uint32_t i = 0; i < n_alt_ids; i++) {
+        r -= weight[alt_ids[i]];
+        if (r < 0.0) return alt_ids[i];
+    }
+    return alt_ids[n_alt_ids - 1];
+}
+
+void save_wtbl(
+    FILE* const weight_file,
+    WeightTable const* const wtbl,
+    GrammarGraph const* const graph
+) {
+    assert(weight_file != NULL);
+    assert(isValid_wtbl(wtbl));
+    assert(isValid_ggraph(graph));
+    assert(wtbl->offset_list->len == graph->rule_list->len + 1);
+
+    for (uint32_t rule_id = 0; rule_id < graph->rule_list->len; rule_id++) {
+        RuleTerm const* const rule  = get_alist(graph->rule_list, rule_id);
+        Item const rule_name        = get_chunk(graph->rule_names, rule->name_id);
+
+        fprintf(weight_file, "%.*s "BNF_STR_EQUIV, (int)rule_name.sz, (char*)rule_name.p);
+        for (uint32_t alt_id = 0; alt_id < rule->alt_list->len; alt_id++) {
+            if (alt_id > 0) fputs(" "BNF_STR_ALTERNATIVE, weight_file);
+            fprintf(weight_file, " %.17g", getWeight_wtbl(wtbl, rule_id, alt_id));
+        }
+        fputs("\n", weight_file);
+    }
+}
+
+void setWeight_wtbl(
+    WeightTable* const wtbl,
+    uint32_t const rule_id,
+    uint32_t const alt_id,
+    double const weight
+) {
+    assert(isValid_wtbl(wtbl));
+    assert(alt_id < nAlternatives_wtbl(wtbl, rule_id));
+    assert(weight >= 0.0);
+    {
+        uint32_t const offset = *(uint32_t*)get_alist(wtbl->offset_list, rule_id);
+        *(double*)get_alist(wtbl->weight_list, offset + alt_id) = weight;
+    }
+}
+
+static void skipSpaces(
+    char const* const line_begin,
+    uint32_t const line_sz,
+    uint32_t* const i
+) {
+    while (*i < line_sz && isspace((unsigned char)line_begin[*i])) (*i)++;
+}
+
+static bool solveExpectedSizes(BoltzmannSystem* const sys) {
+    for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) sys->E[rule_id] = 0.0;
+
+    if (sys->n_dense > 0) {
+        /* (I - M) E = b, where M counts the expected child rules of every rule. */
+        uint32_t const n = sys->n_dense;
+        for (uint32_t i = 0; i < n * n; i++) sys->A[i] = 0.0;
+        for (uint32_t i = 0; i < n; i++) {
+            sys->A[i * n + i]   = 1.0;
+            sys->b[i]           = 0.0;
+        }
+        for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) {
+            uint32_t const row = sys->dense_ids[rule_id];
+            if (row == INVALID_UINT32 || sys->F[rule_id] <= 0.0) continue;
+
+            for (uint32_t alt = sys->alt_offsets[rule_id]; alt < sys->alt_offsets[rule_id + 1]; alt++) {
+                double const p = sys->x_pow[alt] * productOfChildren(sys, sys->F, alt) / sys->F[rule_id];
+                if (p <= 0.0) continue;
+                sys->b[row] += p * sys->n_bytes[alt];
+                for (uint32_t i = sys->child_offsets[alt]; i < sys->child_offsets[alt + 1]; i++)
+                    sys->A[row * n + sys->dense_ids[sys->children[i]]] -= p;
+            }
+        }
+        if (!solveLinearSystem(sys->A, sys->b, n)) return 0;
+
+        for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) {
+            uint32_t const row = sys->dense_ids[rule_id];
+            if (row == INVALID_UINT32) continue;
+            if (!isfinite(sys->b[row]) || sys->b[row] < 0.0 || sys->b[row] > WTBL_DIVERGENCE_LIMIT) return 0;
+            sys->E[rule_id] = sys->b[row];
+        }
+        return 1;
+    }
+
+    REPEAT(WTBL_BOLTZMANN_MAX_ITERATIONS) {
+        double max_change = 0.0;
+        for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) {
+            double E_next = 0.0;
+            if (!sys->is_reachable[rule_id] || sys->F[rule_id] <= 0.0) continue;
+
+            for (uint32_t alt = sys->alt_offsets[rule_id]; alt < sys->alt_offsets[rule_id + 1]; alt++) {
+                double const p  = sys->x_pow[alt] * productOfChildren(sys, sys->F, alt) / sys->F[rule_id];
+                double size     = sys->n_bytes[alt];
+                if (p <= 0.0) continue;
+                for (uint32_t i = sys->child_offsets[alt]; i < sys->child_offsets[alt + 1]; i++)
+                    size += sys->E[sys->children[i]];
+                E_next += p * size;
+            }
+            if (!isfinite(E_next) || E_next > WTBL_DIVERGENCE_LIMIT) return 0;
+            if (E_next - sys->E[rule_id] > max_change * (1.0 + E_next))
+                max_change = (E_next - sys->E[rule_id]) / (1.0 + E_next);
+            sys->E[rule_id] = E_next;
+        }
+        if (max_change < WTBL_TOLERANCE) return 1;
+    }
+    return 0;
+}
+
+static bool solveGeneratingFunctions(
+    BoltzmannSystem* const sys,
+    double const x
+) {
+    for (uint32_t alt = 0; alt < sys->n_alts; alt++)
+        sys->x_pow[alt] = isinf(sys->excess[alt]) ? 0.0 : pow(x, sys->excess[alt]);
+    for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) sys->F[rule_id] = 0.0;
+
+    if (sys->n_dense > 0) {
+        /* Newton's method from zero, solving (I - J) dF = PHI(F) - F at every step. */
+        uint32_t const n = sys->n_dense;
+        REPEAT(WTBL_NEWTON_ITERATIONS) {
+            double max_change = 0.0;
+
+            for (uint32_t i = 0; i < n * n; i++) sys->A[i] = 0.0;
+            for (uint32_t i = 0; i < n; i++) sys->A[i * n + i] = 1.0;
+            for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) {
+                uint32_t const row = sys->dense_ids[rule_id];
+                if (row == INVALID_UINT32) continue;
+
+                sys->b[row] = -sys->F[rule_id];
+                for (uint32_t alt = sys->alt_offsets[rule_id]; alt < sys->alt_offsets[rule_id + 1]; alt++) {
+                    uint32_t const first    = sys->child_offsets[alt];
+                    uint32_t const last     = sys->child_offsets[alt + 1];
+                    if (sys->x_pow[alt] <= 0.0) continue;
+
+                    sys->b[row] += sys->x_pow[alt] * productOfChildren(sys, sys->F, alt);
+                    for (uint32_t i = first; i < last; i++) {
+                        double partial = sys->x_pow[alt];
+                        for (uint32_t j = first; j < last; j++)
+                            if (j != i) partial *= sys->F[sys->children[j]];
+                        sys->A[row * n + sys->dense_ids[sys->children[i]]] -= partial;
+                    }
+                }
+            }
+            if (!solveLinearSystem(sys->A, sys->b, n)) return 0;
+
+            for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) {
+                uint32_t const row  = sys->dense_ids[rule_id];
+                double F_next       = 0.0;
+                if (row == INVALID_UINT32) continue;
+
+                F_next = sys->F[rule_id] + sys->b[row];
+                if (!isfinite(F_next) || F_next < 0.0 || F_next > WTBL_DIVERGENCE_LIMIT) return 0;
+                if (F_next > 0.0 && fabs(sys->b[row]) / F_next > max_change)
+                    max_change = fabs(sys->b[row]) / F_next;
+                sys->F[rule_id] = F_next;
+            }
+            if (max_change < WTBL_TOLERANCE) return 1;
+        }
+        return 0;
+    }
+
+    /* Monotone fixpoint iteration from zero converges to the least solution below the singularity. */
+    REPEAT(WTBL_BOLTZMANN_MAX_ITERATIONS) {
+        double max_change = 0.0;
+        for (uint32_t rule_id = 0; rule_id < sys->n_rules; rule_id++) {
+            double F_next = 0.0;
+            if (!sys->is_reachable[rule_id]) continue;
+
+            for (uint32_t alt = sys->alt_offsets[rule_id]; alt < sys->alt_offsets[rule_id + 1]; alt++)
+                F_next += sys->x_pow[alt] * productOfChildren(sys, sys->F, alt);
+
+            if (!isfinite(F_next) || F_next > WTBL_DIVERGENCE_LIMIT) return 0;
+            if (F_next > 0.0 && (F_next - sys->F[rule_id]) / F_next > max_change)
+                max_change = (F_next - sys->F[rule_id]) / F_next;
+            sys->F[rule_id] = F_next;
+        }
+        if (max_change < WTBL_TOLERANCE) return 1;
+    }
+    return 0;
+}
+
+/* Gaussian elimination with partial pivoting, the solution overwrites b. */
+static bool solveLinearSystem(
+    double* const A,
+    double* const b,
+    uint32_t const n
+) {
+    for (uint32_t col = 0; col < n; col++) {
+        uint32_t pivot = col;
+        for (uint32_t row = col + 1; row < n; row++)
+            if (fabs(A[row * n + col]) > fabs(A[pivot * n + col])) pivot = row;
+        if (!(fabs(A[pivot * n + col]) > WTBL_TOLERANCE)) return 0;
+
+        if (pivot != col) {
+            double tmp;
+            for (uint32_t j = col; j < n; j++) {
+                tmp                 = A[col * n + j];
+                A[col * n + j]      = A[pivot * n + j];
+                A[pivot * n + j]    = tmp;
+            }
+            tmp         = b[col];
+            b[col]      = b[pivot];
+            b[pivot]    = tmp;
+        }
+        for (uint32_t row = col + 1; row < n; row++) {
+            double const factor = A[row * n + col] / A[col * n + col];
+            if (factor == 0.0) continue;
+            for (uint32_t j = col; j < n; j++) A[row * n + j] -= factor * A[col * n + j];
+            b[row] -= factor * b[col];
+        }
+    }
+    for (uint32_t col = n; col-- > 0;) {
+        for (uint32_t j = col + 1; j < n; j++) b[col] -= A[col * n + j] * b[j];
+        b[col] /= A[col * n + col];
+    }
+    return 1;
+}
+
+static bool solveSystem(
+    double* const p_expected_size,
+    BoltzmannSystem* const sys,
+    uint32_t const root_rule_id,
+    double const x
+) {
+    if (!solveGeneratingFunctions(sys, x))  return 0;
+    if (sys->F[root_rule_id] <= 0.0)        return 0;
+    if (!solveExpectedSizes(sys))           return 0;
+
+    *p_expected_size = sys->E[root_rule_id];
+    return 1;
+}
+
+#undef RAND_UNIT